@@ -0,0 +1,160 @@
+/*
+============================================================================
+ Name : 	alloc_guard.cpp
+ Author :
+ Version :	1.00
+ Description : Heap allocations made by the cycle, see alloc_guard.h
+============================================================================
+*/
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "alloc_guard.h"
+
+static __thread int		tiInCycle ;			// The calling thread is in the cycle
+static int				giGuardMode ;
+static ALLOC_GUARD_STATS	gstGuard ;		// Written by the cycle thread only
+/*
+============================================================================
+ Function:				AllocGuardAvailable()
+ Returned value:		true if the allocation functions are replaced, see
+ 						ALLOC_GUARD.
+============================================================================
+*/
+bool AllocGuardAvailable()
+{
+#ifdef ALLOC_GUARD
+	return true ;
+#else
+	return false ;
+#endif
+}
+/*
+============================================================================
+ Function:				AllocGuardMode()
+ Input arguments:		iMode - ALLOC_GUARD_COUNT or ALLOC_GUARD_TRAP.
+============================================================================
+*/
+void AllocGuardMode(int iMode)
+{
+	giGuardMode = iMode ;
+}
+/*
+============================================================================
+ Function:				AllocGuardEnter() / AllocGuardLeave()
+ Description:			Start and end of the code that must not allocate, on
+ 						the calling thread.
+============================================================================
+*/
+void AllocGuardEnter()
+{
+	tiInCycle = 1 ;
+}
+
+void AllocGuardLeave()
+{
+	tiInCycle = 0 ;
+}
+/*
+============================================================================
+ Function:				AllocGuardGetStats() / AllocGuardReset()
+============================================================================
+*/
+void AllocGuardGetStats(ALLOC_GUARD_STATS& stStats)
+{
+	stStats = gstGuard ;
+}
+
+void AllocGuardReset()
+{
+	memset(&gstGuard, 0, sizeof(gstGuard)) ;
+}
+
+#ifdef ALLOC_GUARD
+/*
+============================================================================
+ Replacements of the glibc allocation functions
+============================================================================
+*/
+extern "C"
+{
+void* __libc_malloc(size_t ulSize) ;
+void* __libc_calloc(size_t ulCount, size_t ulSize) ;
+void* __libc_realloc(void* pMem, size_t ulSize) ;
+void* __libc_memalign(size_t ulAlign, size_t ulSize) ;
+void  __libc_free(void* pMem) ;
+}
+/*
+============================================================================
+ Function:				Guarded()
+ Input arguments:		cpWhat - the function called, for the trap message.
+ 						bFree - free(), else an allocation.
+ 						ulBytes - requested by an allocation.
+ 						pCaller - return address of the call.
+ Description:			Counts a call made in the cycle, or aborts in
+ 						ALLOC_GUARD_TRAP mode. Allocates nothing.
+============================================================================
+*/
+static void Guarded(const char* cpWhat, bool bFree, unsigned long ulBytes, void* pCaller)
+{
+	static const char cMsg[] = " called in the cycle, see alloc_guard.h\n" ;
+	ssize_t iWritten ;
+
+	if (giGuardMode == ALLOC_GUARD_TRAP)
+	{
+		tiInCycle = 0 ;
+		//
+		// Nothing to do if stderr fails: the process aborts anyway.
+		iWritten = write(STDERR_FILENO, cpWhat, strlen(cpWhat)) ;
+		iWritten = write(STDERR_FILENO, cMsg, sizeof(cMsg) - 1) ;
+		(void)iWritten ;
+		abort() ;
+	}
+	if (bFree)
+		gstGuard.ulFrees++ ;
+	else
+	{
+		gstGuard.ulAllocs++ ;
+		gstGuard.ulBytes += ulBytes ;
+	}
+	gstGuard.pLastCaller = pCaller ;
+}
+
+extern "C" void* malloc(size_t ulSize) throw()
+{
+	if (tiInCycle)
+		Guarded("malloc", false, ulSize, __builtin_return_address(0)) ;
+	return __libc_malloc(ulSize) ;
+}
+
+extern "C" void* calloc(size_t ulCount, size_t ulSize) throw()
+{
+	if (tiInCycle)
+		Guarded("calloc", false, ulCount * ulSize, __builtin_return_address(0)) ;
+	return __libc_calloc(ulCount, ulSize) ;
+}
+
+extern "C" void* realloc(void* pMem, size_t ulSize) throw()
+{
+	if (tiInCycle)
+		Guarded("realloc", false, ulSize, __builtin_return_address(0)) ;
+	return __libc_realloc(pMem, ulSize) ;
+}
+
+extern "C" int posix_memalign(void** ppMem, size_t ulAlign, size_t ulSize) throw()
+{
+	if (tiInCycle)
+		Guarded("posix_memalign", false, ulSize, __builtin_return_address(0)) ;
+	*ppMem = __libc_memalign(ulAlign, ulSize) ;
+	return (*ppMem != NULL || ulSize == 0) ? 0 : ENOMEM ;
+}
+
+extern "C" void free(void* pMem) throw()
+{
+	if (tiInCycle && pMem != NULL)
+		Guarded("free", true, 0, __builtin_return_address(0)) ;
+	__libc_free(pMem) ;
+}
+
+#endif /* ALLOC_GUARD */
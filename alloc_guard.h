@@ -0,0 +1,52 @@
+/*
+============================================================================
+ Name : alloc_guard.h
+ Author  :
+ Version :
+ Description : 	Detection of the heap allocations made by the cycle.
+
+ The cycle must not allocate: malloc() may take the arena lock held by
+ another thread, or fault in a new page, and either costs more than a cycle
+ period. Everything the cycle uses is sized at start-up.
+
+ Built with -DALLOC_GUARD, this module replaces malloc(), calloc(),
+ realloc(), posix_memalign() and free() of the process, operator new and
+ delete included, with wrappers of the glibc ones that check whether the
+ calling thread is between AllocGuardEnter() and AllocGuardLeave(). Such a
+ call is counted, with the address of its caller, or, in
+ ALLOC_GUARD_TRAP mode, aborts the process with a message, so a core file
+ points at the culprit.
+
+ Without -DALLOC_GUARD the wrappers are not built, Enter() and Leave() only
+ set a thread flag, and AllocGuardAvailable() returns false. The GOLD_D_GUARD
+ build configuration of the project is GOLD_D with ALLOC_GUARD defined: run
+ -bench with it to get the allocations of the cycle in the report.
+
+ Enter() and Leave() are called by the cycle thread. The counters may be
+ read from any thread.
+============================================================================
+*/
+#ifndef ALLOC_GUARD_H_
+#define ALLOC_GUARD_H_
+
+#include <stdint.h>
+
+#define		ALLOC_GUARD_COUNT		0		// Count the allocations of the cycle
+#define		ALLOC_GUARD_TRAP		1		// Abort on the first one
+
+typedef struct
+{
+	unsigned long	ulAllocs;				// malloc(), calloc(), realloc(), posix_memalign() in the cycle
+	unsigned long	ulFrees;				// free() in the cycle
+	unsigned long	ulBytes;				// Requested by the allocations
+	void*			pLastCaller;			// Return address of the last one, for addr2line
+} ALLOC_GUARD_STATS;
+
+bool AllocGuardAvailable() ;
+void AllocGuardMode(int iMode) ;
+void AllocGuardEnter() ;
+void AllocGuardLeave() ;
+void AllocGuardGetStats(ALLOC_GUARD_STATS& stStats) ;
+void AllocGuardReset() ;
+
+#endif /* ALLOC_GUARD_H_ */
@@ -0,0 +1,324 @@
+/*
+============================================================================
+ Name : 	async_log.cpp
+ Author :
+ Version :	1.00
+ Description : Asynchronous, allocation-free logging, see async_log.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "mono_time.h"
+#include "async_log.h"
+//
+//	Ring of the calling thread, index in m_cRing, -1 until the thread posts.
+//	The logger being one per process, so is this variable.
+//
+static __thread int tiLogRing = -1 ;
+/*
+============================================================================
+ Function:				CAsyncLog()
+ Description:			Constructor.
+============================================================================
+*/
+CAsyncLog::CAsyncLog()
+{
+	m_pMsgs 		= 0 ;
+	m_iMsgs 		= 0 ;
+	m_ullStartNs 	= MonoTimeNs() ;
+	m_iRun 			= 0 ;
+	m_ulNoRing 		= 0 ;
+	memset((void*)m_iInUse, 0, sizeof(m_iInUse)) ;
+	memset(m_stRate, 0, sizeof(m_stRate)) ;
+	pthread_mutex_init(&m_stDrainLock, NULL) ;
+	pthread_key_create(&m_stRingKey, ReleaseRing) ;
+}
+/*
+============================================================================
+ Function:				Start()
+ Input arguments:		pMsgs - the message table, must outlive the logger.
+ 						iMsgs - entries in the table, LOG_MAX_MSGS at most.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the background thread could not
+ 						be started. Messages are then printed by Flush() only.
+ Version:				Version 1.00
+
+ Description:
+
+ Sets the message table and starts the background thread. Must be called
+ before the first Post(). Time stamps are printed relative to this call.
+============================================================================
+*/
+int CAsyncLog::Start(const LOG_MSG_DEF* pMsgs, int iMsgs)
+{
+	if (iMsgs > LOG_MAX_MSGS)
+		iMsgs = LOG_MAX_MSGS ;
+
+	m_pMsgs 		= pMsgs ;
+	m_iMsgs 		= iMsgs ;
+	m_ullStartNs 	= MonoTimeNs() ;
+	memset(m_stRate, 0, sizeof(m_stRate)) ;
+
+	if (m_iRun)
+		return 0 ;
+
+	m_iRun = 1 ;
+	if (pthread_create(&m_stThread, NULL, ThreadFunc, this) != 0)
+	{
+		printf("Log: cannot start the background thread\n") ;
+		m_iRun = 0 ;
+		return -1 ;
+	}
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Stop()
+ Description:			Stops the background thread and prints what is left.
+ 						Must not be called from the cycle.
+============================================================================
+*/
+void CAsyncLog::Stop()
+{
+	if (m_iRun)
+	{
+		m_iRun = 0 ;
+		pthread_join(m_stThread, NULL) ;
+	}
+	Flush() ;
+}
+/*
+============================================================================
+ Function:				Flush()
+ Description:			Prints the messages posted so far, from the caller.
+ 						Must not be called from the cycle.
+============================================================================
+*/
+void CAsyncLog::Flush()
+{
+	pthread_mutex_lock(&m_stDrainLock) ;
+	Drain() ;
+	pthread_mutex_unlock(&m_stDrainLock) ;
+	fflush(stdout) ;
+}
+/*
+============================================================================
+ Function:				Post()
+ Input arguments:		iMsg - index of the message in the table.
+ 						lArg0..lArg5 - arguments of the format, in order.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Queues the message for the background thread. Costs a clock read and a
+ copy of LOG_ENTRY. The message is dropped, and counted, if the ring of the
+ thread is full or if the thread could not get a ring.
+============================================================================
+*/
+void CAsyncLog::Post(int iMsg, long lArg0, long lArg1, long lArg2, long lArg3, long lArg4, long lArg5)
+{
+	CSpscRing<LOG_ENTRY, LOG_RING_SIZE>* pRing = Ring() ;
+	LOG_ENTRY stEntry ;
+
+	if (pRing == 0)
+	{
+		__sync_fetch_and_add(&m_ulNoRing, 1) ;
+		return ;
+	}
+
+	stEntry.ullTimeNs 	= MonoTimeNs() ;
+	stEntry.iMsg 		= iMsg ;
+	stEntry.lArg[0] 	= lArg0 ;
+	stEntry.lArg[1] 	= lArg1 ;
+	stEntry.lArg[2] 	= lArg2 ;
+	stEntry.lArg[3] 	= lArg3 ;
+	stEntry.lArg[4] 	= lArg4 ;
+	stEntry.lArg[5] 	= lArg5 ;
+	pRing->Push(stEntry) ;
+}
+/*
+============================================================================
+ Function:				Dropped()
+ Returned value:		Messages lost because a ring was full or missing.
+============================================================================
+*/
+unsigned long CAsyncLog::Dropped() const
+{
+	unsigned long ulDropped = m_ulNoRing ;
+	int i ;
+
+	for (i = 0 ; i < LOG_MAX_THREADS ; i++)
+	{
+		ulDropped += m_cRing[i].Overflows() ;
+	}
+	return ulDropped ;
+}
+/*
+============================================================================
+ Function:				Ring()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		The ring of the calling thread, or NULL if all the
+ 						rings are taken by other threads.
+ Version:				Version 1.00
+
+ Description:
+
+ The first post of a thread takes a free ring and registers ReleaseRing()
+ to give it back when the thread exits. A thread that found no ring tries
+ again at its next post. The ring may still hold messages of the previous
+ owner: they are printed first, the ring stays single producer.
+============================================================================
+*/
+CSpscRing<LOG_ENTRY, LOG_RING_SIZE>* CAsyncLog::Ring()
+{
+	int iRing = tiLogRing ;
+
+	if (iRing < 0)
+	{
+		for (iRing = 0 ; iRing < LOG_MAX_THREADS ; iRing++)
+		{
+			if (!m_iInUse[iRing] && __sync_bool_compare_and_swap(&m_iInUse[iRing], 0, 1))
+				break ;
+		}
+		if (iRing == LOG_MAX_THREADS)
+			return 0 ;
+		pthread_setspecific(m_stRingKey, (const void*)&m_iInUse[iRing]) ;
+		tiLogRing = iRing ;
+	}
+	return &m_cRing[iRing] ;
+}
+/*
+============================================================================
+ Function:				ReleaseRing()
+ Input arguments:		pInUse - m_iInUse entry of the ring of the exiting thread.
+ Description:			Thread exit: gives the ring back. Its pushes are
+ 						published before the next owner can take it.
+============================================================================
+*/
+void CAsyncLog::ReleaseRing(void* pInUse)
+{
+	__sync_lock_release((volatile int*)pInUse) ;
+}
+/*
+============================================================================
+ Function:				Drain()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Prints the queued messages, ring after ring, then the count of repeats
+ suppressed in the seconds that are over. Messages of different threads
+ are not merged in time order: each line carries its own time stamp.
+ Called with m_stDrainLock held.
+============================================================================
+*/
+void CAsyncLog::Drain()
+{
+	LOG_ENTRY stEntry ;
+	uint64_t ullNow ;
+	int i ;
+
+	for (i = 0 ; i < LOG_MAX_THREADS ; i++)
+	{
+		while (m_cRing[i].Pop(stEntry))
+		{
+			Print(stEntry) ;
+		}
+	}
+
+	ullNow = MonoTimeNs() ;
+	for (i = 0 ; i < m_iMsgs ; i++)
+	{
+		LOG_RATE& stRate = m_stRate[i] ;
+
+		if (stRate.ulSuppressed && ullNow - stRate.ullWindowNs >= NSEC_PER_SEC)
+		{
+			printf("(message %d repeated %lu more times)\n", i, stRate.ulSuppressed) ;
+			stRate.ulSuppressed = 0 ;
+		}
+	}
+}
+/*
+============================================================================
+ Function:				Print()
+ Input arguments:		stEntry - a message popped from a ring.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Formats one message, unless its rate limit is reached. The format gets all
+ LOG_MAX_ARGS arguments, the ones it does not convert are ignored.
+============================================================================
+*/
+void CAsyncLog::Print(const LOG_ENTRY& stEntry)
+{
+	const LOG_MSG_DEF* pMsg ;
+	uint64_t ullRel ;
+
+	if (stEntry.iMsg < 0 || stEntry.iMsg >= m_iMsgs)
+	{
+		printf("(unknown message %d)\n", stEntry.iMsg) ;
+		return ;
+	}
+	pMsg = &m_pMsgs[stEntry.iMsg] ;
+
+	if (pMsg->uiMaxPerSec != LOG_UNLIMITED)
+	{
+		LOG_RATE& stRate = m_stRate[stEntry.iMsg] ;
+
+		if (stEntry.ullTimeNs - stRate.ullWindowNs >= NSEC_PER_SEC)
+		{
+			if (stRate.ulSuppressed)
+				printf("(message %d repeated %lu more times)\n", stEntry.iMsg, stRate.ulSuppressed) ;
+			stRate.ullWindowNs 	= stEntry.ullTimeNs ;
+			stRate.uiCount 		= 0 ;
+			stRate.ulSuppressed = 0 ;
+		}
+		if (stRate.uiCount >= pMsg->uiMaxPerSec)
+		{
+			stRate.ulSuppressed++ ;
+			return ;
+		}
+		stRate.uiCount++ ;
+	}
+
+	ullRel = (stEntry.ullTimeNs > m_ullStartNs) ? stEntry.ullTimeNs - m_ullStartNs : 0 ;
+	printf("[%5lu.%03lu] ", (unsigned long)(ullRel / NSEC_PER_SEC), (unsigned long)(ullRel % NSEC_PER_SEC / NSEC_PER_MSEC)) ;
+	printf(pMsg->cpFormat, stEntry.lArg[0], stEntry.lArg[1], stEntry.lArg[2],
+		   stEntry.lArg[3], stEntry.lArg[4], stEntry.lArg[5]) ;
+}
+/*
+============================================================================
+ Function:				ThreadFunc()
+ Description:			Background thread: lowers its priority, then drains
+ 						the rings every LOG_POLL_MS until Stop().
+============================================================================
+*/
+void* CAsyncLog::ThreadFunc(void* pArg)
+{
+	CAsyncLog* pLog = (CAsyncLog*)pArg ;
+	struct timespec stPeriod ;
+
+	stPeriod.tv_sec 	= LOG_POLL_MS / 1000 ;
+	stPeriod.tv_nsec 	= (LOG_POLL_MS % 1000) * 1000000L ;
+	//
+	// On Linux the nice value is per thread: this only affects the logger.
+	setpriority(PRIO_PROCESS, 0, LOG_NICE) ;
+
+	while (pLog->m_iRun)
+	{
+		nanosleep(&stPeriod, NULL) ;
+		pLog->Flush() ;
+	}
+	return NULL ;
+}
@@ -0,0 +1,99 @@
+/*
+============================================================================
+ Name : async_log.h
+ Author  :
+ Version :
+ Description : 	Asynchronous, allocation-free logging for the control path.
+
+ A message is a format string known in advance, declared in a table of
+ LOG_MSG_DEF given to Start(). Post() only stores the message index, a time
+ stamp and up to LOG_MAX_ARGS integer arguments into a wait-free ring of the
+ calling thread (see spsc_ring.h). Apart from reading the clock it never
+ formats, locks, allocates or calls the kernel, so it may be called from the
+ cycle or the IPC callback.
+
+ A background thread, at a low priority, drains the rings every LOG_POLL_MS,
+ formats the messages and writes them to stdout. The formats may only use
+ long conversions (%ld, %lu, %lx...), one per argument.
+
+ Messages may be rate-limited: a message posted more than uiMaxPerSec times
+ in one second is suppressed for the rest of that second, and the number of
+ suppressed repeats is reported once the second is over.
+
+ A posting thread takes a free ring the first time it posts and gives it
+ back when it exits, its messages still queued in it. LOG_MAX_THREADS is
+ the number of threads posting at the same time, not over the life of the
+ process: the runtime threads, started again by every StartRuntime(), do
+ not use up the rings. There is one logger per process.
+============================================================================
+*/
+#ifndef ASYNC_LOG_H_
+#define ASYNC_LOG_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "spsc_ring.h"
+
+#define		LOG_MAX_ARGS			6
+#define		LOG_MAX_THREADS			4		// Threads that may post at the same time
+#define		LOG_RING_SIZE			256		// Messages per thread. Must be a power of 2.
+#define		LOG_MAX_MSGS			64		// Messages in the table
+#define		LOG_POLL_MS				10		// Background drain period
+#define		LOG_NICE				10		// Nice value of the background thread
+#define		LOG_UNLIMITED			0		// LOG_MSG_DEF.uiMaxPerSec: no rate limit
+
+typedef struct
+{
+	const char*		cpFormat;				// printf format, long conversions only
+	unsigned int	uiMaxPerSec;			// Or LOG_UNLIMITED
+} LOG_MSG_DEF;
+
+typedef struct
+{
+	uint64_t		ullTimeNs;
+	int				iMsg;					// Index in the table
+	long			lArg[LOG_MAX_ARGS];
+} LOG_ENTRY;
+
+typedef struct
+{
+	uint64_t		ullWindowNs;			// Start of the current second
+	unsigned int	uiCount;				// Posted in the current second
+	unsigned long	ulSuppressed;			// Not printed in the current second
+} LOG_RATE;
+
+class CAsyncLog
+{
+public:
+	CAsyncLog() ;
+
+	int  Start(const LOG_MSG_DEF* pMsgs, int iMsgs) ;
+	void Stop() ;
+	void Flush() ;
+
+	void Post(int iMsg, long lArg0 = 0, long lArg1 = 0, long lArg2 = 0,
+			  long lArg3 = 0, long lArg4 = 0, long lArg5 = 0) ;
+
+	unsigned long Dropped() const ;
+
+private:
+	CSpscRing<LOG_ENTRY, LOG_RING_SIZE>* Ring() ;
+	void Drain() ;
+	void Print(const LOG_ENTRY& stEntry) ;
+	static void* ThreadFunc(void* pArg) ;
+	static void ReleaseRing(void* pInUse) ;
+
+	const LOG_MSG_DEF*	m_pMsgs ;
+	int					m_iMsgs ;
+	uint64_t			m_ullStartNs ;
+	volatile int		m_iRun ;
+	pthread_t			m_stThread ;
+	pthread_mutex_t		m_stDrainLock ;			// Serializes the consumers: thread and Flush()
+	pthread_key_t		m_stRingKey ;			// Gives the ring back when its thread exits
+	volatile int		m_iInUse[LOG_MAX_THREADS] ;	// TRUE while a thread owns the ring
+	volatile unsigned long	m_ulNoRing ;		// Posts from a thread beyond LOG_MAX_THREADS
+	LOG_RATE			m_stRate[LOG_MAX_MSGS] ;
+	CSpscRing<LOG_ENTRY, LOG_RING_SIZE>	m_cRing[LOG_MAX_THREADS] ;
+} ;
+
+#endif /* ASYNC_LOG_H_ */
@@ -0,0 +1,219 @@
+/*
+============================================================================
+ Name : axis_table.h
+ Author  :
+ Version :
+ Description : 	Structure-of-arrays table of the axes of the application.
+
+ Each per-axis variable is an array indexed by the axis, a01 being 0, so
+ that the cycle walks contiguous memory whatever the number of axes. The
+ variables read every cycle come first, the ones used by the background
+ loop last.
+
+ Snapshot() reads the inputs of all the axes at the start of the cycle, in
+ one exchange when the backend allows it (see CMotionBackend::ReadInputs()).
+ The image is not written again until the next cycle, so every state machine
+ sees the same one. The time it was taken and the time it took are kept.
+
+ After the status words are read, UpdateMasks() evaluates the status tests
+ of all the axes in one pass and keeps the result as AXIS_MASK bit sets, bit
+ i for axis i. The state machines then test a group of axes with one AND:
+
+ 	if ((gcAxes.ulStandStill & SM1_AXES) == SM1_AXES)
+
+ The passes run over all SIZE entries, a constant trip count the compiler
+ unrolls and vectorizes. Entries beyond Count() are kept at 0.
+
+ Must be included after mmc_definitions.h and motion_backend.h.
+============================================================================
+*/
+#ifndef AXIS_TABLE_H_
+#define AXIS_TABLE_H_
+
+#include <stdint.h>
+#include "mono_time.h"
+
+typedef uint32_t	AXIS_MASK ;					// Bit i set for axis i
+
+#define		AXIS_BIT(i)				((AXIS_MASK)1 << (i))
+#define		AXIS_NO_INDEX			-1			// IndexOfRef() of an axis not in the table
+//
+// Inputs read by Snapshot() besides the status, see uiSnapFields
+#define		AXIS_SNAP_POSITION		0x01		// Into lPosition
+#define		AXIS_SNAP_VELOCITY		0x02		// Into lVelocity
+#define		AXIS_SNAP_TORQUE		0x04		// Into iTorque, when not acquired by PDO or SDO
+
+template <unsigned int SIZE>
+class CAxisTable
+{
+public:
+	CAxisTable() : uiSnapFields(AXIS_SNAP_POSITION)
+	{
+		//
+		// SIZE must fit in an AXIS_MASK.
+		typedef char SizeMustFitMask[(SIZE <= sizeof(AXIS_MASK) * 8) ? 1 : -1] ;
+		(void)sizeof(SizeMustFitMask) ;
+		Clear() ;
+	}
+/*
+============================================================================
+ Set up, not called by the cycle
+============================================================================
+*/
+	void Clear()
+	{
+		unsigned int i ;
+
+		for (i = 0 ; i < SIZE ; i++)
+		{
+			pAxis[i] 			= 0 ;
+			usAxisRef[i] 		= 0 ;
+			ulStatus[i] 		= 0 ;
+			lPosition[i] 		= 0 ;
+			lVelocity[i] 		= 0 ;
+			iTorque[i] 			= 0 ;
+			iCurrent[i] 		= 0 ;
+			lDrvPos[i] 			= 0 ;
+			ucInMotion[i] 		= 0 ;
+			iSdoNode[i] 		= 0 ;
+			ulSamples[i] 		= 0 ;
+			ulSdoLatencyUs[i] 	= 0 ;
+			ulDcLinkMv[i] 		= 0 ;
+		}
+		iAxes 			= 0 ;
+		ulAll 			= 0 ;
+		ulStandStill 	= 0 ;
+		ulInMotion 		= 0 ;
+		ulErrorStop 	= 0 ;
+		ullSnapNs 		= 0 ;
+		ulSnapUs 		= 0 ;
+		ulSnapMaxUs 	= 0 ;
+	}
+
+	int Add(CAxisBackend* pNewAxis)
+	{
+		if (pNewAxis == 0 || iAxes >= (int)SIZE)
+			return AXIS_NO_INDEX ;
+
+		pAxis[iAxes] 		= pNewAxis ;
+		usAxisRef[iAxes] 	= pNewAxis->GetRef() ;
+		ulAll 			   |= AXIS_BIT(iAxes) ;
+		return iAxes++ ;
+	}
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	int Count() const	{ return iAxes ; }
+
+	int IndexOfRef(unsigned short usRef) const
+	{
+		int i ;
+
+		for (i = 0 ; i < iAxes ; i++)
+		{
+			if (usAxisRef[i] == usRef)
+				return i ;
+		}
+		return AXIS_NO_INDEX ;
+	}
+	//
+	// Status word of every axis and the inputs of uiSnapFields, then the masks.
+	void Snapshot(CMotionBackend& cBackend)
+	{
+		AXIS_INPUTS stIn ;
+		uint64_t ullDoneNs ;
+
+		stIn.pulStatus 	= ulStatus ;
+		stIn.plPosition = (uiSnapFields & AXIS_SNAP_POSITION) ? lPosition : 0 ;
+		stIn.plVelocity = (uiSnapFields & AXIS_SNAP_VELOCITY) ? lVelocity : 0 ;
+		stIn.plTorque 	= (uiSnapFields & AXIS_SNAP_TORQUE) ? iTorque : 0 ;
+
+		ullSnapNs = MonoTimeNs() ;
+		cBackend.ReadInputs(pAxis, iAxes, stIn) ;
+		ullDoneNs = MonoTimeNs() ;
+
+		ulSnapUs = (uint32_t)((ullDoneNs - ullSnapNs) / NSEC_PER_USEC) ;
+		if (ulSnapUs > ulSnapMaxUs)
+			ulSnapMaxUs = ulSnapUs ;
+		UpdateMasks() ;
+	}
+	//
+	// Axes whose status word has any bit of ulStatusMask set.
+	AXIS_MASK StatusAny(uint32_t ulStatusMask) const
+	{
+		AXIS_MASK ulHit = 0 ;
+		unsigned int i ;
+
+		for (i = 0 ; i < SIZE ; i++)
+		{
+			ulHit |= (AXIS_MASK)((ulStatus[i] & ulStatusMask) != 0) << i ;
+		}
+		return ulHit & ulAll ;
+	}
+	//
+	// The masks every state machine needs, in one pass over the status words.
+	// An axis is in motion when it is neither standing still, disabled nor
+	// stopped on an error.
+	void UpdateMasks()
+	{
+		AXIS_MASK ulStill = 0 ;
+		AXIS_MASK ulError = 0 ;
+		AXIS_MASK ulMoving = 0 ;
+		unsigned int i ;
+
+		for (i = 0 ; i < SIZE ; i++)
+		{
+			uint32_t ulWord = ulStatus[i] ;
+			uint8_t ucMoving = (ulWord & (NC_AXIS_STAND_STILL_MASK | NC_AXIS_DISABLED_MASK | NC_AXIS_ERROR_STOP_MASK)) == 0 ;
+
+			ucInMotion[i] 	= ucMoving ;
+			ulStill 	   |= (AXIS_MASK)((ulWord & NC_AXIS_STAND_STILL_MASK) != 0) << i ;
+			ulError 	   |= (AXIS_MASK)((ulWord & NC_AXIS_ERROR_STOP_MASK) != 0) << i ;
+			ulMoving 	   |= (AXIS_MASK)ucMoving << i ;
+		}
+		ulStandStill 	= ulStill & ulAll ;
+		ulErrorStop 	= ulError & ulAll ;
+		ulInMotion 		= ulMoving & ulAll ;
+	}
+/*
+============================================================================
+ Per axis variables, read every cycle
+============================================================================
+*/
+	CAxisBackend*	pAxis[SIZE] ;
+	unsigned short	usAxisRef[SIZE] ;			// GMAS axis reference, used to pick its PDOs
+	uint32_t		ulStatus[SIZE] ;			// GMAS axis status
+	int32_t			lPosition[SIZE] ;			// GMAS actual position
+	int32_t			lVelocity[SIZE] ;			// GMAS actual velocity
+	int32_t			iTorque[SIZE] ;				// 0x6077, per-mille of rated torque
+	int32_t			iCurrent[SIZE] ;			// 0x6078, per-mille of rated current
+	int32_t			lDrvPos[SIZE] ;				// 0x6064, position actual value in drive counts
+	uint8_t			ucInMotion[SIZE] ;			// 1 while the axis moves, see UpdateMasks()
+/*
+============================================================================
+ Per axis variables of the background loop
+============================================================================
+*/
+	int				iSdoNode[SIZE] ;			// Node in gSdoEngine
+	unsigned long	ulSamples[SIZE] ;			// Torque samples acquired, over PDO or SDO
+	uint32_t		ulSdoLatencyUs[SIZE] ;		// Of the last SDO read
+	uint32_t		ulDcLinkMv[SIZE] ;			// 0x6079, DC link circuit voltage in mV
+/*
+============================================================================
+ Whole table
+============================================================================
+*/
+	int				iAxes ;						// Axes added, a01 onwards
+	AXIS_MASK		ulAll ;						// One bit per axis added
+	AXIS_MASK		ulStandStill ;				// Set by UpdateMasks()
+	AXIS_MASK		ulInMotion ;
+	AXIS_MASK		ulErrorStop ;
+	unsigned int	uiSnapFields ;				// AXIS_SNAP_xxx read by Snapshot()
+	uint64_t		ullSnapNs ;					// MonoTimeNs() when the last snapshot started
+	uint32_t		ulSnapUs ;					// Time the last snapshot took
+	uint32_t		ulSnapMaxUs ;
+} ;
+
+#endif /* AXIS_TABLE_H_ */
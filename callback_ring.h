@@ -0,0 +1,50 @@
+/*
+============================================================================
+ Name : callback_ring.h
+ Author  :
+ Version :
+ Description : 	Records passed from the IPC callback to the cycle.
+
+ CallbackFunc() runs on the library's IPC thread. It only time stamps what it
+ received and pushes it into the callback ring. ReadAllInputData() drains the
+ ring at the beginning of every cycle.
+
+ The same record carries the SDO samples of the acquisition thread to the
+ cycle, in gSampleRing, as SDO_SAMPLE_EVT.
+============================================================================
+*/
+#ifndef CALLBACK_RING_H_
+#define CALLBACK_RING_H_
+
+#include <stdint.h>
+#include "spsc_ring.h"
+#include "pdo_acquisition.h"
+
+#define		CALLBACK_RING_SIZE		1024	// Records. Must be a power of 2.
+#define		EVT_AXIS_REF_OFFSET		PDO_EVT_AXIS_REF_OFFSET	// Same place in all event frames, see pdo_acquisition.h
+#define		EVT_DATA_OFFSET			14		// First event specific byte (e.g. emergency code)
+#define		SDO_SAMPLE_EVT			0xFF	// Not sent by the GMAS: object read by the acquisition thread, see sample_scheduler.h
+
+typedef struct
+{
+	int16_t			sSignal;		// In the table of the sample scheduler
+	int32_t			lValue;
+	uint32_t		ulLatencyUs;	// Of the SDO transfer
+} SDO_SAMPLE;
+
+typedef struct
+{
+	uint64_t		ullTimeNs;		// MonoTimeNs() when the callback received the frame
+	unsigned char	ucEvent;		// Event ID, as in recvBuffer[1]
+	unsigned short	usAxisRef;
+	union
+	{
+		PDO_SAMPLE	stPdo;			// PDORCV_EVT
+		SDO_SAMPLE	stSdo;			// SDO_SAMPLE_EVT
+		long		lData;			// Any other event: first event specific bytes, raw
+	} u;
+} CALLBACK_RECORD;
+
+typedef CSpscRing<CALLBACK_RECORD, CALLBACK_RING_SIZE> CCallbackRing;
+
+#endif /* CALLBACK_RING_H_ */
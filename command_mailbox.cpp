@@ -0,0 +1,300 @@
+/*
+============================================================================
+ Name : 	command_mailbox.cpp
+ Author :
+ Version :	1.00
+ Description : Host commands from the Modbus write events, see command_mailbox.h
+============================================================================
+*/
+#include <string.h>
+#include "mmc_definitions.h"
+#include "command_mailbox.h"
+/*
+============================================================================
+ Function:				CCommandMailbox()
+ Description:			Constructor. No command area until Configure().
+============================================================================
+*/
+CCommandMailbox::CCommandMailbox()
+{
+	m_ulProduced 		= 0 ;
+	m_ulIgnored 		= 0 ;
+	m_ulOverflowsSeen 	= 0 ;
+	m_bLayoutVerified 	= (MBOX_EVT_LAYOUT_VERIFIED != 0) ;
+	Configure(0, 0) ;
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		iStartRef - first holding register of the command area.
+ 						iCount - its registers, MBOX_MAX_REGS at most.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Sets the command area and clears the image and the counters. The writes
+ already queued are still applied by the next Apply(). Must not be called
+ while the callback may run with another area.
+============================================================================
+*/
+void CCommandMailbox::Configure(int iStartRef, int iCount)
+{
+	if (iCount < 0)
+		iCount = 0 ;
+	if (iCount > MBOX_MAX_REGS)
+		iCount = MBOX_MAX_REGS ;
+
+	m_iStartRef 	= iStartRef ;
+	m_iCount 		= iCount ;
+	m_ulWritten 	= 0 ;
+	m_ulApplied 	= 0 ;
+	m_bAnySeq 		= true ;
+	m_ullLastNs 	= 0 ;
+	m_ulWrites 		= 0 ;
+	m_ulReads 		= 0 ;
+	m_ulResyncs 	= 0 ;
+	m_iCounters 	= 0 ;
+	memset(m_sImage, 0, sizeof(m_sImage)) ;
+}
+/*
+============================================================================
+ Function:				AddCounter()
+ Input arguments:		iCounterReg - register the host increments with every
+ 						write of the command.
+ 						iReg, iCount - registers of the command.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if out of the command area or if
+ 						MBOX_MAX_COUNTERS counters are already set.
+ Version:				Version 1.00
+
+ Description:
+
+ When the counter changed since the previous Apply(), that Apply() marks
+ the registers of the command written, even if their value did not change.
+ To be called after Configure(), before Sync().
+============================================================================
+*/
+int CCommandMailbox::AddCounter(int iCounterReg, int iReg, int iCount)
+{
+	MBOX_COUNTER* pCounter ;
+
+	if (m_iCounters >= MBOX_MAX_COUNTERS || iCounterReg < 0 || iCounterReg >= m_iCount
+		|| iReg < 0 || iCount <= 0 || iReg + iCount > m_iCount)
+		return -1 ;
+
+	pCounter = &m_stCounter[m_iCounters++] ;
+	pCounter->iReg 		= iCounterReg ;
+	pCounter->ulMask 	= ((iCount >= 32) ? 0xFFFFFFFFu : ((1u << iCount) - 1)) << iReg ;
+	pCounter->sLast 	= m_sImage[iCounterReg] ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Sync()
+ Input arguments:		cBackend - where the Modbus server is.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the table could not be read.
+ Version:				Version 1.00
+
+ Description:
+
+ Reads the whole command area into the image. Nothing is marked written:
+ a command left in the table by a previous run is not acted upon.
+============================================================================
+*/
+int CCommandMailbox::Sync(CMotionBackend& cBackend)
+{
+	int iRes ;
+	int i ;
+
+	iRes = ReadRange(cBackend, 0, m_iCount, false) ;
+	for (i = 0 ; i < m_iCounters ; i++)
+	{
+		m_stCounter[i].sLast = m_sImage[m_stCounter[i].iReg] ;
+	}
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				OnWrite()
+ Input arguments:		ucpFrame, sFrameSize - the MODBUS_WRITE_EVT frame.
+ 						ullTimeNs - when it was received.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Called from the IPC callback. Queues the part of the write that falls in
+ the command area, with its values when the frame has them. A write whose
+ range is not known from the frame, see command_mailbox.h, queues a write
+ of unknown range, for Apply() to read the whole area.
+ Never blocks; a full ring is detected by Apply().
+============================================================================
+*/
+void CCommandMailbox::OnWrite(const unsigned char* ucpFrame, short sFrameSize, uint64_t ullTimeNs)
+{
+	MBOX_WRITE stWrite ;
+	uint16_t usFunc ;
+	uint16_t usStart ;
+	uint16_t usCount ;
+	bool bMultiple ;
+	int iFirst ;
+	int iLast ;
+
+	stWrite.ullTimeNs 	= ullTimeNs ;
+	stWrite.ucHasRegs 	= 0 ;
+	stWrite.usStart 	= 0 ;
+	stWrite.usCount 	= 0 ;
+	usFunc 				= 0 ;
+	usStart 			= 0 ;
+	usCount 			= 0 ;
+
+	if (sFrameSize >= MBOX_EVT_START_OFFSET + (short)sizeof(usStart))
+	{
+		memcpy(&usFunc, ucpFrame + MBOX_EVT_FUNC_OFFSET, sizeof(usFunc)) ;
+		memcpy(&usStart, ucpFrame + MBOX_EVT_START_OFFSET, sizeof(usStart)) ;
+	}
+	bMultiple = (m_bLayoutVerified && usFunc == MBOX_FUNC_WRITE_MULTIPLE
+				 && sFrameSize >= MBOX_EVT_COUNT_OFFSET + (short)sizeof(usCount)) ;
+	if (usFunc == MBOX_FUNC_WRITE_SINGLE)
+	{
+		usCount = 1 ;						// The value is read by Apply()
+	}
+	else if (bMultiple)
+	{
+		memcpy(&usCount, ucpFrame + MBOX_EVT_COUNT_OFFSET, sizeof(usCount)) ;
+		if (usCount > MBOX_EVT_MAX_COUNT)
+			usCount = 0 ;					// Not a range: queued as unknown below
+	}
+
+	if (usCount != 0)
+	{
+		//
+		// Keep the part in the command area
+		iFirst 	= (usStart > m_iStartRef) ? usStart : m_iStartRef ;
+		iLast 	= ((usStart + usCount < m_iStartRef + m_iCount) ? usStart + usCount : m_iStartRef + m_iCount) - 1 ;
+		if (iLast < iFirst)
+		{
+			m_ulIgnored++ ;
+			return ;
+		}
+		stWrite.usStart = (uint16_t)(iFirst - m_iStartRef) ;
+		stWrite.usCount = (uint16_t)(iLast - iFirst + 1) ;
+		if (bMultiple && sFrameSize >= MBOX_EVT_REGS_OFFSET + (short)(usCount * sizeof(short)))
+		{
+			memcpy(stWrite.sRegs, ucpFrame + MBOX_EVT_REGS_OFFSET + (iFirst - usStart) * sizeof(short),
+				   stWrite.usCount * sizeof(short)) ;
+			stWrite.ucHasRegs = 1 ;
+		}
+	}
+	stWrite.ulSeq = ++m_ulProduced ;
+	m_cRing.Push(stWrite) ;
+}
+/*
+============================================================================
+ Function:				Apply()
+ Input arguments:		cBackend - where the Modbus server is.
+ Output arguments: 		None.
+ Returned value:		The writes applied, 0 if the host wrote nothing.
+ Version:				Version 1.00
+
+ Description:
+
+ Called once per cycle. Clears the written marks, then applies the queued
+ writes in order. A lost write, seen as a gap in the sequence numbers or as
+ a new ring overflow, is recovered by reading the whole area after the
+ queued writes, so the image ends up as the table is now. Last, the
+ commands whose counter changed are marked written.
+============================================================================
+*/
+int CCommandMailbox::Apply(CMotionBackend& cBackend)
+{
+	MBOX_WRITE stWrite ;
+	unsigned long ulOverflows ;
+	bool bLost = false ;
+	int iApplied = 0 ;
+	int i ;
+
+	m_ulWritten = 0 ;
+	while (m_cRing.Pop(stWrite))
+	{
+		if (!m_bAnySeq && stWrite.ulSeq != m_ulApplied + 1)
+			bLost = true ;
+		m_bAnySeq 		= false ;
+		m_ulApplied 	= stWrite.ulSeq ;
+		m_ullLastNs 	= stWrite.ullTimeNs ;
+		m_ulWrites++ ;
+		iApplied++ ;
+
+		if (stWrite.usCount == 0)
+			bLost = true ;
+		else if (stWrite.ucHasRegs)
+			memcpy(&m_sImage[stWrite.usStart], stWrite.sRegs, stWrite.usCount * sizeof(short)) ;
+		else
+			ReadRange(cBackend, stWrite.usStart, stWrite.usCount, false) ;
+		//
+		// Every register of a write counts as written, even if its value did
+		// not change: the host may repeat a command.
+		m_ulWritten |= (((stWrite.usCount >= 32) ? 0xFFFFFFFFu : (1u << stWrite.usCount) - 1)) << stWrite.usStart ;
+	}
+
+	ulOverflows = m_cRing.Overflows() ;
+	if (ulOverflows != m_ulOverflowsSeen)
+	{
+		m_ulOverflowsSeen 	= ulOverflows ;
+		bLost 				= true ;
+	}
+	if (bLost)
+	{
+		m_ulResyncs++ ;
+		ReadRange(cBackend, 0, m_iCount, true) ;
+		m_bAnySeq = true ;					// The next write may be one already read
+		if (iApplied == 0)
+			iApplied = 1 ;
+	}
+	for (i = 0 ; i < m_iCounters ; i++)
+	{
+		MBOX_COUNTER& stCounter = m_stCounter[i] ;
+
+		if (m_sImage[stCounter.iReg] != stCounter.sLast)
+		{
+			stCounter.sLast 	= m_sImage[stCounter.iReg] ;
+			m_ulWritten 		|= stCounter.ulMask ;
+		}
+	}
+	return iApplied ;
+}
+/*
+============================================================================
+ Function:				ReadRange()
+ Input arguments:		cBackend - where the Modbus server is.
+ 						iStart, iCount - registers of the command area.
+ 						bMarkChanged - mark written the registers whose value
+ 						differs from the image.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the table could not be read.
+============================================================================
+*/
+int CCommandMailbox::ReadRange(CMotionBackend& cBackend, int iStart, int iCount, bool bMarkChanged)
+{
+	short sRegs[MBOX_MAX_REGS] ;
+	int i ;
+
+	if (iCount <= 0)
+		return 0 ;
+
+	m_ulReads++ ;
+	if (cBackend.MbusReadRegisters(m_iStartRef + iStart, iCount, sRegs) != 0)
+		return -1 ;
+
+	for (i = 0 ; i < iCount ; i++)
+	{
+		if (bMarkChanged && sRegs[i] != m_sImage[iStart + i])
+			m_ulWritten |= 1u << (iStart + i) ;
+		m_sImage[iStart + i] = sRegs[i] ;
+	}
+	return 0 ;
+}
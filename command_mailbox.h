@@ -0,0 +1,144 @@
+/*
+============================================================================
+ Name : command_mailbox.h
+ Author  :
+ Version :
+ Description : 	Host commands, taken from the Modbus write events.
+
+ The host writes its commands to the holding registers of the command area
+ (MODBUS_READ_OUTPUTS_INDEX onwards). For every write, the GMAS sends a
+ MODBUS_WRITE_EVT with the range written and, when it fits in the frame,
+ the values. OnWrite(), on the IPC thread, keeps the part of the range that
+ falls in the command area, numbers it and pushes it into a wait-free ring
+ (see spsc_ring.h). Apply(), on the cycle, pops the writes in order into a
+ local image of the command area and marks the registers written, so each
+ command is acted upon in the cycle that follows the write, and only once.
+
+ The table itself is read only when needed:
+
+ 	- once at start-up, Sync(), without marking anything written,
+ 	- for a write whose values were not in the frame, that range only,
+ 	- when a write was lost (ring full, or a gap in the sequence numbers),
+ 	  the whole area, marking written the registers that changed.
+
+ The frame layout of MODBUS_WRITE_EVT is given by the MBOX_EVT_xxx offsets.
+ The library itself (CMMCConnection::CallbackFunc()) reads the Modbus
+ function at MBOX_EVT_FUNC_OFFSET and, for a "write single register"
+ (function 6), the register at MBOX_EVT_START_OFFSET: such a write has a
+ known range, its value is read from the table. Where a "write multiple
+ registers" (function 16) puts its count and values is not known from the
+ library. Until the layout is verified, see MBOX_EVT_LAYOUT_VERIFIED and
+ SetLayoutVerified(), such a write queues a write of unknown range, read as a
+ lost write: the whole area, marking written the registers that changed.
+
+ A command the host repeats with the same value does not change the table,
+ so that read alone would miss it. A command may therefore have a counter
+ register, AddCounter(), that the host increments with every write of the
+ command: when the counter changes, the registers of its command are marked
+ written, whichever way the write was found.
+
+ A range that cannot be right (no register, more than a Modbus write can
+ carry) is queued as unknown, not ignored.
+============================================================================
+*/
+#ifndef COMMAND_MAILBOX_H_
+#define COMMAND_MAILBOX_H_
+
+#include <stdint.h>
+#include "spsc_ring.h"
+#include "motion_backend.h"
+
+#define		MBOX_RING_SIZE			16		// Writes queued between two cycles. Must be a power of 2.
+#define		MBOX_MAX_REGS			32		// Registers of the command area
+#define		MBOX_MAX_COUNTERS		4		// Command counters, see AddCounter()
+#define		MBOX_EVT_FUNC_OFFSET	4		// unsigned short, Modbus function of the write
+#define		MBOX_EVT_START_OFFSET	12		// unsigned short, first register written
+#define		MBOX_EVT_COUNT_OFFSET	14		// unsigned short, registers written, function 16
+#define		MBOX_EVT_REGS_OFFSET	16		// The values, function 16, if the frame is long enough
+#ifndef MBOX_EVT_LAYOUT_VERIFIED
+#define		MBOX_EVT_LAYOUT_VERIFIED	0	// 1 once the function 16 offsets are checked on the target
+#endif
+#define		MBOX_FUNC_WRITE_SINGLE	6		// Modbus "write single register"
+#define		MBOX_FUNC_WRITE_MULTIPLE	16	// Modbus "write multiple registers"
+#define		MBOX_EVT_MAX_COUNT		123		// Registers of a Modbus "write multiple registers"
+
+typedef struct
+{
+	uint32_t		ulSeq;					// 1 for the first write, then +1
+	uint64_t		ullTimeNs;				// MonoTimeNs() when the event was received
+	uint16_t		usStart;				// In the command area
+	uint16_t		usCount;				// 0: range unknown, the whole area is read
+	uint8_t			ucHasRegs;				// sRegs holds the values, else they are read
+	short			sRegs[MBOX_MAX_REGS];
+} MBOX_WRITE;
+
+typedef struct
+{
+	int				iReg;					// The counter, in the command area
+	uint32_t		ulMask;					// Registers of its command
+	short			sLast;					// Value at the last Apply()
+} MBOX_COUNTER;
+
+class CCommandMailbox
+{
+public:
+	CCommandMailbox() ;
+
+	void Configure(int iStartRef, int iCount) ;
+	int  AddCounter(int iCounterReg, int iReg, int iCount) ;
+	void SetLayoutVerified(bool bVerified)	{ m_bLayoutVerified = bVerified ; }
+	int  Sync(CMotionBackend& cBackend) ;
+/*
+============================================================================
+ Producer side: the IPC callback
+============================================================================
+*/
+	void OnWrite(const unsigned char* ucpFrame, short sFrameSize, uint64_t ullTimeNs) ;
+/*
+============================================================================
+ Consumer side: the cycle. iReg is relative to the iStartRef of Configure().
+============================================================================
+*/
+	int  Apply(CMotionBackend& cBackend) ;
+	bool Written(int iReg, int iCount) const
+	{
+		uint32_t ulMask = ((iCount >= 32) ? 0xFFFFFFFFu : ((1u << iCount) - 1)) << iReg ;
+
+		return (m_ulWritten & ulMask) != 0 ;
+	}
+	short Short(int iReg) const		{ return m_sImage[iReg] ; }
+	long  Long(int iReg) const		{ return (long)(((uint32_t)(uint16_t)m_sImage[iReg + 1] << 16) | (uint16_t)m_sImage[iReg]) ; }
+	uint32_t Sequence() const		{ return m_ulApplied ; }
+	uint64_t LastWriteNs() const	{ return m_ullLastNs ; }
+
+	unsigned long Writes() const	{ return m_ulWrites ; }
+	unsigned long Reads() const		{ return m_ulReads ; }
+	unsigned long Resyncs() const	{ return m_ulResyncs ; }
+
+private:
+	int  ReadRange(CMotionBackend& cBackend, int iStart, int iCount, bool bMarkChanged) ;
+
+	CSpscRing<MBOX_WRITE, MBOX_RING_SIZE>	m_cRing ;
+	int				m_iStartRef ;
+	int				m_iCount ;
+	bool			m_bLayoutVerified ;				// Set before the callback runs
+	int				m_iCounters ;
+	MBOX_COUNTER	m_stCounter[MBOX_MAX_COUNTERS] ;
+	//
+	// IPC thread
+	uint32_t		m_ulProduced ;					// Sequence number of the last write pushed
+	volatile unsigned long	m_ulIgnored ;			// Writes outside the command area
+	//
+	// Cycle
+	short			m_sImage[MBOX_MAX_REGS] ;
+	uint32_t		m_ulWritten ;					// Bit i: register i written, by the last Apply()
+	uint32_t		m_ulApplied ;					// Sequence number of the last write applied
+	bool			m_bAnySeq ;						// No sequence expected: start-up or after a resync
+	unsigned long	m_ulOverflowsSeen ;
+	uint64_t		m_ullLastNs ;
+	unsigned long	m_ulWrites ;					// Writes applied
+	unsigned long	m_ulReads ;						// Table reads made
+	unsigned long	m_ulResyncs ;					// Whole area reads after a lost write
+} ;
+
+#endif /* COMMAND_MAILBOX_H_ */
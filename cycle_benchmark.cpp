@@ -0,0 +1,202 @@
+/*
+============================================================================
+ Name : 	cycle_benchmark.cpp
+ Author :
+ Version :	1.00
+ Description : Cycle loop benchmark measurements and report, see cycle_benchmark.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include "mono_time.h"
+#include "pdo_acquisition.h"
+#include "alloc_guard.h"
+#include "cycle_benchmark.h"
+/*
+============================================================================
+ Function:				CCycleBenchmark()
+ Description:			Constructor.
+============================================================================
+*/
+CCycleBenchmark::CCycleBenchmark()
+{
+	m_ulIpcLatencyUs 	= 0 ;
+	m_ulCanLatencyUs 	= 0 ;
+	m_ullStartNs 		= 0 ;
+	m_ulCanFrames 		= 0 ;
+	m_ulIpcCalls 		= 0 ;
+	m_ullCpuSumNs 		= 0 ;
+	m_ullCpuMaxNs 		= 0 ;
+	m_ulCpuCycles 		= 0 ;
+	m_iResults 			= 0 ;
+	memset(&m_stConfig, 0, sizeof(m_stConfig)) ;
+	memset(m_stResult, 0, sizeof(m_stResult)) ;
+}
+/*
+============================================================================
+ Function:				Begin()
+ Input arguments:		stConfig - the configuration about to be measured.
+ 						ulCanFrames, ulIpcCalls - the simulator counters now.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Starts the measurement of one configuration. Must be called right after
+ the cycle scheduler was started.
+============================================================================
+*/
+void CCycleBenchmark::Begin(const BENCH_CONFIG& stConfig, unsigned long ulCanFrames, unsigned long ulIpcCalls)
+{
+	m_stConfig 		= stConfig ;
+	m_ulCanFrames 	= ulCanFrames ;
+	m_ulIpcCalls 	= ulIpcCalls ;
+	m_ullCpuSumNs 	= 0 ;
+	m_ullCpuMaxNs 	= 0 ;
+	m_ulCpuCycles 	= 0 ;
+	AllocGuardReset() ;
+	m_ullStartNs 	= MonoTimeNs() ;
+}
+/*
+============================================================================
+ Function:				RecordCycleCpu()
+ Input arguments:		ullCpuNs - CPU time of the cycle thread for one cycle.
+============================================================================
+*/
+void CCycleBenchmark::RecordCycleCpu(uint64_t ullCpuNs)
+{
+	m_ullCpuSumNs += ullCpuNs ;
+	if (ullCpuNs > m_ullCpuMaxNs)
+		m_ullCpuMaxNs = ullCpuNs ;
+	m_ulCpuCycles++ ;
+}
+/*
+============================================================================
+ Function:				End()
+ Input arguments:		cCycleHist - execution time of the cycles run since Begin().
+ 						stSched - the scheduler statistics since Begin().
+ 						ulOverruns - cycles longer than the period.
+ 						ulSamples - torque samples acquired since Begin(), all axes.
+ 						ulCanFrames, ulIpcCalls - the simulator counters now.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Completes the measurement of the configuration and keeps its result. The
+ result is dropped when BENCH_MAX_RESULTS configurations were measured.
+============================================================================
+*/
+void CCycleBenchmark::End(const CLatencyHistogram& cCycleHist, const CYCLE_SCHED_STATS& stSched, unsigned long ulOverruns,
+						  unsigned long ulSamples, unsigned long ulCanFrames, unsigned long ulIpcCalls)
+{
+	BENCH_RESULT* pResult ;
+	ALLOC_GUARD_STATS stGuard ;
+
+	if (m_iResults >= BENCH_MAX_RESULTS)
+		return ;
+
+	pResult = &m_stResult[m_iResults++] ;
+	pResult->stConfig 		= m_stConfig ;
+	pResult->dbSeconds 		= (double)(MonoTimeNs() - m_ullStartNs) / NSEC_PER_SEC ;
+	pResult->ulCycles 		= stSched.ulCycles ;
+	pResult->ulSamples 		= ulSamples ;
+	pResult->ulMissed 		= stSched.ulMissed ;
+	pResult->ulOverruns 	= ulOverruns ;
+	pResult->ulCycleP50Us 	= cCycleHist.Percentile(50.0) ;
+	pResult->ulCycleP99Us 	= cCycleHist.Percentile(99.0) ;
+	pResult->ulCycleP999Us 	= cCycleHist.Percentile(99.9) ;
+	pResult->ulCycleMaxUs 	= cCycleHist.Max() ;
+	pResult->ulJitterAvgUs 	= stSched.ulCycles ? (uint32_t)(stSched.ullJitterSumNs / stSched.ulCycles / NSEC_PER_USEC) : 0 ;
+	pResult->ulJitterMaxUs 	= (uint32_t)(stSched.ullJitterMaxNs / NSEC_PER_USEC) ;
+	pResult->ulCpuAvgUs 	= m_ulCpuCycles ? (uint32_t)(m_ullCpuSumNs / m_ulCpuCycles / NSEC_PER_USEC) : 0 ;
+	pResult->ulCpuMaxUs 	= (uint32_t)(m_ullCpuMaxNs / NSEC_PER_USEC) ;
+	pResult->ulCanFrames 	= ulCanFrames - m_ulCanFrames ;
+	pResult->ulIpcCalls 	= ulIpcCalls - m_ulIpcCalls ;
+	AllocGuardGetStats(stGuard) ;
+	pResult->ulCycleAllocs 	= stGuard.ulAllocs ;
+	pResult->ulCycleFrees 	= stGuard.ulFrees ;
+}
+/*
+============================================================================
+ Function:				PrintResult()
+ Description:			Prints one result on one line to stdout.
+============================================================================
+*/
+void CCycleBenchmark::PrintResult(int i) const
+{
+	const BENCH_RESULT& stRes = m_stResult[i] ;
+	double dbSec = (stRes.dbSeconds > 0.0) ? stRes.dbSeconds : 1.0 ;
+
+	printf("Bench %2d ms %2d axes %s: %8.0f samples/s, cycle p50 %u p99 %u p99.9 %u max %u us, "
+		   "%lu missed, %lu overruns, cpu %u us, %.0f CAN frames/s, %.0f IPC/s\n",
+		   stRes.stConfig.iCycleMs, stRes.stConfig.iAxes, (stRes.stConfig.iAcqMode == ACQ_MODE_PDO) ? "PDO" : "SDO",
+		   stRes.ulSamples / dbSec, stRes.ulCycleP50Us, stRes.ulCycleP99Us, stRes.ulCycleP999Us, stRes.ulCycleMaxUs,
+		   stRes.ulMissed, stRes.ulOverruns, stRes.ulCpuAvgUs, stRes.ulCanFrames / dbSec, stRes.ulIpcCalls / dbSec) ;
+	if (stRes.ulCycleAllocs != 0 || stRes.ulCycleFrees != 0)
+		printf("Bench %2d ms %2d axes: %lu allocations and %lu frees in the cycle\n",
+			   stRes.stConfig.iCycleMs, stRes.stConfig.iAxes, stRes.ulCycleAllocs, stRes.ulCycleFrees) ;
+}
+/*
+============================================================================
+ Function:				WriteJson()
+ Input arguments:		cpFileName - the report file, overwritten.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the file could not be written.
+ Version:				Version 1.00
+
+ Description:
+
+ Writes the simulator latencies and one object per measured configuration.
+ Rates are per second of measurement, times are in micro-seconds. The
+ allocations in the cycle are null when they were not counted.
+============================================================================
+*/
+int CCycleBenchmark::WriteJson(const char* cpFileName) const
+{
+	FILE* pFile ;
+	int i ;
+
+	pFile = fopen(cpFileName, "w") ;
+	if (pFile == NULL)
+	{
+		printf("Benchmark: cannot write %s\n", cpFileName) ;
+		return -1 ;
+	}
+
+	fprintf(pFile, "{\n  \"schema_version\": %d,\n", BENCH_SCHEMA_VERSION) ;
+	fprintf(pFile, "  \"sim_ipc_latency_us\": %lu,\n  \"sim_can_latency_us\": %lu,\n", m_ulIpcLatencyUs, m_ulCanLatencyUs) ;
+	fprintf(pFile, "  \"results\": [\n") ;
+	for (i = 0 ; i < m_iResults ; i++)
+	{
+		const BENCH_RESULT& stRes = m_stResult[i] ;
+		double dbSec = (stRes.dbSeconds > 0.0) ? stRes.dbSeconds : 1.0 ;
+
+		fprintf(pFile, "    {\"cycle_ms\": %d, \"axes\": %d, \"acq_mode\": \"%s\", \"seconds\": %.3f, \"cycles\": %lu,\n",
+				stRes.stConfig.iCycleMs, stRes.stConfig.iAxes, (stRes.stConfig.iAcqMode == ACQ_MODE_PDO) ? "pdo" : "sdo",
+				stRes.dbSeconds, stRes.ulCycles) ;
+		fprintf(pFile, "     \"samples_per_s\": %.1f, \"deadline_misses\": %lu, \"overruns\": %lu,\n",
+				stRes.ulSamples / dbSec, stRes.ulMissed, stRes.ulOverruns) ;
+		fprintf(pFile, "     \"cycle_us\": {\"p50\": %u, \"p99\": %u, \"p99_9\": %u, \"max\": %u},\n",
+				stRes.ulCycleP50Us, stRes.ulCycleP99Us, stRes.ulCycleP999Us, stRes.ulCycleMaxUs) ;
+		fprintf(pFile, "     \"jitter_us\": {\"avg\": %u, \"max\": %u}, \"cpu_per_cycle_us\": {\"avg\": %u, \"max\": %u},\n",
+				stRes.ulJitterAvgUs, stRes.ulJitterMaxUs, stRes.ulCpuAvgUs, stRes.ulCpuMaxUs) ;
+		fprintf(pFile, "     \"can_frames_per_s\": %.1f, \"ipc_calls_per_s\": %.1f,\n",
+				stRes.ulCanFrames / dbSec, stRes.ulIpcCalls / dbSec) ;
+		if (AllocGuardAvailable())
+			fprintf(pFile, "     \"cycle_allocs\": %lu, \"cycle_frees\": %lu}%s\n",
+					stRes.ulCycleAllocs, stRes.ulCycleFrees, (i + 1 < m_iResults) ? "," : "") ;
+		else
+			fprintf(pFile, "     \"cycle_allocs\": null, \"cycle_frees\": null}%s\n", (i + 1 < m_iResults) ? "," : "") ;
+	}
+	fprintf(pFile, "  ]\n}\n") ;
+
+	if (fclose(pFile) != 0)
+	{
+		printf("Benchmark: cannot write %s\n", cpFileName) ;
+		return -1 ;
+	}
+	return 0 ;
+}
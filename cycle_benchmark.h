@@ -0,0 +1,96 @@
+/*
+============================================================================
+ Name : cycle_benchmark.h
+ Author  :
+ Version :
+ Description : 	Measurements and report of the cycle loop benchmark.
+
+ The benchmark runs the real MachineSequencesTimer() pipeline against the
+ simulated backend (see sim_backend.h) for a list of configurations: cycle
+ period, number of axes and acquisition mode. CCycleBenchmark measures one
+ configuration at a time, between Begin() and End(), and keeps the results:
+
+ 	- acquired torque samples per second,
+ 	- cycle execution time distribution (p50, p99, p99.9, max),
+ 	- deadlines missed by the scheduler and cycles longer than the period,
+ 	- wake-up jitter,
+ 	- CPU time of the cycle thread per cycle,
+ 	- CAN frames and IPC calls per second, as counted by the simulator,
+ 	- heap allocations made by the cycle, when built with -DALLOC_GUARD
+ 	  (see alloc_guard.h). There must be none.
+
+ WriteJson() writes all the results to a file, to be compared between
+ releases.
+============================================================================
+*/
+#ifndef CYCLE_BENCHMARK_H_
+#define CYCLE_BENCHMARK_H_
+
+#include <stdint.h>
+#include "latency_histogram.h"
+#include "cycle_scheduler.h"
+
+#define		BENCH_MAX_RESULTS		64		// Configurations in one run
+#define		BENCH_RUN_MS			3000	// Default duration of one configuration
+#define		BENCH_SCHEMA_VERSION	2		// Of the JSON report
+
+typedef struct
+{
+	int				iCycleMs;				// Cycle period
+	int				iAxes;					// Simulated axes acquired
+	int				iAcqMode;				// ACQ_MODE_PDO or ACQ_MODE_SDO
+} BENCH_CONFIG;
+
+typedef struct
+{
+	BENCH_CONFIG	stConfig;
+	double			dbSeconds;				// Measured duration
+	unsigned long	ulCycles;
+	unsigned long	ulSamples;				// Torque samples acquired, all axes
+	unsigned long	ulMissed;				// Deadlines skipped by the scheduler
+	unsigned long	ulOverruns;				// Cycles longer than the period
+	uint32_t		ulCycleP50Us;			// Execution time of MachineSequencesTimer()
+	uint32_t		ulCycleP99Us;
+	uint32_t		ulCycleP999Us;
+	uint32_t		ulCycleMaxUs;
+	uint32_t		ulJitterAvgUs;			// Wake-up time - deadline
+	uint32_t		ulJitterMaxUs;
+	uint32_t		ulCpuAvgUs;				// Cycle thread CPU time per cycle
+	uint32_t		ulCpuMaxUs;
+	unsigned long	ulCanFrames;
+	unsigned long	ulIpcCalls;
+	unsigned long	ulCycleAllocs;			// malloc() and the like in the cycle, see alloc_guard.h
+	unsigned long	ulCycleFrees;
+} BENCH_RESULT;
+
+class CCycleBenchmark
+{
+public:
+	CCycleBenchmark() ;
+
+	void SetSimLatencies(unsigned long ulIpcUs, unsigned long ulCanUs)	{ m_ulIpcLatencyUs = ulIpcUs ; m_ulCanLatencyUs = ulCanUs ; }
+	void Begin(const BENCH_CONFIG& stConfig, unsigned long ulCanFrames, unsigned long ulIpcCalls) ;
+	void RecordCycleCpu(uint64_t ullCpuNs) ;
+	void End(const CLatencyHistogram& cCycleHist, const CYCLE_SCHED_STATS& stSched, unsigned long ulOverruns,
+			 unsigned long ulSamples, unsigned long ulCanFrames, unsigned long ulIpcCalls) ;
+
+	int  Results() const						{ return m_iResults ; }
+	const BENCH_RESULT& Result(int i) const		{ return m_stResult[i] ; }
+	void PrintResult(int i) const ;
+	int  WriteJson(const char* cpFileName) const ;
+
+private:
+	unsigned long	m_ulIpcLatencyUs ;			// Of the simulator, reported with the results
+	unsigned long	m_ulCanLatencyUs ;
+	BENCH_CONFIG	m_stConfig ;
+	uint64_t		m_ullStartNs ;
+	unsigned long	m_ulCanFrames ;				// Simulator counters at Begin()
+	unsigned long	m_ulIpcCalls ;
+	uint64_t		m_ullCpuSumNs ;
+	uint64_t		m_ullCpuMaxNs ;
+	unsigned long	m_ulCpuCycles ;
+	int				m_iResults ;
+	BENCH_RESULT	m_stResult[BENCH_MAX_RESULTS] ;
+} ;
+
+#endif /* CYCLE_BENCHMARK_H_ */
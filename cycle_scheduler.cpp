@@ -0,0 +1,373 @@
+/*
+============================================================================
+ Name : 	cycle_scheduler.cpp
+ Author :
+ Version :	1.00
+ Description : Absolute deadline periodic scheduler, see cycle_scheduler.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <alloca.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "mono_time.h"
+#include "cycle_scheduler.h"
+//
+// Missing from the headers of older toolchains, the values are the ABI of the kernel
+#ifndef FUTEX_PRIVATE_FLAG
+#define		FUTEX_PRIVATE_FLAG			128
+#endif
+#ifndef FUTEX_WAKE_PRIVATE
+#define		FUTEX_WAKE_PRIVATE			(FUTEX_WAKE | FUTEX_PRIVATE_FLAG)
+#endif
+#ifndef FUTEX_WAIT_BITSET
+#define		FUTEX_WAIT_BITSET			9
+#endif
+#ifndef FUTEX_WAIT_BITSET_PRIVATE
+#define		FUTEX_WAIT_BITSET_PRIVATE	(FUTEX_WAIT_BITSET | FUTEX_PRIVATE_FLAG)
+#endif
+#ifndef FUTEX_BITSET_MATCH_ANY
+#define		FUTEX_BITSET_MATCH_ANY		0xffffffff
+#endif
+/*
+============================================================================
+ Function:				NsToTimespec()
+ Description:			Converts a CLOCK_MONOTONIC time in ns to a timespec.
+============================================================================
+*/
+static void NsToTimespec(uint64_t ullNs, struct timespec& stTs)
+{
+	stTs.tv_sec 	= (time_t)(ullNs / NSEC_PER_SEC) ;
+	stTs.tv_nsec 	= (long)(ullNs % NSEC_PER_SEC) ;
+}
+/*
+============================================================================
+ Function:				CCycleScheduler()
+ Description:			Constructor.
+============================================================================
+*/
+CCycleScheduler::CCycleScheduler()
+{
+	m_ullPeriodNs 		= 0 ;
+	m_ullDeadlineNs 	= 0 ;
+	m_bDeadlinePending 	= false ;
+	m_iWake 			= 0 ;
+	m_bNoFutex 			= false ;
+	memset(&m_stStats, 0, sizeof(m_stStats)) ;
+}
+/*
+============================================================================
+ Function:				Start()
+ Input arguments:		ulPeriodUs - cycle period, in micro-seconds.
+ 						iRtPriority - SCHED_FIFO priority, or SCHED_NO_RT_PRIORITY.
+ 						iCpu - CPU to pin the calling thread to, or SCHED_NO_CPU_AFFINITY.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the priority or the affinity could not
+ 						be applied (the scheduler still runs, without them).
+ Version:				Version 1.00
+
+ Description:
+
+ Applies the real-time settings to the calling thread, which must be the
+ thread that will later call WaitNextCycle(), and sets the first deadline
+ one period from now.
+============================================================================
+*/
+int CCycleScheduler::Start(unsigned long ulPeriodUs, int iRtPriority, int iCpu)
+{
+	int iRes = 0 ;
+
+	if (iRtPriority != SCHED_NO_RT_PRIORITY)
+	{
+		struct sched_param stParam ;
+
+		memset(&stParam, 0, sizeof(stParam)) ;
+		stParam.sched_priority = iRtPriority ;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &stParam) != 0)
+		{
+			printf("Cycle scheduler: cannot set SCHED_FIFO priority %d\n", iRtPriority) ;
+			iRes = -1 ;
+		}
+	}
+
+	if (iCpu != SCHED_NO_CPU_AFFINITY)
+	{
+		cpu_set_t stCpus ;
+
+		CPU_ZERO(&stCpus) ;
+		CPU_SET(iCpu, &stCpus) ;
+		if (sched_setaffinity(0, sizeof(stCpus), &stCpus) != 0)
+		{
+			printf("Cycle scheduler: cannot pin to CPU %d\n", iCpu) ;
+			iRes = -1 ;
+		}
+	}
+
+	memset(&m_stStats, 0, sizeof(m_stStats)) ;
+	m_stStats.ullJitterMinNs = (uint64_t)-1 ;
+	m_ullPeriodNs 	= (uint64_t)ulPeriodUs * NSEC_PER_USEC ;
+	m_ullDeadlineNs = MonoTimeNs() ;
+	m_bDeadlinePending 	= false ;
+	m_iWake 			= 0 ;
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				CreateThread()
+ Input arguments:		pfnThread, pArg - the thread function and its argument.
+ 						iRtPriority - SCHED_FIFO priority, or SCHED_NO_RT_PRIORITY
+ 						for SCHED_OTHER.
+ 						iCpu - CPU to pin the thread to, or SCHED_NO_CPU_AFFINITY
+ 						for all the CPUs.
+ 						ulStackBytes - stack size of the thread.
+ Output arguments: 		stThread - the thread.
+ Returned value:		0 on success, else the error of pthread_create().
+ Version:				Version 1.00
+
+ Description:
+
+ Creates the thread with PTHREAD_EXPLICIT_SCHED, so nothing of the calling
+ thread is inherited: policy, priority, affinity and stack size are all set
+ here. With mlockall(MCL_FUTURE) in force, the whole stack is locked, hence
+ the bounded size.
+============================================================================
+*/
+int CCycleScheduler::CreateThread(pthread_t& stThread, void* (*pfnThread)(void*), void* pArg,
+								  int iRtPriority, int iCpu, unsigned long ulStackBytes)
+{
+	pthread_attr_t stAttr ;
+	struct sched_param stParam ;
+	cpu_set_t stCpus ;
+	long lCpus ;
+	int iRes ;
+	int i ;
+
+	memset(&stParam, 0, sizeof(stParam)) ;
+	CPU_ZERO(&stCpus) ;
+	if (iCpu != SCHED_NO_CPU_AFFINITY)
+		CPU_SET(iCpu, &stCpus) ;
+	else
+	{
+		lCpus = sysconf(_SC_NPROCESSORS_CONF) ;
+		for (i = 0 ; i < lCpus && i < CPU_SETSIZE ; i++)
+		{
+			CPU_SET(i, &stCpus) ;
+		}
+	}
+
+	pthread_attr_init(&stAttr) ;
+	pthread_attr_setinheritsched(&stAttr, PTHREAD_EXPLICIT_SCHED) ;
+	if (iRtPriority != SCHED_NO_RT_PRIORITY)
+	{
+		stParam.sched_priority = iRtPriority ;
+		pthread_attr_setschedpolicy(&stAttr, SCHED_FIFO) ;
+	}
+	else
+		pthread_attr_setschedpolicy(&stAttr, SCHED_OTHER) ;
+	pthread_attr_setschedparam(&stAttr, &stParam) ;
+	pthread_attr_setaffinity_np(&stAttr, sizeof(stCpus), &stCpus) ;
+	if (ulStackBytes < (unsigned long)PTHREAD_STACK_MIN)
+		ulStackBytes = (unsigned long)PTHREAD_STACK_MIN ;
+	pthread_attr_setstacksize(&stAttr, ulStackBytes) ;
+
+	iRes = pthread_create(&stThread, &stAttr, pfnThread, pArg) ;
+	if (iRes == EPERM && iRtPriority != SCHED_NO_RT_PRIORITY)
+	{
+		//
+		// No right to SCHED_FIFO: the thread runs at SCHED_OTHER, as Start() does
+		printf("Cycle scheduler: cannot create a thread at SCHED_FIFO priority %d\n", iRtPriority) ;
+		stParam.sched_priority = 0 ;
+		pthread_attr_setschedpolicy(&stAttr, SCHED_OTHER) ;
+		pthread_attr_setschedparam(&stAttr, &stParam) ;
+		iRes = pthread_create(&stThread, &stAttr, pfnThread, pArg) ;
+	}
+	pthread_attr_destroy(&stAttr) ;
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				PrefaultStack()
+ Description:			Writes every page of ulBytes of stack below the caller.
+ 						Not inlined, so the pages are released to the caller
+ 						on return, faulted in.
+============================================================================
+*/
+static void __attribute__((noinline)) PrefaultStack(unsigned long ulBytes)
+{
+	volatile unsigned char* pucStack = (volatile unsigned char*)alloca(ulBytes) ;
+	unsigned long ulPage = (unsigned long)sysconf(_SC_PAGESIZE) ;
+	unsigned long i ;
+
+	for (i = 0 ; i < ulBytes ; i += ulPage)
+	{
+		pucStack[i] = 0 ;
+	}
+}
+/*
+============================================================================
+ Function:				LockMemory()
+ Input arguments:		ulStackBytes - stack of the calling thread to fault in,
+ 						the deepest the cycle goes, with a margin.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the memory could not be locked
+ 						(RLIMIT_MEMLOCK, no CAP_IPC_LOCK). The stack is
+ 						faulted in anyway.
+ Version:				Version 1.00
+
+ Description:
+
+ Locks the pages of the process, present and future, in RAM, and faults in
+ the stack of the calling thread, the thread of the cycle. Called once the
+ start-up allocations are made.
+============================================================================
+*/
+int CCycleScheduler::LockMemory(unsigned long ulStackBytes)
+{
+	int iRes = 0 ;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		printf("Cycle scheduler: cannot lock the memory (%s)\n", strerror(errno)) ;
+		iRes = -1 ;
+	}
+	PrefaultStack(ulStackBytes) ;
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				WaitNextCycle()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		CYCLE_TICK at the deadline, CYCLE_WAKE if Wake() was
+ 						called since the last return, or during the wait.
+ Version:				Version 1.00
+
+ Description:
+
+ Sleeps until the next deadline. If the previous cycle ran past one or more
+ deadlines, they are counted as missed and the next deadline in the future
+ is used, so the cycle keeps its phase instead of bursting to catch up.
+ After a CYCLE_WAKE the deadline is the same as for the wait it ended.
+
+ The futex wait goes round again on a wake-up, EINTR or EAGAIN. Any other
+ error switches to clock_nanosleep() rather than spinning, see m_bNoFutex.
+============================================================================
+*/
+int CCycleScheduler::WaitNextCycle()
+{
+	struct timespec stDeadline ;
+	uint64_t ullNow ;
+	uint64_t ullJitter ;
+
+	if (!m_bDeadlinePending)
+	{
+		m_ullDeadlineNs += m_ullPeriodNs ;
+
+		ullNow = MonoTimeNs() ;
+		if (ullNow > m_ullDeadlineNs)
+		{
+			uint64_t ullLate = (ullNow - m_ullDeadlineNs) / m_ullPeriodNs ;
+
+			m_stStats.ulMissed 	+= (unsigned long)ullLate ;
+			m_ullDeadlineNs 	+= ullLate * m_ullPeriodNs ;
+		}
+	}
+
+	NsToTimespec(m_ullDeadlineNs, stDeadline) ;
+	for (;;)
+	{
+		if (__sync_bool_compare_and_swap(&m_iWake, 1, 0))
+		{
+			m_bDeadlinePending = true ;
+			m_stStats.ulWakes++ ;
+			return CYCLE_WAKE ;
+		}
+		if (m_bNoFutex)
+		{
+			if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &stDeadline, NULL) == 0)
+				break ;
+			continue ;						// EINTR
+		}
+		//
+		// Returns at once if m_iWake is no longer 0 (EAGAIN)
+		if (syscall(SYS_futex, &m_iWake, FUTEX_WAIT_BITSET_PRIVATE, 0, &stDeadline, NULL,
+					FUTEX_BITSET_MATCH_ANY) == 0)
+			continue ;						// Woken, or spurious
+		if (errno == ETIMEDOUT)
+			break ;
+		if (errno != EINTR && errno != EAGAIN)
+			m_bNoFutex = true ;				// ENOSYS, EINVAL: kernel older than 2.6.25
+	}
+	m_bDeadlinePending = false ;
+//
+//	Record the wake-up latency
+//
+	ullNow 		= MonoTimeNs() ;
+	ullJitter 	= (ullNow > m_ullDeadlineNs) ? (ullNow - m_ullDeadlineNs) : 0 ;
+
+	m_stStats.ulCycles++ ;
+	m_stStats.ullJitterSumNs += ullJitter ;
+	if (ullJitter < m_stStats.ullJitterMinNs)
+		m_stStats.ullJitterMinNs = ullJitter ;
+	if (ullJitter > m_stStats.ullJitterMaxNs)
+		m_stStats.ullJitterMaxNs = ullJitter ;
+	return CYCLE_TICK ;
+}
+/*
+============================================================================
+ Function:				Wake()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Ends the current or the next wait of WaitNextCycle(). May be called from
+ any thread, e.g. an IPC callback; several calls before the waiter runs
+ end one wait only.
+============================================================================
+*/
+void CCycleScheduler::Wake()
+{
+	if (__sync_lock_test_and_set(&m_iWake, 1) == 0)
+		syscall(SYS_futex, &m_iWake, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0) ;
+}
+/*
+============================================================================
+ Function:				GetStats()
+ Description:			Copies the scheduling statistics.
+============================================================================
+*/
+void CCycleScheduler::GetStats(CYCLE_SCHED_STATS& stStats) const
+{
+	stStats = m_stStats ;
+}
+/*
+============================================================================
+ Function:				PrintStats()
+ Description:			Prints the scheduling statistics to stdout.
+============================================================================
+*/
+void CCycleScheduler::PrintStats() const
+{
+	unsigned long ulAvgUs = 0 ;
+
+	if (m_stStats.ulCycles)
+		ulAvgUs = (unsigned long)(m_stStats.ullJitterSumNs / m_stStats.ulCycles / NSEC_PER_USEC) ;
+
+	printf("Cycle scheduler: %lu cycles, %lu missed, %lu woken early, jitter min %lu us avg %lu us max %lu us\n",
+			m_stStats.ulCycles, m_stStats.ulMissed, m_stStats.ulWakes,
+			m_stStats.ulCycles ? (unsigned long)(m_stStats.ullJitterMinNs / NSEC_PER_USEC) : 0UL,
+			ulAvgUs,
+			(unsigned long)(m_stStats.ullJitterMaxNs / NSEC_PER_USEC)) ;
+	if (m_bNoFutex)
+		printf("Cycle scheduler: no FUTEX_WAIT_BITSET, Wake() did not shorten the waits\n") ;
+}
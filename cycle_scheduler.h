@@ -0,0 +1,86 @@
+/*
+============================================================================
+ Name : cycle_scheduler.h
+ Author  :
+ Version :
+ Description : 	Deterministic periodic scheduler for the machine sequences cycle.
+
+ The calling thread sleeps until an absolute CLOCK_MONOTONIC deadline with
+ clock_nanosleep(), so the period does not drift with the execution time of
+ the cycle. The wake-up latency (jitter) of every cycle is recorded. When a
+ cycle overruns, the missed deadlines are counted and skipped rather than
+ executed back to back.
+
+ Wake(), from any thread, ends the current wait at once: the caller of
+ WaitNextCycle() runs an extra cycle, and the next wait is for the same
+ deadline, so the periodic cycles keep their phase. The sleep is a futex
+ wait with the deadline as absolute CLOCK_MONOTONIC timeout; Wake() does
+ not block and makes one system call per wait at most.
+
+ FUTEX_WAIT_BITSET needs Linux 2.6.25. On a kernel that rejects it, the
+ scheduler falls back for good to clock_nanosleep(TIMER_ABSTIME) to the
+ deadline: the periodic cycles are unchanged, but Wake() no longer ends a
+ sleep early, the woken cycle runs right after the next deadline.
+
+ Optionally, the thread is given a SCHED_FIFO priority and pinned to a CPU,
+ and LockMemory() keeps the process in RAM and faults in the stack of the
+ thread, so the cycle takes no page fault once started.
+
+ CreateThread() starts another thread with its own policy, priority, CPU
+ and stack size, instead of inheriting those of its creator: a thread
+ created by the cycle would otherwise run at the priority and on the CPU
+ of the cycle, with a default stack locked in RAM.
+============================================================================
+*/
+#ifndef CYCLE_SCHEDULER_H_
+#define CYCLE_SCHEDULER_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define		SCHED_NO_RT_PRIORITY	0		// Keep the default SCHED_OTHER policy
+#define		SCHED_NO_CPU_AFFINITY	(-1)	// Let the kernel place the thread
+//
+// Returned by WaitNextCycle()
+#define		CYCLE_TICK				0		// The deadline was reached
+#define		CYCLE_WAKE				1		// Woken by Wake() before it
+
+typedef struct
+{
+	unsigned long	ulCycles;			// Number of deadlines met or overrun
+	unsigned long	ulMissed;			// Deadlines skipped because a cycle overran
+	unsigned long	ulWakes;			// Waits ended by Wake()
+	uint64_t		ullJitterMinNs;		// Wake-up time - deadline
+	uint64_t		ullJitterMaxNs;
+	uint64_t		ullJitterSumNs;
+} CYCLE_SCHED_STATS;
+
+class CCycleScheduler
+{
+public:
+	CCycleScheduler() ;
+
+	int  Start(unsigned long ulPeriodUs, int iRtPriority, int iCpu) ;
+	int  LockMemory(unsigned long ulStackBytes) ;
+	int  WaitNextCycle() ;
+	void Wake() ;
+	void GetStats(CYCLE_SCHED_STATS& stStats) const ;
+	void PrintStats() const ;
+
+	static int CreateThread(pthread_t& stThread, void* (*pfnThread)(void*), void* pArg,
+							int iRtPriority, int iCpu, unsigned long ulStackBytes) ;
+
+	uint64_t	LastDeadlineNs() const	{ return m_ullDeadlineNs ; }
+	uint64_t	PeriodNs() const		{ return m_ullPeriodNs ; }
+
+private:
+	uint64_t			m_ullPeriodNs ;
+	uint64_t			m_ullDeadlineNs ;		// Deadline of the cycle being executed
+	bool				m_bDeadlinePending ;	// The last wait was ended by Wake()
+	volatile int		m_iWake ;				// Futex word, 1 when Wake() was called
+	bool				m_bNoFutex ;			// FUTEX_WAIT_BITSET rejected, clock_nanosleep() instead
+	CYCLE_SCHED_STATS	m_stStats ;
+} ;
+
+#endif /* CYCLE_SCHEDULER_H_ */
@@ -0,0 +1,354 @@
+/*
+============================================================================
+ Name : 	gmas_backend.cpp
+ Author :
+ Version :	1.00
+ Description : Motion backend forwarding to the Elmo GMAS C++ library.
+============================================================================
+*/
+#include <string.h>
+#include <pthread.h>
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include "gmas_backend.h"
+MMC_MB_CLBK CGmasBackend::m_pfnCallback = NULL ;
+/*
+============================================================================
+ Function:				InitLock()
+ Description:			Initializes a mutex inheriting the priority of its waiters.
+============================================================================
+*/
+static void InitLock(pthread_mutex_t* pMutex)
+{
+	pthread_mutexattr_t stAttr ;
+
+	pthread_mutexattr_init(&stAttr) ;
+	pthread_mutexattr_setprotocol(&stAttr, PTHREAD_PRIO_INHERIT) ;
+	pthread_mutex_init(pMutex, &stAttr) ;
+	pthread_mutexattr_destroy(&stAttr) ;
+}
+/*
+============================================================================
+ Function:				CGmasBackend()
+ Description:			Constructor.
+============================================================================
+*/
+CGmasBackend::CGmasBackend()
+{
+	InitLock(&m_stCycleLock) ;
+	InitLock(&m_stSdoLock) ;
+	InitLock(&m_stHostLock) ;
+	m_hConn 	= 0 ;
+	m_hSdoConn 	= 0 ;
+	m_hHostConn = 0 ;
+	m_iAxes 	= 0 ;
+	m_iBulkAxes = 0 ;
+}
+
+CGmasBackend::~CGmasBackend()
+{
+	pthread_mutex_destroy(&m_stCycleLock) ;
+	pthread_mutex_destroy(&m_stSdoLock) ;
+	pthread_mutex_destroy(&m_stHostLock) ;
+}
+/*
+============================================================================
+ Function:				CycleCallback(), SdoCallback(), HostCallback()
+ Description:			IPC callbacks of the three connections, see gmas_backend.h.
+ 						The event ID is the second byte of the frame.
+============================================================================
+*/
+int CGmasBackend::CycleCallback(unsigned char* ucpBuffer, short sSize, void* pSocket)
+{
+	if (ucpBuffer[1] == ASYNC_REPLY_EVT)
+		return 1 ;
+	return m_pfnCallback(ucpBuffer, sSize, pSocket) ;
+}
+
+int CGmasBackend::SdoCallback(unsigned char* ucpBuffer, short sSize, void* pSocket)
+{
+	if (ucpBuffer[1] != ASYNC_REPLY_EVT)
+		return 1 ;
+	return m_pfnCallback(ucpBuffer, sSize, pSocket) ;
+}
+
+int CGmasBackend::HostCallback(unsigned char* ucpBuffer, short sSize, void* pSocket)
+{
+	return 1 ;
+}
+/*
+============================================================================
+ Function:				ConnectIPCEx()
+ Description:			Connects to the GMAS core over IPC, once per thread, see
+ 						gmas_backend.h. pfnCallback is called from the IPC thread
+ 						of the library for every event in iEventsMask.
+ 						Returns the cycle connection.
+============================================================================
+*/
+MMC_CONNECT_HNDL CGmasBackend::ConnectIPCEx(int iEventsMask, MMC_MB_CLBK pfnCallback)
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+	CGmasLock cSdoLock(&m_stSdoLock) ;
+	CGmasLock cHostLock(&m_stHostLock) ;
+
+	m_pfnCallback 	= pfnCallback ;
+	m_hConn 		= m_cConn.ConnectIPCEx(iEventsMask, (MMC_MB_CLBK)CycleCallback) ;
+	m_hSdoConn 		= m_cSdoConn.ConnectIPCEx(iEventsMask, (MMC_MB_CLBK)SdoCallback) ;
+	m_hHostConn 	= m_cHostConn.ConnectIPCEx(0, (MMC_MB_CLBK)HostCallback) ;
+	return m_hConn ;
+}
+/*
+============================================================================
+ Function:				Close()
+ Description:			Closes the connections to the GMAS core.
+============================================================================
+*/
+void CGmasBackend::Close()
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+	CGmasLock cSdoLock(&m_stSdoLock) ;
+	CGmasLock cHostLock(&m_stHostLock) ;
+
+	MMC_CloseConnection(m_hHostConn) ;
+	MMC_CloseConnection(m_hSdoConn) ;
+	MMC_CloseConnection(m_hConn) ;
+	m_iAxes 	= 0 ;
+	m_iBulkAxes = 0 ;
+}
+/*
+============================================================================
+ Function:				CreateAxis()
+ Input arguments:		cpName - the axis name, as configured in the GMAS (e.g. "a01").
+ Returned value:		The axis, NULL if BACKEND_MAX_AXES axes were already created.
+============================================================================
+*/
+CAxisBackend* CGmasBackend::CreateAxis(const char* cpName)
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+	CGmasLock cSdoLock(&m_stSdoLock) ;
+	CGmasAxis* pAxis ;
+
+	if (m_iAxes >= BACKEND_MAX_AXES)
+		return NULL ;
+
+	pAxis = &m_cAxis[m_iAxes++] ;
+	pAxis->m_pLock 		= &m_stCycleLock ;
+	pAxis->m_pSdoLock 	= &m_stSdoLock ;
+	pAxis->m_cAxis.InitAxisData(cpName, m_hConn) ;
+	pAxis->m_cSdoAxis.InitAxisData(cpName, m_hSdoConn) ;
+	return pAxis ;
+}
+/*
+============================================================================
+ Function:				SetSyncTime()
+ Description:			Sets the CAN SYNC period, in GMAS cycles.
+============================================================================
+*/
+void CGmasBackend::SetSyncTime(int iSyncMultiplier)
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+
+	CMMCPPGlobal::Instance()->SetSyncTime(m_hConn, iSyncMultiplier) ;
+}
+/*
+============================================================================
+ Function:				BulkConfigured()
+ Input arguments:		pAxes, iAxes - axes created by this backend.
+ Output arguments: 		None.
+ Returned value:		TRUE if the bulk read is set up for these axes.
+ Version:				Version 1.00
+
+ Description:
+
+ Sets up the bulk read of the GMAS (preset 1: position, velocity, torque,
+ status, inputs and mode of each axis) for the axes, the first time or when
+ they change. The GMAS returns the factor of every parameter of every axis,
+ axis after axis, that converts its value to user units. A GMAS that
+ refuses it is not asked again: ReadInputs() then reads axis by axis.
+ Called under the cycle lock.
+============================================================================
+*/
+int CGmasBackend::BulkConfigured(CAxisBackend* const* pAxes, int iAxes)
+{
+	int i ;
+
+	if (m_iBulkAxes < 0 || iAxes <= 0 || iAxes > BACKEND_MAX_AXES)
+		return 0 ;
+
+	if (m_iBulkAxes == iAxes)
+	{
+		for (i = 0 ; i < iAxes && m_usBulkRef[i] == ((CGmasAxis*)pAxes[i])->GetRef() ; i++)
+			;
+		if (i == iAxes)
+			return 1 ;
+	}
+
+	for (i = 0 ; i < iAxes ; i++)
+	{
+		m_usBulkRef[i] = ((CGmasAxis*)pAxes[i])->GetRef() ;
+	}
+	try
+	{
+		CMMCPPGlobal::Instance()->ConfigBulkRead(m_hConn, eBULKREAD_CONFIG_1, eNC_BULKREAD_PRESET_1,
+												  m_usBulkRef, (unsigned short)iAxes, m_fBulkFactor) ;
+		m_iBulkAxes = iAxes ;
+	}
+	catch (CMMCException& cErr)
+	{
+		m_iBulkAxes = -1 ;
+	}
+	return (m_iBulkAxes == iAxes) ;
+}
+/*
+============================================================================
+ Function:				ReadInputs()
+ Input arguments:		pAxes, iAxes - axes created by this backend.
+ 						stIn - arrays to fill, NULL for the inputs not needed.
+ Output arguments: 		The arrays of stIn.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ One PerformBulkRead() for all the axes and inputs, on the cycle connection:
+ a single round trip, whatever the number of axes, and an image of all of
+ them as of the same GMAS cycle. The values are converted to user units
+ with the factors of BulkConfigured(), as GetActualPosition() & co. return
+ them.
+
+ Without the bulk read (refused, or failed once), one call per axis and
+ input through the single axis functions: the number of non-NULL arrays
+ times iAxes round trips.
+============================================================================
+*/
+void CGmasBackend::ReadInputs(CAxisBackend* const* pAxes, int iAxes, const AXIS_INPUTS& stIn)
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+	NC_BULKREAD_PRESET_ENUM ePreset = eNC_BULKREAD_PRESET_1 ;
+	int i ;
+
+	if (BulkConfigured(pAxes, iAxes))
+	{
+		try
+		{
+			CMMCPPGlobal::Instance()->PerformBulkRead(m_hConn, (unsigned short)iAxes, eBULKREAD_CONFIG_1, ePreset, m_stBulk) ;
+			for (i = 0 ; i < iAxes ; i++)
+			{
+				const NC_BULKREAD_PRESET_1& stAxis = m_stBulk[i] ;
+				const float* fpFactor = &m_fBulkFactor[i * GMAS_BULK_PARAMS] ;
+
+				if (stIn.pulStatus)
+					stIn.pulStatus[i] = (uint32_t)stAxis.ulAxisStatus ;
+				if (stIn.plPosition)
+					stIn.plPosition[i] = (int32_t)(stAxis.aPos * (double)fpFactor[0]) ;
+				if (stIn.plVelocity)
+					stIn.plVelocity[i] = (int32_t)(stAxis.aVel * (double)fpFactor[1]) ;
+				if (stIn.plTorque)
+					stIn.plTorque[i] = (int32_t)(stAxis.aTorque * (double)fpFactor[2]) ;
+			}
+			return ;
+		}
+		catch (CMMCException& cErr)
+		{
+			m_iBulkAxes = -1 ;
+		}
+	}
+
+	for (i = 0 ; i < iAxes ; i++)
+	{
+		CMMCSingleAxis& cAxis = ((CGmasAxis*)pAxes[i])->m_cAxis ;
+
+		if (stIn.pulStatus)
+			stIn.pulStatus[i] = cAxis.ReadStatus() ;
+		if (stIn.plPosition)
+			stIn.plPosition[i] = (int32_t)cAxis.GetActualPosition() ;
+		if (stIn.plVelocity)
+			stIn.plVelocity[i] = (int32_t)cAxis.GetActualVelocity() ;
+		if (stIn.plTorque)
+			stIn.plTorque[i] = (int32_t)cAxis.GetActualTorque() ;
+	}
+}
+/*
+============================================================================
+ Function:				MbusStartServer()
+ Description:			Starts the Modbus TCP server on the IPC connection.
+ 						Returns 0 on success, else the error of the library,
+ 						also when it is thrown: the application runs on
+ 						without the host.
+============================================================================
+*/
+int CGmasBackend::MbusStartServer()
+{
+	CGmasLock cLock(&m_stCycleLock) ;
+
+	try
+	{
+		return m_cHost.MbusStartServer(m_hConn, 1) ;
+	}
+	catch (CMMCException& cErr)
+	{
+		return (cErr.error() != 0) ? cErr.error() : -1 ;
+	}
+}
+/*
+============================================================================
+ Function:				MbusWriteRegisters()
+ Input arguments:		iStartRef - first holding register.
+ 						iCount - registers to write, at most the size of
+ 						MMC_MODBUSWRITEHOLDINGREGISTERSTABLE_IN.regArr.
+ 						spRegs - their values.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if iCount is out of range, or the
+ 						error of the library.
+ Version:				Version 1.00
+
+ Description:
+
+ One MMC_MbusWriteHoldingRegisterTable() call on the host connection: the
+ table is that of the server, whichever connection writes it.
+============================================================================
+*/
+int CGmasBackend::MbusWriteRegisters(int iStartRef, int iCount, const short* spRegs)
+{
+	MMC_MODBUSWRITEHOLDINGREGISTERSTABLE_IN stIn ;
+	MMC_MODBUSWRITEHOLDINGREGISTERSTABLE_OUT stOut ;
+	CGmasLock cLock(&m_stHostLock) ;
+
+	if (iCount <= 0 || iCount > (int)(sizeof(stIn.regArr) / sizeof(stIn.regArr[0])))
+		return -1 ;
+
+	stIn.startRef 	= iStartRef ;
+	stIn.refCnt 	= iCount ;
+	memcpy(stIn.regArr, spRegs, iCount * sizeof(short)) ;
+	return MMC_MbusWriteHoldingRegisterTable(m_hHostConn, stIn, &stOut) ;
+}
+/*
+============================================================================
+ Function:				MbusReadRegisters()
+ Input arguments:		iStartRef - first holding register.
+ 						iCount - registers to read, at most the size of
+ 						MMC_MODBUSREADHOLDINGREGISTERSTABLE_OUT.regArr.
+ Output arguments: 		spRegs - their values.
+ Returned value:		0 on success, -1 if iCount is out of range, or the
+ 						error of the library.
+ Version:				Version 1.00
+
+ Description:
+
+ One MbusReadHoldingRegisterTable() call, on the cycle connection.
+============================================================================
+*/
+int CGmasBackend::MbusReadRegisters(int iStartRef, int iCount, short* spRegs)
+{
+	MMC_MODBUSREADHOLDINGREGISTERSTABLE_OUT stOut ;
+	CGmasLock cLock(&m_stCycleLock) ;
+	int iRes ;
+
+	if (iCount <= 0 || iCount > (int)(sizeof(stOut.regArr) / sizeof(stOut.regArr[0])))
+		return -1 ;
+
+	iRes = m_cHost.MbusReadHoldingRegisterTable(iStartRef, iCount, stOut) ;
+	if (iRes == 0)
+		memcpy(spRegs, stOut.regArr, iCount * sizeof(short)) ;
+	return iRes ;
+}
@@ -0,0 +1,176 @@
+/*
+============================================================================
+ Name : gmas_backend.h
+ Author  :
+ Version :
+ Description : 	Motion backend forwarding to the Elmo GMAS C++ library.
+
+ The cycle, the acquisition thread and the I/O thread all call the library
+(see StartRuntime() in main.cpp), which is not documented as thread safe
+on one connection. The backend therefore opens one IPC connection per
+thread, each with its own mutex, so that no thread waits for the calls of
+another:
+
+ - the cycle connection gets the events and carries the motion, the status,
+   the snapshot of ReadInputs() and the reads of the command area, on the
+   cycle; also the set-up calls of the main thread.
+ - the SDO connection carries the SDO transfers of the acquisition thread,
+   through a second CMMCSingleAxis per axis.
+ - the host connection carries the Modbus writes of the I/O thread.
+
+The library opens an event channel per connection. The reply of an
+asynchronous SDO transfer is forwarded to the application callback from the
+SDO connection only, every other event from the cycle connection only, so
+no event is seen twice whichever connection the GMAS sends it to.
+
+The mutexes inherit the priority of their waiters, e.g. for the set-up
+calls of the main thread that the cycle could still wait for. The IPC
+callback makes no library call and takes no mutex.
+============================================================================
+*/
+#ifndef GMAS_BACKEND_H_
+#define GMAS_BACKEND_H_
+
+#include <pthread.h>
+#include "motion_backend.h"
+
+#define		GMAS_BULK_PARAMS		6		// Parameters of eNC_BULKREAD_PRESET_1, per axis
+/*
+============================================================================
+ Holds the library mutex for the lifetime of the object, released also when
+ the library throws a CMMCException.
+============================================================================
+*/
+class CGmasLock
+{
+public:
+	CGmasLock(pthread_mutex_t* pMutex) : m_pMutex(pMutex)	{ pthread_mutex_lock(m_pMutex) ; }
+	~CGmasLock()											{ pthread_mutex_unlock(m_pMutex) ; }
+
+private:
+	pthread_mutex_t*	m_pMutex ;
+} ;
+
+class CGmasAxis : public CAxisBackend
+{
+public:
+	CMMCSingleAxis		m_cAxis ;						// On the cycle connection
+	CMMCSingleAxis		m_cSdoAxis ;					// The same axis on the SDO connection
+	pthread_mutex_t*	m_pLock ;						// Of the backend, set by CreateAxis()
+	pthread_mutex_t*	m_pSdoLock ;					// Idem
+
+	unsigned short GetRef()										{ return m_cAxis.GetRef() ; }
+	void SetDefaultParams(MMC_MOTIONPARAMS_SINGLE& stParams)	{ CGmasLock cLock(m_pLock) ; m_cAxis.SetDefaultParams(stParams) ; }
+	void SetAcceleration(float fAcceleration)					{ m_cAxis.m_fAcceleration = fAcceleration ; }
+
+	unsigned int ReadStatus()									{ CGmasLock cLock(m_pLock) ; return m_cAxis.ReadStatus() ; }
+	double GetActualPosition()									{ CGmasLock cLock(m_pLock) ; return m_cAxis.GetActualPosition() ; }
+	double GetActualVelocity()									{ CGmasLock cLock(m_pLock) ; return m_cAxis.GetActualVelocity() ; }
+	double GetActualTorque()									{ CGmasLock cLock(m_pLock) ; return m_cAxis.GetActualTorque() ; }
+	void Reset()												{ CGmasLock cLock(m_pLock) ; m_cAxis.Reset() ; }
+	void PowerOn()												{ CGmasLock cLock(m_pLock) ; m_cAxis.PowerOn() ; }
+	void PowerOff()												{ CGmasLock cLock(m_pLock) ; m_cAxis.PowerOff() ; }
+	void MoveAbsolute(double dbPosition, float fVelocity, MC_BUFFERED_MODE_ENUM eBufferMode)
+	{
+		CGmasLock cLock(m_pLock) ;
+
+		m_cAxis.MoveAbsolute(dbPosition, fVelocity, eBufferMode) ;
+	}
+	void ElmoSetAsyncParam(char* cpName, int iValue)			{ CGmasLock cLock(m_pLock) ; m_cAxis.ElmoSetAsyncParam(cpName, iValue) ; }
+
+	void ConfigPDO(unsigned char ucPDONum, unsigned char ucPDOCommParam, unsigned char ucEventGroup,
+				   unsigned char ucParam1, unsigned char ucParam2, unsigned char ucParam3,
+				   unsigned char ucParam4, unsigned char ucParam5)
+	{
+		CGmasLock cLock(m_pLock) ;
+
+		m_cAxis.ConfigPDO(ucPDONum, ucPDOCommParam, ucEventGroup, ucParam1, ucParam2, ucParam3, ucParam4, ucParam5) ;
+	}
+	long SendSdoUpload(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+	{
+		CGmasLock cLock(m_pSdoLock) ;
+
+		return m_cSdoAxis.SendSdoUpload(ucService, ucLength, usIndex, ucSubIndex) ;
+	}
+	void SendSdoDownload(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+	{
+		CGmasLock cLock(m_pSdoLock) ;
+
+		m_cSdoAxis.SendSdoDownload(lData, ucService, ucLength, usIndex, ucSubIndex) ;
+	}
+	void SendSdoUploadAsync(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+	{
+		CGmasLock cLock(m_pSdoLock) ;
+
+		m_cSdoAxis.SendSdoUploadAsync(ucService, ucLength, usIndex, ucSubIndex) ;
+	}
+	void SendSdoDownloadAsync(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+	{
+		CGmasLock cLock(m_pSdoLock) ;
+
+		m_cSdoAxis.SendSdoDownloadAsync(lData, ucService, ucLength, usIndex, ucSubIndex) ;
+	}
+	int  RetreiveSdoUploadAsync(long& lData)					{ CGmasLock cLock(m_pSdoLock) ; return m_cSdoAxis.RetreiveSdoUploadAsync(lData) ; }
+	//
+	// The library retrieves the reply of either direction with the same call
+	// (MMC_RetrieveSdoAsyncCmd()), and throws if the transfer failed or was
+	// aborted. The data of a download reply has no meaning.
+	int  RetreiveSdoDownloadAsync()
+	{
+		CGmasLock cLock(m_pSdoLock) ;
+		long lData ;
+
+		return m_cSdoAxis.RetreiveSdoUploadAsync(lData) ;
+	}
+} ;
+
+class CGmasBackend : public CMotionBackend
+{
+public:
+	CGmasBackend() ;
+	~CGmasBackend() ;
+
+	const char* Name() const		{ return "GMAS" ; }
+	int  IsSimulated() const		{ return 0 ; }
+
+	MMC_CONNECT_HNDL ConnectIPCEx(int iEventsMask, MMC_MB_CLBK pfnCallback) ;
+	void Close() ;
+	CAxisBackend* CreateAxis(const char* cpName) ;
+	void SetSyncTime(int iSyncMultiplier) ;
+	void ReadInputs(CAxisBackend* const* pAxes, int iAxes, const AXIS_INPUTS& stIn) ;
+
+	int  MbusStartServer() ;
+	void MbusStopServer()			{ CGmasLock cLock(&m_stCycleLock) ; m_cHost.MbusStopServer() ; }
+	int  MbusWriteRegisters(int iStartRef, int iCount, const short* spRegs) ;
+	int  MbusReadRegisters(int iStartRef, int iCount, short* spRegs) ;
+
+private:
+	static int CycleCallback(unsigned char* ucpBuffer, short sSize, void* pSocket) ;
+	static int SdoCallback(unsigned char* ucpBuffer, short sSize, void* pSocket) ;
+	static int HostCallback(unsigned char* ucpBuffer, short sSize, void* pSocket) ;
+
+	int  BulkConfigured(CAxisBackend* const* pAxes, int iAxes) ;
+
+	static MMC_MB_CLBK	m_pfnCallback ;					// Of the application, see ConnectIPCEx()
+
+	pthread_mutex_t		m_stCycleLock ;					// Serializes the calls on each connection
+	pthread_mutex_t		m_stSdoLock ;
+	pthread_mutex_t		m_stHostLock ;
+	CMMCConnection		m_cConn ;						// Cycle
+	CMMCConnection		m_cSdoConn ;
+	CMMCConnection		m_cHostConn ;
+	CMMCHostComm		m_cHost ;						// Server started on the cycle connection
+	MMC_CONNECT_HNDL	m_hConn ;
+	MMC_CONNECT_HNDL	m_hSdoConn ;
+	MMC_CONNECT_HNDL	m_hHostConn ;
+	int					m_iAxes ;
+	CGmasAxis			m_cAxis[BACKEND_MAX_AXES] ;
+	//
+	// Bulk read of ReadInputs(), cycle connection
+	int					m_iBulkAxes ;					// Axes configured, 0: none yet, -1: not available
+	unsigned short		m_usBulkRef[BACKEND_MAX_AXES] ;
+	float				m_fBulkFactor[BACKEND_MAX_AXES * GMAS_BULK_PARAMS] ;
+	NC_BULKREAD_PRESET_1	m_stBulk[BACKEND_MAX_AXES] ;
+} ;
+
+#endif /* GMAS_BACKEND_H_ */
@@ -0,0 +1,117 @@
+/*
+============================================================================
+ Name : 	latency_histogram.cpp
+ Author :
+ Version :	1.00
+ Description : Log-linear latency histogram, see latency_histogram.h
+============================================================================
+*/
+#include <string.h>
+#include "latency_histogram.h"
+/*
+============================================================================
+ Function:				CLatencyHistogram()
+ Description:			Constructor.
+============================================================================
+*/
+CLatencyHistogram::CLatencyHistogram()
+{
+	Reset() ;
+}
+/*
+============================================================================
+ Function:				Reset()
+ Description:			Clears all the counters.
+============================================================================
+*/
+void CLatencyHistogram::Reset()
+{
+	memset((void*)m_ulCounts, 0, sizeof(m_ulCounts)) ;
+	m_ulTotal 	= 0 ;
+	m_ulMax 	= 0 ;
+}
+/*
+============================================================================
+ Function:				Snapshot()
+ Input arguments:		None.
+ Output arguments: 		cCopy - receives a copy of the counters.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Copies the histogram while it may still be updated by the cycle. The total
+ is re-computed from the copied buckets so the copy is self consistent.
+============================================================================
+*/
+void CLatencyHistogram::Snapshot(CLatencyHistogram& cCopy) const
+{
+	uint32_t ulTotal = 0 ;
+	int i ;
+
+	for (i = 0 ; i < HIST_BUCKETS ; i++)
+	{
+		cCopy.m_ulCounts[i] = m_ulCounts[i] ;
+		ulTotal += cCopy.m_ulCounts[i] ;
+	}
+	cCopy.m_ulTotal = ulTotal ;
+	cCopy.m_ulMax 	= m_ulMax ;
+}
+/*
+============================================================================
+ Function:				BucketHighest()
+ Input arguments:		iBucket - bucket index.
+ Returned value:		The highest value that falls in the bucket.
+============================================================================
+*/
+uint32_t CLatencyHistogram::BucketHighest(int iBucket)
+{
+	int iExp ;
+	uint32_t ulMantissa ;
+
+	if (iBucket < HIST_SUB_BUCKETS)
+		return (uint32_t)iBucket ;
+
+	iExp 		= (iBucket - HIST_SUB_BUCKETS) / HIST_HALF_BUCKETS + 1 ;
+	ulMantissa 	= (uint32_t)((iBucket - HIST_SUB_BUCKETS) % HIST_HALF_BUCKETS + HIST_HALF_BUCKETS) ;
+	return ((ulMantissa + 1) << iExp) - 1 ;
+}
+/*
+============================================================================
+ Function:				Percentile()
+ Input arguments:		dbPercent - 0.0 .. 100.0
+ Output arguments: 		None.
+ Returned value:		The value, in us, below which dbPercent of the samples fall.
+ Version:				Version 1.00
+
+ Description:
+
+ Reports the upper bound of the bucket holding the requested rank, clipped
+ to the recorded maximum.
+============================================================================
+*/
+uint32_t CLatencyHistogram::Percentile(double dbPercent) const
+{
+	uint32_t ulRank ;
+	uint32_t ulSeen = 0 ;
+	uint32_t ulHighest ;
+	int i ;
+
+	if (m_ulTotal == 0)
+		return 0 ;
+
+	ulRank = (uint32_t)(dbPercent / 100.0 * m_ulTotal + 0.5) ;
+	if (ulRank == 0)
+		ulRank = 1 ;
+
+	for (i = 0 ; i < HIST_BUCKETS ; i++)
+	{
+		ulSeen += m_ulCounts[i] ;
+		if (ulSeen >= ulRank)
+		{
+			ulHighest = BucketHighest(i) ;
+			return (ulHighest < m_ulMax) ? ulHighest : m_ulMax ;
+		}
+	}
+	return m_ulMax ;
+}
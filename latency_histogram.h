@@ -0,0 +1,64 @@
+/*
+============================================================================
+ Name : latency_histogram.h
+ Author  :
+ Version :
+ Description : 	Log-linear (HDR style) latency histogram.
+
+ Values are recorded in micro-seconds. Values below 2^HIST_SUB_BUCKET_BITS
+ get one bucket each, above that every power of 2 is split into
+ 2^(HIST_SUB_BUCKET_BITS-1) linear sub-buckets, so the relative error of a
+ reported percentile stays below ~3% over the whole 32 bits range.
+
+ Record() is O(1) and does not allocate. It must be called from one thread
+ only. Snapshot() may be called from any thread at any time: it copies the
+ counters without stopping the writer, the copy is at most one sample off.
+============================================================================
+*/
+#ifndef LATENCY_HISTOGRAM_H_
+#define LATENCY_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#define		HIST_SUB_BUCKET_BITS	5
+#define		HIST_SUB_BUCKETS		(1 << HIST_SUB_BUCKET_BITS)
+#define		HIST_HALF_BUCKETS		(HIST_SUB_BUCKETS / 2)
+#define		HIST_BUCKETS			(HIST_SUB_BUCKETS + (32 - HIST_SUB_BUCKET_BITS) * HIST_HALF_BUCKETS)
+
+class CLatencyHistogram
+{
+public:
+	CLatencyHistogram() ;
+
+	void Reset() ;
+	void Record(uint32_t ulValueUs)
+	{
+		m_ulCounts[BucketOf(ulValueUs)]++ ;
+		m_ulTotal++ ;
+		if (ulValueUs > m_ulMax)
+			m_ulMax = ulValueUs ;
+	}
+	void Snapshot(CLatencyHistogram& cCopy) const ;
+
+	uint32_t Percentile(double dbPercent) const ;
+	uint32_t Max() const		{ return m_ulMax ; }
+	uint32_t Count() const		{ return m_ulTotal ; }
+
+	static int BucketOf(uint32_t ulValue)
+	{
+		int iExp ;
+
+		if (ulValue < HIST_SUB_BUCKETS)
+			return (int)ulValue ;
+		iExp = (31 - __builtin_clz(ulValue)) - HIST_SUB_BUCKET_BITS + 1 ;
+		return HIST_SUB_BUCKETS + (iExp - 1) * HIST_HALF_BUCKETS + (int)(ulValue >> iExp) - HIST_HALF_BUCKETS ;
+	}
+	static uint32_t BucketHighest(int iBucket) ;
+
+private:
+	volatile uint32_t	m_ulCounts[HIST_BUCKETS] ;
+	volatile uint32_t	m_ulTotal ;
+	volatile uint32_t	m_ulMax ;
+} ;
+
+#endif /* LATENCY_HISTOGRAM_H_ */
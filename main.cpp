@@ -12,8 +12,15 @@ The following features are demonstrated for a CAN network (Due to SYNC and PDO i
 - Modbus callback registration.
 - Emergency callback registration.
 - PDO3 and SYNC initializations.
+- Torque, current and position acquisition over TPDO3, on every SYNC.
 - Modbus reading and updates of axis status and positions.
 - Point to Point motion state machine
+- Simulated drives, for running without a Gold Maestro (-sim).
+- Cycle loop benchmark against the simulated drives (-bench).
+- Regression checks of the modules that run without drives (-selftest).
+- Binary log of every torque sample, in memory-mapped files.
+- Compressed long-term archive of the torque samples.
+- Console messages of the cycle and callbacks formatted by a background thread.
 
  The program works with 2 axes - a01 and a02.
  For the above functions, the following modbus 'codes' are to be sent to address 40001:
@@ -25,14 +32,39 @@ The following features are demonstrated for a CAN network (Due to SYNC and PDO i
 */
 #include "mmc_definitions.h"
 #include "mmcpplib.h"
+#include "gmas_backend.h"		// Motion backends: GMAS library or simulator
+#include "sim_backend.h"
+#include "pdo_acquisition.h"	// TPDO3 torque, current and position acquisition
+#include "callback_ring.h"		// IPC callback to cycle records
+#include "mono_time.h"
+#include "cycle_scheduler.h"	// Periodic cycle with absolute deadlines
+#include "latency_histogram.h"	// Cycle phases profiling
+#include "sdo_engine.h"			// Asynchronous SDO transfers
+#include "sdo_batch.h"			// Multi-object SDO reads
+#include "cycle_benchmark.h"	// Cycle loop benchmark against the simulator
+#include "torque_log.h"			// Binary log of the acquired samples
+#include "torque_archive.h"		// Compressed archive of the acquired samples
+#include "async_log.h"			// Console messages off the cycle
+#include "axis_table.h"			// Per-axis data, structure of arrays
+#include "sample_scheduler.h"	// Rates of the SDO reads of the drives
+#include "signal_cond.h"			// Torque and current filtering, RMS, peak
+#include "segment_stats.h"		// Torque statistics per motion segment
+#include "torque_signature.h"	// Torque versus position envelope of the test strokes
+#include "modbus_publisher.h"	// Output registers to the host
+#include "command_mailbox.h"		// Host commands from the Modbus write events
+#include "state_machine.h"		// Table driven state machines
+#include "motion_sequencer.h"	// Motion sequences that suspend on axis conditions
+#include "alloc_guard.h"		// Heap allocations made by the cycle
+#include "self_test.h"			// Regression checks of the modules (-selftest)
 #include "main.h"			// Application header file.
 #include <iostream>
 #include <sys/time.h>			// For time structure
 #include <signal.h>				// For Timer mechanism
+#include <pthread.h>			// Acquisition and I/O threads
 /*
 ============================================================================
  Function:				main()
- Input arguments:		None.
+ Input arguments:		argc, argv - see ParseArguments().
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
@@ -45,10 +77,38 @@ The following features are demonstrated for a CAN network (Due to SYNC and PDO i
 ============================================================================
 */
 
-int main()
+int main(int argc, char* argv[])
 {
+	int iFailed;
+
 	try {
 	//
+	//	Select the GMAS library or the simulator
+	//
+	ParseArguments(argc, argv);
+	//
+	//	Console messages of the cycle and the callbacks are printed by a background thread
+	//
+	gcLog.Start(gstLogMsgs, eLOG_COUNT);
+	if (gcpArchiveDump)
+	{
+		CTorqueArchive::Dump(gcpArchiveDump);
+		gcLog.Stop();
+		return 1;
+	}
+	if (gbSelfTest)
+	{
+		iFailed = RunSelfTest();
+		gcLog.Stop();
+		return (iFailed == 0) ? 0 : 2;
+	}
+	if (gcpBenchFile)
+	{
+		RunBenchmark(gcpBenchFile);
+		gcLog.Stop();
+		return 1;
+	}
+	//
 	//	Initialize system, axes and all needed initializations
 	//
 	MainInit();
@@ -60,23 +120,139 @@ int main()
 	//	Close what needs to be closed before program termination
 	//
 	MainClose();
+	gcLog.Stop();
 	//
 	return 1;		// Terminate the application program back to the Operating System
 	}
 	catch(CMMCException& exception)
 	{
+		gcLog.Stop();
 		printf("Exception in function %s, axis ref=%s, err=%d, status=%d, %d, bye\n", exception.what(), exception.axisName(), exception.error(), exception.status(), exception.axisRef());
 		MainClose();
 		exit(0);
 	}
 	catch (...)
 	{
+		gcLog.Stop();
 		std::cerr << "Unknown exception caught\n";
 		MainClose();
 		exit(0);
 	}
 }
 /*
+============================================================================
+ Function:				ParseArguments()
+ Input arguments:		argc, argv - the command line.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Selects the motion backend. Without arguments the application runs against
+ the GMAS library. With -sim it runs against simulated drives, and the IPC
+ and CAN latencies of the simulation may be given in micro-seconds:
+
+ 	MDS-TorqueRead -sim [-ipc <us>] [-can <us>] [-axes <n>]
+
+ -axes sets the number of axes acquired, a01 onwards, up to MAX_AXES.
+ -log sets the path and prefix of the torque log files, -nolog disables the log.
+ -sig sets the file the torque envelope of the test strokes is loaded from and
+ saved to, -nosig keeps it in memory only.
+ -archive sets the path and prefix of the compressed torque archive files,
+ -archivemb the flash they may take, in MB, which sets how long the samples
+ are kept, see torque_archive.h. -noarchive disables the archive. -archdump prints the samples of an archive
+ file and exits, see torque_archive.h:
+
+ 	MDS-TorqueRead -archdump torque.00.tqa
+ -alloctrap aborts on the first heap allocation made by the cycle, instead of
+ counting it, in a build with -DALLOC_GUARD, see alloc_guard.h.
+ -bench runs the cycle loop benchmark against the simulator instead of the
+ application, see RunBenchmark():
+
+ 	MDS-TorqueRead -bench <report.json> [-benchms <ms>] [-ipc <us>] [-can <us>]
+ -selftest runs the regression checks of self_test.h instead of the
+ application, and exits with 0 if they all passed, 2 otherwise.
+============================================================================
+*/
+void ParseArguments(int argc, char* argv[])
+{
+	SIM_CONFIG stSimConfig ;
+	int i ;
+
+	gpBackend 		= &gcGmasBackend ;
+	stSimConfig 	= gcSimBackend.Config() ;
+	giTimerCycle 	= TIMER_CYCLE ;
+	giAxes 			= ACQ_AXES ;
+	giAcqMode 		= ACQ_MODE ;
+	gcpBenchFile 	= NULL ;
+	giBenchMs 		= BENCH_RUN_MS ;
+	gcpLogBase 		= TORQUE_LOG_BASE ;
+	gcpSignatureFile = SIGNATURE_FILE ;
+	gcpArchiveBase 	= TORQUE_ARCHIVE_BASE ;
+	gulArchiveMb 	= TORQUE_ARCHIVE_MB ;
+	gcpArchiveDump 	= NULL ;
+	gbSelfTest 		= false ;
+
+	for (i = 1 ; i < argc ; i++)
+	{
+		if (strcmp(argv[i], "-sim") == 0)
+			gpBackend = &gcSimBackend ;
+		else if (strcmp(argv[i], "-ipc") == 0 && i + 1 < argc)
+			stSimConfig.ulIpcLatencyUs = strtoul(argv[++i], NULL, 0) ;
+		else if (strcmp(argv[i], "-can") == 0 && i + 1 < argc)
+			stSimConfig.ulCanLatencyUs = strtoul(argv[++i], NULL, 0) ;
+		else if (strcmp(argv[i], "-axes") == 0 && i + 1 < argc)
+			giAxes = atoi(argv[++i]) ;
+		else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc)
+			gcpBenchFile = argv[++i] ;
+		else if (strcmp(argv[i], "-benchms") == 0 && i + 1 < argc)
+			giBenchMs = atoi(argv[++i]) ;
+		else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc)
+			gcpLogBase = argv[++i] ;
+		else if (strcmp(argv[i], "-nolog") == 0)
+			gcpLogBase = NULL ;
+		else if (strcmp(argv[i], "-sig") == 0 && i + 1 < argc)
+			gcpSignatureFile = argv[++i] ;
+		else if (strcmp(argv[i], "-nosig") == 0)
+			gcpSignatureFile = NULL ;
+		else if (strcmp(argv[i], "-archive") == 0 && i + 1 < argc)
+			gcpArchiveBase = argv[++i] ;
+		else if (strcmp(argv[i], "-archivemb") == 0 && i + 1 < argc)
+			gulArchiveMb = strtoul(argv[++i], NULL, 0) ;
+		else if (strcmp(argv[i], "-noarchive") == 0)
+			gcpArchiveBase = NULL ;
+		else if (strcmp(argv[i], "-archdump") == 0 && i + 1 < argc)
+			gcpArchiveDump = argv[++i] ;
+		else if (strcmp(argv[i], "-selftest") == 0)
+			gbSelfTest = true ;
+		else if (strcmp(argv[i], "-alloctrap") == 0)
+			AllocGuardMode(ALLOC_GUARD_TRAP) ;
+		else
+			printf("Ignoring unknown argument %s\n", argv[i]) ;
+	}
+	if (giAxes < 1)
+		giAxes = 1 ;
+	if (giAxes > MAX_AXES)
+		giAxes = MAX_AXES ;
+	if (gcpBenchFile)
+	{
+		gpBackend 			= &gcSimBackend ;
+		gcpSignatureFile 	= NULL ;		// The benchmark strokes are not learned
+	}
+	gcSimBackend.Configure(stSimConfig) ;
+	printf("Motion backend: %s\n", gpBackend->Name()) ;
+	//
+	// Built with PDO_EVT_LAYOUT_VERIFIED 0, the PDOs forwarded by the GMAS are not decoded
+	if (giAcqMode == ACQ_MODE_PDO && !PDO_EVT_LAYOUT_VERIFIED && !gpBackend->IsSimulated())
+	{
+		printf("PDORCV_EVT layout not trusted, torque acquisition by SDO\n") ;
+		giAcqMode = ACQ_MODE_SDO ;
+	}
+	printf("Signal conditioning: %s\n", CSignalCond::Isa()) ;
+	printf("Torque archive decoder: %s\n", CTorqueArchive::Isa()) ;
+}
+/*
 ============================================================================
  Function:				MainInit()
  Input arguments:		None.
@@ -100,18 +276,39 @@ void MainInit()
 //
 	int iRes ;
 	float fRes ;
+	char cName[16] ;
+	uint64_t ullStepNs[7] ;		// Start of the start-up steps, and end
+	int i ;
+	ullStepNs[0] = MonoTimeNs() ;
 	currRead = 0;
 	appTimeout = 0;
+	reportTimeout = 0;
 	sleepCount = 0;
-	asyncVal = 0;
+	gulSamples = 0;
 	//
-	gConnHndl = cConn.ConnectIPCEx(0x7fffffff,(MMC_MB_CLBK)CallbackFunc) ;
+	gConnHndl = gpBackend->ConnectIPCEx(0x7fffffff,(MMC_MB_CLBK)CallbackFunc) ;
+	ullStepNs[1] = MonoTimeNs() ;
 	//
-	// Start the Modbus Server:
-	//cHost.MbusStartServer(gConnHndl,1) ;
+	// Start the Modbus Server. The output registers are published every cycle.
+	// The commands are taken from the write events, the table is read once here.
+	gcCmdMailbox.Configure(MODBUS_READ_OUTPUTS_INDEX, MODBUS_READ_CNT) ;
+	gcCmdMailbox.AddCounter(eMBUS_CMD_COUNT1, eMBUS_CMD_STATE1, 2) ;
+	gcCmdMailbox.AddCounter(eMBUS_CMD_COUNT2, eMBUS_CMD_STATE2, 2) ;
+	if (gpBackend->MbusStartServer() == 0)
+	{
+		gcMbusOut.Configure(MODBUS_UPDATE_START_INDEX, MODBUS_UPDATE_CNT) ;
+		gcCmdMailbox.Sync(*gpBackend) ;
+	}
+	else
+	{
+		printf("Modbus server not started, no host link\n") ;
+		gcMbusOut.Configure(MODBUS_UPDATE_START_INDEX, 0) ;
+	}
+	ullStepNs[2] = MonoTimeNs() ;
 	//
 	// Register Run Time Error Callback function
-	CMMCPPGlobal::Instance()->RegisterRTE(OnRunTimeError);
+	if (!gpBackend->IsSimulated())
+		CMMCPPGlobal::Instance()->RegisterRTE(OnRunTimeError);
 	//
 	// Register the callback function for Modbus and Emergency:
 	//cConn.RegisterEventCallback(MMCPP_MODBUS_WRITE,(void*)ModbusWrite_Received) ;
@@ -131,44 +328,60 @@ void MainInit()
 	//
 	// 	TODO: Update number of necessary axes:
 	//
-	a1.InitAxisData("a01",gConnHndl) ;
-	//a2.InitAxisData("a02",gConnHndl) ;
+	// The acquired axes are a01 onwards, a1 is the first one.
+	//
+	gcAxes.Clear() ;
+	gcAxes.uiSnapFields = SNAPSHOT_FIELDS | AXIS_SNAP_POSITION ;		// The envelope bins by it
+	for (i = 0 ; i < giAxes ; i++)
+	{
+		CAxisBackend* pAxis ;
+
+		snprintf(cName, sizeof(cName), "a%02d", i + 1) ;
+		pAxis = gpBackend->CreateAxis(cName) ;
+		gcAxes.Add(pAxis) ;
+		//
+		// Set default motion parameters.
+		pAxis->SetDefaultParams(stSingleDefault) ;
+	}
+	a1 = gcAxes.pAxis[0] ;
+	//a2 = gcAxes.pAxis[1] ;
+	ullStepNs[3] = MonoTimeNs() ;
 	//
-	// Set default motion parameters. TODO: Update for all axes.
-	a1.SetDefaultParams(stSingleDefault) ;
-	//a2.SetDefaultParams(stSingleDefault) ;
+	// The log is prepared here, the cycle only copies records into it.
+	if (gcpLogBase && gcTorqueLog.Open(gcpLogBase) != 0)
+		printf("Torque log disabled\n") ;
+	if (gcpArchiveBase && gcArchive.Open(gcpArchiveBase, gulArchiveMb) != 0)
+		printf("Torque archive disabled\n") ;
+	else if (gcpArchiveBase)
+		printf("Torque archive: %d files of %d MB\n", gcArchive.Files(), ARCH_FILE_BYTES / (1024 * 1024)) ;
 	//
-	giXStatus 	= a1.ReadStatus() ;
-	if(giXStatus & NC_AXIS_ERROR_STOP_MASK)
+	// Torque envelope of the test strokes, learned by the previous runs if any.
+	gcSignature.Configure(gcAxes.Count(), SIGNATURE_MARGIN) ;
+	gcSignature.SetGrid(STROKE_MOVE1, 0, TEST_POS) ;
+	gcSignature.SetGrid(STROKE_MOVE2, TEST_POS, 0) ;
+	if (gcpSignatureFile && gcSignature.Load(gcpSignatureFile) == 0)
+		printf("Torque envelope: %lu and %lu strokes learned\n",
+			   (unsigned long)gcSignature.Learned(STROKE_MOVE1), (unsigned long)gcSignature.Learned(STROKE_MOVE2)) ;
+	ullStepNs[4] = MonoTimeNs() ;
+	//
+	// Reset the axes in error stop, all of them before waiting.
+	if (ResetAxes(INIT_RESET_TIMEOUT_MS) != 0)
 	{
-		a1.Reset() ;
-		sleep(1) ;
-		giXStatus 	= a1.ReadStatus() ;
-		if(giXStatus & NC_AXIS_ERROR_STOP_MASK)
+		for (i = 0 ; i < gcAxes.Count() ; i++)
 		{
-			cout << "Axis a1 in Error Stop. Aborting." ;
-			exit(0) ;
+			if (gcAxes.ulErrorStop & AXIS_BIT(i))
+				gcLog.Post(eLOG_ERROR_STOP, i + 1) ;
 		}
+		gcLog.Stop() ;
+		exit(0) ;
 	}
-	cout << "debug 1" << endl;
-//	giYStatus 	= a2.ReadStatus() ;
-//	if(giYStatus & NC_AXIS_ERROR_STOP_MASK)
-//	{
-//		a2.Reset() ;
-//		sleep(1) ;
-//		giYStatus 	= a2.ReadStatus() ;
-//		if(giYStatus & NC_AXIS_ERROR_STOP_MASK)
-//		{
-//			cout << "Axis a2 in Error Stop. Aborting." ;
-//			exit(0) ;
-//		}
-//	}
+	ullStepNs[5] = MonoTimeNs() ;
 	//
-	// Initialize PDOs and SYNC's in the system:
-	// PDO 3, Group 1, OnSync:
-
-	a1.ConfigPDO(PDO_NUM_3,PDO_PARAM_REG,NC_COMM_EVENT_GROUP1,1,1,1,1,1) ;
-	CMMCPPGlobal::Instance()->SetSyncTime(gConnHndl, SYNC_MULTIPLIER) ;
+	// PDOs, SYNC and scales of the samples, all the drives at once.
+	ConfigureDrives() ;
+	ullStepNs[6] = MonoTimeNs() ;
+	ConfigureSampling(gstSignals) ;
+	ConfigureConditioning() ;
 	//
 //	iRes = 5 ;
 //	// Set UM to 5:
@@ -183,10 +396,366 @@ void MainInit()
 	//
 	// Clear the modbus memory array:
 	//memset(mbus_write_in.regArr,0x0,250) ;
-	cout << "debug 2" << endl;
+	printf("Start-up [ms]: connect %.1f, Modbus %.1f, %d axes %.1f, files %.1f, reset %.1f, drives %.1f, total %.1f\n",
+		   (ullStepNs[1] - ullStepNs[0]) / 1e6, (ullStepNs[2] - ullStepNs[1]) / 1e6, gcAxes.Count(),
+		   (ullStepNs[3] - ullStepNs[2]) / 1e6, (ullStepNs[4] - ullStepNs[3]) / 1e6,
+		   (ullStepNs[5] - ullStepNs[4]) / 1e6, (ullStepNs[6] - ullStepNs[5]) / 1e6,
+		   (ullStepNs[6] - ullStepNs[0]) / 1e6) ;
 	return;
 }
 /*
+============================================================================
+ Function:				ResetAxes()
+ Input arguments:		iTimeoutMs - longest wait for the axes to leave the
+ 						error stop.
+ Output arguments: 		None.
+ Returned value:		0 if no axis is in error stop, -1 if some still are,
+ 						see gcAxes.ulErrorStop.
+ Version:				Version 1.00
+
+ Description:
+
+ Resets all the axes in error stop, then polls their status until none is,
+ every INIT_BACKOFF_MIN_US at first, twice as long after each poll up to
+ INIT_BACKOFF_MAX_US. A drive that resets at once costs a few hundred
+ micro-seconds instead of a fixed second.
+============================================================================
+*/
+int ResetAxes(int iTimeoutMs)
+{
+	uint64_t ullEndNs ;
+	unsigned long ulBackoffUs = INIT_BACKOFF_MIN_US ;
+	int i ;
+
+	gcAxes.Snapshot(*gpBackend) ;
+	if (gcAxes.ulErrorStop == 0)
+		return 0 ;
+
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		if (gcAxes.ulErrorStop & AXIS_BIT(i))
+			gcAxes.pAxis[i]->Reset() ;
+	}
+	ullEndNs = MonoTimeNs() + (uint64_t)iTimeoutMs * NSEC_PER_MSEC ;
+	do
+	{
+		usleep(ulBackoffUs) ;
+		if (ulBackoffUs < INIT_BACKOFF_MAX_US)
+			ulBackoffUs = (2 * ulBackoffUs < INIT_BACKOFF_MAX_US) ? 2 * ulBackoffUs : INIT_BACKOFF_MAX_US ;
+		gcAxes.Snapshot(*gpBackend) ;
+		if (gcAxes.ulErrorStop == 0)
+			return 0 ;
+	} while (MonoTimeNs() < ullEndNs) ;
+	return -1 ;
+}
+/*
+============================================================================
+ Function:				ConfigureDrives()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Registers the axes with the SDO engine, and runs the start-up transfers of
+ all the drives side by side, in two rounds:
+
+ 	- read the rated torque and current, and the TPDO3 COB-ID,
+ 	- in ACQ_MODE_PDO, map torque, current and position into TPDO3.
+
+ The drives process their transfers in parallel, so a round takes about the
+ time of the longest drive, not the sum of all of them. If no reply of the
+ first round could be matched to an axis, the engine is made synchronous
+ and the round run again, see CSdoEngine::SetSynchronous().
+
+ Then the PDOs are registered at the GMAS and the SYNC is set, once. The
+ first PDOs are checked against the position read by SDO, see
+ CheckPdoLayout(), and the acquisition falls back to ACQ_MODE_SDO if they do
+ not match. The SYNC period is measured from the PDOs received, see
+ MeasureSyncPeriod().
+
+ The cycle still reads the GMAS position with the status, even when TPDO3
+ carries the position of every axis: the torque envelope is binned in user
+ units, those of TEST_POS, and 0x6064 is in drive counts. With the bulk read
+ of the GMAS it comes in the same round trip.
+
+ Called before the acquisition thread, which owns the engine afterwards,
+ starts.
+============================================================================
+*/
+void ConfigureDrives()
+{
+	static SDO_RESULT stRatedTorque[MAX_AXES] ;		// Static: still referenced by a transfer that timed out
+	static SDO_RESULT stRatedCurrent[MAX_AXES] ;
+	static SDO_RESULT stCobId[MAX_AXES] ;
+	static PDO_MAP_JOB stMap[MAX_AXES] ;
+	SDO_ENGINE_STATS stStats ;
+	int iMapped[MAX_AXES] ;
+	int iAnyMapped = 0 ;
+	int i ;
+
+	memset(stMap, 0, sizeof(stMap)) ;
+	memset(iMapped, 0, sizeof(iMapped)) ;
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+		gcAxes.iSdoNode[i] = gSdoEngine.AddNode(gcAxes.pAxis[i], gcAxes.usAxisRef[i]) ;
+	for (;;)
+	{
+		memset(stRatedTorque, 0, sizeof(stRatedTorque)) ;
+		memset(stRatedCurrent, 0, sizeof(stRatedCurrent)) ;
+		memset(stCobId, 0, sizeof(stCobId)) ;
+		for (i = 0 ; i < gcAxes.Count() ; i++)
+		{
+			gSdoEngine.Upload(gcAxes.iSdoNode[i], 4, OD_MOTOR_RATED_TORQUE, 0, &stRatedTorque[i]) ;
+			gSdoEngine.Upload(gcAxes.iSdoNode[i], 4, OD_MOTOR_RATED_CURRENT, 0, &stRatedCurrent[i]) ;
+			if (giAcqMode == ACQ_MODE_PDO)
+				gSdoEngine.Upload(gcAxes.iSdoNode[i], 4, OD_TPDO3_COMM, 1, &stCobId[i]) ;
+		}
+		if (RunStartupSdo(INIT_SDO_TIMEOUT_MS) != 0)
+			printf("Start-up SDO transfers not completed in %d ms\n", INIT_SDO_TIMEOUT_MS) ;
+		//
+		// Replies came, but for no axis: their axis reference is not where
+		// CallbackFunc() looks for it. Run the transfers one at a time instead.
+		gSdoEngine.GetStats(stStats) ;
+		if (stStats.ulCompleted != 0 || stStats.ulStrayReplies == 0 || gSdoEngine.Synchronous())
+			break ;
+		printf("SDO replies not matched to the axes, synchronous SDO transfers\n") ;
+		gSdoEngine.SetSynchronous(1) ;
+	}
+	//
+	// Scale of the torque and current samples, from the motor data of each drive.
+	// A drive that does not report them is conditioned in units of its rated value.
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		long lRatedTorque 	= (stRatedTorque[i].iState == eSDO_DONE) ? stRatedTorque[i].lData : 0 ;
+		long lRatedCurrent 	= (stRatedCurrent[i].iState == eSDO_DONE) ? stRatedCurrent[i].lData : 0 ;
+
+		gcTorqueCond.SetScale(i, (lRatedTorque > 0) ? lRatedTorque * 1e-6f : 1e-3f) ;
+		gcCurrentCond.SetScale(i, (lRatedCurrent > 0) ? lRatedCurrent * 1e-6f : 1e-3f) ;
+	}
+	//
+	// Initialize PDOs and SYNC's in the system:
+	// PDO 3, Group 1, OnSync:
+	//
+	// In PDO acquisition mode TPDO3 carries torque, current and position, so it
+	// must be mapped on the drive before the GMAS registers it. In SDO mode it is
+	// not registered: its default mapping would be decoded as torque.
+	if (giAcqMode == ACQ_MODE_PDO)
+	{
+		for (i = 0 ; i < gcAxes.Count() ; i++)
+		{
+			iMapped[i] = (stCobId[i].iState == eSDO_DONE &&
+						  PdoQueueTorqueCurrentPosition(gSdoEngine, gcAxes.iSdoNode[i],
+														(unsigned long)stCobId[i].lData, stMap[i]) == 0) ;
+			if (stCobId[i].iState == eSDO_DONE && !iMapped[i])
+				printf("a%02d TPDO3 mapping not started, SDO queue busy\n", i + 1) ;
+		}
+		if (RunStartupSdo(INIT_SDO_TIMEOUT_MS) != 0)
+			printf("Start-up SDO transfers not completed in %d ms\n", INIT_SDO_TIMEOUT_MS) ;
+
+		for (i = 0 ; i < gcAxes.Count() ; i++)
+		{
+			iMapped[i] = iMapped[i] && (stMap[i].iState == eSDO_DONE) ;
+			if (!iMapped[i])
+				printf("a%02d TPDO3 not mapped, no PDO acquisition\n", i + 1) ;
+			else
+				gcAxes.pAxis[i]->ConfigPDO(PDO_NUM_3,PDO_PARAM_REG,NC_COMM_EVENT_GROUP1,1,1,1,1,1) ;
+			iAnyMapped = iAnyMapped || iMapped[i] ;
+		}
+	}
+	gpBackend->SetSyncTime(SYNC_MULTIPLIER) ;
+	//
+	// A PDO decoded with a wrong layout gives other bytes as torque, with no error.
+	if (iAnyMapped && CheckPdoLayout(iMapped, INIT_SYNC_TIMEOUT_MS) != 0)
+	{
+		printf("TPDO3 not decoded as expected, torque acquisition by SDO\n") ;
+		giAcqMode 	= ACQ_MODE_SDO ;
+		iAnyMapped 	= 0 ;
+	}
+	//
+	// The filters run at the rate of the PDOs: take it from the bus, not from GMAS_CYCLE_US.
+	gullSyncNs = iAnyMapped ? MeasureSyncPeriod(INIT_SYNC_PDOS, INIT_SYNC_TIMEOUT_MS) : 0 ;
+	if (iAnyMapped && gullSyncNs == 0)
+		printf("SYNC period not measured, %d us assumed\n", SYNC_MULTIPLIER * GMAS_CYCLE_US) ;
+	else if (iAnyMapped)
+		printf("SYNC period: %.1f us measured\n", gullSyncNs / 1e3) ;
+	return ;
+}
+/*
+============================================================================
+ Function:				CheckPdoLayout()
+ Input arguments:		iMapped - per axis, TRUE if its TPDO3 is mapped and registered.
+ 						iTimeoutMs - longest wait for a PDO of every one of them.
+ Output arguments: 		None.
+ Returned value:		0 if every mapped axis sent a PDO whose position is
+ 						within PDO_CHECK_COUNTS of 0x6064 read by SDO, -1 if not.
+ Version:				Version 1.00
+
+ Description:
+
+ The offsets of PDORCV_EVT are those the library reads, but not the byte
+ order of the data, see pdo_acquisition.h. The axes stand still at
+ start-up, so the position of a PDO and the one read by SDO right after it
+ must agree; with the bytes decoded in the wrong order they do not, unless
+ the position is 0. Takes the callback records on the calling thread, as
+ MeasureSyncPeriod() does.
+============================================================================
+*/
+int CheckPdoLayout(const int* iMapped, int iTimeoutMs)
+{
+	static SDO_RESULT stPos[MAX_AXES] ;			// Static: still referenced by a transfer that timed out
+	CALLBACK_RECORD stRec ;
+	uint64_t ullEndNs = MonoTimeNs() + (uint64_t)iTimeoutMs * NSEC_PER_MSEC ;
+	long lPdoPos[MAX_AXES] ;
+	uint32_t ulWanted = 0 ;
+	uint32_t ulSeen = 0 ;
+	int iRes = 0 ;
+	int iAxis ;
+	int i ;
+
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		if (iMapped[i])
+			ulWanted |= AXIS_BIT(i) ;
+	}
+	while (ulSeen != ulWanted && MonoTimeNs() < ullEndNs)
+	{
+		while (gCallbackRing.Pop(stRec))
+		{
+			if (stRec.ucEvent != PDORCV_EVT)
+			{
+				HandleCallbackEvent(stRec) ;
+				continue ;
+			}
+			iAxis = gcAxes.IndexOfRef(stRec.usAxisRef) ;
+			if (iAxis != AXIS_NO_INDEX && (ulWanted & AXIS_BIT(iAxis)))
+			{
+				lPdoPos[iAxis] 	= stRec.u.stPdo.lPosition ;
+				ulSeen 			|= AXIS_BIT(iAxis) ;
+			}
+		}
+		usleep(INIT_BACKOFF_MAX_US / 10) ;
+	}
+
+	memset(stPos, 0, sizeof(stPos)) ;
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		if (ulSeen & AXIS_BIT(i))
+			gSdoEngine.Upload(gcAxes.iSdoNode[i], 4, OD_POSITION_ACTUAL, 0, &stPos[i]) ;
+	}
+	RunStartupSdo(INIT_SDO_TIMEOUT_MS) ;
+
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		if (!(ulWanted & AXIS_BIT(i)))
+			continue ;
+		if (!(ulSeen & AXIS_BIT(i)))
+		{
+			printf("a%02d no TPDO3 received for axis reference %u\n", i + 1, gcAxes.usAxisRef[i]) ;
+			iRes = -1 ;
+		}
+		else if (stPos[i].iState != eSDO_DONE)
+		{
+			printf("a%02d 0x6064 not read, TPDO3 not checked\n", i + 1) ;
+			iRes = -1 ;
+		}
+		else if (labs(lPdoPos[i] - stPos[i].lData) > PDO_CHECK_COUNTS)
+		{
+			printf("a%02d TPDO3 position %ld, 0x6064 %ld\n", i + 1, lPdoPos[i], stPos[i].lData) ;
+			iRes = -1 ;
+		}
+	}
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				RunStartupSdo()
+ Input arguments:		iTimeoutMs - longest wait.
+ Output arguments: 		None.
+ Returned value:		0 when all the queued transfers completed, -1 on time-out.
+ Version:				Version 1.00
+
+ Description:
+
+ Runs the SDO engine on the calling thread until it is idle: hands it the
+ replies queued by CallbackFunc() and lets it send the next requests. Polls
+ every INIT_BACKOFF_MIN_US while replies come, backs off up to
+ INIT_BACKOFF_MAX_US while none does.
+============================================================================
+*/
+int RunStartupSdo(int iTimeoutMs)
+{
+	CALLBACK_RECORD stRec ;
+	uint64_t ullEndNs = MonoTimeNs() + (uint64_t)iTimeoutMs * NSEC_PER_MSEC ;
+	unsigned long ulBackoffUs = INIT_BACKOFF_MIN_US ;
+	int iReplies ;
+
+	for (;;)
+	{
+		iReplies = 0 ;
+		while (gAcqRing.Pop(stRec))
+		{
+			gSdoEngine.OnReply(stRec.usAxisRef) ;
+			iReplies++ ;
+		}
+		gSdoEngine.Poll() ;
+		if (gSdoEngine.Idle())
+			return 0 ;
+		if (MonoTimeNs() >= ullEndNs)
+			return -1 ;
+
+		if (iReplies)
+			ulBackoffUs = INIT_BACKOFF_MIN_US ;
+		else if (ulBackoffUs < INIT_BACKOFF_MAX_US)
+			ulBackoffUs = (2 * ulBackoffUs < INIT_BACKOFF_MAX_US) ? 2 * ulBackoffUs : INIT_BACKOFF_MAX_US ;
+		usleep(ulBackoffUs) ;
+	}
+}
+/*
+============================================================================
+ Function:				MeasureSyncPeriod()
+ Input arguments:		iPdos - SYNC periods to measure over.
+ 						iTimeoutMs - longest wait.
+ Output arguments: 		None.
+ Returned value:		The SYNC period in ns, 0 if not enough PDOs came.
+
+ Description:
+
+ Takes the callback records on the calling thread, before the cycle does:
+ the time between the first and the last of iPdos + 1 PDOs of one axis,
+ divided by iPdos. The jitter of the IPC time stamps spreads over all the
+ periods. The PDOs are not acquired, the other events are handled as the
+ cycle does.
+============================================================================
+*/
+uint64_t MeasureSyncPeriod(int iPdos, int iTimeoutMs)
+{
+	CALLBACK_RECORD stRec ;
+	uint64_t ullEndNs = MonoTimeNs() + (uint64_t)iTimeoutMs * NSEC_PER_MSEC ;
+	uint64_t ullFirstNs = 0 ;
+	unsigned short usAxisRef = 0 ;
+	int iCount = 0 ;
+
+	while (MonoTimeNs() < ullEndNs)
+	{
+		while (gCallbackRing.Pop(stRec))
+		{
+			if (stRec.ucEvent != PDORCV_EVT)
+				HandleCallbackEvent(stRec) ;
+			else if (iCount == 0)
+			{
+				usAxisRef 	= stRec.usAxisRef ;
+				ullFirstNs 	= stRec.ullTimeNs ;
+				iCount 		= 1 ;
+			}
+			else if (stRec.usAxisRef == usAxisRef && ++iCount > iPdos)
+				return (stRec.ullTimeNs - ullFirstNs) / iPdos ;
+		}
+		usleep(INIT_BACKOFF_MAX_US / 10) ;
+	}
+	return 0 ;
+}
+/*
 ============================================================================
  Function:				MainClose()
  Input arguments:		None.
@@ -207,8 +776,10 @@ void MainClose()
 //
 //	Here will come code for all closing processes
 //
-	//cHost.MbusStopServer() ;
-	MMC_CloseConnection(gConnHndl) ;
+	gpBackend->MbusStopServer() ;
+	gcTorqueLog.Close() ;
+	gcArchive.Close() ;
+	gpBackend->Close() ;
 	return;
 }
 /*
@@ -231,50 +802,186 @@ void MainClose()
 */
 void MachineSequences()
 {
+	int iWait;		// CYCLE_TICK or CYCLE_WAKE
 //
 //	Init all variables of the states machines
 //
-	cout << "debug 3" << endl;
-	MachineSequencesInit();
+	MachineSequencesInit(eSM1);
 //
-//	Enable MachineSequencesTimer() every TIMER_CYCLE ms
+//	Enable MachineSequencesTimer() every giTimerCycle ms
 //
-	EnableMachineSequencesTimer(TIMER_CYCLE);
+	EnableMachineSequencesTimer(giTimerCycle);
+	StartRuntime();
 //
-//	Background loop. Handles termination request and other less time-critical background proceses
+//	Cycle loop. Sleeps until the next giTimerCycle deadline, executes the states machines,
+//	then handles termination request and other less time-critical background proceses.
 //
 	while (!giTerminate)
 	{
-		// Non-timer version allows you to debug...
+		iWait = gCycleScheduler.WaitNextCycle();
 		MachineSequencesTimer(0);
 //
-//		Execute background process if required
-//
-		BackgroundProcesses();
+//		Execute background process if required. They count the periodic cycles
+//		only, not the cycles run early on a motion end, see CallbackFunc().
 //
-//		Sleep for ~SLEEP_TIME micro-seconds to reduce CPU load
-//		Doesn't do anything with the SIGALRM going off
-		//int awakeTime = sleep(SLEEP_TIME);
-//		if (sleep(SLEEP_TIME) > 0)
-//		{
-//			cout << "Woke up from sleep with: " << awakeTime << " left in sleep" << endl;
-//		}
-		sleepCount++;
+		if (iWait == CYCLE_TICK)
+		{
+			BackgroundProcesses();
+			sleepCount++;
+		}
 	}
 //
 //	Termination requested. Close what needs to be cloased at the states machines
 //
+	StopRuntime();
 	MachineSequencesClose();
 
 	return;		// Back to the main() for program termination
 }
 /*
 ============================================================================
- Function:				MachineSequencesInit()
+ Function:				StartRuntime()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
+
+ Description:
+
+ Starts the acquisition and I/O threads, once the cycle is set up. The cycle
+ itself runs on the calling thread, main(). The threads exchange data only
+ through rings and snapshots:
+
+ 	IPC callback -> acquisition		gAcqRing, SDO replies
+ 	cycle -> acquisition			gAcqRequests, one-off drive reads
+ 	cycle -> acquisition			gcMotionMask, seqlock snapshot of the axes in motion
+ 	acquisition -> cycle			gSampleRing, SDO samples
+ 	cycle -> I/O					gcMbusOut, seqlock snapshot of the outputs
+
+ so an SDO time-out or a slow host never delays the cycle. The console
+ messages and the torque log already have their own threads, see
+ async_log.h and torque_log.h.
+
+ The cycle already runs at its priority, on its CPU, with the memory locked:
+ the threads are given their own policy, CPU and a bounded stack rather than
+ inheriting the cycle's, see CCycleScheduler::CreateThread(). All three make
+ library calls; CGmasBackend gives each its own connection, see gmas_backend.h.
+============================================================================
+*/
+void StartRuntime()
+{
+	giRuntimeStop = FALSE;
+	if (CCycleScheduler::CreateThread(gstAcqThread, AcquisitionThread, NULL,
+									  ACQ_RT_PRIORITY, ACQ_CPU, ACQ_STACK_BYTES) != 0)
+	{
+		printf("Cannot start the acquisition thread\n");
+		exit(1);
+	}
+	if (CCycleScheduler::CreateThread(gstIoThread, IoThread, NULL,
+									  IO_RT_PRIORITY, IO_CPU, IO_STACK_BYTES) != 0)
+	{
+		printf("Cannot start the I/O thread\n");
+		exit(1);
+	}
+	return;
+}
+/*
+============================================================================
+ Function:				StopRuntime()
+ Description:			Ends the acquisition and I/O threads and waits for
+ 						them. The outputs of the last cycle are published.
+============================================================================
+*/
+void StopRuntime()
+{
+	giRuntimeStop = TRUE;
+	gAcqScheduler.Wake();
+	gIoScheduler.Wake();
+	pthread_join(gstAcqThread, NULL);
+	pthread_join(gstIoThread, NULL);
+	return;
+}
+/*
+============================================================================
+ Function:				AcquisitionThread()
+ Input arguments:		pArg - not used.
+ Output arguments: 		None.
+ Returned value:		NULL.
+ Version:				Version 1.00
+
+ Description:
+
+ Owns gSdoEngine. Runs every giTimerCycle ms, and as soon as an SDO reply
+ arrives: hands the replies to the engine, starts the reads the cycle asked
+ for, queues the reads of gcSampler that are due, on the ticks only, and
+ sends the requests that can go.
+ Below the cycle in priority: it may wait, the cycle may not.
+============================================================================
+*/
+void* AcquisitionThread(void* pArg)
+{
+	CALLBACK_RECORD stRec;
+	ACQ_REQUEST stReq;
+	AXIS_MASK ulMoving;
+	int iWait;
+
+	gAcqScheduler.Start(giTimerCycle * 1000, ACQ_RT_PRIORITY, ACQ_CPU);
+	while (!giRuntimeStop)
+	{
+		iWait = gAcqScheduler.WaitNextCycle();
+
+		while (gAcqRing.Pop(stRec))
+		{
+			gSdoEngine.OnReply(stRec.usAxisRef);
+		}
+		while (gAcqRequests.Pop(stReq))
+		{
+			gcXDiagOnce.Start(gSdoEngine, gcAxes.iSdoNode[stReq.iAxis], stReq.pfnDone, stReq.pContext);
+		}
+		if (iWait == CYCLE_TICK)
+		{
+			gcMotionMask.Read(ulMoving);
+			gcSampler.Run(gSdoEngine, gAcqScheduler.LastDeadlineNs(), ulMoving);
+		}
+		gSdoEngine.Poll();
+	}
+	return NULL;
+}
+/*
+============================================================================
+ Function:				IoThread()
+ Input arguments:		pArg - not used.
+ Output arguments: 		None.
+ Returned value:		NULL.
+ Version:				Version 1.00
+
+ Description:
+
+ Publishes the outputs committed by the cycle to the host, when the cycle
+ wakes it up, and every giTimerCycle ms to send again what failed. At
+ IO_RT_PRIORITY, SCHED_OTHER: the host link may be slow, the cycle does not
+ wait for it.
+============================================================================
+*/
+void* IoThread(void* pArg)
+{
+	gIoScheduler.Start(giTimerCycle * 1000, IO_RT_PRIORITY, IO_CPU);
+	while (!giRuntimeStop)
+	{
+		gIoScheduler.WaitNextCycle();
+		gcMbusOut.Publish(*gpBackend);
+	}
+	gcMbusOut.Publish(*gpBackend);
+	return NULL;
+}
+/*
+============================================================================
+ Function:				MachineSequencesInit()
+ Input arguments:		iFirstState - state of the 1st main state machine from the
+ 						first cycle: eSM1, or eBENCH for the benchmark.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
  Updated:				10/03/2011
  Modifications:			N/A
 
@@ -283,20 +990,31 @@ void MachineSequences()
  Initilaize the states machines variables
 ============================================================================
 */
-void MachineSequencesInit()
+void MachineSequencesInit(int iFirstState)
 {
+	int i;
 //
 //	Initializing all variables for the states machines
 //
 	giTerminate 	= FALSE;
 
-	giState1 		= eSM1;
-	giPrevState1 	= eIDLE;
-	giSubState1 	= eIDLE;
+	gcSequencer.Reset();
+	for (i = 0 ; i < MAIN_MACHINES ; i++)
+	{
+		MACHINE& stM = gstMachines[i];
+
+		stM.iMachine 	= i;
+		stM.pAxis 		= a1;
+		stM.ulAxes 		= (i == 0) ? SM1_AXES : SM2_AXES;
+		stM.iTask 		= SEQ_NO_TASK;
+		stM.cMain.Configure(gstMainStates, eMAIN_STATES);
+	}
 	//
-	giState2 		= eIDLE;
-	giPrevState2 	= eIDLE;
-	giSubState2 	= eIDLE;
+	// The 1st state machine runs its sequence from the first cycle
+	gstMachines[0].cMain.Goto(gstMachines[0], iFirstState);
+	//
+	// No segment open until the first cycle
+	gcSegStats.Configure(gcAxes.Count());
 
 	giReentrance = FALSE;
 
@@ -323,6 +1041,27 @@ void MachineSequencesClose()
 //
 //	Here will come code for all closing processes
 //
+	TrackSegments();			// The state machines are idle: closes the last segment
+	TrackStrokes();
+	if (gcpSignatureFile && gcSignature.Save(gcpSignatureFile) != 0)
+		printf("Torque envelope not saved to %s\n", gcpSignatureFile);
+	gcLog.Flush();				// Queued messages first, the statistics below are printed directly
+	gCycleScheduler.PrintStats();
+	gSdoEngine.PrintStats();
+	gcSampler.PrintStats();
+	printf("Torque log: %lu records, %lu dropped\n", gcTorqueLog.Appended(), gcTorqueLog.Dropped());
+	gcArchive.Flush();			// The blocks still open, for the size below
+	if (gcArchive.Appended())
+		printf("Torque archive: %lu samples, %lu dropped, %llu bytes, %.2f bytes per sample\n",
+			   gcArchive.Appended(), gcArchive.Dropped(), (unsigned long long)gcArchive.Bytes(),
+			   (double)gcArchive.Bytes() / gcArchive.Appended());
+	printf("Log: %lu messages dropped\n", gcLog.Dropped());
+	printf("Modbus: %lu cycles, %lu without change, %lu requests, %lu registers, %lu failed\n",
+		   gcMbusOut.Cycles(), gcMbusOut.Skipped(), gcMbusOut.Writes(), gcMbusOut.Registers(), gcMbusOut.Errors());
+	printf("Host commands: %lu writes, %lu table reads, %lu resyncs\n",
+		   gcCmdMailbox.Writes(), gcCmdMailbox.Reads(), gcCmdMailbox.Resyncs());
+	PrintMachineStats();
+	DumpCycleProfile();
 	return;
 }
 /*
@@ -351,14 +1090,16 @@ void BackgroundProcesses()
 	// Doesn't really do anything because of the SIGALRM going off
 	//usleep(90000);
 
-	if (sdoTimeout++ > SDO_COUNT)
+	if (giDumpProfile)
+	{
+		giDumpProfile = FALSE;
+		DumpCycleProfile();
+	}
+
+	if (++reportTimeout >= REPORT_COUNT)
 	{
-		currRead = a1.SendSdoUpload(0,4,0x6077,0);
-		//outputCurrent = (float)currRead / 1000;
-		//cout << "SDO Read: " << outputCurrent << endl;
-		cout << "SDO Torque: " << currRead << endl;
-		//currRead = a1.SendSdoUpload(0,4,0x6078,0);
-		//cout << "SDO Current: " << currRead << endl;
+		reportTimeout = 0;
+		PrintAcquisition();
 	}
 
 //	if (appTimeout++ > SLEEP_COUNT)
@@ -371,50 +1112,217 @@ void BackgroundProcesses()
 }
 /*
 ============================================================================
- Function:				EnableMachineSequencesTimer()
- Input arguments:		None.
+ Function:				ConfigureSampling()
+ Input arguments:		pstSignals - the signals read from the drives, in
+ 						eSampleSignal order: gstSignals, or gstBenchSignals.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Enables the main machine sequences timer function, to be executed each
- TIMER_CYCLE ms.
+ Sets gcSampler up for the acquired axes. The reads queued per cycle are the
+ SAMPLE_BUS_SHARE of the bus time of a cycle, SAMPLE_SDO_US each; the rest
+ is left to the SYNC, the PDOs and the motion commands. Called before the
+ acquisition thread starts.
 ============================================================================
 */
-void EnableMachineSequencesTimer(int TimerCycle)
+void ConfigureSampling(const SAMPLE_SIGNAL_DEF* pstSignals)
 {
-	struct itimerval timer, kill_timer;
-	struct sigaction stSigAction;
-
-	// Whenever a signal is caught, call TerminateApplication function
-	stSigAction.sa_handler = TerminateApplication;
+	int iBudget = giTimerCycle * 1000 * SAMPLE_BUS_SHARE / 100 / SAMPLE_SDO_US;
 
-	sigaction(SIGINT, &stSigAction, NULL);
-	sigaction(SIGTERM, &stSigAction, NULL);
-	sigaction(SIGABRT, &stSigAction, NULL);
+	gcSampler.Configure(pstSignals, eSIG_COUNT, gcAxes.Count(), gcAxes.iSdoNode, giAcqMode == ACQ_MODE_PDO,
+						giTimerCycle * 1000, iBudget, OnSdoSample);
+	gcMotionMask.Write(0);
+	return;
+}
+/*
+============================================================================
+ Function:				OnSdoSample()
+ Input arguments:		iAxis - index of the axis in gcAxes.
+ 						iSignal - eSampleSignal.
+ 						lValue - the value read.
+ 						ulLatencyUs - of the SDO transfer.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Called by gcSampler on the acquisition thread, for every read completed.
+ The value goes to the cycle through gSampleRing.
+============================================================================
+*/
+void OnSdoSample(int iAxis, int iSignal, long lValue, uint32_t ulLatencyUs)
+{
+	CALLBACK_RECORD stRec;
+
+	stRec.ullTimeNs 			= MonoTimeNs();
+	stRec.ucEvent 				= SDO_SAMPLE_EVT;
+	stRec.usAxisRef 			= gcAxes.usAxisRef[iAxis];
+	stRec.u.stSdo.sSignal 		= (int16_t)iSignal;
+	stRec.u.stSdo.lValue 		= (int32_t)lValue;
+	stRec.u.stSdo.ulLatencyUs 	= ulLatencyUs;
+	gSampleRing.Push(stRec);
+	return;
+}
+/*
+============================================================================
+ Function:				AddSample()
+ Input arguments:		iAxis - index of the axis in gcAxes.
+ 						iTorque, iCurrent, lPosition - the sample.
+ 						ullTimeNs - time stamp of the sample.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Takes one TPDO3 sample into the mirror variables, the filters, the
+ segment statistics, the torque envelope and the torque log.
+============================================================================
+*/
+void AddSample(int iAxis, int iTorque, int iCurrent, long lPosition, uint64_t ullTimeNs)
+{
+	gcAxes.lDrvPos[iAxis] = lPosition;
+	AddCurrent(iAxis, iCurrent);
+	AddTorque(iAxis, iTorque, ullTimeNs);
+}
+/*
+============================================================================
+ Function:				AddTorque() / AddCurrent()
+ Description:			Take one torque or current sample, PDO or SDO. The
+ 						torque is binned by the GMAS position of the cycle.
+============================================================================
+*/
+void AddTorque(int iAxis, int iTorque, uint64_t ullTimeNs)
+{
+	gcAxes.iTorque[iAxis] = iTorque;
+	gcAxes.ulSamples[iAxis]++;
+	gulSamples++;
+	gcTorqueCond.Push(iAxis, iTorque);
+	gcSegStats.Add(iAxis, iTorque);
+	if (gcSignature.Add(iAxis, gcAxes.lPosition[iAxis], iTorque))
+		gcLog.Post(eLOG_STROKE_OUT, iAxis + 1, iTorque, gcAxes.lPosition[iAxis]);
+	LogSample(iAxis, ullTimeNs);
+}
+
+void AddCurrent(int iAxis, int iCurrent)
+{
+	gcAxes.iCurrent[iAxis] = iCurrent;
+	gcCurrentCond.Push(iAxis, iCurrent);
+}
+/*
+============================================================================
+ Function:				PrintAcquisition()
+ Description:			Prints the last torque, current, position and DC link
+ 						voltage of every axis.
+============================================================================
+*/
+void PrintAcquisition()
+{
+	int i;
+
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		const SIG_RESULT& stTorque = gcTorqueCond.Result(i);
+		const SIG_RESULT& stCurrent = gcCurrentCond.Result(i);
+
+		if (giAcqMode == ACQ_MODE_SDO)
+			gcLog.Post(eLOG_ACQ_SDO, i + 1, gcAxes.iTorque[i], gcAxes.iCurrent[i], gcAxes.lDrvPos[i],
+					   gcAxes.ulSdoLatencyUs[i]);
+		else
+			gcLog.Post(eLOG_ACQ_PDO, i + 1, gcAxes.iTorque[i], gcAxes.iCurrent[i], gcAxes.lDrvPos[i],
+					   gcAxes.ulSamples[i], gCallbackRing.Overflows());
+		gcLog.Post(eLOG_ACQ_DC_LINK, i + 1, gcAxes.ulDcLinkMv[i]);
+		//
+		// Filtered values, in mNm and mA
+		gcLog.Post(eLOG_COND_TORQUE, i + 1, (long)(stTorque.fValue * 1000.0f), (long)(stTorque.fRms * 1000.0f),
+				   (long)(stTorque.fPeak * 1000.0f), (long)(stTorque.fMin * 1000.0f));
+		gcLog.Post(eLOG_COND_CURRENT, i + 1, (long)(stCurrent.fValue * 1000.0f), (long)(stCurrent.fRms * 1000.0f),
+				   (long)(stCurrent.fPeak * 1000.0f), (long)(stCurrent.fMin * 1000.0f));
+	}
+	return;
+}
+/*
+============================================================================
+ Function:				ConfigureConditioning()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Sets the torque and current filters for the acquired axes, at the rate the
+ samples arrive: every SYNC in ACQ_MODE_PDO, as measured by ConfigureDrives()
+ or else as configured, the moving rate of gcSampler in
+ ACQ_MODE_SDO. At standstill the SDO samples come slower, and the cut-off
+ scales down with them. Clears the filter states and windows.
+============================================================================
+*/
+void ConfigureConditioning()
+{
+	double dbTorqueHz;
+	double dbCurrentHz;
+
+	if (giAcqMode == ACQ_MODE_PDO)
+	{
+		dbTorqueHz 	= (gullSyncNs != 0) ? 1e9 / gullSyncNs : 1000000.0 / (SYNC_MULTIPLIER * GMAS_CYCLE_US);
+		dbCurrentHz = dbTorqueHz;
+	}
+	else
+	{
+		dbTorqueHz 	= gcSampler.RateHz(eSIG_TORQUE, true);
+		dbCurrentHz = gcSampler.RateHz(eSIG_CURRENT, true);
+	}
+	gcTorqueCond.Configure(gcAxes.Count(), dbTorqueHz, TORQUE_CUTOFF_HZ);
+	gcCurrentCond.Configure(gcAxes.Count(), dbCurrentHz, TORQUE_CUTOFF_HZ);
+	return;
+}
+/*
+============================================================================
+ Function:				EnableMachineSequencesTimer()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+ Updated:				10/03/2011
+ Modifications:			N/A
+
+ Description:
+
+ Enables the main machine sequences timer function, to be executed each
+ TIMER_CYCLE ms.
+
+ The cycle is paced by gCycleScheduler, which sleeps on absolute deadlines
+ of the monotonic clock. This replaces the former setitimer()/SIGALRM timer:
+ the cycle no longer runs in a signal handler and the process no longer spins.
+============================================================================
+*/
+void EnableMachineSequencesTimer(int TimerCycle)
+{
+	struct sigaction stSigAction;
+
+	// Whenever a signal is caught, call TerminateApplication function
+	memset(&stSigAction, 0, sizeof(stSigAction));
+	stSigAction.sa_handler = TerminateApplication;
+	sigemptyset(&stSigAction.sa_mask);
+
+	sigaction(SIGINT, &stSigAction, NULL);
+	sigaction(SIGTERM, &stSigAction, NULL);
+	sigaction(SIGABRT, &stSigAction, NULL);
 	sigaction(SIGQUIT, &stSigAction, NULL);
+	//
+	// SIGUSR1 prints the cycle profile, without stopping the cycle
+	stSigAction.sa_handler = RequestProfileDump;
+	sigaction(SIGUSR1, &stSigAction, NULL);
 //
 //	Enable the main machine sequences timer function
 //
-	timer.it_interval.tv_sec 	= 0;
-	timer.it_interval.tv_usec 	= TimerCycle * 1000;// From ms to micro seconds
-	timer.it_value.tv_sec 		= 0;
-	timer.it_value.tv_usec 		= TimerCycle * 1000;// From ms to micro seconds
-
-//	timer.it_interval.tv_sec 	= 0;
-//	timer.it_interval.tv_usec 	= 10 * 1000 * 1000;// From ms to micro seconds
-//	timer.it_value.tv_sec 		= 0;
-//	timer.it_value.tv_usec 		= 10 * 1000 * 1000;// From ms to micro seconds
-
-	//setitimer(ITIMER_REAL, &timer, NULL);
-	//setitimer(ITIMER_REAL, &kill_timer,NULL);
-
-	//signal(SIGALRM, MachineSequencesTimer); 		// every TIMER_CYCLE ms SIGALRM is received which calls MachineSequencesTimer()
-	//signal(SIGALRM, TerminateApplication);
+	gCycleScheduler.Start(TimerCycle * 1000, CYCLE_RT_PRIORITY, CYCLE_CPU);	// From ms to micro seconds
+	if (CYCLE_LOCK_MEMORY)
+		gCycleScheduler.LockMemory(CYCLE_STACK_PREFAULT);
 
 	return;
 }
@@ -430,13 +1338,16 @@ void EnableMachineSequencesTimer(int TimerCycle)
 
  Description:
 
- A timer function that is called by the OS every TIMER_CYCLE ms.
+ A timer function that is called by the cycle loop every TIMER_CYCLE ms.
  It executes the machine sequences states machines and actully controls
  the sequences and behavior of the machine.
 ============================================================================
 */
 void MachineSequencesTimer(int iSig)
 {
+	uint64_t ullPhaseNs[ePHASE_COUNT + 1] ;		// Time stamps at the boundaries of the phases
+	SEQ_INPUTS stSeqIn ;
+	int i ;
 //
 //	In case the application is waiting for termination, do nothing.
 //	This can happen if giTerminate has been set, but the background loop
@@ -457,12 +1368,15 @@ void MachineSequencesTimer(int iSig)
 //
 //		Print an error message and return. Actual code should take application related error handling
 //
-		printf("Reentrancy!\n");
+		gcLog.Post(eLOG_REENTRANCY);
+		gulReentrances++;
 
 		return;
 	}
 
 	giReentrance = TRUE;		// to enable detection of reentrancy. The flag is cleared at teh end of this function
+	AllocGuardEnter();			// Nothing below allocates, see alloc_guard.h
+	ullPhaseNs[ePHASE_READ] = MonoTimeNs();
 //
 //	Read all input data.
 //
@@ -477,6 +1391,7 @@ void MachineSequencesTimer(int iSig)
 //	functions) or from any other source.
 //
 	ReadAllInputData();
+	ullPhaseNs[ePHASE_SEQ] = MonoTimeNs();
 /*
 ============================================================================
 
@@ -486,106 +1401,36 @@ void MachineSequencesTimer(int iSig)
 */
 
 //
-//	In case it is a new state value, clear also the value of the sub-state
-//	to ensure it will start from its beginning (from the first ssub-state)
+//	A state commanded by the host starts its sequence from the first sub-state.
+//	The sequence running is not restarted if commanded again.
 //
-	if(giTempState1 != eIDLE)
+	if (giTempState1 != eIDLE && giTempState1 != MachineState(0))
 	{
-		giState1  = giTempState1 ;
+		gstMachines[0].cMain.Goto(gstMachines[0], giTempState1);
 	}
-	if(giTempState2 != eIDLE)
+	if (giTempState2 != eIDLE && giTempState2 != MachineState(1))
 	{
-		giState2  = giTempState2 ;
-	}
-
-	if (giState1 != giPrevState1)
-	{
-		giSubState1 	= FIRST_SUB_STATE;
-		giPrevState1 	= giState1;
-//		mbus_write_in.startRef 		= 0	;       // Reset Current state we are running on in Modbus so we do not return to it.
-//		mbus_write_in.refCnt 		= 1	;
-//		mbus_write_in.regArr[0] 	= 0;
-		//cHost.MbusWriteHoldingRegisterTable(mbus_write_in) ;
+		gstMachines[1].cMain.Goto(gstMachines[1], giTempState2);
 	}
 //
-	if (giState2 != giPrevState2)
-	{
-		giSubState2 	= FIRST_SUB_STATE;
-		giPrevState2 	= giState2;
-	}
-//	Handle the main state machine.
+//	Resume the sequences whose awaited condition holds in this cycle's inputs.
+//	The sequences of both main machines run here.
 //
-//	The value of the State variable is used to make decisions of the main states machine and to call,
-//	as necessary, the relevant function that handles to process itslef in a sub-state machine.
+	stSeqIn.ullNowNs 		= ullPhaseNs[ePHASE_SEQ];
+	stSeqIn.ulStandStill 	= gcAxes.ulStandStill;
+	stSeqIn.ulInMotion 		= gcAxes.ulInMotion;
+	stSeqIn.pcTorque 		= &gcTorqueCond;
+	gcSequencer.Run(stSeqIn);
 //
-	switch (giState1)
-	{
+//	Handle the main state machines.
 //
-//		Do nothing, waiting for commands
+//	The state of a main machine is the sequence it runs, see CRunSequence. It
+//	goes back to eIDLE when the sequence has ended.
 //
-		case eIDLE:
-		{
-			break;
-		}
-//
-//		Do State Machine1
-//
-		case eSM1:
-		{
-			StateFunction_1();			// calls a sub-state machine function to handle this proocess
-			break;
-		}
-//
-//		Do State Machine2
-//
-		case eSM2:
-		{
-			StateFunction_2();			// calls a sub-state machine function to handle this proocess
-			break;
-		}
-//
-//		The default case. Should not happen, the user can implement error handling.
-//
-		default:
-		{
-			break;
-		}
-	}
-
+	ullPhaseNs[ePHASE_MACHINES] = MonoTimeNs();
+	gstMachines[0].cMain.Step(gstMachines[0]);
 	// 2nd state machine.
-		switch (giState2)
-		{
-	//
-	//		Do nothing, waiting for commands
-	//
-			case eIDLE:
-			{
-				break;
-			}
-	//
-	//		Do State Machine1
-	//
-			case eSM1:
-			{
-				StateFunction_1();			// calls a sub-state machine function to handle this proocess
-				break;
-			}
-	//
-	//		Do State Machine2
-	//
-			case eSM2:
-			{
-				StateFunction_2();			// calls a sub-state machine function to handle this proocess
-				break;
-			}
-	//
-	//		The default case. Should not happen, the user can implement error handling.
-	//
-			default:
-			{
-				break;
-			}
-		}
+	gstMachines[1].cMain.Step(gstMachines[1]);
 
 //
 //	Write all output data
@@ -598,10 +1443,25 @@ void MachineSequencesTimer(int iSig)
 //	After alll states machines were executed and generated their outputs, the outputs
 //	are writen to the "external world" to actually execute the states machines "decisions"
 //
+	ullPhaseNs[ePHASE_WRITE] = MonoTimeNs();
 	WriteAllOutputData();
+	ullPhaseNs[ePHASE_TOTAL] = MonoTimeNs();
+//
+//	Account the execution time of each phase, and of the whole cycle
+//
+	for (i = ePHASE_READ ; i < ePHASE_TOTAL ; i++)
+	{
+		gPhaseHist[i].Record((uint32_t)((ullPhaseNs[i + 1] - ullPhaseNs[i]) / NSEC_PER_USEC));
+	}
+	gPhaseHist[ePHASE_TOTAL].Record((uint32_t)((ullPhaseNs[ePHASE_TOTAL] - ullPhaseNs[ePHASE_READ]) / NSEC_PER_USEC));
+	if (ullPhaseNs[ePHASE_TOTAL] - ullPhaseNs[ePHASE_READ] > (uint64_t)giTimerCycle * NSEC_PER_MSEC)
+	{
+		gulOverruns++;
+	}
 //
 //	Clear the reentrancy flag. Now next execution of this function is allowed
 //
+	AllocGuardLeave();
 	giReentrance = FALSE;
 //
 	return;		// End of the sequences timer function. The function will be triggered again upon the next timer event.
@@ -629,257 +1489,296 @@ void MachineSequencesTimer(int iSig)
 */
 void ReadAllInputData()
 {
-	MMC_MODBUSREADHOLDINGREGISTERSTABLE_OUT 	mbus_read_out;
 //
 //	Here should come the code to read all required input data, for instance:
 //
-//	giXInMotion = ...
-//	giYInMotion = ...
+//	gcAxes.ulStatus[i] = ...
 //
 // The data read here may arrive from different sources:
 // 	- Host Communication (Modbus, Ethernet-IP. This can be read on a cyclic basis, or from a callback.
 //	- GMAS Firmware. Such as actual positions, torque, velocities.
 
-	// TODO: Change the number of registers to read.
-	//cHost.MbusReadHoldingRegisterTable(MODBUS_READ_OUTPUTS_INDEX,MODBUS_READ_CNT,mbus_read_out) ;
-
-	//giTempState1= (mbus_read_out.regArr[1] << 16 & 0xFFFF0000) | (mbus_read_out.regArr[0] & 0xFFFF);
-	//giTempState2= (mbus_read_out.regArr[3] << 16 & 0xFFFF0000) | (mbus_read_out.regArr[2] & 0xFFFF);
 	//
-	giXStatus 	= a1.ReadStatus() ;
-	//giYStatus 	= a2.ReadStatus() ;
-	giXPos 		= (int)a1.GetActualPosition() ;
-	//giYPos 		= (int)a2.GetActualPosition() ;
+	// Host commands written since the last cycle, see eMbusIn. A command is
+	// acted upon once, in the cycle after it was written: it is not read back
+	// from the table every cycle.
+	ReadHostCommands() ;
+	//
+	// Status, position and velocity of every axis in one exchange, and the
+	// stand still / in motion / error stop masks the state machines test.
+	// This image is not changed by the rest of the cycle.
+	gcAxes.Snapshot(*gpBackend) ;
+	gSnapHist.Record(gcAxes.ulSnapUs) ;
+	gcMotionMask.Write(gcAxes.ulInMotion) ;
+	//
+	// The samples received from now on belong to the sub-state the state
+	// machines left at the end of the previous cycle.
+	TrackSegments() ;
+	TrackStrokes() ;
+	//
+	// PDO samples and events received by the IPC callback, and SDO samples
+	// read by the acquisition thread, since the last cycle.
+	DrainCallbackRing() ;
+	//
+	// Filter the samples of this cycle, all axes side by side.
+	gcTorqueCond.Process() ;
+	gcCurrentCond.Process() ;
 	return;
 }
 /*
 ============================================================================
- Function:				WriteAllOutputData()
+ Function:				ReadHostCommands()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Write all the data, generated by the states machines code, to the "external
- world".
-
- This is done here (and not inside the states machines code) to ensure that
- all data is updated simultaneously and in a synchronous way.
-
- The states machines code write the data into "mirror" variables, that are here
- copied or sent to the "external world" (Host via MODBUS, GMAS core firmware, etc.)
-  ============================================================================
+ Applies the Modbus writes queued by CallbackFunc() since the last cycle.
+ The state commands written by the host go to giTempState1 / giTempState2
+ for this cycle only; they are eIDLE in a cycle without a new command.
+============================================================================
 */
-void WriteAllOutputData()
+void ReadHostCommands()
 {
-//
-//	Here should come the code to write/send all ouput data
-//
-//	mbus_write_in.startRef 		= MODBUS_UPDATE_START_INDEX	;       // index of start write modbus register.
-//	mbus_write_in.refCnt 		= MODBUS_UPDATE_CNT			;		// number of indexes to write
-	//
-//	InsertLongVarToModbusShortArr(&mbus_write_in.regArr[0],  (long) giXPos) ;
-//	InsertLongVarToModbusShortArr(&mbus_write_in.regArr[2],  (long) giYPos) ;
-	//
-//	cHost.MbusWriteHoldingRegisterTable(mbus_write_in) ;
-	return;
+	giTempState1 = eIDLE ;
+	giTempState2 = eIDLE ;
+
+	if (gcCmdMailbox.Apply(*gpBackend) == 0)
+		return ;
+
+	if (gcCmdMailbox.Written(eMBUS_CMD_STATE1, 2))
+		giTempState1 = (int)gcCmdMailbox.Long(eMBUS_CMD_STATE1) ;
+	if (gcCmdMailbox.Written(eMBUS_CMD_STATE2, 2))
+		giTempState2 = (int)gcCmdMailbox.Long(eMBUS_CMD_STATE2) ;
+	gcLog.Post(eLOG_HOST_CMD, gcCmdMailbox.Sequence(), giTempState1, giTempState2,
+			   (long)((MonoTimeNs() - gcCmdMailbox.LastWriteNs()) / NSEC_PER_USEC)) ;
+	return ;
 }
 /*
 ============================================================================
- Function:				StateFunction_1()
+ Function:				TrackSegments()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- A sub-states machine function. This function executes the sub-states machine
- of the Function1 process.
+ Gives gcSegStats the current sub-state of the 1st state machine, which is
+ the segment the torque samples are accounted to. No segment is open while
+ the state machine is idle or not started yet. When a sub-state is left, posts the statistics
+ of its torque samples for every axis that had some, in per-mille of the
+ rated torque.
+============================================================================
+*/
+void TrackSegments()
+{
+	long lKey = SEG_NO_KEY ;
+	int i ;
 
- For instance, a homing state machine will consist of:
+	if (MachineState(0) != eIDLE && MachineSubState(0) != SM_IDLE)
+		lKey = SEGMENT_KEY(MachineState(0), MachineSubState(0)) ;
 
-	 Change Operation Mode.
-	 Power Enable
-	 Start homing - method number n
-	 Wait for end of homing
+	if (!gcSegStats.Track(lKey, MonoTimeNs()))
+		return ;
 
- Each step is handled by a dedicated function. However, calling a function
- is not a must and the relevant code for each sub-state can be directly
- written within the switch-case structure.
+	for (i = 0 ; i < gcAxes.Count() ; i++)
+	{
+		const SEG_SUMMARY& stSum = gcSegStats.Closed(i) ;
+
+		if (stSum.ulSamples == 0)
+			continue ;
+		gcLog.Post(eLOG_SEGMENT, i + 1, stSum.lKey / SEGMENT_KEY(1, 0), stSum.lKey % SEGMENT_KEY(1, 0),
+				   stSum.ulSamples, (long)((stSum.ullEndNs - stSum.ullStartNs) / NSEC_PER_MSEC)) ;
+		gcLog.Post(eLOG_SEGMENT_STATS, (long)stSum.dbMean, (long)(stSum.dbStdDev + 0.5),
+				   stSum.lMin, stSum.lMax, stSum.lP50, stSum.lP99) ;
+	}
+	return ;
+}
+/*
+============================================================================
+ Function:				TrackStrokes()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Captures the torque signature of the SM1_AXES while the 1st state machine
+ waits for the end of Move1 or Move2, of State Machine1 or of the benchmark. The samples are binned by the GMAS
+ actual position of the cycle they arrive in, in user units as TEST_POS, not
+ by 0x6064, in drive counts. When a stroke ends, posts for every axis the bins it covered and the bins out
+ of the envelope.
 ============================================================================
 */
-void StateFunction_1()
+void TrackStrokes()
 {
-//
-//	Handle the sub-state machine.
-//
-//	The value of the Sub-State variable is used to make decisions of the sub-states machine and to call,
-//	as necessary, the relevant function that handles to process itself.
-//
-	switch (giSubState1)
+	int iStroke = TSIG_NO_STROKE ;
+	int iEnded = gcSignature.Stroke() ;
+	int iSm1 = (MachineState(0) == eSM1 || MachineState(0) == eBENCH) ;
+	int i ;
+
+	if (iSm1 && MachineSubState(0) == eSubState_SM1_WMove1)
+		iStroke = STROKE_MOVE1 ;
+	else if (iSm1 && MachineSubState(0) == eSubState_SM1_WMove2)
+		iStroke = STROKE_MOVE2 ;
+
+	if (iStroke == iEnded)
+		return ;
+
+	if (iEnded != TSIG_NO_STROKE)
 	{
-//
-//		Perform sub SM 1
-//
-		case eSubState_SM1_PowerOn:
-		{
-			SubState1_1PowerOn();
-			break;
-		}
-//
-//		Perform sub SM 2
-//
-		case eSubState_SM1_WPowerOn:
+		gcSignature.End() ;
+		for (i = 0 ; i < gcAxes.Count() ; i++)
 		{
-			SubState1_2WPowerOn();
-			break;
-		}
-//
-//		Perform sub SM 3
-//
-		case eSubState_SM1_Move1:
-		{
-			SubState1_3Function();
-			break;
-		}
-//
-//		Perform sub SM 4
-//
-		case eSubState_SM1_WMove1:
-		{
-			SubState1_4Function();
-			break;
-		}
-		case eSubState_SM1_Move2:
-			//
-			// Change acceleration:
-			a1.m_fAcceleration 	= 50000.0 ;
-			a1.MoveAbsolute(0.0,TEST_SPEED,MC_ABORTING_MODE) ;
-			giSubState1 		= eSubState_SM1_WMove2 ;
-			break ;
-		case eSubState_SM1_WMove2:
-			if (giXStatus & NC_AXIS_STAND_STILL_MASK)
-			{
-				a1.PowerOff() ;
-				//a2.PowerOff() ;
-				giState1 = eIDLE;
-				giTerminate = true;
-			}
-			break ;
-//
-//		The default case. Should not happen, the user can implement error handling.
-//
-		default:
-		{
-			break;
+			if ((SM1_AXES & AXIS_BIT(i)) == 0)
+				continue ;
+			gcLog.Post(eLOG_STROKE, i + 1, iEnded + 1, gcSignature.BinsCovered(i), gcSignature.BinsOut(i),
+					   gcSignature.SamplesOut(i), gcSignature.Learned(iEnded)) ;
 		}
 	}
-//
-	return;
+	if (iStroke != TSIG_NO_STROKE)
+		gcSignature.Begin(iStroke, SM1_AXES) ;
+	return ;
 }
 /*
 ============================================================================
- Function:				StateFunction_2()
+ Function:				DrainCallbackRing()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- A sub-states machine function. This function executes the sub-states machine
- of the XY move process.
-
- The move prcess, in this simplified example consists of the following steps:
-
- Begin move
- Wait for end of motion
-
- Each step is handled by a dedicated function. However, calling a function
- is not a must and the relevant code for each sub-state can be directly
- written within the switch-case structure.
-============================================================================
+ Consumes all the records pushed by CallbackFunc() and by the acquisition
+ thread since the previous cycle. PDO and SDO samples update the torque,
+ current, position and DC link mirror variables with the most recent
+ values. Events are reported here, on the cycle thread, so the IPC thread
+ is never blocked on stdout.
+ ============================================================================
 */
-void StateFunction_2()
+void DrainCallbackRing()
 {
-//
-//	Handle the sub-state machine.
-//
-//	The value of the Sub-State variable is used to make decisions of the sub-states machine and to call,
-//	as necessary, the relevant function that handles to process itslef.
-//
-	switch (giSubState1)
+	CALLBACK_RECORD stRec ;
+	int iAxis ;
+
+	while (gSampleRing.Pop(stRec))
 	{
-//
-//		Begin move
-//
-		case eSubState_SM2_1:
+		iAxis = gcAxes.IndexOfRef(stRec.usAxisRef) ;
+		if (iAxis == AXIS_NO_INDEX)
+			continue ;
+
+		switch (stRec.u.stSdo.sSignal)
 		{
-			SubState2_1Function();
-			break;
+		case eSIG_TORQUE:
+			gcAxes.ulSdoLatencyUs[iAxis] = stRec.u.stSdo.ulLatencyUs ;
+			AddTorque(iAxis, stRec.u.stSdo.lValue, stRec.ullTimeNs) ;
+			break ;
+		case eSIG_CURRENT:
+			AddCurrent(iAxis, stRec.u.stSdo.lValue) ;
+			break ;
+		case eSIG_POSITION:
+			gcAxes.lDrvPos[iAxis] = stRec.u.stSdo.lValue ;
+			break ;
+		case eSIG_DC_LINK:
+			gcAxes.ulDcLinkMv[iAxis] = (uint32_t)stRec.u.stSdo.lValue ;
+			break ;
 		}
-//
-//		Wait for end of motion
-//
-		case eSubState_SM2_2:
+	}
+
+	while (gCallbackRing.Pop(stRec))
+	{
+		switch (stRec.ucEvent)
 		{
-			SubState2_2Function();
-			break;
-		}
-//
-//		The default case. Should not happen, the user can implement error handling.
-//
+		case PDORCV_EVT:
+			//
+			// Still sent when CheckPdoLayout() rejected them, not acquired then.
+			iAxis = gcAxes.IndexOfRef(stRec.usAxisRef) ;
+			if (iAxis != AXIS_NO_INDEX && giAcqMode == ACQ_MODE_PDO)
+				AddSample(iAxis, stRec.u.stPdo.sTorque, stRec.u.stPdo.sCurrent, stRec.u.stPdo.lPosition,
+						  stRec.ullTimeNs) ;
+			break ;
 		default:
-		{
-			break;
+			HandleCallbackEvent(stRec) ;
 		}
 	}
-//
-	return;
+	return ;
 }
 /*
 ============================================================================
- Function:				SubState1_1Function()
- Input arguments:		None.
+ Function:				HandleCallbackEvent()
+ Input arguments:		stRec - a callback record other than a PDO.
+ Output arguments: 		None.
+ Returned value:		None.
+ Description:			Reports the event on the console, through gcLog.
+============================================================================
+*/
+void HandleCallbackEvent(const CALLBACK_RECORD& stRec)
+{
+	switch (stRec.ucEvent)
+	{
+	case EMCY_EVT:
+		gcLog.Post(eLOG_EVT_EMCY, stRec.usAxisRef, stRec.u.lData) ;
+		break ;
+	case MOTIONENDED_EVT:
+		gEventHist.Record((uint32_t)((MonoTimeNs() - stRec.ullTimeNs) / NSEC_PER_USEC)) ;
+		gcLog.Post(eLOG_EVT_MOTION_END, stRec.usAxisRef) ;
+		break ;
+	case HBEAT_EVT:
+		gcLog.Post(eLOG_EVT_HBEAT) ;
+		break ;
+	case DRVERROR_EVT:
+		gcLog.Post(eLOG_EVT_DRV_ERROR, stRec.usAxisRef) ;
+		break ;
+	case HOME_ENDED_EVT:
+		gEventHist.Record((uint32_t)((MonoTimeNs() - stRec.ullTimeNs) / NSEC_PER_USEC)) ;
+		gcLog.Post(eLOG_EVT_HOME_END, stRec.usAxisRef) ;
+		break ;
+	case SYSTEMERROR_EVT:
+		gcLog.Post(eLOG_EVT_SYS_ERROR) ;
+		break ;
+	default:
+		gcLog.Post(eLOG_EVT_OTHER, stRec.ucEvent) ;
+	}
+	return ;
+}
+/*
+============================================================================
+ Function:				LogSample()
+ Input arguments:		iAxis - index of the axis in gcAxes.
+ 						ullTimeNs - time stamp of the sample.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Starts a motion to the reverse limits of X and Y, as part of the
- states machine code for X,Y Homing, and chage the sub state to wait for the
- limits.
+ Appends the last torque, current, position and status of the axis to the
+ torque log and to the archive. Only a copy into the mapped segment, see
+ torque_log.h, and a few deltas into the open group, see torque_archive.h.
  ============================================================================
 */
-void SubState1_1PowerOn()
+void LogSample(int iAxis, uint64_t ullTimeNs)
 {
-//
-//	Here will come the code to start the relevant motions
-//
-	a1.PowerOn() ;
-	//a2.PowerOn() ;
-//
-//	Changing to the next sub-state
-//
-	giSubState1 = eSubState_SM1_WPowerOn;
-
-	return;
+	TORQUE_LOG_RECORD stRec ;
+
+	stRec.ullTimeNs 	= ullTimeNs ;
+	stRec.lPosition 	= gcAxes.lDrvPos[iAxis] ;
+	stRec.ulStatus 		= gcAxes.ulStatus[iAxis] ;
+	stRec.usAxis 		= (uint16_t)iAxis ;
+	stRec.sTorque 		= (int16_t)gcAxes.iTorque[iAxis] ;
+	stRec.sCurrent 		= (int16_t)gcAxes.iCurrent[iAxis] ;
+	stRec.usReserved 	= 0 ;
+	gcTorqueLog.Append(stRec) ;
+	gcArchive.Append(stRec) ;
 }
 /*
 ============================================================================
- Function:				SubState1_2Function()
+ Function:				WriteAllOutputData()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
@@ -889,166 +1788,306 @@ void SubState1_1PowerOn()
 
  Description:
 
- Waits for X and Y limits to be in motion - only then move to the next sub-state.
+ Write all the data, generated by the states machines code, to the "external
+ world".
+
+ This is done here (and not inside the states machines code) to ensure that
+ all data is updated simultaneously and in a synchronous way.
+
+ The states machines code write the data into "mirror" variables, that are here
+ copied or sent to the "external world" (Host via MODBUS, GMAS core firmware, etc.)
   ============================================================================
 */
-void SubState1_2WPowerOn()
+void WriteAllOutputData()
 {
 //
-//	Changing to the next sub-state only if axis changed to standstill.
+//	Here should come the code to write/send all ouput data
+//
+//	The whole output map is set every cycle. Only the registers that changed
+//	since they were last sent go to the host, see modbus_publisher.h.
 //
-//	Note that a faster implementation could be to put here the code of the next sub-state as well.
+	int i;
 
-	if (giXStatus & NC_AXIS_STAND_STILL_MASK)
+	gcMbusOut.SetShort(eMBUS_STATE1, (short)MachineState(0));
+	gcMbusOut.SetShort(eMBUS_SUBSTATE1, (short)MachineSubState(0));
+	gcMbusOut.SetShort(eMBUS_STATE2, (short)MachineState(1));
+	gcMbusOut.SetShort(eMBUS_SUBSTATE2, (short)MachineSubState(1));
+	gcMbusOut.SetLong(eMBUS_SAMPLES, (long)gulSamples);
+	gcMbusOut.SetShort(eMBUS_AXES, (short)gcAxes.Count());
+
+	for (i = 0 ; i < gcAxes.Count() ; i++)
 	{
-		giSubState1 = eSubState_SM1_Move1;
+		const int iBase = eMBUS_AXIS_BASE + i * eMBUS_AX_REGS;
+		const SIG_RESULT& stTorque = gcTorqueCond.Result(i);
+
+		gcMbusOut.SetLong(iBase + eMBUS_AX_STATUS, (long)gcAxes.ulStatus[i]);
+		gcMbusOut.SetLong(iBase + eMBUS_AX_POSITION, (gcAxes.uiSnapFields & AXIS_SNAP_POSITION) ?
+						  (long)gcAxes.lPosition[i] : (long)gcAxes.lDrvPos[i]);
+		gcMbusOut.SetShort(iBase + eMBUS_AX_TORQUE, (short)gcAxes.iTorque[i]);
+		gcMbusOut.SetShort(iBase + eMBUS_AX_CURRENT, (short)gcAxes.iCurrent[i]);
+		gcMbusOut.SetLong(iBase + eMBUS_AX_TORQUE_RMS, (long)(stTorque.fRms * 1000.0f));
+		gcMbusOut.SetLong(iBase + eMBUS_AX_TORQUE_PEAK, (long)(stTorque.fPeak * 1000.0f));
+		gcMbusOut.SetShort(iBase + eMBUS_AX_SEG_P99, (short)gcSegStats.Closed(i).lP99);
+		gcMbusOut.SetShort(iBase + eMBUS_AX_STROKE_OUT, (short)gcSignature.BinsOut(i));
 	}
-
+	//
+	// Handed to the I/O thread, which sends it: the cycle never waits for the host.
+	gcMbusOut.Commit();
+	gIoScheduler.Wake();
 	return;
 }
 /*
 ============================================================================
- Function:				SubState1_3Function()
- Input arguments:		None.
+ Function:				MachineState(), MachineSubState()
+ Input arguments:		iMachine - 0 for the 1st main state machine.
  Output arguments: 		None.
- Returned value:		None.
+ Returned value:		The sequence the machine runs, eMainStateMachines, and
+ 						the step of that sequence. SM_IDLE when idle.
+============================================================================
+*/
+int MachineState(int iMachine)
+{
+	return gstMachines[iMachine].cMain.State();
+}
+int MachineSubState(int iMachine)
+{
+	const MACHINE& stM = gstMachines[iMachine];
+
+	if (stM.cMain.State() == eIDLE)
+		return SM_IDLE;
+	return gcSequencer.Step(stM.iTask);
+}
+/*
+============================================================================
+ Function:				CRunSequence
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Starts a motion to the index of X and Y, as part of the
- states machine code for X,Y Homing, and chage the sub state to wait for the
- indexes.
- ============================================================================
+ The states of the main state machines, one per sequence. Entering the state
+ starts the sequence as a task of gcSequencer, and the main machine goes
+ back to eIDLE when the task ends. Leaving the state while the sequence
+ runs, on a command of the host, kills the task.
+============================================================================
 */
-void SubState1_3Function()
+template <int SEQ, int (*BODY)(SEQ_TASK& stTask)>
+struct CRunSequence : CState<MACHINE, SEQ>
 {
-//
-//	Here will come the code to start the relevant motions
-//
-	a1.MoveAbsolute(TEST_POS,TEST_SPEED,MC_ABORTING_MODE) ;
-//
-//	Changing to the next sub-state
-//
-	giSubState1 = eSubState_SM1_WMove1;
+	static void Entry(MACHINE& stM)
+	{
+		stM.iTask = gcSequencer.Start(BODY, &stM);
+	}
+	static int Do(MACHINE& stM)
+	{
+		return gcSequencer.Running(stM.iTask) ? SM_STAY : (int)eIDLE;
+	}
+	static void Exit(MACHINE& stM)
+	{
+		gcSequencer.Kill(stM.iTask);
+		stM.iTask = SEQ_NO_TASK;
+	}
+};
+typedef CState<MACHINE, eIDLE>				CMainIdle;
+typedef CRunSequence<eSM1, Sm1Sequence>		CRunSm1;
+typedef CRunSequence<eSM2, Sm2Sequence>		CRunSm2;
+typedef CRunSequence<eBENCH, BenchSequence>	CRunBench;
+/*
+============================================================================
+ Function:				Sm1Sequence()
+ Input arguments:		stTask - the task, its context is the MACHINE.
+ Output arguments: 		None.
+ Returned value:		SEQ_WAITING, or SEQ_ENDED at the end.
+ Version:				Version 1.00
 
-	return;
+ Description:
+
+ State Machine1: power on, move to TEST_POS, move back to 0 with another
+ acceleration, power off and end the application. Each wait is an await of
+ gcSequencer, see motion_sequencer.h; the code between two awaits runs in
+ one cycle. The step reported is the eSubStateMachine_1 value of the wait.
+
+ For instance, a homing state machine will consist of:
+
+	 Change Operation Mode.
+	 Power Enable
+	 Start homing - method number n
+	 Wait for end of homing
+============================================================================
+*/
+int Sm1Sequence(SEQ_TASK& stTask)
+{
+	MACHINE& stM = *(MACHINE*)stTask.pContext;
+
+	SEQ_BEGIN(stTask);
+	SEQ_STEP(stTask, eSubState_SM1_PowerOn);
+	stM.pAxis->PowerOn() ;
+	SEQ_STEP(stTask, eSubState_SM1_WPowerOn);
+	SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
+
+	stM.pAxis->MoveAbsolute(TEST_POS,TEST_SPEED,MC_ABORTING_MODE) ;
+	SEQ_STEP(stTask, eSubState_SM1_WMove1);
+	SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
+	//
+	// Change acceleration:
+	stM.pAxis->SetAcceleration(50000.0) ;
+	stM.pAxis->MoveAbsolute(0.0,TEST_SPEED,MC_ABORTING_MODE) ;
+	SEQ_STEP(stTask, eSubState_SM1_WMove2);
+	SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
+
+	stM.pAxis->PowerOff() ;
+	giTerminate = true;
+	SEQ_END(stTask);
 }
 /*
 ============================================================================
- Function:				SubState1_4Function()
- Input arguments:		None.
+ Function:				Sm2Sequence()
+ Input arguments:		stTask - the task, its context is the MACHINE.
  Output arguments: 		None.
- Returned value:		None.
+ Returned value:		SEQ_WAITING, or SEQ_ENDED at the end.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Waits for X and Y motions to end.
-  ============================================================================
+ State Machine2, the XY move process. In this simplified example:
+
+ Begin move, reading the torque, current and position of X once
+ Wait for the end of motion
+============================================================================
 */
-void SubState1_4Function()
+int Sm2Sequence(SEQ_TASK& stTask)
 {
-//
-//	Ending state machine only if both axes are not in motion.
-//
-	if (giXStatus & NC_AXIS_STAND_STILL_MASK)
-	{
-		giSubState1 = eSubState_SM1_Move2;
-	}
+	MACHINE& stM = *(MACHINE*)stTask.pContext;
+	char cmd [] = "pa";
+	int pos = 0;
+	ACQ_REQUEST stReq;
 
-	return;
+	SEQ_BEGIN(stTask);
+	SEQ_STEP(stTask, eSubState_SM2_1);
+	stM.pAxis->PowerOn() ;
+	gcLog.Post(eLOG_SET_PARAMS);
+	//
+	// Torque, current and position are read in one batch by the acquisition thread,
+	// three SDOs one after the other, reported by PrintDriveDiag() when the last
+	// reply arrives. The cycle does not wait for them.
+	stReq.iAxis 	= 0;
+	stReq.pfnDone 	= PrintDriveDiag;
+	stReq.pContext 	= (void*)0;
+	gAcqRequests.Push(stReq);
+	gAcqScheduler.Wake();
+	gcLog.Post(eLOG_PARAMS_SET);
+	SEQ_STEP(stTask, eSubState_SM2_2);
+	SEQ_AWAIT_STOPPED(stTask, stM.ulAxes);
+
+	stM.pAxis->ElmoSetAsyncParam(cmd,pos);
+	SEQ_END(stTask);
 }
 /*
 ============================================================================
- Function:				SubState2_1Function()
- Input arguments:		None.
+ Function:				BenchSequence()
+ Input arguments:		stTask - the task, its context is the MACHINE.
  Output arguments: 		None.
- Returned value:		None.
+ Returned value:		SEQ_WAITING. It never ends.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Starts an XY motion as part of the states machine code for X,Y move,
- and chage the sub state to wait for the end of motions.
- ============================================================================
+ The strokes of State Machine1, to TEST_POS and back to 0, over and over,
+ for RunBenchmark(): the cycle does the same work as in the application for
+ as long as a configuration is measured, and the application is not
+ terminated at the end of a stroke. The steps are those of State Machine1,
+ so the torque envelope is captured as well, see TrackStrokes().
+============================================================================
 */
-void SubState2_1Function()
+int BenchSequence(SEQ_TASK& stTask)
 {
-//
-//	Here will come the code to start the relevant motions
-//
-//
-//	Changing to the next sub-state
-	a1.PowerOn() ;
-	char cmd [] = "pa";
-	int pos = 2000;
-	cout << "Setting async param..." << endl;
-	currRead = a1.SendSdoUpload(0,4,0x6077,0);
-	//		//outputCurrent = (float)currRead / 1000;
-	//		//cout << "SDO Read: " << outputCurrent << endl;
-	cout << "SDO Torque Read: " << currRead << endl;
-	currRead = a1.SendSdoUpload(0,4,0x6078, 0);
-	cout << "SDO Current Read: " << currRead << endl;
-	//a1.SendSdoDownload(2000,0,4,0x607a,0);
-	int control_word = 0xf;
-	control_word &= 1 << 7;
-	//a1.SendSdoDownload(control_word,0,2,0x6040,0);
-	//a1.SendSdoDownload(0,0,4,0x3020,0);
-	long sdo_ret = 999;
-
-	sdo_ret = a1.SendSdoUpload(0,4,0x6064,0);
-	cout << "SDO position returned: " << sdo_ret << endl;
-	//a1.ElmoSetAsyncParam(cmd,pos);
-
-//	a1.ElmoGetSyncParam (cmd, pos);
-//	a1.elmo
-//
-//	printf("\n ++++ DRIVER AxisA %s Position=%d (set to %d)", cmd, pos, 2000);
+	MACHINE& stM = *(MACHINE*)stTask.pContext;
 
-	cout << "Done setting params..." << endl;
-//
-	giSubState1 = eSubState_SM1_WMove2;
+	SEQ_BEGIN(stTask);
+	SEQ_STEP(stTask, eSubState_SM1_PowerOn);
+	stM.pAxis->PowerOn() ;
+	SEQ_STEP(stTask, eSubState_SM1_WPowerOn);
+	SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
 
-	return;
+	for (;;)
+	{
+		stM.pAxis->MoveAbsolute(TEST_POS,TEST_SPEED,MC_ABORTING_MODE) ;
+		SEQ_STEP(stTask, eSubState_SM1_WMove1);
+		SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
+
+		stM.pAxis->MoveAbsolute(0.0,TEST_SPEED,MC_ABORTING_MODE) ;
+		SEQ_STEP(stTask, eSubState_SM1_WMove2);
+		SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes);
+	}
+	SEQ_END(stTask);
 }
 /*
 ============================================================================
- Function:				SubStateXYMoveWaitEndMotionFunction()
+ State table of the main state machines, in ID order
+============================================================================
+*/
+const SM_STATE_DEF<MACHINE> gstMainStates[eMAIN_STATES] =
+{
+	SM_STATE(CMainIdle),
+	SM_STATE(CRunSm1),
+	SM_STATE(CRunSm2),
+	SM_STATE(CRunBench),
+};
+/*
+============================================================================
+ Function:				PrintMachineStats()
  Input arguments:		None.
  Output arguments: 		None.
  Returned value:		None.
  Version:				Version 1.00
- Updated:				10/03/2011
- Modifications:			N/A
 
  Description:
 
- Waits for X and Y to stop motions and only then finishes the XY move process.
-  ============================================================================
+ Prints, for every sequence run, how many times and for how many cycles in
+ total and at most, then what the sequences cost.
+============================================================================
 */
-void SubState2_2Function()
+void PrintMachineStats()
 {
-//
-//	Ending X,Y move only if both indexes are activated.
-//
-	if ( (~giXInMotion) && (~giYInMotion) )
+	int i, j;
+
+	for (i = 0 ; i < MAIN_MACHINES ; i++)
 	{
-		char cmd [] = "pa";
-		int pos = 0;
-		a1.ElmoSetAsyncParam(cmd,pos);
-		giState1 = eIDLE;
-	}
+		const MACHINE& stM = gstMachines[i];
 
+		for (j = eIDLE + 1 ; j < eMAIN_STATES ; j++)
+		{
+			if (stM.cMain.Entries(j) == 0)
+				continue;
+			printf("Machine %d %s: %u entries, %u cycles, longest %u\n", i + 1, stM.cMain.Name(j),
+				   stM.cMain.Entries(j), stM.cMain.Dwell(j), stM.cMain.MaxDwell(j));
+		}
+		if (stM.cMain.Rejected())
+			printf("Machine %d: %u commands to an unknown state\n", i + 1, stM.cMain.Rejected());
+	}
+	printf("Sequences: %lu started, %lu resumes, %lu conditions tested, %lu not started (table full)\n",
+		   gcSequencer.Started(), gcSequencer.Resumes(), gcSequencer.Tests(), gcSequencer.Full());
 	return;
 }
 
+///////////////////////////////////////////////////////////////////////
+//	Function name	:	void PrintDriveDiag(const CSdoBatchRead& cBatch, void* pContext)
+//	Created			:	Version 1.00
+//	Purpose			:	Batch completion callback. Prints torque, current and position.
+//	Input			:	cBatch - the completed batch, pContext - index of the axis in gcAxes.
+//	Output			:	N/A
+//	Return Value	:	void
+//////////////////////////////////////////////////////////////////////
+void PrintDriveDiag(const CSdoBatchRead& cBatch, void* pContext)
+{
+	DRIVE_DIAG stDiag;
+	long lAxis = (long)pContext + 1;
+
+	if (CDriveDiagRead::Get(cBatch, stDiag))
+		gcLog.Post(eLOG_DIAG, lAxis, stDiag.sTorque, stDiag.sCurrent, stDiag.lPosition, stDiag.ulLatencyUs);
+	else
+		gcLog.Post(eLOG_DIAG_FAILED, lAxis);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //	Function name	:	void callback function																		//
 //	Created			:	Version 1.00																				//
@@ -1063,47 +2102,62 @@ void SubState2_2Function()
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int CallbackFunc(unsigned char* recvBuffer, short recvBufferSize,void* lpsock)
 {
+	CALLBACK_RECORD stRec ;
+	//
+	// This runs on the library's IPC thread: only time stamp what was received
+	// and queue it to the cycle. No console output, no blocking calls.
+	stRec.ullTimeNs = MonoTimeNs() ;
+	stRec.ucEvent 	= recvBuffer[1] ;
+	stRec.usAxisRef = 0 ;
+	stRec.u.lData 	= 0 ;
 	// Whcih function ID was received ...
 	switch(recvBuffer[1])
 	{
-	case ASYNC_REPLY_EVT:
-		//printf("ASYNC event Reply\r\n") ;
-		//a1.RetreiveSdoUploadAsync(asyncVal); // Gives a cool seg fault last time I tried this
-		//cout << "Async event: " << asyncVal << endl;
-		break ;
-	case EMCY_EVT:
-		// Please note - The emergency event was registered.
-		printf("Emergency Event received\r\n") ;
-		break ;
-	case MOTIONENDED_EVT:
-		printf("Motion Ended Event received\r\n") ;
-		break ;
-	case HBEAT_EVT:
-		printf("H Beat Fail Event received\r\n") ;
-		break ;
 	case PDORCV_EVT:
-		printf("PDO Received Event received - Updating Inputs\r\n") ;
-		break ;
-	case DRVERROR_EVT:
-		printf("Drive Error Received Event received\r\n") ;
-		break ;
-	case HOME_ENDED_EVT:
-		printf("Home Ended Event received\r\n") ;
-		break ;
-	case SYSTEMERROR_EVT:
-		printf("System Error Event received\r\n") ;
+		if (!PdoDecodeEvent(recvBuffer, recvBufferSize, stRec.usAxisRef, stRec.u.stPdo))
+			return 1 ;
 		break ;
 	case MODBUS_WRITE_EVT:
-		// TODO Update additional data tobe read such as function parameters.
-		// TODO Remove return 0 if you want to handle as part of callback.
-		return 0;
-		printf("Modbus Write Event received - Updating Outputs\r\n") ;
+		//
+		// The written range goes to the command mailbox, not to the ring.
+		gcCmdMailbox.OnWrite(recvBuffer, recvBufferSize, stRec.ullTimeNs) ;
+		return 1 ;
+	case ASYNC_REPLY_EVT:
+		//
+		// SDO replies go to the acquisition thread, which owns the SDO engine.
+		if (recvBufferSize >= EVT_DATA_OFFSET)
+			memcpy(&stRec.usAxisRef, recvBuffer + EVT_AXIS_REF_OFFSET, sizeof(stRec.usAxisRef)) ;
+		gAcqRing.Push(stRec) ;
+		gAcqScheduler.Wake() ;
+		return 1 ;
+	case EMCY_EVT:
+		//
+		// The emergency code, a short, as the library passes it to Emergency_Received().
+		if (recvBufferSize >= EVT_DATA_OFFSET)
+			memcpy(&stRec.usAxisRef, recvBuffer + EVT_AXIS_REF_OFFSET, sizeof(stRec.usAxisRef)) ;
+		if (recvBufferSize >= (short)(EVT_DATA_OFFSET + sizeof(short)))
+		{
+			short sEmcyCode ;
 
+			memcpy(&sEmcyCode, recvBuffer + EVT_DATA_OFFSET, sizeof(sEmcyCode)) ;
+			stRec.u.lData = (unsigned short)sEmcyCode ;
+		}
 		break ;
 	default:
-		printf("Event received: %d \r\n", recvBuffer[1]);
+		if (recvBufferSize >= EVT_DATA_OFFSET)
+			memcpy(&stRec.usAxisRef, recvBuffer + EVT_AXIS_REF_OFFSET, sizeof(stRec.usAxisRef)) ;
+		if (recvBufferSize >= (short)(EVT_DATA_OFFSET + sizeof(stRec.u.lData)))
+			memcpy(&stRec.u.lData, recvBuffer + EVT_DATA_OFFSET, sizeof(stRec.u.lData)) ;
+		break ;
 	}
 	//
+	// A full ring is counted by the ring itself, see gCallbackRing.Overflows().
+	gCallbackRing.Push(stRec) ;
+	//
+	// The end of a motion or of a homing is handled by a cycle run now, so the
+	// sequence waiting for it goes on without waiting for the next deadline.
+	if (stRec.ucEvent == MOTIONENDED_EVT || stRec.ucEvent == HOME_ENDED_EVT)
+		gCycleScheduler.Wake() ;
 	return 1 ;
 }
 
@@ -1116,6 +2170,7 @@ void InsertLongVarToModbusShortArr(short* spArr, long lVal)
 int OnRunTimeError(const char *msg,  unsigned int uiConnHndl, unsigned short usAxisRef, short sErrorID, unsigned short usStatus)
 {
 	MMC_CloseConnection(uiConnHndl);
+	gcLog.Stop();
 	printf("OnRunTimeError: %s,axis ref=%d, err=%d, status=%d, bye\n", msg, usAxisRef, sErrorID, usStatus);
 	exit(0);
 }
@@ -1145,15 +2200,168 @@ void TerminateApplication(int iSigNum)
 	return ;
 }
 
+///////////////////////////////////////////////////////////////////////
+//	Function name	:	void RequestProfileDump(int iSigNum)
+//	Created			:	Version 1.00
+//	Purpose			:	SIGUSR1 handler. Requests the background loop to print the cycle profile.
+//	Input			:	int iSigNum - Signal Num.
+//	Output			:	N/A
+//	Return Value	:	void
+//////////////////////////////////////////////////////////////////////
+void RequestProfileDump(int iSigNum)
+{
+	giDumpProfile = TRUE ;
+}
+
+///////////////////////////////////////////////////////////////////////
+//	Function name	:	void DumpCycleProfile()
+//	Created			:	Version 1.00
+//	Purpose			:	Prints p50, p99, p99.9 and max of each cycle phase. The histograms
+//						are copied first, the cycle keeps updating them meanwhile.
+//	Input			:	N/A
+//	Output			:	N/A
+//	Return Value	:	void
+//////////////////////////////////////////////////////////////////////
+void DumpCycleProfile()
+{
+	static const char* cpPhaseName[ePHASE_COUNT] = { "Read", "Seq", "SM", "Write", "Total" } ;
+	static CLatencyHistogram cCopy ;
+	ALLOC_GUARD_STATS stGuard ;
+	int i ;
+
+	printf("Cycle profile [us]: %lu overruns of %d ms, %lu reentrances\n", gulOverruns, giTimerCycle, gulReentrances) ;
+	for (i = 0 ; i < ePHASE_COUNT ; i++)
+	{
+		gPhaseHist[i].Snapshot(cCopy) ;
+		printf("  %-6s n=%-9u p50=%-7u p99=%-7u p99.9=%-7u max=%u\n", cpPhaseName[i],
+				cCopy.Count(), cCopy.Percentile(50.0), cCopy.Percentile(99.0),
+				cCopy.Percentile(99.9), cCopy.Max()) ;
+	}
+	gSnapHist.Snapshot(cCopy) ;
+	printf("  %-6s n=%-9u p50=%-7u p99=%-7u p99.9=%-7u max=%u (%d axes, part of Read)\n", "Inputs",
+			cCopy.Count(), cCopy.Percentile(50.0), cCopy.Percentile(99.0),
+			cCopy.Percentile(99.9), cCopy.Max(), gcAxes.Count()) ;
+	gEventHist.Snapshot(cCopy) ;
+	printf("  %-6s n=%-9u p50=%-7u p99=%-7u p99.9=%-7u max=%u (motion end to its cycle)\n", "Events",
+			cCopy.Count(), cCopy.Percentile(50.0), cCopy.Percentile(99.0),
+			cCopy.Percentile(99.9), cCopy.Max()) ;
+	if (AllocGuardAvailable())
+	{
+		AllocGuardGetStats(stGuard) ;
+		printf("  Heap in the cycle: %lu allocations (%lu bytes), %lu frees, last from %p\n",
+				stGuard.ulAllocs, stGuard.ulBytes, stGuard.ulFrees, stGuard.pLastCaller) ;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+//	Function name	:	void RunBenchmark(const char* cpJsonFile)
+//	Created			:	Version 1.00
+//	Purpose			:	Runs the real cycle pipeline - MainInit(), MachineSequencesTimer() and
+//						BackgroundProcesses() - against the simulator, for every combination of
+//						cycle period, number of axes and acquisition mode, each for giBenchMs.
+//						In ACQ_MODE_SDO the drives are read every cycle, as fast as the bus
+//						allows, to compare with PDO. The results are printed and written as
+//						JSON to cpJsonFile, see cycle_benchmark.h.
+//						The 1st state machine runs BenchSequence(), strokes without end,
+//						so giBenchMs may be any length.
+//	Input			:	cpJsonFile - the report file.
+//	Output			:	N/A
+//	Return Value	:	void
+//////////////////////////////////////////////////////////////////////
+void RunBenchmark(const char* cpJsonFile)
+{
+	static const int iCycleMs[] = { 1, 2, 5, 10, 20 } ;
+	static const int iAxes[] 	= { 1, 2, 4, 8, 16 } ;
+	static const int iAcqMode[] = { ACQ_MODE_PDO, ACQ_MODE_SDO } ;
+	static CCycleBenchmark cBench ;
+	BENCH_CONFIG stConfig ;
+	CYCLE_SCHED_STATS stSched ;
+	CALLBACK_RECORD stRec ;
+	uint64_t ullEndNs ;
+	uint64_t ullCpuNs ;
+	unsigned int m, c, a ;
+	int iWait ;
+	int i ;
+
+	cBench.SetSimLatencies(gcSimBackend.Config().ulIpcLatencyUs, gcSimBackend.Config().ulCanLatencyUs) ;
+
+	for (m = 0 ; m < sizeof(iAcqMode) / sizeof(iAcqMode[0]) ; m++)
+	for (c = 0 ; c < sizeof(iCycleMs) / sizeof(iCycleMs[0]) ; c++)
+	for (a = 0 ; a < sizeof(iAxes) / sizeof(iAxes[0]) ; a++)
+	{
+		if (iAxes[a] > MAX_AXES)
+			continue ;
+
+		stConfig.iAcqMode 	= iAcqMode[m] ;
+		stConfig.iCycleMs 	= iCycleMs[c] ;
+		stConfig.iAxes 		= iAxes[a] ;
+		giAcqMode 			= stConfig.iAcqMode ;
+		giTimerCycle 		= stConfig.iCycleMs ;
+		giAxes 				= stConfig.iAxes ;
+		//
+		// Same start-up as the application, from a fresh simulator
+		MainInit() ;
+		ConfigureSampling(gstBenchSignals) ;
+		ConfigureConditioning() ;
+		MachineSequencesInit(eBENCH) ;
+		for (i = 0 ; i < ePHASE_COUNT ; i++)
+		{
+			gPhaseHist[i].Reset() ;
+		}
+		gSnapHist.Reset() ;
+		gEventHist.Reset() ;
+		gulOverruns 	= 0 ;
+		gulReentrances 	= 0 ;
+		EnableMachineSequencesTimer(giTimerCycle) ;
+		StartRuntime() ;
+
+		gulSamples = 0 ;							// Not the ones of the start-up
+		cBench.Begin(stConfig, gcSimBackend.CanFrames(), gcSimBackend.IpcCalls()) ;
+		ullEndNs = MonoTimeNs() + (uint64_t)giBenchMs * NSEC_PER_MSEC ;
+		while (!giTerminate && MonoTimeNs() < ullEndNs)
+		{
+			iWait 		= gCycleScheduler.WaitNextCycle() ;
+			ullCpuNs 	= ThreadCpuNs() ;
+			MachineSequencesTimer(0) ;
+			if (iWait == CYCLE_TICK)
+				BackgroundProcesses() ;
+			cBench.RecordCycleCpu(ThreadCpuNs() - ullCpuNs) ;
+		}
+		StopRuntime() ;
+		gCycleScheduler.GetStats(stSched) ;
+		cBench.End(gPhaseHist[ePHASE_TOTAL], stSched, gulOverruns, gulSamples,
+				   gcSimBackend.CanFrames(), gcSimBackend.IpcCalls()) ;
+		cBench.PrintResult(cBench.Results() - 1) ;
+		//
+		// Stop the simulator and forget its axes and pending transfers
+		MainClose() ;
+		gSdoEngine = CSdoEngine() ;
+		while (gCallbackRing.Pop(stRec))
+			;
+		while (gAcqRing.Pop(stRec))
+			;
+		while (gSampleRing.Pop(stRec))
+			;
+		if (giTerminate)
+		{
+			printf("Benchmark interrupted\n") ;
+			break ;
+		}
+	}
+
+	cBench.WriteJson(cpJsonFile) ;
+	printf("Benchmark: %d configurations written to %s\n", cBench.Results(), cpJsonFile) ;
+}
+
 //
 // Callback Function once a Modbus message is received.
 void ModbusWrite_Received()
 {
-	printf("Modbus Write Received\n") ;
+	gcLog.Post(eLOG_MODBUS_WRITE) ;
 }
 //
 // Callback Function once an Emergency is received.
 void Emergency_Received(unsigned short usAxisRef, short sEmcyCode)
 {
-	printf("Emergency Message Received on Axis %d. Code: %x\n",usAxisRef,sEmcyCode) ;
+	gcLog.Post(eLOG_EMCY_MSG, usAxisRef, (unsigned short)sEmcyCode) ;
 }
@@ -12,35 +12,59 @@
 ============================================================================
 */
 void MainInit();
+int  ResetAxes(int iTimeoutMs);
+void ConfigureDrives();
+int  RunStartupSdo(int iTimeoutMs);
+uint64_t MeasureSyncPeriod(int iPdos, int iTimeoutMs);
+int  CheckPdoLayout(const int* iMapped, int iTimeoutMs);
+void ParseArguments(int argc, char* argv[]);
+void RunBenchmark(const char* cpJsonFile);
 void MachineSequences();
 void MainClose();
-void MachineSequencesInit();
+void MachineSequencesInit(int iFirstState);
 void EnableMachineSequencesTimer(int TimerCycle);
 void BackgroundProcesses();
 void MachineSequencesClose();
 void MachineSequencesTimer(int iSig);
+void StartRuntime();
+void StopRuntime();
+void* AcquisitionThread(void* pArg);
+void* IoThread(void* pArg);
 void ReadAllInputData();
+void HandleCallbackEvent(const CALLBACK_RECORD& stRec);
+void DrainCallbackRing();
+void ConfigureSampling(const SAMPLE_SIGNAL_DEF* pstSignals);
+void OnSdoSample(int iAxis, int iSignal, long lValue, uint32_t ulLatencyUs);
+void AddSample(int iAxis, int iTorque, int iCurrent, long lPosition, uint64_t ullTimeNs);
+void AddTorque(int iAxis, int iTorque, uint64_t ullTimeNs);
+void AddCurrent(int iAxis, int iCurrent);
+void LogSample(int iAxis, uint64_t ullTimeNs);
+void PrintAcquisition();
+void ConfigureConditioning();
+void ReadHostCommands();
+void TrackSegments();
+void TrackStrokes();
 void WriteAllOutputData();
 void InsertLongVarToModbusShortArr(short* spArr, long lVal) ;
 int OnRunTimeError(const char *msg,  unsigned int uiConnHndl, unsigned short usAxisRef, short sErrorID, unsigned short usStatus) ;
 void TerminateApplication(int iSigNum);
+void RequestProfileDump(int iSigNum);
+void DumpCycleProfile();
 void Emergency_Received(unsigned short usAxisRef, short sEmcyCode) ;
 void ModbusWrite_Received() ;
 int  CallbackFunc(unsigned char* recvBuffer, short recvBufferSize,void* lpsock);
+void PrintDriveDiag(const CSdoBatchRead& cBatch, void* pContext);
 /*
 ============================================================================
  States functions
 ============================================================================
 */
-void StateFunction_1();							// TODO: Change the name of these functions accordingly
-	void SubState1_1PowerOn();
-	void SubState1_2WPowerOn();
-	void SubState1_3Function();
-	void SubState1_4Function();
-
-void StateFunction_2 () ;						// TODO: Change the name of these functions accordingly
-	void SubState2_1Function();
-	void SubState2_2Function();
+int  MachineState(int iMachine);
+int  Sm1Sequence(SEQ_TASK& stTask);
+int  Sm2Sequence(SEQ_TASK& stTask);
+int  BenchSequence(SEQ_TASK& stTask);
+int  MachineSubState(int iMachine);
+void PrintMachineStats();
 
 void StateXYDefaultFunction();
 void MMCPP_InitConnection() ;
@@ -49,7 +73,7 @@ void MMCPP_InitConnection() ;
  General constants
 ============================================================================
 */
-#define 	MAX_AXES				3		// number of Physical axes in the system. TODO Update MAX_AXES accordingly
+#define 	MAX_AXES				16		// number of Physical axes in the system, up to BACKEND_MAX_AXES. TODO Update MAX_AXES accordingly
 #define 	FALSE					0
 #define 	TRUE					1
 //
@@ -57,17 +81,36 @@ void MMCPP_InitConnection() ;
 #define 	MODBUS_READ_OUTPUTS_INDEX	0	// Start of Modbus read address
 #define 	MODBUS_READ_CNT				16	// Number of registers to read
 #define 	MODBUS_UPDATE_START_INDEX	16	// Start of Modbus write address (update to host)
-#define 	MODBUS_UPDATE_CNT			16	// Number of registers to update
+#define 	MODBUS_UPDATE_CNT			(eMBUS_AXIS_BASE + MAX_AXES * eMBUS_AX_REGS)	// Number of registers to update, see eMbusOut
 /*
 ============================================================================
  Project constants
 ============================================================================
 */
 #define		SLEEP_TIME				15// Sleep time of the backround idle loop, in seconds
-#define 	SLEEP_COUNT				SLEEP_TIME * 1000 / TIMER_CYCLE
-#define 	SDO_TIME				1
-#define 	SDO_COUNT				SDO_TIME * 1000 / TIMER_CYCLE
+#define 	SLEEP_COUNT				SLEEP_TIME * 1000 / giTimerCycle
+#define 	REPORT_TIME				1		// Acquisition printed every REPORT_TIME seconds
+#define 	REPORT_COUNT			REPORT_TIME * 1000 / giTimerCycle
 #define		TIMER_CYCLE				20		// Cycle time of the main sequences timer, in ms
+#define		CYCLE_RT_PRIORITY		SCHED_NO_RT_PRIORITY	// SCHED_FIFO priority of the cycle (1..99)
+#define		CYCLE_CPU				SCHED_NO_CPU_AFFINITY	// CPU the cycle is pinned to
+#define		CYCLE_LOCK_MEMORY		TRUE	// mlockall() the process before the cycle starts
+#define		CYCLE_STACK_PREFAULT	(256 * 1024)	// Stack of the cycle faulted in, in bytes
+#define		ACQ_RT_PRIORITY			SCHED_NO_RT_PRIORITY	// SCHED_FIFO priority of the acquisition thread, below the cycle
+#define		ACQ_CPU					SCHED_NO_CPU_AFFINITY	// CPU the acquisition thread is pinned to
+#define		ACQ_STACK_BYTES			(256 * 1024)	// Stack of the acquisition thread, locked in RAM
+#define		IO_RT_PRIORITY			SCHED_NO_RT_PRIORITY	// I/O thread: SCHED_OTHER, the host link may be slow
+#define		IO_CPU					SCHED_NO_CPU_AFFINITY	// CPU the I/O thread is pinned to
+#define		IO_STACK_BYTES			(256 * 1024)	// Stack of the I/O thread, locked in RAM
+#define		ACQ_REQUESTS			16		// Requests of the cycle queued to the acquisition thread
+#define		INIT_RESET_TIMEOUT_MS	2000	// Axes in error stop not reset by then abort the start-up
+#define		INIT_SDO_TIMEOUT_MS		2000	// Start-up SDO transfers of all the drives
+#define		INIT_BACKOFF_MIN_US		100		// Start-up polls: first wait, doubled while nothing changes
+#define		INIT_BACKOFF_MAX_US		20000	// Longest wait between two polls
+#define		INIT_SYNC_PDOS			64		// SYNC periods measured from the PDOs of one axis, see MeasureSyncPeriod()
+#define		INIT_SYNC_TIMEOUT_MS	500		// Longest wait for them
+#define		SAMPLE_BUS_SHARE		50		// Percentage of the CAN bus time given to the SDO reads
+#define		SAMPLE_SDO_US			250		// Bus time of one expedited upload, request and response, at 1 Mbit/s
 
 #define 	TEST_TIME				15
 #define 	STEP_COUNT				2000
@@ -75,18 +118,37 @@ void MMCPP_InitConnection() ;
 #define		TEST_POS				15000 * TEST_SPEED / STEP_COUNT
 
 #define		SYNC_MULTIPLIER			1		// SYNC Time
+#define		GMAS_CYCLE_US			1000	// GMAS cycle, SYNC_MULTIPLIER 1. Assumed only if the SYNC period is not measured
+#define		TORQUE_CUTOFF_HZ		50.0	// Low-pass of the torque and current, see signal_cond.h
+#define		ACQ_MODE				ACQ_MODE_PDO	// Torque acquisition: ACQ_MODE_PDO or ACQ_MODE_SDO, see PDO_EVT_LAYOUT_VERIFIED
+#define		ACQ_AXES				1		// Axes acquired, a01 onwards. Up to MAX_AXES, see -axes
+#define		TORQUE_LOG_BASE			"torque"	// Binary log segments: torque.<nn>.tlog, see -log
+#define		TORQUE_ARCHIVE_BASE		"torque"	// Compressed archive files: torque.<nn>.tqa, see -archive
+#define		TORQUE_ARCHIVE_MB		ARCH_BUDGET_MB	// Flash of the archive: 6 to 9 h of one axis, see -archivemb
+#define		SNAPSHOT_FIELDS			AXIS_SNAP_POSITION	// Read every cycle with the status. The position always, see ConfigureDrives()
+#define		SM1_AXES				AXIS_BIT(0)	// Axes moved by the 1st state machine, a01
+#define		SM2_AXES				AXIS_BIT(0)	// Axes moved by the 2nd state machine, a01
+#define		SIGNATURE_FILE			"torque.sig"	// Torque envelope of the test strokes, see -sig
+#define		SIGNATURE_MARGIN		50		// Tolerance around the envelope, per-mille of rated torque
+#define		STROKE_MOVE1			0		// Signature strokes, see TrackStrokes()
+#define		STROKE_MOVE2			1
 /*
 ============================================================================
  States Machines constants
 ============================================================================
 */
 #define 	FIRST_SUB_STATE			1
+#define		SEGMENT_KEY(s, ss)		((s) * 100 + (ss))	// Torque statistics segment of a sub-state, see TrackSegments()
+
+#define		MAIN_MACHINES			2		// Main state machines, stepped in this order every cycle
 
 enum eMainStateMachines						// TODO: Change names of state machines to reflect dedicated project
 {
 	eIDLE		= 	0,
 	eSM1 		= 	1,						// Main state machine #1
 	eSM2		= 	2,						// Main state machine #2
+	eBENCH		=	3,						// Test strokes without end, see RunBenchmark()
+	eMAIN_STATES =	4,
 } ;
 
 enum eSubStateMachine_1						// TODO: Change names of sub-state machines.
@@ -98,6 +160,15 @@ enum eSubStateMachine_1						// TODO: Change names of sub-state machines.
 	eSubState_SM1_Move2 	= 5,
 	eSubState_SM1_WMove2 	= 6,
 };
+enum eCyclePhase							// Phases of MachineSequencesTimer() that are timed
+{
+	ePHASE_READ		= 0,					// ReadAllInputData()
+	ePHASE_SEQ		= 1,					// Host commands and gcSequencer.Run(), both main machines
+	ePHASE_MACHINES	= 2,					// Step() of both main state machines
+	ePHASE_WRITE	= 3,					// WriteAllOutputData()
+	ePHASE_TOTAL	= 4,					// Whole cycle
+	ePHASE_COUNT	= 5,
+};
 enum eSubStateMachine_2						// TODO: Change names of sub-state machines.
 {
 	eSubState_SM2_1 = 1,
@@ -105,6 +176,120 @@ enum eSubStateMachine_2						// TODO: Change names of sub-state machines.
 	eSubState_SM2_3 = 3,
 	eSubState_SM2_4 = 4,
 };
+/*
+============================================================================
+ A main state machine. Its states are the sequences, eMainStateMachines; each
+ sequence runs as a task of gcSequencer with the MACHINE as context, so two
+ main machines, or one per axis, never share a sub-state. The state types
+ and table are in main.cpp, see state_machine.h and motion_sequencer.h.
+============================================================================
+*/
+struct MACHINE
+{
+	int						iMachine ;					// 0 for the 1st main state machine
+	CAxisBackend*			pAxis ;						// Axis the sequences command
+	AXIS_MASK				ulAxes ;					// Axes the sequences wait for
+	CStateMachine<MACHINE>	cMain ;						// The sequence running, eMainStateMachines
+	int						iTask ;						// Its task in gcSequencer
+} ;
+/*
+============================================================================
+ Threads of the runtime, see StartRuntime():
+
+ 	- the cycle, main(): MachineSequencesTimer(), pinned, memory locked,
+ 	- the acquisition thread: owns gSdoEngine, all the SDO traffic,
+ 	- the I/O thread: publishes the output registers to the host.
+
+ They share no data but the rings and the seqlock snapshot below, and what
+ is set up before they start.
+============================================================================
+*/
+typedef struct
+{
+	int				iAxis ;						// Index in gcAxes
+	SDO_BATCH_CLBK	pfnDone ;					// Called on the acquisition thread
+	void*			pContext ;
+} ACQ_REQUEST ;								// Read of the drive diagnostics, cycle -> acquisition
+/*
+============================================================================
+ Modbus command map, written by the host, from MODBUS_READ_OUTPUTS_INDEX.
+ 32 bits values take two registers, low word first. The host increments the
+ counter of a command with every write of it, so the same command sent
+ twice is acted upon twice, see CCommandMailbox::AddCounter().
+============================================================================
+*/
+enum eMbusIn
+{
+	eMBUS_CMD_STATE1	= 0,				// 32 bits, state of the 1st state machine to go to
+	eMBUS_CMD_STATE2	= 2,				// 32 bits, state of the 2nd state machine to go to
+	eMBUS_CMD_COUNT1	= 4,				// Counter of eMBUS_CMD_STATE1
+	eMBUS_CMD_COUNT2	= 5,				// Counter of eMBUS_CMD_STATE2
+};
+/*
+============================================================================
+ Modbus output map, from MODBUS_UPDATE_START_INDEX. 32 bits values take two
+ registers, low word first.
+============================================================================
+*/
+enum eMbusOut
+{
+	eMBUS_STATE1		= 0,
+	eMBUS_SUBSTATE1		= 1,
+	eMBUS_STATE2		= 2,
+	eMBUS_SUBSTATE2		= 3,
+	eMBUS_SAMPLES		= 4,				// 32 bits, torque samples acquired, all axes
+	eMBUS_AXES			= 6,				// Axes acquired
+	eMBUS_AXIS_BASE		= 8,				// Block of a01, then eMBUS_AX_REGS per axis
+};
+enum eMbusAxisOut							// In the block of each axis
+{
+	eMBUS_AX_STATUS		= 0,				// 32 bits, GMAS axis status
+	eMBUS_AX_POSITION	= 2,				// 32 bits, actual position, from TPDO3 when it carries it
+	eMBUS_AX_TORQUE		= 4,				// per-mille of rated torque
+	eMBUS_AX_CURRENT	= 5,				// per-mille of rated current
+	eMBUS_AX_TORQUE_RMS	= 6,				// 32 bits, mNm, filtered
+	eMBUS_AX_TORQUE_PEAK = 8,				// 32 bits, mNm, filtered
+	eMBUS_AX_SEG_P99	= 10,				// per-mille, last segment closed
+	eMBUS_AX_STROKE_OUT	= 11,				// Bins out of the envelope in the last stroke
+	eMBUS_AX_REGS		= 12,
+};
+enum eLogMsg								// Messages of gcLog, see gstLogMsgs
+{
+	eLOG_ERROR_STOP		= 0,
+	eLOG_REENTRANCY		= 1,
+	eLOG_EVT_EMCY		= 2,
+	eLOG_EVT_MOTION_END	= 3,
+	eLOG_EVT_HBEAT		= 4,
+	eLOG_EVT_DRV_ERROR	= 5,
+	eLOG_EVT_HOME_END	= 6,
+	eLOG_EVT_SYS_ERROR	= 7,
+	eLOG_EVT_OTHER		= 8,
+	eLOG_ACQ_SDO		= 9,
+	eLOG_ACQ_PDO		= 10,
+	eLOG_SET_PARAMS		= 11,
+	eLOG_PARAMS_SET		= 12,
+	eLOG_DIAG			= 13,
+	eLOG_DIAG_FAILED	= 14,
+	eLOG_MODBUS_WRITE	= 15,
+	eLOG_EMCY_MSG		= 16,
+	eLOG_COND_TORQUE	= 17,
+	eLOG_COND_CURRENT	= 18,
+	eLOG_SEGMENT		= 19,
+	eLOG_SEGMENT_STATS	= 20,
+	eLOG_STROKE			= 21,
+	eLOG_STROKE_OUT		= 22,
+	eLOG_HOST_CMD		= 23,
+	eLOG_ACQ_DC_LINK	= 24,
+	eLOG_COUNT			= 25,
+};
+enum eSampleSignal							// Signals read from the drives, see gstSignals
+{
+	eSIG_TORQUE			= 0,
+	eSIG_CURRENT		= 1,
+	eSIG_POSITION		= 2,
+	eSIG_DC_LINK		= 3,
+	eSIG_COUNT			= 4,
+};
 
 /*
 ============================================================================
@@ -113,32 +298,42 @@ enum eSubStateMachine_2						// TODO: Change names of sub-state machines.
 */
 int 	giTerminate;		// Flag to request program termination
 int		giReentrance;		// Used to detect reentrancy to the main timer function
+volatile int	giDumpProfile;	// Set by SIGUSR1 to print the cycle profile
+//
+CLatencyHistogram	gPhaseHist[ePHASE_COUNT];	// Execution time of each cycle phase, in us
+CLatencyHistogram	gSnapHist;					// Time taken by the input snapshot of all axes, in us
+CLatencyHistogram	gEventHist;					// From a motion or homing end event to the cycle handling it, in us
+unsigned long		gulOverruns;				// Cycles that took longer than giTimerCycle
+int					giTimerCycle;				// Cycle time in ms: TIMER_CYCLE, or swept by the benchmark
+unsigned long		gulReentrances;				// Cycles skipped because of reentrancy
 //
-int 	giTempState1;		// Holds temp state
-int 	giTempState2;		// Holds temp state
-int 	giState1;			// Holds the current state of the 1st main state machine
-int 	giPrevState1;		// Holds the value of giState1 at previous cycle
-int		giSubState1;		// Holds teh current state of the sub-state machine of 1st main state machine
+int 	giTempState1;		// State commanded to the 1st main state machine in this cycle, eIDLE for none
+int 	giTempState2;		// State commanded to the 2nd main state machine in this cycle, eIDLE for none
+MACHINE	gstMachines[MAIN_MACHINES];	// The main state machines, see MachineState()
+extern const SM_STATE_DEF<MACHINE> gstMainStates[eMAIN_STATES];		// State table, in main.cpp
+CMotionSequencer	gcSequencer;		// The sequences of the main state machines
 //
-int 	giState2;			// Holds the current state of the 2nd main state machine
-int 	giPrevState2;		// Holds the value of giState2 at previous cycle
-int		giSubState2;		// Holds the current state of the sub-state machine of 2nd main state machine
+// 	Data read from the GMAS core and the drives, per axis, a01 first
+CAxisTable<MAX_AXES>	gcAxes;
+int				giAxes;				// Number of axes to create and acquire
+unsigned long	gulSamples;			// Torque samples acquired, all axes
+CDriveDiagRead	gcXDiagOnce;		// Torque, current and position of X, read once at the request of the 2nd state machine
+int		giAcqMode;			// ACQ_MODE_PDO or ACQ_MODE_SDO
+uint64_t	gullSyncNs;			// SYNC period measured from the PDOs at start-up, 0 if not measured
+const char*	gcpLogBase;			// Torque log segments prefix, NULL for no log
+const char*	gcpSignatureFile;	// Torque envelope file, NULL to keep it in memory only
+const char*	gcpArchiveBase;		// Torque archive files prefix, NULL for no archive
+unsigned long	gulArchiveMb;		// Flash the archive files may take, in MB
+const char*	gcpArchiveDump;		// -archdump: print this archive file instead of running
 //
-// 	Examples for data read from the GMAS core about the X, Y drives
-int		giXTorque;
-int		giYTorque;
-int		giXInMotion;
-int		giYInMotion;
-int 	giXStatus ;
-int 	giYStatus ;
-int 	giXPos ;
-int 	giYPos ;
+const char*	gcpBenchFile;		// -bench: run the benchmark and write its JSON report there
+int			giBenchMs;			// Duration of each benchmark configuration
+bool		gbSelfTest;			// -selftest: run the checks of self_test.h instead of running
 
 int 	appTimeout;
-int		sdoTimeout;
+int		reportTimeout;
 int16_t	currRead;
 int 	sleepCount;
-long	asyncVal;
 float	outputCurrent;
 //
 /*
@@ -147,9 +342,84 @@ float	outputCurrent;
 ============================================================================
 */
 MMC_CONNECT_HNDL gConnHndl ;					// Connection Handle
-CMMCConnection cConn ;
-CMMCSingleAxis 	a1,a2 ;							// TODO : Update the names and number of the axes in the system
+CGmasBackend	gcGmasBackend ;					// Elmo GMAS library
+CSimBackend		gcSimBackend ;					// In-process simulated drives, selected with -sim
+CMotionBackend*	gpBackend ;						// One of the two above
+CAxisBackend* 	a1 ;							// TODO : Update the names and number of the axes in the system
+CAxisBackend*	a2 ;
 CMMCHostComm	cHost ;
 MMC_MODBUSWRITEHOLDINGREGISTERSTABLE_IN 	mbus_write_in;
 MMC_MODBUSWRITEHOLDINGREGISTERSTABLE_OUT 	mbus_write_out;
 MMC_MOTIONPARAMS_SINGLE 	stSingleDefault ;	// Single axis default data
+CCallbackRing	gCallbackRing ;					// IPC callback -> cycle, see callback_ring.h
+CCycleScheduler	gCycleScheduler ;				// Runs MachineSequencesTimer() every giTimerCycle ms
+CSdoEngine		gSdoEngine ;					// Asynchronous SDO transfers, owned by the acquisition thread
+CCallbackRing	gAcqRing ;						// IPC callback -> acquisition thread: SDO replies
+CCallbackRing	gSampleRing ;					// Acquisition thread -> cycle: SDO samples
+CSampleScheduler	gcSampler ;					// SDO reads of the drives, run by the acquisition thread
+CSeqLock<AXIS_MASK>	gcMotionMask ;				// Cycle -> acquisition thread: axes in motion
+CSpscRing<ACQ_REQUEST, ACQ_REQUESTS>	gAcqRequests ;	// Cycle -> acquisition thread
+CCycleScheduler	gAcqScheduler ;					// Paces the acquisition thread, woken by the SDO replies
+CCycleScheduler	gIoScheduler ;					// Paces the I/O thread, woken by the cycle
+pthread_t		gstAcqThread ;
+pthread_t		gstIoThread ;
+volatile int	giRuntimeStop ;					// Ends the acquisition and I/O threads
+CTorqueLog		gcTorqueLog ;					// Every acquired sample, memory-mapped binary log
+CTorqueArchive	gcArchive ;						// Every acquired sample, compressed, as long as gulArchiveMb holds
+CSignalCond		gcTorqueCond ;					// Torque of the acquired axes, in Nm
+CSignalCond		gcCurrentCond ;					// Current of the acquired axes, in A
+CTorqueSignature	gcSignature ;				// Torque versus position of the test strokes
+CCommandMailbox	gcCmdMailbox ;					// Host commands, from the Modbus write events
+CModbusPublisher	gcMbusOut ;					// Output registers, written where they changed
+CSegmentStats	gcSegStats ;					// Torque statistics of the sub-states of the 1st state machine
+CAsyncLog		gcLog ;							// Console messages of the cycle and callbacks
+//
+// In eLogMsg order. Arguments are long, see async_log.h
+const LOG_MSG_DEF gstLogMsgs[eLOG_COUNT] =
+{
+	{ "Axis a%02ld in Error Stop. Aborting.\n",							LOG_UNLIMITED },
+	{ "Reentrancy!\n",													1 },
+	{ "Emergency Event received on axis %ld, code %04lx\n",			10 },
+	{ "Motion Ended Event received on axis %ld\n",						10 },
+	{ "H Beat Fail Event received\n",									1 },
+	{ "Drive Error Received Event received on axis %ld\n",				10 },
+	{ "Home Ended Event received on axis %ld\n",						10 },
+	{ "System Error Event received\n",									1 },
+	{ "Event received: %ld\n",											10 },
+	{ "a%02ld SDO Torque: %ld Current: %ld Position: %ld (%lu us)\n",	LOG_UNLIMITED },
+	{ "a%02ld PDO Torque: %ld Current: %ld Position: %ld (%lu PDOs, %lu dropped)\n",	LOG_UNLIMITED },
+	{ "Setting async param...\n",										LOG_UNLIMITED },
+	{ "Done setting params...\n",										LOG_UNLIMITED },
+	{ "a%02ld SDO Torque Read: %ld Current Read: %ld Position: %ld (%lu us)\n",	LOG_UNLIMITED },
+	{ "a%02ld SDO diagnostics read failed\n",							LOG_UNLIMITED },
+	{ "Modbus Write Received\n",										10 },
+	{ "Emergency Message Received on Axis %ld. Code: %lx\n",			10 },
+	{ "a%02ld Torque: %ld mNm, RMS %ld peak %ld min %ld\n",				LOG_UNLIMITED },
+	{ "a%02ld Current: %ld mA, RMS %ld peak %ld min %ld\n",				LOG_UNLIMITED },
+	{ "a%02ld Segment %ld.%ld: %lu torque samples in %ld ms\n",			LOG_UNLIMITED },
+	{ "    mean %ld std %ld min %ld max %ld p50 %ld p99 %ld\n",			LOG_UNLIMITED },
+	{ "a%02ld Stroke %ld: %ld bins, %ld out of envelope (%lu samples). Envelope of %ld strokes\n",	LOG_UNLIMITED },
+	{ "a%02ld Torque %ld out of envelope at position %ld\n",			10 },
+	{ "Host command %lu: state1 %ld state2 %ld (%ld us after the write)\n",	10 },
+	{ "a%02ld DC link: %lu mV\n",										LOG_UNLIMITED },
+};
+//
+// In eSampleSignal order. The torque, current and position are read faster
+// while the axis moves; in ACQ_MODE_PDO they come in TPDO3 instead.
+const SAMPLE_SIGNAL_DEF gstSignals[eSIG_COUNT] =
+{
+	{ "torque",		OD_TORQUE_ACTUAL,	0, 2, 1, 0, SAMPLE_TPDO3,	20,		200 },
+	{ "current",	OD_CURRENT_ACTUAL,	0, 2, 1, 2, SAMPLE_TPDO3,	40,		500 },
+	{ "position",	OD_POSITION_ACTUAL,	0, 4, 1, 1, SAMPLE_TPDO3,	20,		1000 },
+	{ "DC link",	OD_DC_LINK_VOLTAGE,	0, 4, 0, 3, SAMPLE_SDO,		1000,	1000 },
+};
+//
+// The benchmark reads torque, current and position every cycle, as fast as
+// the bus budget allows.
+const SAMPLE_SIGNAL_DEF gstBenchSignals[eSIG_COUNT] =
+{
+	{ "torque",		OD_TORQUE_ACTUAL,	0, 2, 1, 0, SAMPLE_TPDO3,	0,		0 },
+	{ "current",	OD_CURRENT_ACTUAL,	0, 2, 1, 1, SAMPLE_TPDO3,	0,		0 },
+	{ "position",	OD_POSITION_ACTUAL,	0, 4, 1, 2, SAMPLE_TPDO3,	0,		0 },
+	{ "DC link",	OD_DC_LINK_VOLTAGE,	0, 4, 0, 3, SAMPLE_SDO,		1000,	1000 },
+};
@@ -0,0 +1,179 @@
+/*
+============================================================================
+ Name : 	modbus_publisher.cpp
+ Author :
+ Version :	1.00
+ Description : Modbus output image with dirty tracking, see modbus_publisher.h
+============================================================================
+*/
+#include "mmc_definitions.h"
+#include "modbus_publisher.h"
+/*
+============================================================================
+ Function:				CModbusPublisher()
+ Description:			Constructor. Owns no register until Configure().
+============================================================================
+*/
+CModbusPublisher::CModbusPublisher()
+{
+	Configure(0, 0) ;
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		iStartRef - first holding register owned.
+ 						iCount - registers owned, MBUS_MAX_REGS at most. 0
+ 						disables the publisher.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Clears the images and the counters. The whole image is sent by the next
+ Publish() after a Commit(), since what the host holds is not known. Not
+ called while the I/O thread publishes.
+============================================================================
+*/
+void CModbusPublisher::Configure(int iStartRef, int iCount)
+{
+	if (iCount < 0)
+		iCount = 0 ;
+	if (iCount > MBUS_MAX_REGS)
+		iCount = MBUS_MAX_REGS ;
+
+	m_iStartRef 	= iStartRef ;
+	m_iCount 		= iCount ;
+	m_ulCycles 		= 0 ;
+	m_ulSkipped 	= 0 ;
+	m_ulWrites 		= 0 ;
+	m_ulRegisters 	= 0 ;
+	m_ulErrors 		= 0 ;
+	memset(&m_stNext, 0, sizeof(m_stNext)) ;
+	memset(&m_stSnap, 0, sizeof(m_stSnap)) ;
+	memset(m_sSent, 0, sizeof(m_sSent)) ;
+	memset(m_ulDirty, 0, sizeof(m_ulDirty)) ;
+	m_ulSeq 	= m_cImage.Sequence() ;		// What was committed before is not sent
+	m_bRetry 	= false ;
+	Invalidate() ;
+}
+/*
+============================================================================
+ Function:				Invalidate()
+ Description:			Sends all the registers owned with the next
+ 						snapshot, e.g. when the host reconnects. Called
+ 						from the I/O thread.
+============================================================================
+*/
+void CModbusPublisher::Invalidate()
+{
+	int i ;
+
+	memset(m_ulForce, 0, sizeof(m_ulForce)) ;
+	for (i = 0 ; i < m_iCount ; i++)
+	{
+		m_ulForce[i / 32] |= 1u << (i % 32) ;
+	}
+}
+/*
+============================================================================
+ Function:				NextDirty()
+ Input arguments:		iFrom - first register to look at.
+ Returned value:		The first dirty register from iFrom, m_iCount if none.
+============================================================================
+*/
+int CModbusPublisher::NextDirty(int iFrom) const
+{
+	int iWord = iFrom / 32 ;
+	uint32_t ulBits ;
+
+	if (iFrom >= m_iCount)
+		return m_iCount ;
+
+	ulBits = m_ulDirty[iWord] & (0xFFFFFFFFu << (iFrom % 32)) ;
+	while (ulBits == 0)
+	{
+		if (++iWord >= MBUS_MAX_REGS / 32)
+			return m_iCount ;
+		ulBits = m_ulDirty[iWord] ;
+	}
+	iFrom = iWord * 32 + __builtin_ctz(ulBits) ;
+	return (iFrom < m_iCount) ? iFrom : m_iCount ;
+}
+/*
+============================================================================
+ Function:				Publish()
+ Input arguments:		cBackend - where the Modbus server is.
+ Output arguments: 		None.
+ Returned value:		The requests sent, 0 if nothing changed.
+ Version:				Version 1.00
+
+ Description:
+
+ Takes the last snapshot committed by the cycle, if it is new or the last
+ call failed, and sends the registers that differ from the sent image, in
+ as few requests as the merge rules give. On a failed request the remaining
+ ranges are not tried in this call: the link is likely down, and they stay
+ dirty.
+============================================================================
+*/
+int CModbusPublisher::Publish(CMotionBackend& cBackend)
+{
+	int iStart ;
+	int iEnd ;
+	int iNext ;
+	int iWrites = 0 ;
+	int i ;
+
+	if (m_cImage.Sequence() == m_ulSeq && !m_bRetry)
+		return 0 ;
+	m_ulSeq 	= m_cImage.Read(m_stSnap) ;
+	m_bRetry 	= false ;
+	m_ulCycles++ ;
+
+	for (i = 0 ; i < MBUS_MAX_REGS / 32 ; i++)
+	{
+		m_ulDirty[i] = m_ulForce[i] ;
+	}
+	for (i = 0 ; i < m_iCount ; i++)
+	{
+		if (m_stSnap.sRegs[i] != m_sSent[i])
+			m_ulDirty[i / 32] |= 1u << (i % 32) ;
+	}
+	iStart = NextDirty(0) ;
+	if (iStart >= m_iCount)
+	{
+		m_ulSkipped++ ;
+		return 0 ;
+	}
+
+	while (iStart < m_iCount)
+	{
+		//
+		// Extend the range over the next dirty registers that are close enough
+		iEnd 	= iStart + 1 ;
+		iNext 	= NextDirty(iEnd) ;
+		while (iNext < m_iCount && iNext - iEnd <= MBUS_GAP_MERGE && iNext + 1 - iStart <= MBUS_MAX_WRITE)
+		{
+			iEnd 	= iNext + 1 ;
+			iNext 	= NextDirty(iEnd) ;
+		}
+
+		if (cBackend.MbusWriteRegisters(m_iStartRef + iStart, iEnd - iStart, &m_stSnap.sRegs[iStart]) != 0)
+		{
+			m_ulErrors++ ;
+			m_bRetry = true ;
+			break ;
+		}
+		for (i = iStart ; i < iEnd ; i++)
+		{
+			m_sSent[i] = m_stSnap.sRegs[i] ;
+			m_ulForce[i / 32] &= ~(1u << (i % 32)) ;
+		}
+		m_ulWrites++ ;
+		m_ulRegisters += iEnd - iStart ;
+		iWrites++ ;
+		iStart = iNext ;
+	}
+	return iWrites ;
+}
@@ -0,0 +1,114 @@
+/*
+============================================================================
+ Name : modbus_publisher.h
+ Author  :
+ Version :
+ Description : 	Modbus output image, written to the host only where it changed.
+
+ The publisher is split between two threads:
+
+ 	- the cycle writes the next image with the typed setters, and hands it
+ 	  over with Commit() at the end of the cycle, as a seqlock snapshot,
+ 	- the I/O thread takes the last snapshot in Publish() and writes to the
+ 	  host what differs from the sent image, what the host was last given.
+
+ The cycle never waits for the host: it only copies the image. Snapshots
+ committed faster than they are published are skipped, the host gets the
+ last one.
+
+ Publish() compares the snapshot with the sent image, merges the dirty
+ registers into contiguous ranges, and writes each range with one request.
+ Dirty registers separated by MBUS_GAP_MERGE clean ones or less go in the
+ same request: a few more registers cost less than one more round trip. A
+ request holds MBUS_MAX_WRITE registers at most.
+
+ Nothing is sent for a snapshot equal to the sent image. A range whose
+ write failed still differs from the sent image and is sent again by the
+ next Publish().
+
+ 32 bits values take two registers, the low word first, as
+ InsertLongVarToModbusShortArr() does.
+
+ Configure() is called before the threads start.
+============================================================================
+*/
+#ifndef MODBUS_PUBLISHER_H_
+#define MODBUS_PUBLISHER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "motion_backend.h"
+#include "seqlock.h"
+
+#define		MBUS_MAX_REGS			256		// Registers of the image
+#define		MBUS_MAX_WRITE			123		// Registers per request, Modbus function 16
+#define		MBUS_GAP_MERGE			8		// Clean registers written to save a request
+
+typedef struct
+{
+	short			sRegs[MBUS_MAX_REGS] ;
+} MBUS_IMAGE;
+
+class CModbusPublisher
+{
+public:
+	CModbusPublisher() ;
+
+	void Configure(int iStartRef, int iCount) ;
+/*
+============================================================================
+ Cycle side. iReg is relative to the iStartRef of Configure().
+============================================================================
+*/
+	void SetShort(int iReg, short sValue)
+	{
+		m_stNext.sRegs[iReg] = sValue ;
+	}
+	void SetLong(int iReg, long lValue)
+	{
+		SetShort(iReg, (short)(lValue & 0xFFFF)) ;
+		SetShort(iReg + 1, (short)((lValue >> 16) & 0xFFFF)) ;
+	}
+	void SetFloat(int iReg, float fValue)
+	{
+		uint32_t ulBits ;
+
+		memcpy(&ulBits, &fValue, sizeof(ulBits)) ;
+		SetLong(iReg, (long)ulBits) ;
+	}
+	void Commit()						{ m_cImage.Write(m_stNext) ; }
+/*
+============================================================================
+ I/O thread side
+============================================================================
+*/
+	int  Publish(CMotionBackend& cBackend) ;
+	void Invalidate() ;
+
+	unsigned long Cycles() const		{ return m_ulCycles ; }
+	unsigned long Skipped() const		{ return m_ulSkipped ; }
+	unsigned long Writes() const		{ return m_ulWrites ; }
+	unsigned long Registers() const		{ return m_ulRegisters ; }
+	unsigned long Errors() const		{ return m_ulErrors ; }
+
+private:
+	int  NextDirty(int iFrom) const ;
+
+	MBUS_IMAGE		m_stNext ;						// Cycle: being written
+	CSeqLock<MBUS_IMAGE>	m_cImage ;				// Cycle -> I/O thread: last committed
+	MBUS_IMAGE		m_stSnap ;						// I/O thread: being published
+	short			m_sSent[MBUS_MAX_REGS] ;
+	uint32_t		m_ulDirty[MBUS_MAX_REGS / 32] ;		// Bit set: m_stSnap differs from m_sSent
+	uint32_t		m_ulForce[MBUS_MAX_REGS / 32] ;		// Bit set: sent even if equal, see Invalidate()
+	uint32_t		m_ulSeq ;						// Of the snapshot last published
+	bool			m_bRetry ;						// A request of the last Publish() failed
+	int				m_iStartRef ;
+	int				m_iCount ;
+	unsigned long	m_ulCycles ;					// Snapshots published
+	unsigned long	m_ulSkipped ;					// Snapshots with nothing to send
+	unsigned long	m_ulWrites ;					// Requests sent
+	unsigned long	m_ulRegisters ;					// Registers sent, all requests
+	unsigned long	m_ulErrors ;					// Requests failed
+} ;
+
+#endif /* MODBUS_PUBLISHER_H_ */
@@ -0,0 +1,46 @@
+/*
+============================================================================
+ Name : mono_time.h
+ Author  :
+ Version :
+ Description : 	Monotonic time stamps for samples, events and cycle timing,
+ 				and thread CPU time for the benchmark.
+============================================================================
+*/
+#ifndef MONO_TIME_H_
+#define MONO_TIME_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#define		NSEC_PER_SEC			1000000000ULL
+#define		NSEC_PER_MSEC			1000000ULL
+#define		NSEC_PER_USEC			1000ULL
+/*
+============================================================================
+ Function:				MonoTimeNs()
+ Returned value:		CLOCK_MONOTONIC in nano-seconds.
+============================================================================
+*/
+static inline uint64_t MonoTimeNs()
+{
+	struct timespec stNow ;
+
+	clock_gettime(CLOCK_MONOTONIC, &stNow) ;
+	return (uint64_t)stNow.tv_sec * NSEC_PER_SEC + (uint64_t)stNow.tv_nsec ;
+}
+/*
+============================================================================
+ Function:				ThreadCpuNs()
+ Returned value:		CPU time consumed by the calling thread, in nano-seconds.
+============================================================================
+*/
+static inline uint64_t ThreadCpuNs()
+{
+	struct timespec stNow ;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &stNow) ;
+	return (uint64_t)stNow.tv_sec * NSEC_PER_SEC + (uint64_t)stNow.tv_nsec ;
+}
+
+#endif /* MONO_TIME_H_ */
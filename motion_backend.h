@@ -0,0 +1,107 @@
+/*
+============================================================================
+ Name : motion_backend.h
+ Author  :
+ Version :
+ Description : 	Abstraction of the GMAS calls used by the application.
+
+ The application talks to a CMotionBackend and to the CAxisBackend objects it
+ creates, never to CMMCConnection / CMMCSingleAxis directly. Two backends
+ exist:
+
+ 	CGmasBackend	- gmas_backend.h, forwards to the Elmo C++ library.
+ 	CSimBackend		- sim_backend.h, an in-process simulated CAN network with
+ 					  drives, for running and benchmarking on plain Linux.
+
+ Both deliver their events through the same MMC_MB_CLBK callback and frame
+ layout (see pdo_acquisition.h and callback_ring.h), so the same binary runs
+ against either of them.
+============================================================================
+*/
+#ifndef MOTION_BACKEND_H_
+#define MOTION_BACKEND_H_
+
+#include <stdint.h>
+
+#define		BACKEND_MAX_AXES		16		// Axes a backend can create
+/*
+============================================================================
+ Inputs of a group of axes, see CMotionBackend::ReadInputs(). One entry per
+ axis in each array, NULL for an input that is not needed.
+============================================================================
+*/
+typedef struct
+{
+	uint32_t*	pulStatus;					// GMAS axis status
+	int32_t*	plPosition;					// Actual position
+	int32_t*	plVelocity;					// Actual velocity
+	int32_t*	plTorque;					// Actual torque
+} AXIS_INPUTS;
+
+class CAxisBackend
+{
+public:
+	virtual ~CAxisBackend() {}
+
+	virtual unsigned short GetRef() = 0 ;
+	virtual void SetDefaultParams(MMC_MOTIONPARAMS_SINGLE& stParams) = 0 ;
+	virtual void SetAcceleration(float fAcceleration) = 0 ;
+//
+//	Status and motion
+//
+	virtual unsigned int ReadStatus() = 0 ;
+	virtual double GetActualPosition() = 0 ;
+	virtual double GetActualVelocity() = 0 ;
+	virtual double GetActualTorque() = 0 ;
+	virtual void Reset() = 0 ;
+	virtual void PowerOn() = 0 ;
+	virtual void PowerOff() = 0 ;
+	virtual void MoveAbsolute(double dbPosition, float fVelocity, MC_BUFFERED_MODE_ENUM eBufferMode) = 0 ;
+	virtual void ElmoSetAsyncParam(char* cpName, int iValue) = 0 ;
+//
+//	CANopen
+//
+	virtual void ConfigPDO(unsigned char ucPDONum, unsigned char ucPDOCommParam, unsigned char ucEventGroup,
+						   unsigned char ucParam1, unsigned char ucParam2, unsigned char ucParam3,
+						   unsigned char ucParam4, unsigned char ucParam5) = 0 ;
+	virtual long SendSdoUpload(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) = 0 ;
+	virtual void SendSdoDownload(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) = 0 ;
+	virtual void SendSdoUploadAsync(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) = 0 ;
+	virtual void SendSdoDownloadAsync(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) = 0 ;
+	virtual int  RetreiveSdoUploadAsync(long& lData) = 0 ;
+	//
+	// Outcome of the oldest asynchronous download replied: 0 if the drive
+	// accepted it, else the error or SDO abort code.
+	virtual int  RetreiveSdoDownloadAsync() = 0 ;
+} ;
+
+class CMotionBackend
+{
+public:
+	virtual ~CMotionBackend() {}
+
+	virtual const char* Name() const = 0 ;
+	virtual int  IsSimulated() const = 0 ;
+
+	virtual MMC_CONNECT_HNDL ConnectIPCEx(int iEventsMask, MMC_MB_CLBK pfnCallback) = 0 ;
+	virtual void Close() = 0 ;
+	virtual CAxisBackend* CreateAxis(const char* cpName) = 0 ;
+	virtual void SetSyncTime(int iSyncMultiplier) = 0 ;
+	//
+	// Reads the inputs of iAxes axes created by this backend, with as few
+	// exchanges with the GMAS as the backend allows.
+	virtual void ReadInputs(CAxisBackend* const* pAxes, int iAxes, const AXIS_INPUTS& stIn) = 0 ;
+//
+//	Modbus TCP server of the GMAS, holding registers read by the host
+//
+	virtual int  MbusStartServer() = 0 ;
+	virtual void MbusStopServer() = 0 ;
+	//
+	// Writes iCount registers from iStartRef in one request, 0 on success.
+	virtual int  MbusWriteRegisters(int iStartRef, int iCount, const short* spRegs) = 0 ;
+	//
+	// Reads iCount registers from iStartRef in one request, 0 on success.
+	virtual int  MbusReadRegisters(int iStartRef, int iCount, short* spRegs) = 0 ;
+} ;
+
+#endif /* MOTION_BACKEND_H_ */
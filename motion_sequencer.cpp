@@ -0,0 +1,316 @@
+/*
+============================================================================
+ Name : 	motion_sequencer.cpp
+ Author :
+ Version :	1.00
+ Description : Resumable motion sequences, see motion_sequencer.h
+============================================================================
+*/
+#include <string.h>
+#include "mmc_definitions.h"
+#include "motion_sequencer.h"
+/*
+============================================================================
+ Function:				CMotionSequencer()
+ Description:			Constructor. No task.
+============================================================================
+*/
+CMotionSequencer::CMotionSequencer()
+{
+	memset(m_stTask, 0, sizeof(m_stTask)) ;
+	Reset() ;
+}
+/*
+============================================================================
+ Function:				Reset()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Drops all the tasks, without resuming them, and clears the counters. The
+ handles given before are no longer valid.
+============================================================================
+*/
+void CMotionSequencer::Reset()
+{
+	int i ;
+
+	for (i = 0 ; i < SEQ_MAX_TASKS ; i++)
+	{
+		m_stTask[i].ulGen++ ;
+	}
+	memset(m_ulUsed, 0, sizeof(m_ulUsed)) ;
+	memset(m_ulFresh, 0, sizeof(m_ulFresh)) ;
+	memset(m_ulAxisWaiters, 0, sizeof(m_ulAxisWaiters)) ;
+	memset(m_ulDelayWaiters, 0, sizeof(m_ulDelayWaiters)) ;
+	memset(m_ulTorqueWaiters, 0, sizeof(m_ulTorqueWaiters)) ;
+	m_ullNextDeadlineNs 	= ~0ULL ;
+	m_ullNowNs 				= 0 ;
+	m_ulPrevStandStill 		= 0 ;
+	m_ulPrevInMotion 		= 0 ;
+	m_iTasks 				= 0 ;
+	m_ulStarted 			= 0 ;
+	m_ulResumes 			= 0 ;
+	m_ulTests 				= 0 ;
+	m_ulFull 				= 0 ;
+}
+/*
+============================================================================
+ Function:				Start()
+ Input arguments:		pfnBody - the sequence.
+ 						pContext - given to it in SEQ_TASK::pContext.
+ Output arguments: 		None.
+ Returned value:		The handle of the task, SEQ_NO_TASK if the table is full.
+ Version:				Version 1.00
+
+ Description:
+
+ The sequence runs from its beginning in the next Run().
+============================================================================
+*/
+int CMotionSequencer::Start(int (*pfnBody)(SEQ_TASK& stTask), void* pContext)
+{
+	int iWord ;
+	int iSlot ;
+	SEQ_TASK* pstTask ;
+
+	for (iWord = 0 ; iWord < SEQ_WORDS ; iWord++)
+	{
+		if (m_ulUsed[iWord] != 0xFFFFFFFFu)
+			break ;
+	}
+	if (iWord == SEQ_WORDS)
+	{
+		m_ulFull++ ;
+		return SEQ_NO_TASK ;
+	}
+	iSlot 	= iWord * 32 + __builtin_ctz(~m_ulUsed[iWord]) ;
+	pstTask = &m_stTask[iSlot] ;
+
+	pstTask->pfnBody 		= pfnBody ;
+	pstTask->pContext 		= pContext ;
+	pstTask->iResume 		= 0 ;
+	pstTask->iStep 			= 0 ;
+	pstTask->iWait 			= eSEQ_WAIT_NONE ;
+	pstTask->ulAxes 		= 0 ;
+	pstTask->ulResumes 		= 0 ;
+	m_ulUsed[iWord] |= 1u << (iSlot % 32) ;
+	File(iSlot) ;
+	m_iTasks++ ;
+	m_ulStarted++ ;
+	return (int)(pstTask->ulGen & 0x7FFFFF) * SEQ_MAX_TASKS + iSlot ;
+}
+/*
+============================================================================
+ Function:				Kill()
+ Input arguments:		iTask - handle given by Start(). A task that ended
+ 						already is ignored.
+ Output arguments: 		None.
+ Returned value:		None.
+ Description:			Drops the task where it waits.
+============================================================================
+*/
+void CMotionSequencer::Kill(int iTask)
+{
+	if (Task(iTask) == 0)
+		return ;
+	Unfile(iTask % SEQ_MAX_TASKS) ;
+	Free(iTask % SEQ_MAX_TASKS) ;
+}
+/*
+============================================================================
+ Function:				Run()
+ Input arguments:		stIn - the inputs of this cycle.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Gathers the tasks whose condition may have changed since the last Run(),
+ tests their condition, and resumes those where it holds. A task resumed
+ here that waits again is tested by the next Run(), not by this one.
+============================================================================
+*/
+void CMotionSequencer::Run(const SEQ_INPUTS& stIn)
+{
+	uint32_t ulCandidates[SEQ_WORDS] ;
+	AXIS_MASK ulChanged ;
+	bool bDue ;
+	int iAxis ;
+	int iWord ;
+	int iSlot ;
+	int i ;
+
+	m_ullNowNs 	= stIn.ullNowNs ;
+	ulChanged 	= (stIn.ulStandStill ^ m_ulPrevStandStill) | (stIn.ulInMotion ^ m_ulPrevInMotion) ;
+	bDue 		= (m_ullNowNs >= m_ullNextDeadlineNs) ;
+	m_ulPrevStandStill 	= stIn.ulStandStill ;
+	m_ulPrevInMotion 	= stIn.ulInMotion ;
+
+	for (i = 0 ; i < SEQ_WORDS ; i++)
+	{
+		ulCandidates[i] = m_ulFresh[i] | m_ulTorqueWaiters[i] | (bDue ? m_ulDelayWaiters[i] : 0) ;
+		m_ulFresh[i] 	= 0 ;
+	}
+	while (ulChanged)
+	{
+		iAxis 		= __builtin_ctz(ulChanged) ;
+		ulChanged 	&= ulChanged - 1 ;
+		for (i = 0 ; i < SEQ_WORDS ; i++)
+		{
+			ulCandidates[i] |= m_ulAxisWaiters[iAxis][i] ;
+		}
+	}
+
+	for (iWord = 0 ; iWord < SEQ_WORDS ; iWord++)
+	{
+		while (ulCandidates[iWord])
+		{
+			iSlot = iWord * 32 + __builtin_ctz(ulCandidates[iWord]) ;
+			ulCandidates[iWord] &= ulCandidates[iWord] - 1 ;
+			//
+			// Killed by a task resumed before it
+			if ((m_ulUsed[iWord] & (1u << (iSlot % 32))) == 0)
+				continue ;
+			m_ulTests++ ;
+			if (Satisfied(m_stTask[iSlot], stIn))
+				Resume(iSlot) ;
+		}
+	}
+	//
+	// The earliest deadline of the delays left
+	if (bDue)
+	{
+		m_ullNextDeadlineNs = ~0ULL ;
+		for (iSlot = 0 ; iSlot < SEQ_MAX_TASKS ; iSlot++)
+		{
+			if ((m_ulDelayWaiters[iSlot / 32] & (1u << (iSlot % 32))) != 0 &&
+				m_stTask[iSlot].ullDeadlineNs < m_ullNextDeadlineNs)
+				m_ullNextDeadlineNs = m_stTask[iSlot].ullDeadlineNs ;
+		}
+	}
+}
+/*
+============================================================================
+ Function:				Satisfied()
+ Input arguments:		stTask - a task that waits. stIn - the inputs.
+ Returned value:		true if the condition of its wait holds.
+============================================================================
+*/
+bool CMotionSequencer::Satisfied(const SEQ_TASK& stTask, const SEQ_INPUTS& stIn) const
+{
+	switch (stTask.iWait)
+	{
+		case eSEQ_WAIT_STANDSTILL:
+			return (stIn.ulStandStill & stTask.ulAxes) == stTask.ulAxes ;
+		case eSEQ_WAIT_STOPPED:
+			return (stIn.ulInMotion & stTask.ulAxes) == 0 ;
+		case eSEQ_WAIT_DELAY:
+			return m_ullNowNs >= stTask.ullDeadlineNs ;
+		case eSEQ_WAIT_TORQUE_ABOVE:
+			return stIn.pcTorque != 0 && stIn.pcTorque->Result(stTask.iAxis).fValue > stTask.fLevel ;
+		default:
+			return true ;
+	}
+}
+/*
+============================================================================
+ Function:				Resume()
+ Input arguments:		iSlot - a task whose condition holds.
+ Description:			Runs the task up to its next await or to its end.
+============================================================================
+*/
+void CMotionSequencer::Resume(int iSlot)
+{
+	SEQ_TASK& stTask = m_stTask[iSlot] ;
+
+	Unfile(iSlot) ;
+	stTask.iWait = eSEQ_WAIT_NONE ;
+	stTask.ulResumes++ ;
+	m_ulResumes++ ;
+
+	if (stTask.pfnBody(stTask) == SEQ_ENDED)
+		Free(iSlot) ;
+	else
+		File(iSlot) ;
+}
+/*
+============================================================================
+ Function:				File()
+ Input arguments:		iSlot - a task that just started or awaited.
+ Description:			Puts the task in the set of its condition, and in
+ 						the set tested by the next Run().
+============================================================================
+*/
+void CMotionSequencer::File(int iSlot)
+{
+	SEQ_TASK& stTask = m_stTask[iSlot] ;
+	uint32_t ulBit = 1u << (iSlot % 32) ;
+	int iWord = iSlot / 32 ;
+	AXIS_MASK ulAxes ;
+
+	switch (stTask.iWait)
+	{
+		case eSEQ_WAIT_STANDSTILL:
+		case eSEQ_WAIT_STOPPED:
+			for (ulAxes = stTask.ulAxes ; ulAxes ; ulAxes &= ulAxes - 1)
+			{
+				m_ulAxisWaiters[__builtin_ctz(ulAxes)][iWord] |= ulBit ;
+			}
+			break ;
+		case eSEQ_WAIT_DELAY:
+			stTask.ullDeadlineNs = m_ullNowNs + stTask.ullDelayNs ;
+			if (stTask.ullDeadlineNs < m_ullNextDeadlineNs)
+				m_ullNextDeadlineNs = stTask.ullDeadlineNs ;
+			m_ulDelayWaiters[iWord] |= ulBit ;
+			break ;
+		case eSEQ_WAIT_TORQUE_ABOVE:
+			m_ulTorqueWaiters[iWord] |= ulBit ;
+			break ;
+		default:
+			break ;
+	}
+	m_ulFresh[iWord] |= ulBit ;
+}
+/*
+============================================================================
+ Function:				Unfile()
+ Input arguments:		iSlot - a task.
+ Description:			Removes the task from the sets of File().
+============================================================================
+*/
+void CMotionSequencer::Unfile(int iSlot)
+{
+	const SEQ_TASK& stTask = m_stTask[iSlot] ;
+	uint32_t ulMask = ~(1u << (iSlot % 32)) ;
+	int iWord = iSlot / 32 ;
+	AXIS_MASK ulAxes ;
+
+	if (stTask.iWait == eSEQ_WAIT_STANDSTILL || stTask.iWait == eSEQ_WAIT_STOPPED)
+	{
+		for (ulAxes = stTask.ulAxes ; ulAxes ; ulAxes &= ulAxes - 1)
+		{
+			m_ulAxisWaiters[__builtin_ctz(ulAxes)][iWord] &= ulMask ;
+		}
+	}
+	m_ulDelayWaiters[iWord] 	&= ulMask ;
+	m_ulTorqueWaiters[iWord] 	&= ulMask ;
+	m_ulFresh[iWord] 			&= ulMask ;
+}
+/*
+============================================================================
+ Function:				Free()
+ Input arguments:		iSlot - a task that ended or was killed.
+============================================================================
+*/
+void CMotionSequencer::Free(int iSlot)
+{
+	m_stTask[iSlot].ulGen++ ;
+	m_stTask[iSlot].iWait = eSEQ_WAIT_NONE ;
+	m_ulUsed[iSlot / 32] &= ~(1u << (iSlot % 32)) ;
+	m_iTasks-- ;
+}
@@ -0,0 +1,171 @@
+/*
+============================================================================
+ Name : motion_sequencer.h
+ Author  :
+ Version :
+ Description : 	Motion sequences written as straight code, that suspend on
+ 				axis conditions.
+
+ A sequence is a function run as a resumable task. It is written as the
+ motion it describes, and waits where the motion waits:
+
+ 	int PointToPoint(SEQ_TASK& stTask)
+ 	{
+ 		MACHINE& stM = *(MACHINE*)stTask.pContext ;
+
+ 		SEQ_BEGIN(stTask) ;
+ 		stM.pAxis->PowerOn() ;
+ 		SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes) ;
+ 		stM.pAxis->MoveAbsolute(...) ;
+ 		SEQ_AWAIT_STANDSTILL(stTask, stM.ulAxes) ;
+ 		SEQ_END(stTask) ;
+ 	}
+
+ An await returns from the function. The next resume jumps back to the
+ point after it (a switch on the line of the await), so, as for any
+ protothread, local variables do not survive an await: what must, goes in
+ the context. An await never completes in the cycle it is made in, since
+ the inputs of that cycle were taken before the command just sent.
+
+ Run(), once per cycle after the input snapshot, resumes only the tasks
+ whose condition may have become true:
+
+ 	- standstill / stopped: the tasks waiting on an axis whose bit changed
+ 	  in the standstill or in motion masks, found through per-axis sets,
+ 	- delay: all the delays, only when the earliest deadline is reached,
+ 	- torque above a level: every such task, the torque changes each cycle,
+ 	- any condition: the tasks that started waiting in the previous cycle.
+
+ A cycle where nothing changed costs a few word operations, however many
+ tasks wait. The tasks are in a fixed table, nothing is allocated.
+
+ All the methods are called from the cycle thread.
+============================================================================
+*/
+#ifndef MOTION_SEQUENCER_H_
+#define MOTION_SEQUENCER_H_
+
+#include <stdint.h>
+#include "motion_backend.h"
+#include "axis_table.h"				// AXIS_MASK
+#include "signal_cond.h"
+
+#define		SEQ_MAX_TASKS			256		// Tasks running at a time. A multiple of 32, 256 at most
+#define		SEQ_WORDS				(SEQ_MAX_TASKS / 32)
+#define		SEQ_MAX_AXES			32		// Bits of AXIS_MASK
+#define		SEQ_NO_TASK				-1
+//
+// Returned by a sequence function
+#define		SEQ_WAITING				0
+#define		SEQ_ENDED				1
+
+enum eSeqWait
+{
+	eSEQ_WAIT_NONE			= 0,			// Resumed by the next Run()
+	eSEQ_WAIT_STANDSTILL	= 1,			// All of ulAxes stand still
+	eSEQ_WAIT_STOPPED		= 2,			// None of ulAxes in motion
+	eSEQ_WAIT_DELAY			= 3,			// ullDelayNs elapsed
+	eSEQ_WAIT_TORQUE_ABOVE	= 4,			// Filtered torque of iAxis above fLevel
+} ;
+
+struct SEQ_TASK
+{
+	int				(*pfnBody)(SEQ_TASK& stTask) ;
+	void*			pContext ;
+	int				iResume ;				// Line of the await to resume at, 0 to start
+	int				iStep ;					// Reported, see SEQ_STEP()
+	int				iWait ;					// eSeqWait
+	AXIS_MASK		ulAxes ;				// eSEQ_WAIT_STANDSTILL and eSEQ_WAIT_STOPPED
+	int				iAxis ;					// eSEQ_WAIT_TORQUE_ABOVE
+	float			fLevel ;
+	uint64_t		ullDelayNs ;			// eSEQ_WAIT_DELAY, from the cycle of the await
+	uint64_t		ullDeadlineNs ;
+	uint32_t		ulGen ;					// Incremented when the slot is reused
+	uint32_t		ulResumes ;
+} ;
+/*
+============================================================================
+ Sequence macros. Only one await per line.
+============================================================================
+*/
+#define		SEQ_BEGIN(t)			switch ((t).iResume) { case 0:
+#define		SEQ_END(t)				} (t).iResume = 0 ; return SEQ_ENDED
+#define		SEQ_STEP(t, n)			((t).iStep = (n))
+#define		SEQ_YIELD(t)			do { (t).iResume = __LINE__ ; return SEQ_WAITING ; case __LINE__: ; } while (0)
+
+#define		SEQ_AWAIT_STANDSTILL(t, m)	do { (t).iWait = eSEQ_WAIT_STANDSTILL ; (t).ulAxes = (m) ; SEQ_YIELD(t) ; } while (0)
+#define		SEQ_AWAIT_STOPPED(t, m)		do { (t).iWait = eSEQ_WAIT_STOPPED ; (t).ulAxes = (m) ; SEQ_YIELD(t) ; } while (0)
+#define		SEQ_AWAIT_DELAY(t, ms)		do { (t).iWait = eSEQ_WAIT_DELAY ; (t).ullDelayNs = (uint64_t)(ms) * 1000000ULL ; SEQ_YIELD(t) ; } while (0)
+#define		SEQ_AWAIT_TORQUE_ABOVE(t, a, x)	do { (t).iWait = eSEQ_WAIT_TORQUE_ABOVE ; (t).iAxis = (a) ; (t).fLevel = (x) ; SEQ_YIELD(t) ; } while (0)
+
+typedef struct
+{
+	uint64_t			ullNowNs ;
+	AXIS_MASK			ulStandStill ;
+	AXIS_MASK			ulInMotion ;
+	const CSignalCond*	pcTorque ;			// Filtered torque, Nm
+} SEQ_INPUTS;
+
+class CMotionSequencer
+{
+public:
+	CMotionSequencer() ;
+
+	void Reset() ;
+	int  Start(int (*pfnBody)(SEQ_TASK& stTask), void* pContext) ;
+	void Kill(int iTask) ;
+	void Run(const SEQ_INPUTS& stIn) ;
+
+	bool Running(int iTask) const
+	{
+		const SEQ_TASK* pstTask = Task(iTask) ;
+
+		return pstTask != 0 ;
+	}
+	int  Step(int iTask) const
+	{
+		const SEQ_TASK* pstTask = Task(iTask) ;
+
+		return pstTask ? pstTask->iStep : 0 ;
+	}
+
+	int  Tasks() const						{ return m_iTasks ; }
+	unsigned long Started() const			{ return m_ulStarted ; }
+	unsigned long Resumes() const			{ return m_ulResumes ; }
+	unsigned long Tests() const				{ return m_ulTests ; }
+	unsigned long Full() const				{ return m_ulFull ; }
+
+private:
+	const SEQ_TASK* Task(int iTask) const
+	{
+		int iSlot = iTask % SEQ_MAX_TASKS ;
+
+		if (iTask < 0 || (m_ulUsed[iSlot / 32] & (1u << (iSlot % 32))) == 0 ||
+			(int)(m_stTask[iSlot].ulGen & 0x7FFFFF) != iTask / SEQ_MAX_TASKS)
+			return 0 ;
+		return &m_stTask[iSlot] ;
+	}
+	bool Satisfied(const SEQ_TASK& stTask, const SEQ_INPUTS& stIn) const ;
+	void Resume(int iSlot) ;
+	void File(int iSlot) ;
+	void Unfile(int iSlot) ;
+	void Free(int iSlot) ;
+
+	SEQ_TASK		m_stTask[SEQ_MAX_TASKS] ;
+	uint32_t		m_ulUsed[SEQ_WORDS] ;
+	uint32_t		m_ulFresh[SEQ_WORDS] ;					// Tested by the next Run() whatever changed
+	uint32_t		m_ulAxisWaiters[SEQ_MAX_AXES][SEQ_WORDS] ;	// Standstill and stopped waits, per axis
+	uint32_t		m_ulDelayWaiters[SEQ_WORDS] ;
+	uint32_t		m_ulTorqueWaiters[SEQ_WORDS] ;
+	uint64_t		m_ullNextDeadlineNs ;					// Earliest delay, ~0 if none
+	uint64_t		m_ullNowNs ;							// Of the Run() in progress
+	AXIS_MASK		m_ulPrevStandStill ;
+	AXIS_MASK		m_ulPrevInMotion ;
+	int				m_iTasks ;
+	unsigned long	m_ulStarted ;
+	unsigned long	m_ulResumes ;
+	unsigned long	m_ulTests ;								// Conditions tested
+	unsigned long	m_ulFull ;								// Start() with no free slot
+} ;
+
+#endif /* MOTION_SEQUENCER_H_ */
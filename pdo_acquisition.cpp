@@ -0,0 +1,182 @@
+/*
+============================================================================
+ Name : 	pdo_acquisition.cpp
+ Author :
+ Version :	1.00
+ Description : TPDO3 mapping and decoding of torque, current and position.
+============================================================================
+*/
+#include <string.h>
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include "pdo_acquisition.h"
+/*
+============================================================================
+ The downloads that map 0x6077, 0x6078 and 0x6064 into TPDO3, in order
+============================================================================
+*/
+static const struct
+{
+	unsigned char	ucLength ;
+	unsigned short	usIndex ;
+	unsigned char	ucSubIndex ;
+} gstMapWrite[PDO_MAP_WRITES] =
+{
+	{ 4, OD_TPDO3_COMM, 1 },			// Invalidate the PDO before changing its mapping
+	{ 1, OD_TPDO3_MAP, 0 },				// The new mapping: <index:16><sub-index:8><length in bits:8>
+	{ 4, OD_TPDO3_MAP, 1 },
+	{ 4, OD_TPDO3_MAP, 2 },
+	{ 4, OD_TPDO3_MAP, 3 },
+	{ 1, OD_TPDO3_MAP, 0 },
+	{ 1, OD_TPDO3_COMM, 2 },			// Transmit on every SYNC
+	{ 4, OD_TPDO3_COMM, 1 },			// and validate the PDO again
+} ;
+
+static long PdoMapData(const PDO_MAP_JOB& stJob, int iWrite)
+{
+	switch (iWrite)
+	{
+	case 0:		return (long)(stJob.ulCobId | PDO_COBID_INVALID) ;
+	case 2:		return (OD_TORQUE_ACTUAL   << 16) | 0x0010 ;
+	case 3:		return (OD_CURRENT_ACTUAL  << 16) | 0x0010 ;
+	case 4:		return (OD_POSITION_ACTUAL << 16) | 0x0020 ;
+	case 5:		return 3 ;
+	case 6:		return PDO_TRANS_SYNC_EVERY ;
+	case 7:		return (long)(stJob.ulCobId & ~PDO_COBID_INVALID) ;
+	default:	return 0 ;
+	}
+}
+
+static void PdoMapNext(const SDO_RESULT& stResult, void* pContext) ;
+/*
+============================================================================
+ Function:				PdoMapFailed()
+ Description:			Ends the sequence of a job on a failure: the original
+ 						COB-ID is written back, so the drive is not left with
+ 						its TPDO3 invalid, or valid over a partial mapping.
+============================================================================
+*/
+static void PdoMapFailed(PDO_MAP_JOB& stJob)
+{
+	int i ;
+
+	for (i = stJob.iNext ; i < PDO_MAP_WRITES ; i++)
+	{
+		stJob.stWrite[i].iState = eSDO_ERROR ;
+	}
+	stJob.iNext 	= PDO_MAP_WRITES ;
+	stJob.iState 	= eSDO_ERROR ;
+	stJob.pEngine->Download(stJob.iNode, (long)stJob.ulCobId, 4, OD_TPDO3_COMM, 1, &stJob.stRestore) ;
+}
+/*
+============================================================================
+ Function:				PdoMapQueue()
+ Description:			Queues the next download of a job, chained to the
+ 						completion of the previous one.
+============================================================================
+*/
+static void PdoMapQueue(PDO_MAP_JOB& stJob)
+{
+	int i = stJob.iNext++ ;
+
+	if (stJob.pEngine->Download(stJob.iNode, PdoMapData(stJob, i), gstMapWrite[i].ucLength, gstMapWrite[i].usIndex,
+								gstMapWrite[i].ucSubIndex, &stJob.stWrite[i], PdoMapNext, &stJob) != 0)
+	{
+		stJob.iNext = i ;
+		PdoMapFailed(stJob) ;
+	}
+}
+/*
+============================================================================
+ Function:				PdoMapNext()
+ Description:			SDO engine callback of every download of a job.
+============================================================================
+*/
+static void PdoMapNext(const SDO_RESULT& stResult, void* pContext)
+{
+	PDO_MAP_JOB& stJob = *(PDO_MAP_JOB*)pContext ;
+
+	if (stResult.iState != eSDO_DONE)
+		PdoMapFailed(stJob) ;
+	else if (stJob.iNext == PDO_MAP_WRITES)
+		stJob.iState = eSDO_DONE ;
+	else
+		PdoMapQueue(stJob) ;
+}
+/*
+============================================================================
+ Function:				PdoQueueTorqueCurrentPosition()
+ Input arguments:		cEngine - the SDO engine, run by the caller.
+ 						iNode - the node of the axis whose drive TPDO3 is mapped.
+ 						ulCobId - TPDO3 COB-ID, as read from the drive.
+ Output arguments: 		stJob - state of the mapping, eSDO_DONE in iState once
+ 						all the downloads completed. Must stay valid until
+ 						the engine is idle.
+ Returned value:		0 if the sequence was started, -1 if the queue of the
+ 						node has not room for all of it. Nothing is queued then.
+ Version:				Version 1.00
+
+ Description:
+
+ Starts the downloads that map 0x6077, 0x6078 and 0x6064 into the drive's
+ TPDO3 and set it to be transmitted on every SYNC. The PDO is invalidated
+ while the mapping is written, as required by CiA 301, and validated again
+ at the end. The downloads are chained, each one queued when the previous
+ one completed: the first failure stops the sequence and writes the
+ original COB-ID back. The sequences of the other drives run at the same
+ time. Must complete before ConfigPDO(PDO_NUM_3, ...) registers the PDO at
+ the GMAS.
+============================================================================
+*/
+int PdoQueueTorqueCurrentPosition(CSdoEngine& cEngine, int iNode, unsigned long ulCobId, PDO_MAP_JOB& stJob)
+{
+	memset(&stJob, 0, sizeof(stJob)) ;
+	stJob.pEngine 	= &cEngine ;
+	stJob.iNode 	= iNode ;
+	stJob.ulCobId 	= ulCobId ;
+	stJob.iState 	= eSDO_IDLE ;
+	//
+	// Room for the whole sequence, as a batch: transfers left over by a time-out
+	// may still be queued.
+	if (SDO_QUEUE_DEPTH - cEngine.Pending(iNode) < PDO_MAP_WRITES)
+		return -1 ;
+
+	stJob.iState = eSDO_PENDING ;
+	PdoMapQueue(stJob) ;
+	return (stJob.iState == eSDO_PENDING) ? 0 : -1 ;
+}
+/*
+============================================================================
+ Function:				PdoDecodeEvent()
+ Input arguments:		recvBuffer, recvBufferSize - the event frame as given to the callback.
+ Output arguments: 		usAxisRef - the axis the PDO was received from.
+ 						stSample - the decoded torque, current and position.
+ Returned value:		TRUE if the frame is long enough to hold our TPDO3, FALSE otherwise.
+ Version:				Version 1.00
+
+ Description:
+
+ Decodes a PDORCV_EVT frame, see pdo_acquisition.h. Only TPDO3 is
+ registered at the GMAS, so the PDO number is not looked for: the byte the
+ library gives there is the payload type. The CAN data is little endian
+ whatever the byte order of the controller, so it is assembled byte by byte.
+============================================================================
+*/
+int PdoDecodeEvent(const unsigned char* recvBuffer, short recvBufferSize, unsigned short& usAxisRef, PDO_SAMPLE& stSample)
+{
+	const unsigned char* ucpData ;
+
+	if (recvBufferSize < PDO_EVT_MIN_SIZE)
+		return 0 ;
+
+	memcpy(&usAxisRef, recvBuffer + PDO_EVT_AXIS_REF_OFFSET, sizeof(usAxisRef)) ;
+	ucpData = recvBuffer + PDO_EVT_DATA_OFFSET ;
+
+	stSample.sTorque 	= (int16_t)(ucpData[0] | (ucpData[1] << 8)) ;
+	stSample.sCurrent 	= (int16_t)(ucpData[2] | (ucpData[3] << 8)) ;
+	stSample.lPosition 	= (int32_t)((uint32_t)ucpData[4]
+						| ((uint32_t)ucpData[5] << 8)
+						| ((uint32_t)ucpData[6] << 16)
+						| ((uint32_t)ucpData[7] << 24)) ;
+	return 1 ;
+}
@@ -0,0 +1,104 @@
+/*
+============================================================================
+ Name : pdo_acquisition.h
+ Author  :
+ Version :
+ Description : 	PDO based acquisition of torque, current and position.
+
+ The drive's TPDO3 is re-mapped at start-up so that every SYNC it transmits:
+
+ 	Byte 0..1	- 0x6077 Torque actual value	(INTEGER16, per-mille of rated torque)
+ 	Byte 2..3	- 0x6078 Current actual value	(INTEGER16, per-mille of rated current)
+ 	Byte 4..7	- 0x6064 Position actual value	(INTEGER32, counts)
+
+ The GMAS forwards the received PDO to the application as a PDORCV_EVT, which
+ is decoded in the IPC callback and queued to the cycle through the callback
+ ring, so no SDO traffic is needed to follow the three objects.
+============================================================================
+*/
+#ifndef PDO_ACQUISITION_H_
+#define PDO_ACQUISITION_H_
+
+#include <stdint.h>
+#include "sdo_engine.h"
+/*
+============================================================================
+ Acquisition modes
+============================================================================
+*/
+#define		ACQ_MODE_SDO			0		// Poll 0x6077 by SDO upload from the background loop
+#define		ACQ_MODE_PDO			1		// Consume TPDO3, transmitted by the drive on every SYNC
+/*
+============================================================================
+ CANopen objects used by the TPDO3 mapping
+============================================================================
+*/
+#define		OD_TPDO3_COMM			0x1802	// TPDO3 communication parameters
+#define		OD_TPDO3_MAP			0x1A02	// TPDO3 mapping parameters
+#define		OD_TORQUE_ACTUAL		0x6077
+#define		OD_CURRENT_ACTUAL		0x6078
+#define		OD_POSITION_ACTUAL		0x6064
+#define		OD_MOTOR_RATED_CURRENT	0x6075	// mA, 1000 per-mille of OD_CURRENT_ACTUAL
+#define		OD_MOTOR_RATED_TORQUE	0x6076	// mNm, 1000 per-mille of OD_TORQUE_ACTUAL
+#define		OD_DC_LINK_VOLTAGE		0x6079	// mV, read by SDO only
+
+#define		PDO_COBID_INVALID		0x80000000	// Bit 31 of the COB-ID entry disables the PDO
+#define		PDO_TRANS_SYNC_EVERY	1			// Transmission type: synchronous, every SYNC
+#define		PDO3_DATA_LEN			8			// 16 + 16 + 32 bits
+#define		PDO_MAP_WRITES			8			// SDO downloads of PdoQueueTorqueCurrentPosition()
+/*
+============================================================================
+ Layout of a PDORCV_EVT frame as delivered to the IPC callback, as
+ CMMCConnection::CallbackFunc() of the library reads it before calling the
+ registered PDO callback (GOLD_D/MDS-TorqueRead.gexe links the library):
+
+ 	Byte 0..1	- event ID, native byte order
+ 	Byte 12..13	- axis reference, native byte order, the same in every event
+ 	Byte 14		- type of the payload, by which the library sizes it
+ 	Byte 15..	- the PDO data, up to 8 bytes, copied byte by byte
+
+ The library does not tell the byte order of the data: it is decoded as it
+ is on the bus, little endian, and ConfigureDrives() checks the position of
+ the first PDOs against 0x6064 read by SDO before it trusts them. Build with
+ -DPDO_EVT_LAYOUT_VERIFIED=0 to acquire by SDO on the GMAS all the same.
+============================================================================
+*/
+#ifndef PDO_EVT_LAYOUT_VERIFIED
+#define		PDO_EVT_LAYOUT_VERIFIED	1
+#endif
+#define		PDO_EVT_AXIS_REF_OFFSET	12		// unsigned short, native byte order
+#define		PDO_EVT_TYPE_OFFSET		14		// unsigned char, payload type
+#define		PDO_EVT_DATA_OFFSET		15		// raw CAN data, little endian
+#define		PDO_EVT_MIN_SIZE		(PDO_EVT_DATA_OFFSET + PDO3_DATA_LEN)
+#define		PDO_CHECK_COUNTS		100		// Largest difference between the TPDO3 and 0x6064 positions at start-up
+/*
+============================================================================
+ Data types
+============================================================================
+*/
+typedef struct
+{
+	int16_t		sTorque;			// 0x6077, per-mille of rated torque
+	int16_t		sCurrent;			// 0x6078, per-mille of rated current
+	int32_t		lPosition;			// 0x6064, counts
+} PDO_SAMPLE;
+
+typedef struct
+{
+	CSdoEngine*		pEngine;
+	int				iNode;
+	unsigned long	ulCobId;			// TPDO3 COB-ID as read from the drive, restored on a failure
+	int				iNext;				// Next download of the sequence
+	volatile int	iState;				// eSdoState of the whole mapping
+	SDO_RESULT		stWrite[PDO_MAP_WRITES];
+	SDO_RESULT		stRestore;			// Download of ulCobId after a failure
+} PDO_MAP_JOB;						// See PdoQueueTorqueCurrentPosition()
+/*
+============================================================================
+ Functions prototypes
+============================================================================
+*/
+int  PdoQueueTorqueCurrentPosition(CSdoEngine& cEngine, int iNode, unsigned long ulCobId, PDO_MAP_JOB& stJob);
+int  PdoDecodeEvent(const unsigned char* recvBuffer, short recvBufferSize, unsigned short& usAxisRef, PDO_SAMPLE& stSample);
+
+#endif /* PDO_ACQUISITION_H_ */
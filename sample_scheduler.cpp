@@ -0,0 +1,266 @@
+/*
+============================================================================
+ Name : 	sample_scheduler.cpp
+ Author :
+ Version :	1.00
+ Description : Rate monotonic scheduling of the SDO reads, see sample_scheduler.h
+============================================================================
+*/
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include "motion_backend.h"
+#include "mono_time.h"
+#include "sample_scheduler.h"
+/*
+============================================================================
+ Function:				CSampleScheduler()
+ Description:			Constructor. Nothing is scheduled until Configure().
+============================================================================
+*/
+CSampleScheduler::CSampleScheduler()
+{
+	m_pstSignals 	= 0 ;
+	m_iSignals 		= 0 ;
+	m_iScheduled 	= 0 ;
+	m_iAxes 		= 0 ;
+	m_iFirstAxis 	= 0 ;
+	m_iBudget 		= 0 ;
+	m_bPdo 			= false ;
+	m_ullTickNs 	= 0 ;
+	m_ulMoving 		= 0 ;
+	m_pfnSample 	= 0 ;
+	memset(m_iOrder, 0, sizeof(m_iOrder)) ;
+	memset(m_iNode, 0, sizeof(m_iNode)) ;
+	memset(&m_stStats, 0, sizeof(m_stStats)) ;
+	memset(m_stSlot, 0, sizeof(m_stSlot)) ;
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		pstSignals, iSignals - the signals. The table must stay
+ 						valid while the scheduler runs.
+ 						iAxes, piNodes - the axes, and their node in the SDO engine.
+ 						bPdo - ACQ_MODE_PDO: the SAMPLE_TPDO3 signals are not read.
+ 						ulTickUs - period of Run().
+ 						iBudget - reads queued per tick at most, all axes.
+ 						pfnSample - called with every value read.
+ Output arguments: 		None.
+ Returned value:		0, -1 if there are too many signals or axes.
+ Version:				Version 1.00
+
+ Description:
+
+ Sorts the signals read by SDO by priority, and makes all of them due at the
+ first Run(). Clears the statistics. No read may be in flight.
+============================================================================
+*/
+int CSampleScheduler::Configure(const SAMPLE_SIGNAL_DEF* pstSignals, int iSignals, int iAxes, const int* piNodes,
+								bool bPdo, unsigned long ulTickUs, int iBudget, SAMPLE_CLBK pfnSample)
+{
+	int i, j, s ;
+
+	if (iSignals < 0 || iSignals > SAMPLE_MAX_SIGNALS || iAxes < 0 || iAxes > SAMPLE_MAX_AXES)
+		return -1 ;
+
+	*this = CSampleScheduler() ;
+	m_pstSignals 	= pstSignals ;
+	m_iSignals 		= iSignals ;
+	m_iAxes 		= iAxes ;
+	m_iBudget 		= (iBudget > 0) ? iBudget : 1 ;
+	m_bPdo 			= bPdo ;
+	m_ullTickNs 	= (uint64_t)ulTickUs * NSEC_PER_USEC ;
+	m_pfnSample 	= pfnSample ;
+	for (i = 0 ; i < iAxes ; i++)
+	{
+		m_iNode[i] = piNodes[i] ;
+	}
+	//
+	// Insertion sort, the signals of the same priority keep the table order
+	for (s = 0 ; s < iSignals ; s++)
+	{
+		if (!Scheduled(s))
+			continue ;
+		for (j = m_iScheduled ; j > 0 && pstSignals[m_iOrder[j - 1]].iPriority > pstSignals[s].iPriority ; j--)
+		{
+			m_iOrder[j] = m_iOrder[j - 1] ;
+		}
+		m_iOrder[j] = s ;
+		m_iScheduled++ ;
+	}
+	for (s = 0 ; s < iSignals ; s++)
+	{
+		for (i = 0 ; i < iAxes ; i++)
+		{
+			m_stSlot[s][i].pOwner 	= this ;
+			m_stSlot[s][i].iAxis 	= i ;
+			m_stSlot[s][i].iSignal 	= s ;
+		}
+	}
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Run()
+ Input arguments:		cEngine - the SDO engine the reads are queued to.
+ 						ullNowNs - time of this tick, its deadline rather than
+ 						the wake-up time, so the reads stay on the tick grid.
+ 						ulMoving - the axes in motion.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Queues the reads that are due, highest priority signal first, until the
+ budget of the tick is spent. A read is due again one period after it was
+ due, not after it was queued, so a deferred read does not shift the ones
+ that follow; after a stall the signal restarts from now rather than
+ catching up in a burst.
+============================================================================
+*/
+void CSampleScheduler::Run(CSdoEngine& cEngine, uint64_t ullNowNs, AXIS_MASK ulMoving)
+{
+	AXIS_MASK ulStarted = ulMoving & ~m_ulMoving ;
+	int iBudget = m_iBudget ;
+	int k, n, i ;
+
+	m_stStats.ulTicks++ ;
+	m_ulMoving = ulMoving ;
+
+	for (k = 0 ; k < m_iScheduled ; k++)
+	{
+		int iSignal = m_iOrder[k] ;
+		const SAMPLE_SIGNAL_DEF& stSig = m_pstSignals[iSignal] ;
+
+		for (n = 0 ; n < m_iAxes ; n++)
+		{
+			i = (m_iFirstAxis + n) % m_iAxes ;
+
+			SLOT& stSlot = m_stSlot[iSignal][i] ;
+			uint64_t ullPeriodNs ;
+
+			if ((ulStarted & AXIS_BIT(i)) && stSlot.ullDueNs > ullNowNs)
+				stSlot.ullDueNs = ullNowNs ;
+			if (stSlot.ullDueNs > ullNowNs)
+				continue ;
+			if (stSlot.iBusy)
+			{
+				m_stStats.ulOverlapped++ ;
+				continue ;
+			}
+			if (iBudget == 0 || cEngine.Pending(m_iNode[i]) >= SDO_QUEUE_DEPTH ||
+				cEngine.Upload(m_iNode[i], stSig.ucLength, stSig.usIndex, stSig.ucSubIndex,
+							   &stSlot.stResult, OnRead, &stSlot) != 0)
+			{
+				m_stStats.ulDeferred++ ;
+				continue ;
+			}
+			stSlot.iBusy = 1 ;
+			iBudget-- ;
+			m_stStats.ulQueued++ ;
+
+			ullPeriodNs = PeriodNs(iSignal, (ulMoving & AXIS_BIT(i)) != 0) ;
+			stSlot.ullDueNs += ullPeriodNs ;
+			if (stSlot.ullDueNs <= ullNowNs)
+				stSlot.ullDueNs = ullNowNs + ullPeriodNs ;
+		}
+	}
+	if (m_iAxes)
+		m_iFirstAxis = (m_iFirstAxis + 1) % m_iAxes ;
+}
+/*
+============================================================================
+ Function:				OnRead()
+ Description:			SDO engine callback of every read. Hands the value,
+ 						sign extended, to the SAMPLE_CLBK.
+============================================================================
+*/
+void CSampleScheduler::OnRead(const SDO_RESULT& stResult, void* pContext)
+{
+	SLOT* pSlot = (SLOT*)pContext ;
+	CSampleScheduler* pOwner = pSlot->pOwner ;
+	const SAMPLE_SIGNAL_DEF& stSig = pOwner->m_pstSignals[pSlot->iSignal] ;
+	long lValue = stResult.lData ;
+
+	pSlot->iBusy = 0 ;
+	if (stResult.iState != eSDO_DONE)
+	{
+		pOwner->m_stStats.ulFailed++ ;
+		return ;
+	}
+	if (stSig.ucSigned)
+	{
+		switch (stSig.ucLength)
+		{
+		case 1:	lValue = (long)(int8_t)lValue ;		break ;
+		case 2:	lValue = (long)(int16_t)lValue ;	break ;
+		case 4:	lValue = (long)(int32_t)lValue ;	break ;
+		}
+	}
+	pOwner->m_stStats.ulSamples[pSlot->iSignal]++ ;
+	if (pOwner->m_pfnSample)
+		pOwner->m_pfnSample(pSlot->iAxis, pSlot->iSignal, lValue,
+							(uint32_t)(stResult.ullLatencyNs / NSEC_PER_USEC)) ;
+}
+/*
+============================================================================
+ Function:				PeriodNs()
+ Returned value:		The read period of a signal, one tick at least.
+============================================================================
+*/
+uint64_t CSampleScheduler::PeriodNs(int iSignal, bool bMoving) const
+{
+	const SAMPLE_SIGNAL_DEF& stSig = m_pstSignals[iSignal] ;
+	uint64_t ullPeriodNs = (uint64_t)(bMoving ? stSig.ulMovingMs : stSig.ulStillMs) * NSEC_PER_MSEC ;
+
+	return (ullPeriodNs > m_ullTickNs) ? ullPeriodNs : m_ullTickNs ;
+}
+/*
+============================================================================
+ Function:				Scheduled()
+ Returned value:		true if the signal is read by SDO.
+============================================================================
+*/
+bool CSampleScheduler::Scheduled(int iSignal) const
+{
+	if (iSignal < 0 || iSignal >= m_iSignals)
+		return false ;
+	return !(m_bPdo && m_pstSignals[iSignal].iTransport == SAMPLE_TPDO3) ;
+}
+/*
+============================================================================
+ Function:				RateHz()
+ Input arguments:		iSignal - index in the table of Configure().
+ 						bMoving - rate while the axis moves, else at standstill.
+ Returned value:		Reads per second of one axis when the bus keeps up,
+ 						0 if the signal is not read by SDO.
+============================================================================
+*/
+double CSampleScheduler::RateHz(int iSignal, bool bMoving) const
+{
+	if (!Scheduled(iSignal) || m_ullTickNs == 0)
+		return 0.0 ;
+	return 1e9 / (double)PeriodNs(iSignal, bMoving) ;
+}
+/*
+============================================================================
+ Function:				PrintStats()
+ Description:			Prints the scheduler counters to stdout.
+============================================================================
+*/
+void CSampleScheduler::PrintStats() const
+{
+	int s ;
+
+	printf("Sampling: %lu ticks, %lu reads, %lu deferred, %lu overlapped, %lu failed, %d per tick\n",
+		   m_stStats.ulTicks, m_stStats.ulQueued, m_stStats.ulDeferred, m_stStats.ulOverlapped,
+		   m_stStats.ulFailed, m_iBudget) ;
+	for (s = 0 ; s < m_iSignals ; s++)
+	{
+		if (Scheduled(s))
+			printf("    %-10s %lu reads, %.1f Hz moving, %.1f Hz still\n", m_pstSignals[s].cpName,
+				   m_stStats.ulSamples[s], RateHz(s, true), RateHz(s, false)) ;
+		else
+			printf("    %-10s in TPDO3\n", m_pstSignals[s].cpName) ;
+	}
+}
@@ -0,0 +1,124 @@
+/*
+============================================================================
+ Name : sample_scheduler.h
+ Author  :
+ Version :
+ Description : 	Rate monotonic scheduling of the SDO reads of the drives.
+
+ Every signal read from the drives is declared once, in a table of
+ SAMPLE_SIGNAL_DEF: its object, its priority, its transport, and the period
+ it is read at while its axis moves and while it stands still. The
+ scheduler keeps, for every axis and signal, the time the next read is due.
+
+ Run() is called once per tick of the acquisition thread. It walks the
+ signals by priority, highest first, and queues the reads that are due to
+ the SDO engine, up to the bus budget of the tick. What does not fit waits
+ for the next tick, where it is still due: a busy bus delays the low
+ priority signals, not the torque. Within a signal, the axis served first
+ rotates from tick to tick, so no axis always comes last.
+
+ The motion mask given to Run() selects the period. An axis that starts
+ moving gets its signals read at once, at the moving period, and goes back
+ to the standstill period after its next read once it stopped: the bus
+ bandwidth goes to the axes whose data changes.
+
+ A signal of SAMPLE_TPDO3 is carried by TPDO3 in ACQ_MODE_PDO and is not
+ read by SDO then; in ACQ_MODE_SDO it is scheduled like the others. A period
+ shorter than the tick is read every tick.
+
+ A signal is not read again while its previous read is in flight. The
+ completed reads are handed to the SAMPLE_CLBK of Configure(), on the thread
+ that calls OnReply() / Poll() of the engine.
+
+ Configure() is called before the acquisition thread starts. Run(), and the
+ engine, are then called from that thread only. RateHz() may be called from
+ any thread.
+
+ Must be included after mmc_definitions.h and motion_backend.h, see
+ axis_table.h.
+============================================================================
+*/
+#ifndef SAMPLE_SCHEDULER_H_
+#define SAMPLE_SCHEDULER_H_
+
+#include <stdint.h>
+#include "sdo_engine.h"
+#include "axis_table.h"
+
+#define		SAMPLE_MAX_SIGNALS		8
+#define		SAMPLE_MAX_AXES			SDO_MAX_NODES
+//
+// Transports, see SAMPLE_SIGNAL_DEF
+#define		SAMPLE_SDO				0		// Read by SDO upload
+#define		SAMPLE_TPDO3			1		// In TPDO3 in ACQ_MODE_PDO, read by SDO otherwise
+
+typedef struct
+{
+	const char*		cpName;					// For the statistics
+	unsigned short	usIndex;
+	unsigned char	ucSubIndex;
+	unsigned char	ucLength;				// 1, 2 or 4 bytes
+	unsigned char	ucSigned;				// Sign extend the uploaded value
+	int				iPriority;				// 0 is the highest
+	int				iTransport;				// SAMPLE_SDO or SAMPLE_TPDO3
+	unsigned long	ulMovingMs;				// Read period while the axis moves
+	unsigned long	ulStillMs;				// Read period at standstill
+} SAMPLE_SIGNAL_DEF;
+
+typedef void (*SAMPLE_CLBK)(int iAxis, int iSignal, long lValue, uint32_t ulLatencyUs);
+
+typedef struct
+{
+	unsigned long	ulTicks;				// Calls to Run()
+	unsigned long	ulQueued;				// Reads queued to the engine
+	unsigned long	ulDeferred;				// Due, left for a next tick: budget or node queue full
+	unsigned long	ulOverlapped;			// Due while the previous read was still in flight
+	unsigned long	ulFailed;				// Reads timed out or rejected
+	unsigned long	ulSamples[SAMPLE_MAX_SIGNALS];	// Reads completed, per signal
+} SAMPLE_STATS;
+
+class CSampleScheduler
+{
+public:
+	CSampleScheduler() ;
+
+	int  Configure(const SAMPLE_SIGNAL_DEF* pstSignals, int iSignals, int iAxes, const int* piNodes,
+				   bool bPdo, unsigned long ulTickUs, int iBudget, SAMPLE_CLBK pfnSample) ;
+	void Run(CSdoEngine& cEngine, uint64_t ullNowNs, AXIS_MASK ulMoving) ;
+
+	bool   Scheduled(int iSignal) const ;
+	double RateHz(int iSignal, bool bMoving) const ;
+	void   GetStats(SAMPLE_STATS& stStats) const	{ stStats = m_stStats ; }
+	void   PrintStats() const ;
+
+private:
+	typedef struct
+	{
+		CSampleScheduler*	pOwner;
+		int					iAxis;
+		int					iSignal;
+		int					iBusy;				// Read in flight
+		uint64_t			ullDueNs;
+		SDO_RESULT			stResult;
+	} SLOT;
+
+	static void OnRead(const SDO_RESULT& stResult, void* pContext) ;
+	uint64_t PeriodNs(int iSignal, bool bMoving) const ;
+
+	const SAMPLE_SIGNAL_DEF*	m_pstSignals ;
+	int				m_iSignals ;
+	int				m_iOrder[SAMPLE_MAX_SIGNALS] ;		// Signals read by SDO, by priority
+	int				m_iScheduled ;
+	int				m_iAxes ;
+	int				m_iNode[SAMPLE_MAX_AXES] ;
+	int				m_iFirstAxis ;						// Served first in this tick
+	int				m_iBudget ;							// Reads queued per tick
+	bool			m_bPdo ;							// ACQ_MODE_PDO: SAMPLE_TPDO3 signals not read
+	uint64_t		m_ullTickNs ;
+	AXIS_MASK		m_ulMoving ;						// Of the previous Run()
+	SAMPLE_CLBK		m_pfnSample ;
+	SAMPLE_STATS	m_stStats ;
+	SLOT			m_stSlot[SAMPLE_MAX_SIGNALS][SAMPLE_MAX_AXES] ;
+} ;
+
+#endif /* SAMPLE_SCHEDULER_H_ */
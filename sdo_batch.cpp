@@ -0,0 +1,174 @@
+/*
+============================================================================
+ Name : 	sdo_batch.cpp
+ Author :
+ Version :	1.00
+ Description : Multi-object SDO reads, see sdo_batch.h
+============================================================================
+*/
+#include <string.h>
+#include "mono_time.h"
+#include "pdo_acquisition.h"
+#include "sdo_batch.h"
+/*
+============================================================================
+ Objects read by CDriveDiagRead, in the order of DRIVE_DIAG
+============================================================================
+*/
+enum eDriveDiagEntry
+{
+	eDIAG_TORQUE	= 0,
+	eDIAG_CURRENT	= 1,
+	eDIAG_POSITION	= 2,
+	eDIAG_COUNT		= 3,
+};
+
+static const SDO_OD_ENTRY gstDriveDiagEntries[eDIAG_COUNT] =
+{
+	{ OD_TORQUE_ACTUAL,		0, 2, 1 },		// INTEGER16
+	{ OD_CURRENT_ACTUAL,	0, 2, 1 },		// INTEGER16
+	{ OD_POSITION_ACTUAL,	0, 4, 1 },		// INTEGER32
+};
+/*
+============================================================================
+ Function:				CSdoBatchRead()
+ Description:			Constructor.
+============================================================================
+*/
+CSdoBatchRead::CSdoBatchRead()
+{
+	m_pEntries 		= 0 ;
+	m_iCount 		= 0 ;
+	m_iPending 		= 0 ;
+	m_iFailed 		= 0 ;
+	m_ullStartNs 	= 0 ;
+	m_ullEndNs 		= 0 ;
+	m_pfnDone 		= 0 ;
+	m_pContext 		= 0 ;
+	memset(m_stResult, 0, sizeof(m_stResult)) ;
+}
+/*
+============================================================================
+ Function:				Start()
+ Input arguments:		cEngine, iNode - the SDO engine and the node to read from.
+ 						pEntries, iCount - the objects to read. The table must stay
+ 						valid until the batch completes.
+ 						pfnDone, pContext - called once, when the last entry completed.
+ Output arguments: 		None.
+ Returned value:		0 if all the entries were queued, -1 otherwise (batch busy,
+ 						too many entries, or no room in the node queue).
+ Version:				Version 1.00
+
+ Description:
+
+ Queues all the uploads of the batch together; the engine sends them in
+ turn. The batch is queued entirely or not at all.
+============================================================================
+*/
+int CSdoBatchRead::Start(CSdoEngine& cEngine, int iNode, const SDO_OD_ENTRY* pEntries, int iCount,
+						 SDO_BATCH_CLBK pfnDone, void* pContext)
+{
+	int i ;
+
+	if (m_iPending || iCount <= 0 || iCount > SDO_BATCH_MAX)
+		return -1 ;
+	if (SDO_QUEUE_DEPTH - cEngine.Pending(iNode) < iCount)
+		return -1 ;
+
+	m_pEntries 		= pEntries ;
+	m_iCount 		= iCount ;
+	m_iPending 		= iCount ;
+	m_iFailed 		= 0 ;
+	m_pfnDone 		= pfnDone ;
+	m_pContext 		= pContext ;
+	m_ullStartNs 	= MonoTimeNs() ;
+	m_ullEndNs 		= m_ullStartNs ;
+
+	for (i = 0 ; i < iCount ; i++)
+	{
+		if (cEngine.Upload(iNode, pEntries[i].ucLength, pEntries[i].usIndex, pEntries[i].ucSubIndex,
+						   &m_stResult[i], OnEntryDone, this) != 0)
+		{
+			//
+			// Only an unknown node gets here, the room was checked above.
+			m_stResult[i].iState = eSDO_ERROR ;
+			m_iFailed++ ;
+			m_iPending-- ;
+		}
+	}
+	return (m_iPending == iCount) ? 0 : -1 ;
+}
+/*
+============================================================================
+ Function:				OnEntryDone()
+ Description:			SDO engine callback of each entry of the batch.
+============================================================================
+*/
+void CSdoBatchRead::OnEntryDone(const SDO_RESULT& stResult, void* pContext)
+{
+	CSdoBatchRead* pBatch = (CSdoBatchRead*)pContext ;
+
+	if (stResult.iState != eSDO_DONE)
+		pBatch->m_iFailed++ ;
+
+	if (--pBatch->m_iPending == 0)
+	{
+		pBatch->m_ullEndNs = MonoTimeNs() ;
+		if (pBatch->m_pfnDone)
+			pBatch->m_pfnDone(*pBatch, pBatch->m_pContext) ;
+	}
+}
+/*
+============================================================================
+ Function:				Value()
+ Input arguments:		i - entry index.
+ Returned value:		The uploaded value, sign extended according to the entry.
+============================================================================
+*/
+long CSdoBatchRead::Value(int i) const
+{
+	long lData = m_stResult[i].lData ;
+
+	if (m_pEntries[i].ucSigned)
+	{
+		switch (m_pEntries[i].ucLength)
+		{
+		case 1:	return (long)(int8_t)lData ;
+		case 2:	return (long)(int16_t)lData ;
+		}
+	}
+	return lData ;
+}
+/*
+============================================================================
+ Function:				CDriveDiagRead::Start()
+ Description:			Starts reading torque, current and position of a node.
+============================================================================
+*/
+int CDriveDiagRead::Start(CSdoEngine& cEngine, int iNode, SDO_BATCH_CLBK pfnDone, void* pContext)
+{
+	return m_cBatch.Start(cEngine, iNode, gstDriveDiagEntries, eDIAG_COUNT, pfnDone, pContext) ;
+}
+/*
+============================================================================
+ Function:				CDriveDiagRead::Get()
+ Output arguments: 		stDiag - the diagnostics read by the last batch.
+ Returned value:		TRUE if the batch completed and all the entries were read.
+============================================================================
+*/
+int CDriveDiagRead::Get(DRIVE_DIAG& stDiag) const
+{
+	return Get(m_cBatch, stDiag) ;
+}
+
+int CDriveDiagRead::Get(const CSdoBatchRead& cBatch, DRIVE_DIAG& stDiag)
+{
+	if (!cBatch.Ok())
+		return 0 ;
+
+	stDiag.sTorque 		= (int16_t)cBatch.Value(eDIAG_TORQUE) ;
+	stDiag.sCurrent 	= (int16_t)cBatch.Value(eDIAG_CURRENT) ;
+	stDiag.lPosition 	= (int32_t)cBatch.Value(eDIAG_POSITION) ;
+	stDiag.ulLatencyUs 	= (uint32_t)(cBatch.LatencyNs() / NSEC_PER_USEC) ;
+	return 1 ;
+}
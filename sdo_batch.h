@@ -0,0 +1,92 @@
+/*
+============================================================================
+ Name : sdo_batch.h
+ Author  :
+ Version :
+ Description : 	Multi-object SDO reads.
+
+ A batch is a list of object dictionary entries of one axis. All the uploads
+ are queued to the SDO engine at once, entirely or not at all, and complete
+ with one callback and typed values. It is a convenience wrapper, not a
+ faster transfer: the drive serves one SDO at a time (CiA 301), so the engine
+ sends them one after the other, see SDO_MAX_IN_FLIGHT, and N entries cost
+ N request/confirm round trips. A segmented or block transfer moves one
+ object only, there is no multi-object upload in CANopen: values needed
+ often belong in TPDO3, see pdo_acquisition.h.
+
+ CDriveDiagRead is the typed batch used for the drive diagnostics:
+ torque actual (0x6077), current actual (0x6078) and position actual (0x6064).
+============================================================================
+*/
+#ifndef SDO_BATCH_H_
+#define SDO_BATCH_H_
+
+#include <stdint.h>
+#include "sdo_engine.h"
+
+#define		SDO_BATCH_MAX			SDO_QUEUE_DEPTH		// Entries in one batch
+
+typedef struct
+{
+	unsigned short	usIndex;
+	unsigned char	ucSubIndex;
+	unsigned char	ucLength;				// 1, 2 or 4 bytes
+	unsigned char	ucSigned;				// Sign extend the uploaded value
+} SDO_OD_ENTRY;
+
+class CSdoBatchRead ;
+typedef void (*SDO_BATCH_CLBK)(const CSdoBatchRead& cBatch, void* pContext);
+
+class CSdoBatchRead
+{
+public:
+	CSdoBatchRead() ;
+
+	int  Start(CSdoEngine& cEngine, int iNode, const SDO_OD_ENTRY* pEntries, int iCount,
+			   SDO_BATCH_CLBK pfnDone = 0, void* pContext = 0) ;
+	int  Busy() const		{ return m_iPending != 0 ; }
+	int  Ok() const			{ return m_iCount != 0 && m_iPending == 0 && m_iFailed == 0 ; }
+	long Value(int i) const ;
+	int  State(int i) const	{ return m_stResult[i].iState ; }
+	uint64_t LatencyNs() const	{ return m_ullEndNs - m_ullStartNs ; }
+
+private:
+	static void OnEntryDone(const SDO_RESULT& stResult, void* pContext) ;
+
+	const SDO_OD_ENTRY*	m_pEntries ;
+	int					m_iCount ;
+	int					m_iPending ;
+	int					m_iFailed ;
+	uint64_t			m_ullStartNs ;
+	uint64_t			m_ullEndNs ;
+	SDO_BATCH_CLBK		m_pfnDone ;
+	void*				m_pContext ;
+	SDO_RESULT			m_stResult[SDO_BATCH_MAX] ;
+} ;
+/*
+============================================================================
+ Drive diagnostics
+============================================================================
+*/
+typedef struct
+{
+	int16_t		sTorque;				// 0x6077, per-mille of rated torque
+	int16_t		sCurrent;				// 0x6078, per-mille of rated current
+	int32_t		lPosition;				// 0x6064, counts
+	uint32_t	ulLatencyUs;			// From the first request to the last reply: the 3 round trips
+} DRIVE_DIAG;
+
+class CDriveDiagRead
+{
+public:
+	int  Start(CSdoEngine& cEngine, int iNode, SDO_BATCH_CLBK pfnDone = 0, void* pContext = 0) ;
+	int  Busy() const		{ return m_cBatch.Busy() ; }
+	int  Get(DRIVE_DIAG& stDiag) const ;
+
+	static int Get(const CSdoBatchRead& cBatch, DRIVE_DIAG& stDiag) ;
+
+private:
+	CSdoBatchRead	m_cBatch ;
+} ;
+
+#endif /* SDO_BATCH_H_ */
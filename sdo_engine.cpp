@@ -0,0 +1,385 @@
+/*
+============================================================================
+ Name : 	sdo_engine.cpp
+ Author :
+ Version :	1.00
+ Description : Pipelined asynchronous SDO engine, see sdo_engine.h
+============================================================================
+*/
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include "motion_backend.h"
+#include "mono_time.h"
+#include "sdo_engine.h"
+/*
+============================================================================
+ Function:				CSdoEngine()
+ Description:			Constructor.
+============================================================================
+*/
+CSdoEngine::CSdoEngine()
+{
+	m_iNodes = 0 ;
+	m_iSynchronous = 0 ;
+	memset(m_stNode, 0, sizeof(m_stNode)) ;
+	memset(&m_stStats, 0, sizeof(m_stStats)) ;
+}
+/*
+============================================================================
+ Function:				AddNode()
+ Input arguments:		pAxis - the axis used to send the SDOs.
+ 						usAxisRef - its GMAS axis reference, as found in the events.
+ Output arguments: 		None.
+ Returned value:		The node index to use with Upload() / Download(), -1 if full.
+ Version:				Version 1.00
+============================================================================
+*/
+int CSdoEngine::AddNode(CAxisBackend* pAxis, unsigned short usAxisRef)
+{
+	if (m_iNodes >= SDO_MAX_NODES)
+		return -1 ;
+
+	m_stNode[m_iNodes].pAxis 		= pAxis ;
+	m_stNode[m_iNodes].usAxisRef 	= usAxisRef ;
+	return m_iNodes++ ;
+}
+/*
+============================================================================
+ Function:				Upload()
+ Input arguments:		iNode - as returned by AddNode().
+ 						ucLength, usIndex, ucSubIndex - the object to read.
+ 						pResult - the caller's future, may be NULL.
+ 						pfnDone, pContext - completion callback, may be NULL.
+ Output arguments: 		None.
+ Returned value:		0 if queued, -1 if the node queue is full.
+ Version:				Version 1.00
+
+ Description:
+
+ Queues an upload. It is sent from Poll(), as soon as the node has no
+ transfer in flight. *pResult must stay valid until the request completes.
+============================================================================
+*/
+int CSdoEngine::Upload(int iNode, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex,
+					   SDO_RESULT* pResult, SDO_DONE_CLBK pfnDone, void* pContext)
+{
+	SDO_REQUEST stReq ;
+
+	memset(&stReq, 0, sizeof(stReq)) ;
+	stReq.ucUpload 		= 1 ;
+	stReq.ucLength 		= ucLength ;
+	stReq.usIndex 		= usIndex ;
+	stReq.ucSubIndex 	= ucSubIndex ;
+	stReq.pResult 		= pResult ;
+	stReq.pfnDone 		= pfnDone ;
+	stReq.pContext 		= pContext ;
+	return Queue(iNode, stReq) ;
+}
+/*
+============================================================================
+ Function:				Download()
+ Description:			Same as Upload(), for writing lData to the object.
+============================================================================
+*/
+int CSdoEngine::Download(int iNode, long lData, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex,
+						 SDO_RESULT* pResult, SDO_DONE_CLBK pfnDone, void* pContext)
+{
+	SDO_REQUEST stReq ;
+
+	memset(&stReq, 0, sizeof(stReq)) ;
+	stReq.ucUpload 		= 0 ;
+	stReq.ucLength 		= ucLength ;
+	stReq.usIndex 		= usIndex ;
+	stReq.ucSubIndex 	= ucSubIndex ;
+	stReq.lData 		= lData ;
+	stReq.pResult 		= pResult ;
+	stReq.pfnDone 		= pfnDone ;
+	stReq.pContext 		= pContext ;
+	return Queue(iNode, stReq) ;
+}
+/*
+============================================================================
+ Function:				Queue()
+ Description:			Appends a request to the node queue.
+============================================================================
+*/
+int CSdoEngine::Queue(int iNode, const SDO_REQUEST& stReq)
+{
+	SDO_NODE* pNode ;
+
+	if (iNode < 0 || iNode >= m_iNodes)
+		return -1 ;
+
+	pNode = &m_stNode[iNode] ;
+	if (pNode->ulHead - pNode->ulTail >= SDO_QUEUE_DEPTH)
+	{
+		m_stStats.ulRejected++ ;
+		return -1 ;
+	}
+	if (stReq.pResult)
+		stReq.pResult->iState = eSDO_PENDING ;
+
+	pNode->stQueue[pNode->ulHead % SDO_QUEUE_DEPTH] = stReq ;
+	pNode->ulHead++ ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				OnReply()
+ Input arguments:		usAxisRef - axis reference found in the ASYNC_REPLY_EVT.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Called on the acquisition thread for each ASYNC_REPLY_EVT taken from
+ gAcqRing. Completes the oldest request in flight of the node with the reply
+ retrieved from the library: the uploaded value, or for a download whether
+ the drive accepted it. A failed transfer completes as eSDO_ERROR, with the
+ error or SDO abort code in lData when the library gives one.
+============================================================================
+*/
+void CSdoEngine::OnReply(unsigned short usAxisRef)
+{
+	SDO_NODE* pNode = 0 ;
+	SDO_REQUEST* pReq ;
+	long lData = 0 ;
+	int iState = eSDO_DONE ;
+	int iAbort ;
+	int i ;
+
+	for (i = 0 ; i < m_iNodes ; i++)
+	{
+		if (m_stNode[i].usAxisRef == usAxisRef)
+		{
+			pNode = &m_stNode[i] ;
+			break ;
+		}
+	}
+	if (pNode)
+		CompleteFailed(*pNode, MonoTimeNs()) ;
+	if (pNode == 0 || pNode->ulSent == pNode->ulTail)
+	{
+		m_stStats.ulStrayReplies++ ;
+		return ;
+	}
+
+	pReq = &pNode->stQueue[pNode->ulTail % SDO_QUEUE_DEPTH] ;
+	try
+	{
+		if (pReq->ucUpload)
+		{
+			iAbort = pNode->pAxis->RetreiveSdoUploadAsync(lData) ;
+		}
+		else
+		{
+			iAbort = pNode->pAxis->RetreiveSdoDownloadAsync() ;
+			lData = pReq->lData ;
+		}
+		if (iAbort != 0)
+		{
+			iState = eSDO_ERROR ;
+			lData = iAbort ;
+		}
+	}
+	catch (CMMCException& exception)
+	{
+		iState = eSDO_ERROR ;
+		lData = exception.error() ;
+	}
+	Complete(*pNode, iState, lData, MonoTimeNs()) ;
+	//
+	// Send the next request of the node.
+	SendQueued(*pNode, MonoTimeNs()) ;
+	return ;
+}
+/*
+============================================================================
+ Function:				Poll()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Called once per cycle. Times out requests whose reply did not arrive and
+ sends the queued requests of every node that has room in flight.
+============================================================================
+*/
+void CSdoEngine::Poll()
+{
+	uint64_t ullNow = MonoTimeNs() ;
+	int i ;
+
+	for (i = 0 ; i < m_iNodes ; i++)
+	{
+		SDO_NODE& stNode = m_stNode[i] ;
+
+		if (stNode.ulSent != stNode.ulTail
+			&& ullNow - stNode.stQueue[stNode.ulTail % SDO_QUEUE_DEPTH].ullStartNs >= (uint64_t)SDO_TIMEOUT_MS * NSEC_PER_MSEC)
+		{
+			//
+			// The reply may still come, and would then be matched against the next request.
+			// All requests in flight are given up and the node is left quiet for one more
+			// timeout, replies meanwhile are stray.
+			stNode.ullQuietUntilNs = ullNow + (uint64_t)SDO_TIMEOUT_MS * NSEC_PER_MSEC ;
+			while (stNode.ulSent != stNode.ulTail)
+			{
+				Complete(stNode, eSDO_TIMEOUT, 0, ullNow) ;
+			}
+		}
+		SendQueued(stNode, ullNow) ;
+	}
+	return ;
+}
+/*
+============================================================================
+ Function:				SendQueued()
+ Description:			Sends queued requests of a node, up to SDO_MAX_IN_FLIGHT.
+ 						When synchronous, runs and completes all of them.
+============================================================================
+*/
+void CSdoEngine::SendQueued(SDO_NODE& stNode, uint64_t ullNow)
+{
+	if (ullNow < stNode.ullQuietUntilNs && stNode.ulSent == stNode.ulTail)
+		return ;
+
+	while (m_iSynchronous && stNode.ulSent != stNode.ulHead)
+	{
+		SDO_REQUEST& stReq = stNode.stQueue[stNode.ulSent % SDO_QUEUE_DEPTH] ;
+		long lData = stReq.lData ;
+		int iState = eSDO_DONE ;
+
+		stReq.ullSentNs = ullNow ;
+		stNode.ulSent++ ;
+		try
+		{
+			if (stReq.ucUpload)
+				lData = stNode.pAxis->SendSdoUpload(0, stReq.ucLength, stReq.usIndex, stReq.ucSubIndex) ;
+			else
+				stNode.pAxis->SendSdoDownload(stReq.lData, 0, stReq.ucLength, stReq.usIndex, stReq.ucSubIndex) ;
+		}
+		catch (CMMCException& exception)
+		{
+			iState = eSDO_ERROR ;
+			lData = exception.error() ;
+		}
+		ullNow = MonoTimeNs() ;
+		Complete(stNode, iState, lData, ullNow) ;
+	}
+
+	while (stNode.ulSent != stNode.ulHead && stNode.ulSent - stNode.ulTail < SDO_MAX_IN_FLIGHT)
+	{
+		SDO_REQUEST& stReq = stNode.stQueue[stNode.ulSent % SDO_QUEUE_DEPTH] ;
+
+		stReq.ullSentNs 	= ullNow ;
+		stReq.ullStartNs 	= ullNow ;
+		stNode.ulSent++ ;
+		try
+		{
+			if (stReq.ucUpload)
+				stNode.pAxis->SendSdoUploadAsync(0, stReq.ucLength, stReq.usIndex, stReq.ucSubIndex) ;
+			else
+				stNode.pAxis->SendSdoDownloadAsync(stReq.lData, 0, stReq.ucLength, stReq.usIndex, stReq.ucSubIndex) ;
+		}
+		catch (CMMCException& exception)
+		{
+			stReq.iSendFailed = 1 ;
+		}
+	}
+	CompleteFailed(stNode, ullNow) ;
+	return ;
+}
+/*
+============================================================================
+ Function:				CompleteFailed()
+ Description:			Completes, in FIFO order, the requests at the tail that
+ 						could not be sent. No reply will come for them.
+============================================================================
+*/
+void CSdoEngine::CompleteFailed(SDO_NODE& stNode, uint64_t ullNow)
+{
+	while (stNode.ulSent != stNode.ulTail && stNode.stQueue[stNode.ulTail % SDO_QUEUE_DEPTH].iSendFailed)
+	{
+		Complete(stNode, eSDO_ERROR, 0, ullNow) ;
+	}
+	return ;
+}
+/*
+============================================================================
+ Function:				Complete()
+ Description:			Completes the oldest request in flight of a node.
+============================================================================
+*/
+void CSdoEngine::Complete(SDO_NODE& stNode, int iState, long lData, uint64_t ullNow)
+{
+	SDO_REQUEST stReq = stNode.stQueue[stNode.ulTail % SDO_QUEUE_DEPTH] ;
+	SDO_RESULT stResult ;
+
+	stNode.ulTail++ ;
+	//
+	// The next request in flight only starts its transfer now.
+	if (stNode.ulSent != stNode.ulTail)
+		stNode.stQueue[stNode.ulTail % SDO_QUEUE_DEPTH].ullStartNs = ullNow ;
+
+	stResult.iState 		= iState ;
+	stResult.lData 			= lData ;
+	stResult.ullLatencyNs 	= ullNow - stReq.ullSentNs ;
+
+	switch (iState)
+	{
+	case eSDO_DONE:		m_stStats.ulCompleted++ ;	break ;
+	case eSDO_TIMEOUT:	m_stStats.ulTimeouts++ ;	break ;
+	default:			m_stStats.ulErrors++ ;		break ;
+	}
+	//
+	// The request is released before the callback, so the callback may queue a new one.
+	if (stReq.pResult)
+		*stReq.pResult = stResult ;
+	if (stReq.pfnDone)
+		stReq.pfnDone(stResult, stReq.pContext) ;
+	return ;
+}
+/*
+============================================================================
+ Function:				Pending()
+ Returned value:		Number of requests queued or in flight for a node.
+============================================================================
+*/
+int CSdoEngine::Pending(int iNode) const
+{
+	if (iNode < 0 || iNode >= m_iNodes)
+		return 0 ;
+	return (int)(m_stNode[iNode].ulHead - m_stNode[iNode].ulTail) ;
+}
+/*
+============================================================================
+ Function:				Idle()
+ Returned value:		TRUE if no request is queued or in flight on any node.
+============================================================================
+*/
+int CSdoEngine::Idle() const
+{
+	int i ;
+
+	for (i = 0 ; i < m_iNodes ; i++)
+	{
+		if (m_stNode[i].ulHead != m_stNode[i].ulTail)
+			return 0 ;
+	}
+	return 1 ;
+}
+/*
+============================================================================
+ Function:				PrintStats()
+ Description:			Prints the engine counters to stdout.
+============================================================================
+*/
+void CSdoEngine::PrintStats() const
+{
+	printf("SDO engine: %lu completed, %lu timeouts, %lu errors, %lu rejected, %lu stray replies\n",
+			m_stStats.ulCompleted, m_stStats.ulTimeouts, m_stStats.ulErrors,
+			m_stStats.ulRejected, m_stStats.ulStrayReplies) ;
+}
@@ -0,0 +1,135 @@
+/*
+============================================================================
+ Name : sdo_engine.h
+ Author  :
+ Version :
+ Description : 	Pipelined asynchronous SDO engine.
+
+ Requests are queued per node and sent with SendSdoUploadAsync() /
+ SendSdoDownloadAsync(), so the caller never waits for the CAN round trip.
+ The GMAS signals the end of a transfer with an ASYNC_REPLY_EVT. The IPC
+ callback only queues that event to the acquisition thread (gAcqRing, see
+ main.cpp), which then calls OnReply(): it retrieves the reply, the uploaded
+ value or the outcome of a download, and completes the request. Retrieving
+ it from the callback itself re-enters the library from its own IPC thread,
+ which is what used to crash. A transfer the drive aborts, or the library
+ reports failed, completes as eSDO_ERROR, downloads included.
+
+ A CANopen SDO server handles one transfer at a time (CiA 301), and
+ RetreiveSdoUploadAsync() does not tell which request a reply belongs to.
+ So a node has SDO_MAX_IN_FLIGHT (1) request handed to the GMAS at a time;
+ the next one is sent when its reply arrived or it timed out. Whether the
+ GMAS client queues and orders several requests of a node is not verified
+ on the target firmware: if it dropped or reordered them, FIFO matching
+ would assign the values to the wrong objects without any error. Requests
+ of different nodes are in flight concurrently.
+
+ If the replies cannot be matched to the nodes, SetSynchronous() makes the
+ engine send each request with the blocking SendSdoUpload() /
+ SendSdoDownload() instead, and complete it at once: the same requests and
+ results, one round trip at a time on the calling thread.
+
+ A request completes through an SDO_RESULT owned by the caller (a future,
+ polled by the caller), through a callback, or both. The engine is not
+ thread safe: Upload(), Download(), OnReply() and Poll() must all be called
+ from the same thread.
+============================================================================
+*/
+#ifndef SDO_ENGINE_H_
+#define SDO_ENGINE_H_
+
+#include <stdint.h>
+
+#define		SDO_MAX_NODES			16		// Axes that may be registered
+#define		SDO_QUEUE_DEPTH			8		// Requests queued per node, including the ones in flight
+#define		SDO_MAX_IN_FLIGHT		1		// Per node. More only once the GMAS is known to queue them in order
+#define		SDO_TIMEOUT_MS			100		// Time to wait for an ASYNC_REPLY_EVT, once on the bus
+
+enum eSdoState
+{
+	eSDO_IDLE		= 0,					// Result not used yet
+	eSDO_PENDING	= 1,					// Queued or in flight
+	eSDO_DONE		= 2,
+	eSDO_TIMEOUT	= 3,
+	eSDO_ERROR		= 4,					// Rejected by the library or by the drive
+};
+
+typedef struct
+{
+	volatile int	iState;					// eSdoState
+	long			lData;					// Uploaded value. On eSDO_ERROR, the error or abort code when known
+	uint64_t		ullLatencyNs;			// From the send to the reply
+} SDO_RESULT;
+
+typedef void (*SDO_DONE_CLBK)(const SDO_RESULT& stResult, void* pContext);
+
+typedef struct
+{
+	unsigned char	ucUpload;
+	unsigned char	ucLength;
+	unsigned short	usIndex;
+	unsigned char	ucSubIndex;
+	long			lData;					// Value to download
+	uint64_t		ullSentNs;
+	uint64_t		ullStartNs;				// When it reached the bus: sent, or previous one completed
+	int				iSendFailed;			// No reply will come, complete it in its turn
+	SDO_RESULT*		pResult;				// May be NULL
+	SDO_DONE_CLBK	pfnDone;				// May be NULL
+	void*			pContext;
+} SDO_REQUEST;
+
+class CAxisBackend;
+
+typedef struct
+{
+	CAxisBackend*	pAxis;
+	unsigned short	usAxisRef;
+	uint32_t		ulHead;					// Next free entry
+	uint32_t		ulSent;					// First entry not sent yet
+	uint32_t		ulTail;					// Oldest entry in flight
+	uint64_t		ullQuietUntilNs;		// After a timeout, a late reply may still come
+	SDO_REQUEST		stQueue[SDO_QUEUE_DEPTH];
+} SDO_NODE;
+
+typedef struct
+{
+	unsigned long	ulCompleted;
+	unsigned long	ulTimeouts;
+	unsigned long	ulErrors;
+	unsigned long	ulRejected;				// Queue full
+	unsigned long	ulStrayReplies;			// Reply with no request in flight
+} SDO_ENGINE_STATS;
+
+class CSdoEngine
+{
+public:
+	CSdoEngine() ;
+
+	int  AddNode(CAxisBackend* pAxis, unsigned short usAxisRef) ;
+	int  Upload(int iNode, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex,
+				SDO_RESULT* pResult, SDO_DONE_CLBK pfnDone = 0, void* pContext = 0) ;
+	int  Download(int iNode, long lData, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex,
+				SDO_RESULT* pResult, SDO_DONE_CLBK pfnDone = 0, void* pContext = 0) ;
+	void OnReply(unsigned short usAxisRef) ;
+	void Poll() ;
+	void SetSynchronous(int iSynchronous)	{ m_iSynchronous = iSynchronous ; }
+	int  Synchronous() const				{ return m_iSynchronous ; }
+
+	int  Pending(int iNode) const ;
+	int  Idle() const ;
+	void GetStats(SDO_ENGINE_STATS& stStats) const	{ stStats = m_stStats ; }
+	void PrintStats() const ;
+
+private:
+	int  Queue(int iNode, const SDO_REQUEST& stReq) ;
+	void SendQueued(SDO_NODE& stNode, uint64_t ullNow) ;
+	void CompleteFailed(SDO_NODE& stNode, uint64_t ullNow) ;
+	void Complete(SDO_NODE& stNode, int iState, long lData, uint64_t ullNow) ;
+
+	int					m_iNodes ;
+	int					m_iSynchronous ;	// Blocking transfers, see SetSynchronous()
+	SDO_NODE			m_stNode[SDO_MAX_NODES] ;
+	SDO_ENGINE_STATS	m_stStats ;
+} ;
+
+#endif /* SDO_ENGINE_H_ */
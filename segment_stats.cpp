@@ -0,0 +1,197 @@
+/*
+============================================================================
+ Name : 	segment_stats.cpp
+ Author :
+ Version :	1.00
+ Description : Streaming statistics per motion segment, see segment_stats.h
+============================================================================
+*/
+#include <math.h>
+#include <string.h>
+#include "segment_stats.h"
+/*
+============================================================================
+ Function:				CSegmentStats()
+ Description:			Constructor.
+============================================================================
+*/
+CSegmentStats::CSegmentStats()
+{
+	Configure(0) ;
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		iAxes - axes fed with Add(), SEG_MAX_AXES at most.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Closes nothing: drops the open segment and the summaries, and waits for the
+ first key given to Track().
+============================================================================
+*/
+void CSegmentStats::Configure(int iAxes)
+{
+	int i ;
+
+	if (iAxes > SEG_MAX_AXES)
+		iAxes = SEG_MAX_AXES ;
+
+	m_iAxes 		= iAxes ;
+	m_lKey 			= SEG_NO_KEY ;
+	m_ullStartNs 	= 0 ;
+	memset(m_stClosed, 0, sizeof(m_stClosed)) ;
+	for (i = 0 ; i < SEG_MAX_AXES ; i++)
+	{
+		m_stClosed[i].lKey = SEG_NO_KEY ;
+		Clear(i) ;
+	}
+}
+/*
+============================================================================
+ Function:				Track()
+ Input arguments:		lKey - the segment the next samples belong to, or
+ 						SEG_NO_KEY to ignore them.
+ 						ullNowNs - MonoTimeNs().
+ Output arguments: 		None.
+ Returned value:		true if a segment was closed, see Closed().
+ Version:				Version 1.00
+
+ Description:
+
+ Called once per cycle, before the samples of the cycle are added. Does
+ nothing while the key is the same. Otherwise closes the open segment, if
+ any, and opens the one of lKey.
+============================================================================
+*/
+bool CSegmentStats::Track(long lKey, uint64_t ullNowNs)
+{
+	bool bClosed = false ;
+
+	if (lKey == m_lKey)
+		return false ;
+
+	if (m_lKey != SEG_NO_KEY)
+	{
+		Close(ullNowNs) ;
+		bClosed = true ;
+	}
+	m_lKey 			= lKey ;
+	m_ullStartNs 	= ullNowNs ;
+	return bClosed ;
+}
+/*
+============================================================================
+ Function:				Close()
+ Input arguments:		ullNowNs - end of the segment.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Computes the summary of every axis into m_stClosed and clears the
+ accumulators. An axis without samples gets a summary with ulSamples 0.
+============================================================================
+*/
+void CSegmentStats::Close(uint64_t ullNowNs)
+{
+	int i ;
+
+	for (i = 0 ; i < m_iAxes ; i++)
+	{
+		const SEG_ACC& stAcc = m_stAcc[i] ;
+		SEG_SUMMARY& stSum = m_stClosed[i] ;
+
+		memset(&stSum, 0, sizeof(stSum)) ;
+		stSum.lKey 			= m_lKey ;
+		stSum.ullStartNs 	= m_ullStartNs ;
+		stSum.ullEndNs 		= ullNowNs ;
+		stSum.ulSamples 	= stAcc.ulCount ;
+		if (stAcc.ulCount)
+		{
+			stSum.dbMean 	= stAcc.dbMean ;
+			stSum.dbStdDev 	= (stAcc.ulCount > 1) ? sqrt(stAcc.dbM2 / (stAcc.ulCount - 1)) : 0.0 ;
+			stSum.lMin 		= stAcc.lMin ;
+			stSum.lMax 		= stAcc.lMax ;
+			stSum.lP50 		= Quantile(stAcc, 50.0) ;
+			stSum.lP90 		= Quantile(stAcc, 90.0) ;
+			stSum.lP99 		= Quantile(stAcc, 99.0) ;
+		}
+		Clear(i) ;
+	}
+}
+/*
+============================================================================
+ Function:				Clear()
+ Input arguments:		iAxis - accumulator to clear.
+ Description:			Empties the accumulator of the axis.
+============================================================================
+*/
+void CSegmentStats::Clear(int iAxis)
+{
+	SEG_ACC& stAcc = m_stAcc[iAxis] ;
+
+	memset(&stAcc, 0, sizeof(stAcc)) ;
+	stAcc.lMin = 0x7FFFFFFF ;
+	stAcc.lMax = -0x7FFFFFFF - 1 ;
+}
+/*
+============================================================================
+ Function:				Quantile()
+ Input arguments:		stAcc - a non empty accumulator.
+ 						dbPercent - 0.0 .. 100.0
+ Output arguments: 		None.
+ Returned value:		The value below which dbPercent of the samples fall.
+ Version:				Version 1.00
+
+ Description:
+
+ Walks the negative buckets from the largest magnitude down, then the
+ positive ones up, until the rank is reached. Reports the upper end of the
+ bucket (the smallest magnitude for a negative one), clipped to the minimum
+ and maximum seen, as CLatencyHistogram::Percentile() does.
+============================================================================
+*/
+int32_t CSegmentStats::Quantile(const SEG_ACC& stAcc, double dbPercent) const
+{
+	unsigned long ulRank ;
+	unsigned long ulSeen = 0 ;
+	int32_t lValue = stAcc.lMax ;
+	int i ;
+
+	ulRank = (unsigned long)(dbPercent / 100.0 * stAcc.ulCount + 0.5) ;
+	if (ulRank == 0)
+		ulRank = 1 ;
+
+	for (i = SEG_HIST_BUCKETS - 1 ; i >= 0 ; i--)
+	{
+		ulSeen += stAcc.ulNeg[i] ;
+		if (ulSeen >= ulRank)
+		{
+			lValue = (i == 0) ? 0 : -(int32_t)(CLatencyHistogram::BucketHighest(i - 1) + 1) ;
+			break ;
+		}
+	}
+	if (ulSeen < ulRank)
+	{
+		for (i = 0 ; i < SEG_HIST_BUCKETS ; i++)
+		{
+			ulSeen += stAcc.ulPos[i] ;
+			if (ulSeen >= ulRank)
+			{
+				lValue = (int32_t)CLatencyHistogram::BucketHighest(i) ;
+				break ;
+			}
+		}
+	}
+
+	if (lValue < stAcc.lMin)
+		lValue = stAcc.lMin ;
+	if (lValue > stAcc.lMax)
+		lValue = stAcc.lMax ;
+	return lValue ;
+}
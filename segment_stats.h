@@ -0,0 +1,114 @@
+/*
+============================================================================
+ Name : segment_stats.h
+ Author  :
+ Version :
+ Description : 	Streaming torque statistics per motion segment.
+
+ A segment is the time spent in one sub-state of a state machine, identified
+ by a key given by the application (see Track()). While a segment is open,
+ every torque sample of an axis updates, in O(1) and without allocating:
+
+ 	- the count, mean and variance (Welford's algorithm),
+ 	- the minimum and the maximum,
+ 	- a signed log-linear histogram, for the quantiles.
+
+ The histogram uses the buckets of CLatencyHistogram on the magnitude of the
+ sample, one set for the positive and one for the negative values, so the
+ quantiles are within ~3% of the true value over the int16 range.
+
+ When the key changes the segment is closed: the summary of every axis is
+ computed, O(SEG_HIST_BUCKETS) per axis, kept until the next close, and the
+ accumulators are cleared for the new segment. The memory does not depend
+ on the length of a segment.
+
+ Track() and Add() are called from the cycle thread only.
+============================================================================
+*/
+#ifndef SEGMENT_STATS_H_
+#define SEGMENT_STATS_H_
+
+#include <stdint.h>
+#include "latency_histogram.h"
+
+#define		SEG_MAX_AXES			16
+#define		SEG_NO_KEY				-1		// Track(): no segment open, the samples are ignored
+#define		SEG_MAGNITUDE_BITS		16		// int16 samples
+#define		SEG_HIST_BUCKETS		(HIST_SUB_BUCKETS + (SEG_MAGNITUDE_BITS - HIST_SUB_BUCKET_BITS) * HIST_HALF_BUCKETS)
+
+typedef struct
+{
+	long			lKey;					// Of the segment
+	uint64_t		ullStartNs;				// MonoTimeNs() at the opening and at the close
+	uint64_t		ullEndNs;
+	unsigned long	ulSamples;
+	double			dbMean;					// Same unit as the samples
+	double			dbStdDev;
+	int32_t			lMin;
+	int32_t			lMax;
+	int32_t			lP50;
+	int32_t			lP90;
+	int32_t			lP99;
+} SEG_SUMMARY;
+
+class CSegmentStats
+{
+public:
+	CSegmentStats() ;
+
+	void Configure(int iAxes) ;
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	bool Track(long lKey, uint64_t ullNowNs) ;
+	void Add(int iAxis, int32_t lSample)
+	{
+		SEG_ACC& stAcc = m_stAcc[iAxis] ;
+		double dbDelta ;
+
+		if (m_lKey == SEG_NO_KEY)
+			return ;
+
+		stAcc.ulCount++ ;
+		dbDelta 		= lSample - stAcc.dbMean ;
+		stAcc.dbMean   += dbDelta / stAcc.ulCount ;
+		stAcc.dbM2 	   += dbDelta * (lSample - stAcc.dbMean) ;
+		if (lSample < stAcc.lMin)
+			stAcc.lMin = lSample ;
+		if (lSample > stAcc.lMax)
+			stAcc.lMax = lSample ;
+		if (lSample < 0)
+			stAcc.ulNeg[CLatencyHistogram::BucketOf((uint32_t)-lSample)]++ ;
+		else
+			stAcc.ulPos[CLatencyHistogram::BucketOf((uint32_t)lSample)]++ ;
+	}
+
+	long Key() const								{ return m_lKey ; }
+	const SEG_SUMMARY& Closed(int iAxis) const		{ return m_stClosed[iAxis] ; }
+
+private:
+	typedef struct
+	{
+		unsigned long	ulCount;
+		double			dbMean;
+		double			dbM2;				// Sum of the squared differences to the mean
+		int32_t			lMin;
+		int32_t			lMax;
+		uint32_t		ulPos[SEG_HIST_BUCKETS];	// Samples >= 0, by magnitude
+		uint32_t		ulNeg[SEG_HIST_BUCKETS];	// Samples < 0, by magnitude
+	} SEG_ACC;
+
+	void Close(uint64_t ullNowNs) ;
+	void Clear(int iAxis) ;
+	int32_t Quantile(const SEG_ACC& stAcc, double dbPercent) const ;
+
+	SEG_ACC			m_stAcc[SEG_MAX_AXES] ;
+	SEG_SUMMARY		m_stClosed[SEG_MAX_AXES] ;
+	long			m_lKey ;
+	uint64_t		m_ullStartNs ;
+	int				m_iAxes ;
+} ;
+
+#endif /* SEGMENT_STATS_H_ */
@@ -0,0 +1,1072 @@
+/*
+============================================================================
+ Name : 	self_test.cpp
+ Author :
+ Version :	1.00
+ Description : Regression checks of the modules, see self_test.h
+============================================================================
+*/
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include "mono_time.h"
+#include "sim_backend.h"
+#include "callback_ring.h"
+#include "sdo_engine.h"
+#include "motion_sequencer.h"
+#include "signal_cond.h"
+#include "torque_signature.h"
+#include "segment_stats.h"
+#include "command_mailbox.h"
+#include "modbus_publisher.h"
+#include "torque_archive.h"
+#include "self_test.h"
+
+#define		SELF_CHECK(bCond)		SelfCheck((bCond), #bCond, __LINE__)
+#define		SELF_ARCH_BASE			SELF_TEST_DIR "/selftest"	// Archive files of CheckArchive()
+#define		SELF_ARCH_SAMPLES		3000	// Appended by CheckArchive(), all axes
+#define		SELF_ARCH_FILES			2		// Archive files of the budget given by CheckArchive()
+#define		SELF_ARCH_MB			(SELF_ARCH_FILES * ARCH_FILE_BYTES / (1024 * 1024))
+#define		SELF_SDO_CAN_US			500		// SDO transfer time of the simulated drives, CheckSdoEngine()
+#define		SELF_SDO_WAIT_MS		1000	// Longest run of the engine for one step of CheckSdoEngine()
+#define		SELF_RATED_TORQUE		1111	// Rated torque and current of the simulated drives, told
+#define		SELF_RATED_CURRENT		2222	// apart from every other object read
+#define		SELF_SEQ_DELAY_MS		5		// Delay awaited by CheckSequencer()
+#define		SELF_SEQ_TORQUE			100		// Torque level awaited by CheckSequencer(), raw = Nm
+#define		SELF_SEQ_WAITERS		100		// Tasks waiting on one axis in CheckSequencer()
+#define		SELF_SIG_FILE			SELF_TEST_DIR "/selftest.sig"	// Envelope saved by CheckSignature()
+#define		SELF_SIG_BIN_WIDTH		10		// Positions per bin of the grid of CheckSignature()
+#define		SELF_SIG_TORQUE			100		// Torque of the learning strokes, and SELF_SIG_TORQUE + SELF_SIG_SPREAD
+#define		SELF_SIG_SPREAD			5
+#define		SELF_SIG_MARGIN			10
+#define		SELF_SEG_SAMPLES		1000	// Samples 1 .. SELF_SEG_SAMPLES of a segment in CheckSegments()
+#define		SELF_COND_AXES			11		// Axes of CheckSignalCond(), not a multiple of the SIMD width
+#define		SELF_COND_HALF_AXIS		3		// Pushes half a block per block
+#define		SELF_COND_LATE_AXIS		10		// Pushes nothing in the first block
+#define		SELF_COND_BLOCKS		8		// Blocks processed, more than a window
+#define		SELF_COND_HZ			1000.0
+#define		SELF_COND_CUTOFF_HZ		50.0
+#define		SELF_COND_AMPLITUDE		1000	// Of the raw sine, per-mille
+#define		SELF_COND_TOLERANCE		1e-4	// Of the float kernels, relative to the largest value
+
+typedef struct
+{
+	const char*		cpName;
+	void			(*pfnCheck)();
+} SELF_TEST;
+
+static int giChecks ;					// Conditions tested by the current check
+static int giFailed ;					// Conditions that failed
+static CSpscRing<unsigned short, 64> gcSdoReplies ;	// ASYNC_REPLY_EVT of CheckSdoEngine(), sim -> test
+/*
+============================================================================
+ Function:				SelfCheck()
+ Input arguments:		bOk - the condition.
+ 						cpCond, iLine - its text and line, for the report.
+ Output arguments: 		None.
+ Returned value:		None.
+============================================================================
+*/
+static void SelfCheck(bool bOk, const char* cpCond, int iLine)
+{
+	giChecks++ ;
+	if (!bOk)
+	{
+		giFailed++ ;
+		printf("  self_test.cpp:%d: %s\n", iLine, cpCond) ;
+	}
+}
+/*
+============================================================================
+ Function:				MailboxWrite()
+ Input arguments:		cSim, cMbox - the Modbus server and the mailbox.
+ 						iStartRef, iCount, spRegs - what the host writes.
+ Output arguments: 		None.
+ Returned value:		None.
+
+ Description:
+
+ Plays the host write: the table is written directly, the simulator is not
+ running to report it, and its MODBUS_WRITE_EVT is made here, laid out as
+ the MBOX_EVT_xxx offsets say: a "write single register" for one register,
+ else a "write multiple registers" with the values.
+============================================================================
+*/
+static void MailboxWrite(CSimBackend& cSim, CCommandMailbox& cMbox, int iStartRef, int iCount, const short* spRegs)
+{
+	unsigned char ucFrame[MBOX_EVT_REGS_OFFSET + MBOX_MAX_REGS * sizeof(short)] ;
+	uint16_t usFunc = (iCount == 1) ? MBOX_FUNC_WRITE_SINGLE : MBOX_FUNC_WRITE_MULTIPLE ;
+	uint16_t usStart = (uint16_t)iStartRef ;
+	uint16_t usCount = (uint16_t)iCount ;
+
+	cSim.MbusWriteRegisters(iStartRef, iCount, spRegs) ;
+	memset(ucFrame, 0, sizeof(ucFrame)) ;
+	memcpy(ucFrame + MBOX_EVT_FUNC_OFFSET, &usFunc, sizeof(usFunc)) ;
+	memcpy(ucFrame + MBOX_EVT_START_OFFSET, &usStart, sizeof(usStart)) ;
+	if (iCount == 1)
+	{
+		cMbox.OnWrite(ucFrame, (short)(MBOX_EVT_START_OFFSET + sizeof(usStart)), MonoTimeNs()) ;
+		return ;
+	}
+	memcpy(ucFrame + MBOX_EVT_COUNT_OFFSET, &usCount, sizeof(usCount)) ;
+	memcpy(ucFrame + MBOX_EVT_REGS_OFFSET, spRegs, iCount * sizeof(short)) ;
+	cMbox.OnWrite(ucFrame, (short)(MBOX_EVT_REGS_OFFSET + iCount * sizeof(short)), MonoTimeNs()) ;
+}
+/*
+============================================================================
+ Function:				CheckMailbox()
+ Description:			Host commands: a write is applied once, also when it
+ 						repeats the value, the writes lost by a full ring are
+ 						recovered by a read of the whole area, and the writes
+ 						after it are applied. A write of unknown range finds a
+ 						repeated command through its counter.
+============================================================================
+*/
+static void CheckMailbox()
+{
+	static CSimBackend cSim ;				// Not started: only its Modbus table is used
+	static CCommandMailbox cMbox ;
+	SIM_CONFIG stConfig ;
+	short sRegs[3] ;
+	unsigned long ulResyncs ;
+	unsigned long ulReads ;
+	int i ;
+
+	stConfig = cSim.Config() ;
+	stConfig.ulIpcLatencyUs = 0 ;
+	cSim.Configure(stConfig) ;
+	sRegs[0] = 5 ;
+	cSim.MbusWriteRegisters(100, 1, sRegs) ;	// Left by a previous run
+	cMbox.Configure(100, 8) ;
+	SELF_CHECK(cMbox.AddCounter(6, 4, 2) == 0) ;
+	SELF_CHECK(cMbox.AddCounter(8, 4, 2) == -1) ;
+	SELF_CHECK(cMbox.Sync(cSim) == 0) ;
+	SELF_CHECK(cMbox.Short(0) == 5 && !cMbox.Written(0, 8)) ;
+	//
+	// One write
+	sRegs[0] = 7 ;
+	MailboxWrite(cSim, cMbox, 102, 1, sRegs) ;
+	SELF_CHECK(cMbox.Apply(cSim) == 1) ;
+	SELF_CHECK(cMbox.Written(2, 1) && !cMbox.Written(0, 2) && !cMbox.Written(3, 5)) ;
+	SELF_CHECK(cMbox.Short(2) == 7) ;
+	SELF_CHECK(cMbox.Apply(cSim) == 0 && !cMbox.Written(0, 8)) ;
+	//
+	// The same value again: its range is in the frame, written again
+	ulResyncs = cMbox.Resyncs() ;
+	MailboxWrite(cSim, cMbox, 102, 1, sRegs) ;
+	SELF_CHECK(cMbox.Apply(cSim) == 1 && cMbox.Written(2, 1)) ;
+	SELF_CHECK(cMbox.Resyncs() == ulResyncs) ;
+	//
+	// More writes than the ring holds before the cycle applies them
+	for (i = 0 ; i < MBOX_RING_SIZE + 4 ; i++)
+	{
+		sRegs[0] = (short)(1000 + i) ;
+		sRegs[1] = (short)i ;
+		MailboxWrite(cSim, cMbox, 104, 2, sRegs) ;
+	}
+	ulResyncs = cMbox.Resyncs() ;
+	SELF_CHECK(cMbox.Apply(cSim) == MBOX_RING_SIZE) ;
+	SELF_CHECK(cMbox.Resyncs() == ulResyncs + 1) ;
+	SELF_CHECK(cMbox.Written(4, 2)) ;
+	SELF_CHECK(cMbox.Long(4) == (long)(((uint32_t)(MBOX_RING_SIZE + 3) << 16) | (1000 + MBOX_RING_SIZE + 3))) ;
+	SELF_CHECK(cMbox.Short(2) == 7) ;
+	//
+	// The sequence numbers skipped by the lost writes do not hide the next one
+	sRegs[0] = 9 ;
+	MailboxWrite(cSim, cMbox, 107, 1, sRegs) ;
+	SELF_CHECK(cMbox.Apply(cSim) == 1) ;
+	SELF_CHECK(cMbox.Written(7, 1) && cMbox.Short(7) == 9) ;
+	//
+	// The range of several registers is not trusted: the whole area is read.
+	// The command keeps its value, only its counter tells it was sent again.
+	sRegs[0] = (short)(1000 + MBOX_RING_SIZE + 3) ;
+	sRegs[1] = (short)(MBOX_RING_SIZE + 3) ;
+	sRegs[2] = 1 ;
+	MailboxWrite(cSim, cMbox, 104, 3, sRegs) ;
+	ulResyncs = cMbox.Resyncs() ;
+	SELF_CHECK(cMbox.Apply(cSim) == 1) ;
+	SELF_CHECK(cMbox.Resyncs() == ulResyncs + 1) ;
+	SELF_CHECK(cMbox.Written(4, 2) && cMbox.Written(6, 1) && !cMbox.Written(7, 1)) ;
+	//
+	// Layout verified: the values come with the frame, no table read
+	cMbox.SetLayoutVerified(true) ;
+	sRegs[2] = 2 ;
+	ulResyncs 	= cMbox.Resyncs() ;
+	ulReads 	= cMbox.Reads() ;
+	MailboxWrite(cSim, cMbox, 104, 3, sRegs) ;
+	SELF_CHECK(cMbox.Apply(cSim) == 1) ;
+	SELF_CHECK(cMbox.Resyncs() == ulResyncs && cMbox.Reads() == ulReads) ;
+	SELF_CHECK(cMbox.Written(4, 3) && !cMbox.Written(0, 4) && !cMbox.Written(7, 1)) ;
+	SELF_CHECK(cMbox.Short(6) == 2) ;
+	cMbox.SetLayoutVerified(MBOX_EVT_LAYOUT_VERIFIED != 0) ;
+	//
+	// Outside the command area
+	sRegs[0] = 3 ;
+	MailboxWrite(cSim, cMbox, 200, 1, sRegs) ;
+	cMbox.Apply(cSim) ;
+	SELF_CHECK(!cMbox.Written(0, 8)) ;
+}
+/*
+============================================================================
+ Function:				CheckPublisher()
+ Description:			Output registers: only what changed is sent, close
+ 						ranges are merged, long ones split, and a failed
+ 						request is sent again.
+============================================================================
+*/
+static void CheckPublisher()
+{
+	static CSimBackend cSim ;
+	static CModbusPublisher cOut ;
+	SIM_CONFIG stConfig ;
+	unsigned long ulWrites ;
+	unsigned long ulRegs ;
+
+	stConfig = cSim.Config() ;
+	stConfig.ulIpcLatencyUs = 0 ;
+	cSim.Configure(stConfig) ;
+	//
+	// The first snapshot is sent whole, the host image is not known
+	cOut.Configure(200, 40) ;
+	SELF_CHECK(cOut.Publish(cSim) == 0) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 1 && cSim.MbusRegisters() == 40) ;
+	//
+	// Nothing changed: nothing sent
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 0 && cOut.Skipped() == 1) ;
+	//
+	// MBUS_GAP_MERGE clean registers between two dirty ones: one request
+	ulWrites 	= cSim.MbusWrites() ;
+	ulRegs 		= cSim.MbusRegisters() ;
+	cOut.SetShort(2, 11) ;
+	cOut.SetShort(3 + MBUS_GAP_MERGE, 12) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 1) ;
+	SELF_CHECK(cSim.MbusWrites() == ulWrites + 1 && cSim.MbusRegisters() == ulRegs + MBUS_GAP_MERGE + 2) ;
+	SELF_CHECK(cSim.MbusRegister(202) == 11 && cSim.MbusRegister(203 + MBUS_GAP_MERGE) == 12) ;
+	//
+	// One more clean register: two requests
+	cOut.SetShort(20, 13) ;
+	cOut.SetShort(21 + MBUS_GAP_MERGE + 1, 14) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 2) ;
+	//
+	// 32 bits values, the low word first
+	cOut.SetLong(36, 0x12345678L) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 1) ;
+	SELF_CHECK((uint16_t)cSim.MbusRegister(236) == 0x5678 && (uint16_t)cSim.MbusRegister(237) == 0x1234) ;
+	//
+	// A whole image longer than a request
+	cOut.Configure(300, MBUS_MAX_REGS) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == (MBUS_MAX_REGS + MBUS_MAX_WRITE - 1) / MBUS_MAX_WRITE) ;
+	//
+	// A failed request stays dirty and is sent again without a new snapshot
+	cOut.Configure(SIM_MBUS_REGS - 4, 8) ;
+	cOut.Commit() ;
+	SELF_CHECK(cOut.Publish(cSim) == 0 && cOut.Errors() == 1) ;
+	SELF_CHECK(cOut.Publish(cSim) == 0 && cOut.Errors() == 2) ;
+}
+/*
+============================================================================
+ Function:				ArchiveRead()
+ Input arguments:		cpFile - an archive file.
+ 						pstOut, iMax - where to decode its samples.
+ Output arguments: 		pstOut - the samples of all its blocks, in order.
+ Returned value:		The number of samples, -1 if the file cannot be read
+ 						or a block is damaged.
+============================================================================
+*/
+static int ArchiveRead(const char* cpFile, TORQUE_LOG_RECORD* pstOut, int iMax)
+{
+	static ARCH_BLOCK stBlock ;
+	ARCH_FILE_HEADER stFile ;
+	ARCH_BLOCK_HEADER* pHead = (ARCH_BLOCK_HEADER*)stBlock.ulData ;
+	FILE* pFile ;
+	int iCount = 0 ;
+	int n ;
+
+	pFile = fopen(cpFile, "rb") ;
+	if (pFile == NULL)
+		return -1 ;
+	if (fread(&stFile, sizeof(stFile), 1, pFile) != 1 || memcmp(stFile.cMagic, ARCH_MAGIC, sizeof(stFile.cMagic)) != 0)
+	{
+		fclose(pFile) ;
+		return -1 ;
+	}
+	while (fread(pHead, sizeof(ARCH_BLOCK_HEADER), 1, pFile) == 1)
+	{
+		if (pHead->ulMagic != ARCH_BLOCK_MAGIC || pHead->ulBytes < sizeof(ARCH_BLOCK_HEADER) ||
+			pHead->ulBytes > sizeof(stBlock.ulData) ||
+			(pHead->ulBytes > sizeof(ARCH_BLOCK_HEADER) &&
+			 fread((uint8_t*)stBlock.ulData + sizeof(ARCH_BLOCK_HEADER), pHead->ulBytes - sizeof(ARCH_BLOCK_HEADER), 1, pFile) != 1))
+			break ;
+		n = CTorqueArchive::Decode(stBlock.ulData, pHead->ulBytes, pstOut + iCount, iMax - iCount) ;
+		if (n < 0)
+		{
+			iCount = -1 ;
+			break ;
+		}
+		iCount += n ;
+	}
+	fclose(pFile) ;
+	return iCount ;
+}
+/*
+============================================================================
+ Function:				CheckArchive()
+ Description:			Torque archive: the samples appended are read back
+ 						the same, per axis and in order, across all the
+ 						column widths and the blocks cut by a time step
+ 						backwards or too long. A second Open() continues in
+ 						a new file.
+============================================================================
+*/
+static void CheckArchive()
+{
+	static TORQUE_LOG_RECORD stIn[SELF_ARCH_SAMPLES] ;
+	static TORQUE_LOG_RECORD stOut[SELF_ARCH_SAMPLES + ARCH_BLOCK_SAMPLES] ;
+	static CTorqueArchive cArchive ;
+	char cPath[ARCH_PATH_LEN + 16] ;
+	uint64_t ullTimeNs = 1000000000ULL ;
+	uint32_t ulRand = 12345 ;
+	int iOut ;
+	int iAxis ;
+	int i, j ;
+
+	for (i = 0 ; i < SELF_ARCH_FILES ; i++)
+	{
+		snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", SELF_ARCH_BASE, i) ;
+		unlink(cPath) ;
+	}
+	//
+	// Two axes, samples every ms with some jitter. Now and then a step of
+	// every field, a full 32 bits status change, and time steps that cut
+	// the block.
+	for (i = 0 ; i < SELF_ARCH_SAMPLES ; i++)
+	{
+		ulRand = ulRand * 1103515245u + 12345u ;
+		ullTimeNs += 500000 + (ulRand >> 16) % 7 * 1000 ;
+		if (i == 1000)
+			ullTimeNs -= 5000000 ;
+		if (i == 2000)
+			ullTimeNs += (uint64_t)ARCH_MAX_TIME_DELTA * ARCH_TIME_UNIT_NS * 2 ;
+		stIn[i].ullTimeNs 	= ullTimeNs ;
+		stIn[i].usAxis 		= (uint16_t)(i & 1) ;
+		stIn[i].lPosition 	= 40 * i + (int32_t)((ulRand >> 8) % 9) - 4 ;
+		stIn[i].sTorque 	= (int16_t)((ulRand >> 4) % 2001 - 1000) ;
+		stIn[i].sCurrent 	= (int16_t)((i % 300 == 7) ? -32768 : (i % 300 == 8) ? 32767 : i % 50) ;
+		stIn[i].ulStatus 	= (i % 500 == 3) ? 0xFFFFFFFFu : 0x1000u + i / 100 ;
+		stIn[i].usReserved 	= 0 ;
+		if (i % 977 == 5)
+			stIn[i].lPosition = (int32_t)0x80000000u ;
+	}
+	SELF_CHECK(cArchive.Open(SELF_ARCH_BASE, SELF_ARCH_MB) == 0 && cArchive.Files() == SELF_ARCH_FILES) ;
+	for (i = 0 ; i < SELF_ARCH_SAMPLES ; i++)
+	{
+		cArchive.Append(stIn[i]) ;
+	}
+	cArchive.Close() ;
+	SELF_CHECK(cArchive.Appended() == SELF_ARCH_SAMPLES && cArchive.Dropped() == 0) ;
+
+	snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", SELF_ARCH_BASE, 0) ;
+	iOut = ArchiveRead(cPath, stOut, SELF_ARCH_SAMPLES + ARCH_BLOCK_SAMPLES) ;
+	SELF_CHECK(iOut == SELF_ARCH_SAMPLES) ;
+	//
+	// Blocks of the two axes are interleaved in the file, compare axis by axis
+	for (iAxis = 0 ; iAxis < 2 && iOut > 0 ; iAxis++)
+	{
+		int iErrors = 0 ;
+
+		for (i = 0, j = 0 ; i < SELF_ARCH_SAMPLES && j < iOut ; i++, j++)
+		{
+			while (i < SELF_ARCH_SAMPLES && stIn[i].usAxis != iAxis)
+				i++ ;
+			while (j < iOut && stOut[j].usAxis != iAxis)
+				j++ ;
+			if (i == SELF_ARCH_SAMPLES || j == iOut)
+				break ;
+			if (stOut[j].ullTimeNs != stIn[i].ullTimeNs / ARCH_TIME_UNIT_NS * ARCH_TIME_UNIT_NS ||
+				stOut[j].lPosition != stIn[i].lPosition || stOut[j].ulStatus != stIn[i].ulStatus ||
+				stOut[j].sTorque != stIn[i].sTorque || stOut[j].sCurrent != stIn[i].sCurrent)
+				iErrors++ ;
+		}
+		SELF_CHECK(iErrors == 0) ;
+	}
+	//
+	// A restart keeps the file written and continues in the next one
+	SELF_CHECK(cArchive.Open(SELF_ARCH_BASE, SELF_ARCH_MB) == 0) ;
+	cArchive.Append(stIn[0]) ;
+	cArchive.Close() ;
+	SELF_CHECK(ArchiveRead(cPath, stOut, SELF_ARCH_SAMPLES + ARCH_BLOCK_SAMPLES) == SELF_ARCH_SAMPLES) ;
+	snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", SELF_ARCH_BASE, 1) ;
+	SELF_CHECK(ArchiveRead(cPath, stOut, SELF_ARCH_SAMPLES + ARCH_BLOCK_SAMPLES) == 1) ;
+	//
+	// and, the budget used up, overwrites the oldest one
+	SELF_CHECK(cArchive.Open(SELF_ARCH_BASE, SELF_ARCH_MB) == 0) ;
+	cArchive.Append(stIn[0]) ;
+	cArchive.Close() ;
+	snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", SELF_ARCH_BASE, 0) ;
+	SELF_CHECK(ArchiveRead(cPath, stOut, SELF_ARCH_SAMPLES + ARCH_BLOCK_SAMPLES) == 1) ;
+	for (i = 0 ; i < SELF_ARCH_FILES ; i++)
+	{
+		snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", SELF_ARCH_BASE, i) ;
+		unlink(cPath) ;
+	}
+}
+/*
+============================================================================
+ Function:				SdoReplyCallback()
+ Description:			Event callback of the simulator in CheckSdoEngine():
+ 						queues the axis of every SDO reply, as CallbackFunc()
+ 						does for the acquisition thread.
+============================================================================
+*/
+static int SdoReplyCallback(unsigned char* recvBuffer, short recvBufferSize, void* lpsock)
+{
+	unsigned short usAxisRef ;
+
+	if (recvBuffer[1] == ASYNC_REPLY_EVT && recvBufferSize >= EVT_DATA_OFFSET)
+	{
+		memcpy(&usAxisRef, recvBuffer + EVT_AXIS_REF_OFFSET, sizeof(usAxisRef)) ;
+		gcSdoReplies.Push(usAxisRef) ;
+	}
+	return 1 ;
+}
+/*
+============================================================================
+ Function:				SdoRun()
+ Input arguments:		cEngine - the engine under test.
+ 						iMs - how long to run it, at most.
+ 						bUntilIdle - return as soon as no request is left.
+ Output arguments: 		None.
+ Returned value:		None.
+ Description:			Plays the acquisition thread: replies, then Poll().
+============================================================================
+*/
+static void SdoRun(CSdoEngine& cEngine, int iMs, bool bUntilIdle)
+{
+	uint64_t ullEndNs = MonoTimeNs() + (uint64_t)iMs * NSEC_PER_MSEC ;
+	unsigned short usAxisRef ;
+
+	while (MonoTimeNs() < ullEndNs && !(bUntilIdle && cEngine.Idle()))
+	{
+		while (gcSdoReplies.Pop(usAxisRef))
+			cEngine.OnReply(usAxisRef) ;
+		cEngine.Poll() ;
+		usleep(200) ;
+	}
+}
+/*
+============================================================================
+ Function:				SdoDone()
+ Description:			Completion callback of CheckSdoEngine(): appends the
+ 						tag of the request to the order of completion.
+============================================================================
+*/
+static int giSdoOrder[2 * SDO_QUEUE_DEPTH] ;
+static int giSdoDone ;
+
+static void SdoDone(const SDO_RESULT& stResult, void* pContext)
+{
+	if (giSdoDone < (int)(sizeof(giSdoOrder) / sizeof(giSdoOrder[0])))
+		giSdoOrder[giSdoDone++] = (int)(long)pContext ;
+}
+/*
+============================================================================
+ Function:				CheckSdoEngine()
+ Description:			SDO engine against two simulated drives: the replies of
+ 						a node are matched to its requests in order, also with
+ 						the requests of the nodes interleaved; a download the
+ 						drive aborts completes as eSDO_ERROR with the abort
+ 						code; a full queue rejects; a reply later than
+ 						SDO_TIMEOUT_MS times the request out, and then counts
+ 						as stray; the synchronous mode gives the same values.
+============================================================================
+*/
+static void CheckSdoEngine()
+{
+	static CSimBackend cSim ;
+	static CSdoEngine cEngine ;
+	static const unsigned short usObject[4] = { OD_MOTOR_RATED_TORQUE, OD_MOTOR_RATED_CURRENT, OD_DC_LINK_VOLTAGE, OD_TPDO3_COMM } ;
+	static const long lValue[4] = { SELF_RATED_TORQUE, SELF_RATED_CURRENT, SIM_DC_LINK_MV, PDO_TRANS_SYNC_EVERY } ;
+	SDO_RESULT stResult[2][SDO_QUEUE_DEPTH + 1] ;
+	SDO_ENGINE_STATS stStats ;
+	SIM_CONFIG stConfig ;
+	CAxisBackend* pAxis[2] ;
+	unsigned short usRef ;
+	int iNode[2] ;
+	int iOrdered ;
+	int i, n ;
+
+	while (gcSdoReplies.Pop(usRef))
+		;
+	stConfig = cSim.Config() ;
+	stConfig.ulIpcLatencyUs 	= 0 ;
+	stConfig.ulCanLatencyUs 	= SELF_SDO_CAN_US ;
+	stConfig.ulRatedTorqueMnm 	= SELF_RATED_TORQUE ;
+	stConfig.ulRatedCurrentMa 	= SELF_RATED_CURRENT ;
+	cSim.Configure(stConfig) ;
+	cSim.ConnectIPCEx(0, SdoReplyCallback) ;
+	cSim.SetSyncTime(1) ;
+	cEngine = CSdoEngine() ;
+	for (n = 0 ; n < 2 ; n++)
+	{
+		pAxis[n] = cSim.CreateAxis(n ? "a02" : "a01") ;
+		iNode[n] = cEngine.AddNode(pAxis[n], pAxis[n]->GetRef()) ;
+	}
+	//
+	// Four different objects on each node, in the opposite order on the
+	// second one, queued alternately
+	memset(stResult, 0, sizeof(stResult)) ;
+	giSdoDone = 0 ;
+	for (i = 0 ; i < 4 ; i++)
+	{
+		for (n = 0 ; n < 2 ; n++)
+		{
+			int iObj = n ? 3 - i : i ;
+
+			SELF_CHECK(cEngine.Upload(iNode[n], 4, usObject[iObj], (unsigned char)(iObj == 3 ? 2 : 0),
+									  &stResult[n][i], SdoDone, (void*)(long)(n * 4 + i)) == 0) ;
+		}
+	}
+	SdoRun(cEngine, SELF_SDO_WAIT_MS, true) ;
+	for (n = 0 ; n < 2 ; n++)
+	{
+		for (i = 0 ; i < 4 ; i++)
+		{
+			int iObj = n ? 3 - i : i ;
+
+			SELF_CHECK(stResult[n][i].iState == eSDO_DONE && stResult[n][i].lData == lValue[iObj]) ;
+		}
+	}
+	SELF_CHECK(giSdoDone == 8) ;
+	for (n = 0 ; n < 2 ; n++)
+	{
+		int iLast = -1 ;
+
+		iOrdered = 1 ;
+		for (i = 0 ; i < giSdoDone ; i++)
+		{
+			if (giSdoOrder[i] / 4 != n)
+				continue ;
+			iOrdered = iOrdered && giSdoOrder[i] > iLast ;
+			iLast = giSdoOrder[i] ;
+		}
+		SELF_CHECK(iOrdered) ;
+	}
+	//
+	// Downloads: accepted, read only, no such object
+	cEngine.Download(iNode[0], 0, 4, OD_TPDO3_MAP, 0, &stResult[0][0]) ;
+	cEngine.Download(iNode[0], 0, 2, OD_TORQUE_ACTUAL, 0, &stResult[0][1]) ;
+	cEngine.Download(iNode[0], 0, 4, 0x2FFF, 0, &stResult[0][2]) ;
+	SdoRun(cEngine, SELF_SDO_WAIT_MS, true) ;
+	SELF_CHECK(stResult[0][0].iState == eSDO_DONE) ;
+	SELF_CHECK(stResult[0][1].iState == eSDO_ERROR && stResult[0][1].lData == SIM_SDO_ABORT_READ_ONLY) ;
+	SELF_CHECK(stResult[0][2].iState == eSDO_ERROR && stResult[0][2].lData == SIM_SDO_ABORT_NO_OBJECT) ;
+	//
+	// A full queue rejects the next request, and still completes the others
+	for (i = 0 ; i <= SDO_QUEUE_DEPTH ; i++)
+	{
+		if (cEngine.Upload(iNode[1], 4, OD_MOTOR_RATED_TORQUE, 0, &stResult[1][i]) != 0)
+			break ;
+	}
+	SELF_CHECK(i == SDO_QUEUE_DEPTH) ;
+	cEngine.GetStats(stStats) ;
+	SELF_CHECK(stStats.ulRejected == 1) ;
+	SdoRun(cEngine, SELF_SDO_WAIT_MS, true) ;
+	for (iOrdered = 1, i = 0 ; i < SDO_QUEUE_DEPTH ; i++)
+	{
+		iOrdered = iOrdered && stResult[1][i].iState == eSDO_DONE && stResult[1][i].lData == SELF_RATED_TORQUE ;
+	}
+	SELF_CHECK(iOrdered) ;
+	//
+	// A reply later than the timeout: the request times out, the reply is
+	// stray, and the node is quiet until it came
+	cEngine.GetStats(stStats) ;
+	SELF_CHECK(stStats.ulTimeouts == 0 && stStats.ulStrayReplies == 0 && stStats.ulErrors == 2) ;
+	stConfig.ulCanLatencyUs = SDO_TIMEOUT_MS * 1500 ;
+	cSim.Configure(stConfig) ;
+	cEngine.Upload(iNode[0], 4, OD_MOTOR_RATED_TORQUE, 0, &stResult[0][0]) ;
+	SdoRun(cEngine, SDO_TIMEOUT_MS * 3, false) ;
+	cEngine.GetStats(stStats) ;
+	SELF_CHECK(stResult[0][0].iState == eSDO_TIMEOUT) ;
+	SELF_CHECK(stStats.ulTimeouts == 1 && stStats.ulStrayReplies == 1) ;
+	cSim.Close() ;
+	//
+	// Synchronous: completed by the Poll() that sends it
+	stConfig.ulCanLatencyUs = SELF_SDO_CAN_US ;
+	cSim.Configure(stConfig) ;
+	cEngine.SetSynchronous(1) ;
+	cSim.CreateAxis("a01") ;					// The same object as before, node 0 of the engine
+	cEngine.Upload(iNode[0], 4, OD_MOTOR_RATED_CURRENT, 0, &stResult[0][0]) ;
+	cEngine.Poll() ;
+	SELF_CHECK(stResult[0][0].iState == eSDO_DONE && stResult[0][0].lData == SELF_RATED_CURRENT) ;
+	cSim.Close() ;
+}
+/*
+============================================================================
+ Function:				SeqStages(), SeqWaiter()
+ Description:			Bodies of CheckSequencer(). SeqStages() counts its
+ 						stages in the context: standstill of axis 0, a delay
+ 						of SELF_SEQ_DELAY_MS, axis 1 stopped, torque of axis 0
+ 						above SELF_SEQ_TORQUE. SeqWaiter() waits for the
+ 						standstill of axis 2 and counts in the context.
+============================================================================
+*/
+static int SeqStages(SEQ_TASK& stTask)
+{
+	int* piStage = (int*)stTask.pContext ;
+
+	SEQ_BEGIN(stTask) ;
+	*piStage = 1 ;
+	SEQ_AWAIT_STANDSTILL(stTask, AXIS_BIT(0)) ;
+	*piStage = 2 ;
+	SEQ_AWAIT_DELAY(stTask, SELF_SEQ_DELAY_MS) ;
+	*piStage = 3 ;
+	SEQ_AWAIT_STOPPED(stTask, AXIS_BIT(1)) ;
+	*piStage = 4 ;
+	SEQ_AWAIT_TORQUE_ABOVE(stTask, 0, SELF_SEQ_TORQUE) ;
+	*piStage = 5 ;
+	SEQ_END(stTask) ;
+}
+
+static int SeqWaiter(SEQ_TASK& stTask)
+{
+	SEQ_BEGIN(stTask) ;
+	SEQ_AWAIT_STANDSTILL(stTask, AXIS_BIT(2)) ;
+	(*(int*)stTask.pContext)++ ;
+	SEQ_END(stTask) ;
+}
+/*
+============================================================================
+ Function:				SeqRun()
+ Input arguments:		cSeq - the sequencer. stIn - the inputs, the time is
+ 						advanced by ulMs before the Run().
+ Output arguments: 		None.
+ Returned value:		None.
+============================================================================
+*/
+static void SeqRun(CMotionSequencer& cSeq, SEQ_INPUTS& stIn, unsigned long ulMs)
+{
+	stIn.ullNowNs += (uint64_t)ulMs * 1000000ULL ;
+	cSeq.Run(stIn) ;
+}
+/*
+============================================================================
+ Function:				CheckSequencer()
+ Description:			Motion sequencer: an await is tested from the next
+ 						Run() on and resumes only when its condition holds;
+ 						a change on an axis tests only the tasks waiting on
+ 						it; a killed task does not run again and its handle
+ 						stays stale when the slot is reused; a full table
+ 						rejects Start().
+============================================================================
+*/
+static void CheckSequencer()
+{
+	static CMotionSequencer cSeq ;
+	static CSignalCond cTorque ;
+	SEQ_INPUTS stIn ;
+	unsigned long ulTests ;
+	unsigned long ulResumes ;
+	int iStage = 0 ;
+	int iWoken = 0 ;
+	int iTask ;
+	int iStale ;
+	int i ;
+
+	cSeq.Reset() ;
+	cTorque.Configure(1, 1000.0, 0.0) ;			// No filter, the value is the sample
+	cTorque.SetScale(0, 1.0f) ;
+	memset(&stIn, 0, sizeof(stIn)) ;
+	stIn.ullNowNs 		= 1000000000ULL ;
+	stIn.ulStandStill 	= AXIS_BIT(0) ;
+	stIn.ulInMotion 	= AXIS_BIT(1) ;
+	stIn.pcTorque 		= &cTorque ;
+	//
+	// Each await waits at least one Run(), even when its condition holds
+	iTask = cSeq.Start(SeqStages, &iStage) ;
+	SELF_CHECK(iTask != SEQ_NO_TASK && iStage == 0) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 1) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 2) ;
+	SeqRun(cSeq, stIn, SELF_SEQ_DELAY_MS - 1) ;
+	SELF_CHECK(iStage == 2) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 3) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 3) ;					// Axis 1 still in motion
+	stIn.ulInMotion = 0 ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 4) ;
+	cTorque.Push(0, SELF_SEQ_TORQUE) ;
+	cTorque.Process() ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 4) ;					// Not above
+	cTorque.Push(0, SELF_SEQ_TORQUE + 1) ;
+	cTorque.Process() ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 5 && !cSeq.Running(iTask) && cSeq.Tasks() == 0) ;
+	//
+	// A killed task is not resumed, its handle does not name the next task
+	// of its slot
+	iStage 	= 0 ;
+	iStale 	= cSeq.Start(SeqStages, &iStage) ;
+	stIn.ulStandStill = 0 ;
+	SeqRun(cSeq, stIn, 1) ;
+	cSeq.Kill(iStale) ;
+	stIn.ulStandStill = AXIS_BIT(0) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iStage == 1 && !cSeq.Running(iStale)) ;
+	iTask = cSeq.Start(SeqWaiter, &iWoken) ;
+	SELF_CHECK(iTask % SEQ_MAX_TASKS == iStale % SEQ_MAX_TASKS && iTask != iStale) ;
+	SELF_CHECK(cSeq.Running(iTask) && !cSeq.Running(iStale)) ;
+	cSeq.Kill(iStale) ;
+	SELF_CHECK(cSeq.Running(iTask)) ;
+	//
+	// Changes of axes 0 and 1 test none of the tasks waiting on axis 2
+	for (i = 1 ; i < SELF_SEQ_WAITERS ; i++)
+	{
+		cSeq.Start(SeqWaiter, &iWoken) ;
+	}
+	SeqRun(cSeq, stIn, 1) ;						// To their await
+	SeqRun(cSeq, stIn, 1) ;						// Tested once, fresh
+	ulTests 	= cSeq.Tests() ;
+	ulResumes 	= cSeq.Resumes() ;
+	stIn.ulStandStill 	= AXIS_BIT(0) | AXIS_BIT(1) ;
+	stIn.ulInMotion 	= AXIS_BIT(0) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(cSeq.Tests() == ulTests && cSeq.Resumes() == ulResumes && iWoken == 0) ;
+	stIn.ulStandStill |= AXIS_BIT(2) ;
+	SeqRun(cSeq, stIn, 1) ;
+	SELF_CHECK(iWoken == SELF_SEQ_WAITERS && cSeq.Tasks() == 0) ;
+	SELF_CHECK(cSeq.Tests() == ulTests + SELF_SEQ_WAITERS) ;
+	//
+	// A full table
+	for (i = 0 ; i < SEQ_MAX_TASKS ; i++)
+	{
+		cSeq.Start(SeqWaiter, &iWoken) ;
+	}
+	SELF_CHECK(cSeq.Tasks() == SEQ_MAX_TASKS && cSeq.Full() == 0) ;
+	SELF_CHECK(cSeq.Start(SeqWaiter, &iWoken) == SEQ_NO_TASK && cSeq.Full() == 1) ;
+	cSeq.Reset() ;
+	SELF_CHECK(cSeq.Tasks() == 0 && !cSeq.Running(iTask)) ;
+}
+/*
+============================================================================
+ Function:				CheckSignature()
+ Description:			Torque signature: the learning strokes widen the
+ 						envelope and flag nothing; then a sample beyond the
+ 						margin flags its bin, one within does not; samples
+ 						off the grid or of an axis not captured are ignored;
+ 						the envelope survives Save() and Load(), and a file
+ 						of another grid is refused.
+============================================================================
+*/
+static void CheckSignature()
+{
+	static CTorqueSignature cSig ;
+	static CTorqueSignature cLoaded ;
+	const int32_t lHigh = TSIG_BINS * SELF_SIG_BIN_WIDTH - 1 ;
+	int32_t lTorque ;
+	int iFlagged ;
+	int iSame ;
+	int s, p, b ;
+
+	cSig.SetGrid(0, lHigh, 0) ;					// Any order
+	cSig.SetGrid(1, 0, TSIG_BINS - 2) ;			// Too short, never captured
+	cSig.Configure(2, SELF_SIG_MARGIN) ;
+	SELF_CHECK(cSig.BinPosition(0, 0) == SELF_SIG_BIN_WIDTH / 2) ;
+	//
+	// Learning: two torque levels, one per stroke parity
+	for (iFlagged = 0, s = 0 ; s < TSIG_LEARN_STROKES ; s++)
+	{
+		SELF_CHECK(cSig.Learning(0) && cSig.Learned(0) == (uint32_t)s) ;
+		cSig.Begin(0, AXIS_BIT(0)) ;
+		for (p = 0 ; p <= lHigh ; p++)
+		{
+			iFlagged += cSig.Add(0, p, SELF_SIG_TORQUE + (s & 1) * SELF_SIG_SPREAD) ;
+		}
+		cSig.End() ;
+	}
+	SELF_CHECK(iFlagged == 0 && !cSig.Learning(0) && cSig.Learning(1)) ;
+	SELF_CHECK(cSig.BinsCovered(0) == TSIG_BINS && cSig.Signature(0, 0, lTorque) && lTorque == SELF_SIG_TORQUE) ;
+	SELF_CHECK(cSig.Envelope(0, 0, 0).lMin == SELF_SIG_TORQUE && cSig.Envelope(0, 0, 0).lMax == SELF_SIG_TORQUE + SELF_SIG_SPREAD) ;
+	SELF_CHECK(cSig.Envelope(0, 0, 0).ulLearned == TSIG_LEARN_STROKES * SELF_SIG_BIN_WIDTH) ;
+	//
+	// Checking: at the margin, beyond it in bin 3, off the grid, axis 1
+	cSig.Begin(0, AXIS_BIT(0)) ;
+	for (iFlagged = 0, p = 0 ; p <= lHigh ; p++)
+	{
+		b = p / SELF_SIG_BIN_WIDTH ;
+		iFlagged += cSig.Add(0, p, (b == 3) ? SELF_SIG_TORQUE - SELF_SIG_MARGIN - 1
+											: SELF_SIG_TORQUE + SELF_SIG_SPREAD + SELF_SIG_MARGIN) ;
+	}
+	SELF_CHECK(iFlagged == SELF_SIG_BIN_WIDTH) ;
+	SELF_CHECK(!cSig.Add(0, -1, 0) && !cSig.Add(0, lHigh + 1, 0)) ;
+	SELF_CHECK(!cSig.Add(1, 0, 0)) ;
+	SELF_CHECK(cSig.BinsOut(0) == 1 && cSig.SamplesOut(0) == SELF_SIG_BIN_WIDTH && cSig.BinsCovered(1) == 0) ;
+	cSig.End() ;
+	SELF_CHECK(cSig.Stroke() == TSIG_NO_STROKE && !cSig.Add(0, 0, 0) && cSig.Learned(0) == TSIG_LEARN_STROKES) ;
+	//
+	// Stroke 1 has no grid
+	cSig.Begin(1, AXIS_BIT(0)) ;
+	SELF_CHECK(!cSig.Add(0, 0, SELF_SIG_TORQUE) && cSig.BinsCovered(0) == 0) ;
+	cSig.End() ;
+	//
+	// Save and load, then a file of another grid
+	SELF_CHECK(cSig.Save(SELF_SIG_FILE) == 0) ;
+	cLoaded.SetGrid(0, 0, lHigh) ;
+	cLoaded.SetGrid(1, 0, TSIG_BINS - 2) ;
+	cLoaded.Configure(2, SELF_SIG_MARGIN) ;
+	SELF_CHECK(cLoaded.Load(SELF_SIG_FILE) == 0 && cLoaded.Learned(0) == TSIG_LEARN_STROKES) ;
+	for (iSame = 1, b = 0 ; b < TSIG_BINS ; b++)
+	{
+		iSame = iSame && memcmp(&cLoaded.Envelope(0, 0, b), &cSig.Envelope(0, 0, b), sizeof(TSIG_BIN)) == 0 ;
+	}
+	SELF_CHECK(iSame) ;
+	cLoaded.SetGrid(0, 0, lHigh + 1) ;
+	SELF_CHECK(cLoaded.Load(SELF_SIG_FILE) != 0 && cLoaded.Learned(0) == 0) ;
+	unlink(SELF_SIG_FILE) ;
+}
+/*
+============================================================================
+ Function:				SegNear()
+ Description:			true if a quantile of CheckSegments() is within the
+ 						~3% of the histogram of the exact one.
+============================================================================
+*/
+static bool SegNear(int32_t lValue, double dbExpected)
+{
+	return fabs(lValue - dbExpected) <= 0.03 * fabs(dbExpected) + 1.0 ;
+}
+/*
+============================================================================
+ Function:				CheckSegments()
+ Description:			Segment statistics: samples before the first key and
+ 						after SEG_NO_KEY are ignored; a change of key closes
+ 						the segment with the count, mean, deviation, extremes
+ 						and quantiles of every axis, within the ~3% of the
+ 						histogram for the quantiles, for positive and negative
+ 						samples; an axis without samples reports none.
+============================================================================
+*/
+static void CheckSegments()
+{
+	static CSegmentStats cSeg ;
+	int i ;
+
+	cSeg.Configure(2) ;
+	cSeg.Add(0, 12345) ;						// No segment open
+	SELF_CHECK(!cSeg.Track(1, 1000) && cSeg.Key() == 1) ;
+	SELF_CHECK(!cSeg.Track(1, 2000)) ;
+	for (i = 1 ; i <= SELF_SEG_SAMPLES ; i++)
+	{
+		cSeg.Add(0, i) ;
+	}
+	SELF_CHECK(cSeg.Track(2, 5000)) ;
+	{
+		const SEG_SUMMARY& stSum = cSeg.Closed(0) ;
+
+		SELF_CHECK(stSum.lKey == 1 && stSum.ullStartNs == 1000 && stSum.ullEndNs == 5000) ;
+		SELF_CHECK(stSum.ulSamples == SELF_SEG_SAMPLES && stSum.lMin == 1 && stSum.lMax == SELF_SEG_SAMPLES) ;
+		SELF_CHECK(fabs(stSum.dbMean - (SELF_SEG_SAMPLES + 1) / 2.0) < 1e-6) ;
+		SELF_CHECK(fabs(stSum.dbStdDev - sqrt(SELF_SEG_SAMPLES * (SELF_SEG_SAMPLES + 1.0) / 12.0)) < 1e-6) ;
+		SELF_CHECK(SegNear(stSum.lP50, 0.50 * SELF_SEG_SAMPLES) && SegNear(stSum.lP90, 0.90 * SELF_SEG_SAMPLES)) ;
+		SELF_CHECK(SegNear(stSum.lP99, 0.99 * SELF_SEG_SAMPLES)) ;
+	}
+	SELF_CHECK(cSeg.Closed(1).lKey == 1 && cSeg.Closed(1).ulSamples == 0) ;
+	//
+	// Negative samples, closed by SEG_NO_KEY
+	for (i = 1 ; i <= SELF_SEG_SAMPLES ; i++)
+	{
+		cSeg.Add(1, -i) ;
+	}
+	SELF_CHECK(cSeg.Track(SEG_NO_KEY, 9000) && !cSeg.Track(SEG_NO_KEY, 9500)) ;
+	cSeg.Add(1, 12345) ;
+	{
+		const SEG_SUMMARY& stSum = cSeg.Closed(1) ;
+
+		SELF_CHECK(stSum.lKey == 2 && stSum.ulSamples == SELF_SEG_SAMPLES) ;
+		SELF_CHECK(stSum.lMin == -SELF_SEG_SAMPLES && stSum.lMax == -1) ;
+		SELF_CHECK(fabs(stSum.dbMean + (SELF_SEG_SAMPLES + 1) / 2.0) < 1e-6) ;
+		SELF_CHECK(SegNear(stSum.lP50, -0.50 * SELF_SEG_SAMPLES) && SegNear(stSum.lP90, -0.10 * SELF_SEG_SAMPLES)) ;
+		SELF_CHECK(SegNear(stSum.lP99, -0.01 * SELF_SEG_SAMPLES)) ;
+	}
+	SELF_CHECK(cSeg.Closed(0).lKey == 2 && cSeg.Closed(0).ulSamples == 0) ;
+	SELF_CHECK(!cSeg.Track(3, 10000) && cSeg.Track(4, 11000) && cSeg.Closed(1).ulSamples == 0) ;
+}
+/*
+============================================================================
+ Function:				CheckSignalCond()
+ Description:			Signal conditioning kernels of Isa() against a double
+ 						precision filter and window, sample by sample, over
+ 						more axes than one SIMD register, one axis with half
+ 						the samples of the others and one starting a block
+ 						late; a full block is processed by the next Push().
+============================================================================
+*/
+static void CheckSignalCond()
+{
+	static CSignalCond cCond ;
+	static double dbWindow[SELF_COND_AXES][SIG_WINDOW] ;
+	double dbB0[SIG_BIQUADS], dbB1[SIG_BIQUADS], dbB2[SIG_BIQUADS], dbA1[SIG_BIQUADS], dbA2[SIG_BIQUADS] ;
+	double dbZ1[SIG_BIQUADS][SELF_COND_AXES] ;
+	double dbZ2[SIG_BIQUADS][SELF_COND_AXES] ;
+	double dbRef[SELF_COND_AXES][SIG_BLOCK] ;
+	unsigned long ulSamples[SELF_COND_AXES] ;
+	double dbSumSq, dbPeak, dbMin ;
+	double dbTol ;
+	int iCount[SELF_COND_AXES] ;
+	int iClose ;
+	int iStats ;
+	int a, b, k, s ;
+
+	SELF_CHECK(CSignalCond::Isa() != 0) ;
+	cCond.Configure(SELF_COND_AXES, SELF_COND_HZ, SELF_COND_CUTOFF_HZ) ;
+	for (s = 0 ; s < SIG_BIQUADS ; s++)
+	{
+		double dbW0 	= 2.0 * M_PI * SELF_COND_CUTOFF_HZ / SELF_COND_HZ ;
+		double dbAlpha 	= sin(dbW0) / (2.0 * (s ? 1.30656296 : 0.54119610)) ;
+		double dbA0 	= 1.0 + dbAlpha ;
+
+		dbB0[s] = (1.0 - cos(dbW0)) / 2.0 / dbA0 ;
+		dbB1[s] = (1.0 - cos(dbW0)) / dbA0 ;
+		dbB2[s] = dbB0[s] ;
+		dbA1[s] = -2.0 * cos(dbW0) / dbA0 ;
+		dbA2[s] = (1.0 - dbAlpha) / dbA0 ;
+	}
+	memset(ulSamples, 0, sizeof(ulSamples)) ;
+	for (a = 0 ; a < SELF_COND_AXES ; a++)
+	{
+		cCond.SetScale(a, 0.01f * (a + 1)) ;
+	}
+
+	for (iClose = 1, b = 0 ; b < SELF_COND_BLOCKS ; b++)
+	{
+		for (a = 0 ; a < SELF_COND_AXES ; a++)
+		{
+			iCount[a] = (a == SELF_COND_HALF_AXIS) ? SIG_BLOCK / 2 : (a == SELF_COND_LATE_AXIS && b == 0) ? 0 : SIG_BLOCK ;
+			for (k = 0 ; k < iCount[a] ; k++)
+			{
+				int16_t sRaw = (int16_t)(100 * a + SELF_COND_AMPLITUDE * sin(2.0 * M_PI * (a + 1) * ulSamples[a] / SIG_BLOCK)) ;
+				double dbX = sRaw * (double)(0.01f * (a + 1)) ;
+
+				cCond.Push(a, sRaw) ;
+				for (s = 0 ; s < SIG_BIQUADS ; s++)
+				{
+					double dbY ;
+
+					if (ulSamples[a] == 0)
+					{
+						dbZ1[s][a] = dbX * (1.0 - dbB0[s]) ;		// Steady state of the first sample
+						dbZ2[s][a] = dbX * (dbB2[s] - dbA2[s]) ;
+					}
+					dbY 		= dbB0[s] * dbX + dbZ1[s][a] ;
+					dbZ1[s][a] 	= dbB1[s] * dbX - dbA1[s] * dbY + dbZ2[s][a] ;
+					dbZ2[s][a] 	= dbB2[s] * dbX - dbA2[s] * dbY ;
+					dbX 		= dbY ;
+				}
+				dbRef[a][k] = dbX ;
+				dbWindow[a][ulSamples[a] % SIG_WINDOW] = dbX ;
+				ulSamples[a]++ ;
+			}
+		}
+		cCond.Process() ;
+		for (a = 0 ; a < SELF_COND_AXES ; a++)
+		{
+			dbTol = SELF_COND_TOLERANCE * (SELF_COND_AMPLITUDE + 100 * a) * 0.01 * (a + 1) ;
+			iClose = iClose && cCond.OutputCount(a) == iCount[a] && cCond.Result(a).ulSamples == ulSamples[a] ;
+			for (k = 0 ; k < iCount[a] ; k++)
+			{
+				iClose = iClose && fabs(cCond.Output(a)[k] - dbRef[a][k]) <= dbTol ;
+			}
+		}
+	}
+	SELF_CHECK(iClose) ;
+	//
+	// Window of the last SIG_WINDOW samples, or of all when fewer
+	for (iStats = 1, a = 0 ; a < SELF_COND_AXES ; a++)
+	{
+		int iFill = (ulSamples[a] < SIG_WINDOW) ? (int)ulSamples[a] : SIG_WINDOW ;
+
+		dbTol 	= SELF_COND_TOLERANCE * (SELF_COND_AMPLITUDE + 100 * a) * 0.01 * (a + 1) ;
+		dbSumSq = 0.0 ;
+		dbPeak 	= dbWindow[a][0] ;
+		dbMin 	= dbWindow[a][0] ;
+		for (k = 0 ; k < iFill ; k++)
+		{
+			dbSumSq += dbWindow[a][k] * dbWindow[a][k] ;
+			dbPeak 	= (dbWindow[a][k] > dbPeak) ? dbWindow[a][k] : dbPeak ;
+			dbMin 	= (dbWindow[a][k] < dbMin) ? dbWindow[a][k] : dbMin ;
+		}
+		iStats = iStats && fabs(cCond.Result(a).fRms - sqrt(dbSumSq / iFill)) <= dbTol ;
+		iStats = iStats && fabs(cCond.Result(a).fPeak - dbPeak) <= dbTol && fabs(cCond.Result(a).fMin - dbMin) <= dbTol ;
+		iStats = iStats && fabs(cCond.Result(a).fValue - dbWindow[a][(ulSamples[a] - 1) % SIG_WINDOW]) <= dbTol ;
+	}
+	SELF_CHECK(iStats) ;
+	//
+	// The sample after a full block processes it first
+	cCond.Configure(1, SELF_COND_HZ, SELF_COND_CUTOFF_HZ) ;
+	for (k = 0 ; k <= SIG_BLOCK ; k++)
+	{
+		cCond.Push(0, (int16_t)k) ;
+	}
+	SELF_CHECK(cCond.OutputCount(0) == SIG_BLOCK && cCond.Result(0).ulSamples == SIG_BLOCK) ;
+	cCond.Process() ;
+	SELF_CHECK(cCond.OutputCount(0) == 1 && cCond.Result(0).ulSamples == SIG_BLOCK + 1) ;
+}
+/*
+============================================================================
+ The checks, in the order they run
+============================================================================
+*/
+static const SELF_TEST gstSelfTests[] =
+{
+	{ "command mailbox", 	CheckMailbox },
+	{ "modbus publisher", 	CheckPublisher },
+	{ "torque archive", 	CheckArchive },
+	{ "SDO engine", 		CheckSdoEngine },
+	{ "motion sequencer", 	CheckSequencer },
+	{ "torque signature", 	CheckSignature },
+	{ "segment stats", 		CheckSegments },
+	{ "signal conditioning", 	CheckSignalCond },
+} ;
+/*
+============================================================================
+ Function:				RunSelfTest()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		The checks that failed, 0 if all passed.
+ Version:				Version 1.00
+
+ Description:
+
+ Runs the checks of gstSelfTests[] and prints their results.
+============================================================================
+*/
+int RunSelfTest()
+{
+	int iFailed = 0 ;
+	int i ;
+
+	for (i = 0 ; i < (int)(sizeof(gstSelfTests) / sizeof(gstSelfTests[0])) ; i++)
+	{
+		giChecks = 0 ;
+		giFailed = 0 ;
+		gstSelfTests[i].pfnCheck() ;
+		printf("%-24s %s, %d of %d conditions failed\n", gstSelfTests[i].cpName,
+			   (giFailed == 0) ? "passed" : "FAILED", giFailed, giChecks) ;
+		if (giFailed != 0)
+			iFailed++ ;
+	}
+	printf("Self test: %d of %d checks failed\n", iFailed, i) ;
+	return iFailed ;
+}
@@ -0,0 +1,26 @@
+/*
+============================================================================
+ Name : self_test.h
+ Author  :
+ Version :
+ Description : 	Regression checks of the modules that run without drives.
+
+ RunSelfTest() runs each check of the table in self_test.cpp against the
+ simulated backend or against memory and files only, and prints one line
+ per check:
+
+ 	MDS-TorqueRead -selftest
+
+ A check counts the conditions that failed and prints each of them with its
+ line. The checks are short and deterministic: they test what a change may
+ break silently, not the timing of the cycle, which is the job of -bench.
+============================================================================
+*/
+#ifndef SELF_TEST_H_
+#define SELF_TEST_H_
+
+#define		SELF_TEST_DIR			"/tmp"	// Where the checks that need files write them
+
+int  RunSelfTest() ;
+
+#endif /* SELF_TEST_H_ */
@@ -0,0 +1,73 @@
+/*
+============================================================================
+ Name : seqlock.h
+ Author  :
+ Version :
+ Description : 	Latest value of a structure, written by one thread and read
+ 				by others, without a lock.
+
+ The writer makes the sequence number odd, copies the value, and makes it
+ even again. A reader copies the value between two reads of the sequence
+ number and starts again if it changed or was odd. The writer never waits:
+ it suits a real-time thread publishing to slower ones, which always get
+ a consistent copy of the last value, never a queue of old ones.
+
+ One writer thread only. T must be copyable with =, with no pointer the
+ reader would follow.
+============================================================================
+*/
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <stdint.h>
+
+template <typename T>
+class CSeqLock
+{
+public:
+	CSeqLock() : m_ulSeq(0)
+	{
+	}
+/*
+============================================================================
+ Writer side
+============================================================================
+*/
+	void Write(const T& stValue)
+	{
+		m_ulSeq = m_ulSeq + 1 ;
+		__sync_synchronize() ;				// Odd before the value changes
+		m_Value = stValue ;
+		__sync_synchronize() ;				// Value complete before even again
+		m_ulSeq = m_ulSeq + 1 ;
+	}
+/*
+============================================================================
+ Reader side. Returns the sequence number of the copy, even, 0 if nothing
+ was written yet.
+============================================================================
+*/
+	uint32_t Read(T& stValue) const
+	{
+		uint32_t ulSeq ;
+
+		for (;;)
+		{
+			ulSeq = m_ulSeq ;
+			if (ulSeq & 1)
+				continue ;					// Write in progress, it is short
+			__sync_synchronize() ;
+			stValue = m_Value ;
+			__sync_synchronize() ;
+			if (ulSeq == m_ulSeq)
+				return ulSeq ;
+		}
+	}
+	uint32_t Sequence() const		{ return m_ulSeq ; }
+
+private:
+	volatile uint32_t	m_ulSeq ;
+	T					m_Value ;
+} ;
+
+#endif /* SEQLOCK_H_ */
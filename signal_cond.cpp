@@ -0,0 +1,407 @@
+/*
+============================================================================
+ Name : 	signal_cond.cpp
+ Author :
+ Version :	1.00
+ Description : Torque and current signal conditioning, see signal_cond.h
+============================================================================
+*/
+#include <string.h>
+#include <math.h>
+#include "signal_cond.h"
+/*
+============================================================================
+ SIMD primitives. The kernels below are written once against these, for
+ SIG_LANES axes or samples at a time. Loads and stores are unaligned, so
+ any offset may be used.
+============================================================================
+*/
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+#define		SIG_LANES		8
+#define		SIG_ISA			"AVX2"
+typedef __m256		SIG_VEC ;
+typedef __m256		SIG_MASK ;
+
+static inline SIG_VEC VecLoad(const float* p)				{ return _mm256_loadu_ps(p) ; }
+static inline void VecStore(float* p, SIG_VEC v)			{ _mm256_storeu_ps(p, v) ; }
+static inline SIG_VEC VecSet1(float f)						{ return _mm256_set1_ps(f) ; }
+static inline SIG_VEC VecAdd(SIG_VEC a, SIG_VEC b)			{ return _mm256_add_ps(a, b) ; }
+static inline SIG_VEC VecSub(SIG_VEC a, SIG_VEC b)			{ return _mm256_sub_ps(a, b) ; }
+static inline SIG_VEC VecMul(SIG_VEC a, SIG_VEC b)			{ return _mm256_mul_ps(a, b) ; }
+static inline SIG_VEC VecMax(SIG_VEC a, SIG_VEC b)			{ return _mm256_max_ps(a, b) ; }
+static inline SIG_VEC VecMin(SIG_VEC a, SIG_VEC b)			{ return _mm256_min_ps(a, b) ; }
+static inline SIG_VEC VecFromI16(const int16_t* p)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p))) ;
+}
+static inline SIG_MASK VecBelow(int k, const int32_t* p)	// Lanes where k < p[lane]
+{
+	return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)p), _mm256_set1_epi32(k))) ;
+}
+static inline SIG_VEC VecSelect(SIG_MASK m, SIG_VEC a, SIG_VEC b)	{ return _mm256_blendv_ps(b, a, m) ; }
+
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+
+#define		SIG_LANES		4
+#define		SIG_ISA			"SSE2"
+typedef __m128		SIG_VEC ;
+typedef __m128		SIG_MASK ;
+
+static inline SIG_VEC VecLoad(const float* p)				{ return _mm_loadu_ps(p) ; }
+static inline void VecStore(float* p, SIG_VEC v)			{ _mm_storeu_ps(p, v) ; }
+static inline SIG_VEC VecSet1(float f)						{ return _mm_set1_ps(f) ; }
+static inline SIG_VEC VecAdd(SIG_VEC a, SIG_VEC b)			{ return _mm_add_ps(a, b) ; }
+static inline SIG_VEC VecSub(SIG_VEC a, SIG_VEC b)			{ return _mm_sub_ps(a, b) ; }
+static inline SIG_VEC VecMul(SIG_VEC a, SIG_VEC b)			{ return _mm_mul_ps(a, b) ; }
+static inline SIG_VEC VecMax(SIG_VEC a, SIG_VEC b)			{ return _mm_max_ps(a, b) ; }
+static inline SIG_VEC VecMin(SIG_VEC a, SIG_VEC b)			{ return _mm_min_ps(a, b) ; }
+static inline SIG_VEC VecFromI16(const int16_t* p)
+{
+	__m128i v = _mm_loadl_epi64((const __m128i*)p) ;
+
+	return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)) ;
+}
+static inline SIG_MASK VecBelow(int k, const int32_t* p)
+{
+	return _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set1_epi32(k), _mm_loadu_si128((const __m128i*)p))) ;
+}
+static inline SIG_VEC VecSelect(SIG_MASK m, SIG_VEC a, SIG_VEC b)	{ return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)) ; }
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+#define		SIG_LANES		4
+#define		SIG_ISA			"NEON"
+typedef float32x4_t	SIG_VEC ;
+typedef uint32x4_t	SIG_MASK ;
+
+static inline SIG_VEC VecLoad(const float* p)				{ return vld1q_f32(p) ; }
+static inline void VecStore(float* p, SIG_VEC v)			{ vst1q_f32(p, v) ; }
+static inline SIG_VEC VecSet1(float f)						{ return vdupq_n_f32(f) ; }
+static inline SIG_VEC VecAdd(SIG_VEC a, SIG_VEC b)			{ return vaddq_f32(a, b) ; }
+static inline SIG_VEC VecSub(SIG_VEC a, SIG_VEC b)			{ return vsubq_f32(a, b) ; }
+static inline SIG_VEC VecMul(SIG_VEC a, SIG_VEC b)			{ return vmulq_f32(a, b) ; }
+static inline SIG_VEC VecMax(SIG_VEC a, SIG_VEC b)			{ return vmaxq_f32(a, b) ; }
+static inline SIG_VEC VecMin(SIG_VEC a, SIG_VEC b)			{ return vminq_f32(a, b) ; }
+static inline SIG_VEC VecFromI16(const int16_t* p)			{ return vcvtq_f32_s32(vmovl_s16(vld1_s16(p))) ; }
+static inline SIG_MASK VecBelow(int k, const int32_t* p)	{ return vcltq_s32(vdupq_n_s32(k), vld1q_s32(p)) ; }
+static inline SIG_VEC VecSelect(SIG_MASK m, SIG_VEC a, SIG_VEC b)	{ return vbslq_f32(m, a, b) ; }
+
+#else
+
+#define		SIG_LANES		1
+#define		SIG_ISA			"scalar"
+typedef float		SIG_VEC ;
+typedef int			SIG_MASK ;
+
+static inline SIG_VEC VecLoad(const float* p)				{ return *p ; }
+static inline void VecStore(float* p, SIG_VEC v)			{ *p = v ; }
+static inline SIG_VEC VecSet1(float f)						{ return f ; }
+static inline SIG_VEC VecAdd(SIG_VEC a, SIG_VEC b)			{ return a + b ; }
+static inline SIG_VEC VecSub(SIG_VEC a, SIG_VEC b)			{ return a - b ; }
+static inline SIG_VEC VecMul(SIG_VEC a, SIG_VEC b)			{ return a * b ; }
+static inline SIG_VEC VecMax(SIG_VEC a, SIG_VEC b)			{ return (a > b) ? a : b ; }
+static inline SIG_VEC VecMin(SIG_VEC a, SIG_VEC b)			{ return (a < b) ? a : b ; }
+static inline SIG_VEC VecFromI16(const int16_t* p)			{ return (float)*p ; }
+static inline SIG_MASK VecBelow(int k, const int32_t* p)	{ return k < *p ; }
+static inline SIG_VEC VecSelect(SIG_MASK m, SIG_VEC a, SIG_VEC b)	{ return m ? a : b ; }
+
+#endif
+//
+// Q of the two sections of a 4th order Butterworth filter
+//
+static const double gdbButterworthQ[SIG_BIQUADS] = { 0.54119610, 1.30656296 } ;
+/*
+============================================================================
+ Function:				CSignalCond()
+ Description:			Constructor. Unit scale, filter passing everything.
+============================================================================
+*/
+CSignalCond::CSignalCond()
+{
+	int i ;
+
+	for (i = 0 ; i < SIG_MAX_AXES ; i++)
+	{
+		m_fScale[i] = 1.0f ;
+	}
+	Configure(0, 1.0, 0.0) ;
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		iAxes - axes conditioned, SIG_MAX_AXES at most.
+ 						dbSampleHz - rate of the samples pushed for one axis.
+ 						dbCutoffHz - low-pass corner frequency. 0 or above
+ 						0.45 dbSampleHz disables the filter.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Designs the low-pass sections (bilinear transform, RBJ cookbook form) and
+ clears the blocks, filter states, windows and results. The scales are kept.
+============================================================================
+*/
+void CSignalCond::Configure(int iAxes, double dbSampleHz, double dbCutoffHz)
+{
+	int s ;
+
+	if (iAxes > SIG_MAX_AXES)
+		iAxes = SIG_MAX_AXES ;
+	m_iAxes = iAxes ;
+
+	for (s = 0 ; s < SIG_BIQUADS ; s++)
+	{
+		SIG_BIQUAD& stBq = m_stBiquad[s] ;
+
+		if (dbCutoffHz <= 0.0 || dbSampleHz <= 0.0 || dbCutoffHz > 0.45 * dbSampleHz)
+		{
+			stBq.fB0 = 1.0f ;
+			stBq.fB1 = stBq.fB2 = stBq.fA1 = stBq.fA2 = 0.0f ;
+		}
+		else
+		{
+			double dbW0 	= 2.0 * M_PI * dbCutoffHz / dbSampleHz ;
+			double dbCos 	= cos(dbW0) ;
+			double dbAlpha 	= sin(dbW0) / (2.0 * gdbButterworthQ[s]) ;
+			double dbA0 	= 1.0 + dbAlpha ;
+
+			stBq.fB0 = (float)((1.0 - dbCos) / 2.0 / dbA0) ;
+			stBq.fB1 = (float)((1.0 - dbCos) / dbA0) ;
+			stBq.fB2 = stBq.fB0 ;
+			stBq.fA1 = (float)(-2.0 * dbCos / dbA0) ;
+			stBq.fA2 = (float)((1.0 - dbAlpha) / dbA0) ;
+		}
+	}
+
+	memset(m_sRaw, 0, sizeof(m_sRaw)) ;
+	memset(m_fBlock, 0, sizeof(m_fBlock)) ;
+	memset(m_iCount, 0, sizeof(m_iCount)) ;
+	memset(m_fZ1, 0, sizeof(m_fZ1)) ;
+	memset(m_fZ2, 0, sizeof(m_fZ2)) ;
+	memset(m_iPrimed, 0, sizeof(m_iPrimed)) ;
+	memset(m_fOut, 0, sizeof(m_fOut)) ;
+	memset(m_iOutCount, 0, sizeof(m_iOutCount)) ;
+	memset(m_fWindow, 0, sizeof(m_fWindow)) ;
+	memset(m_ulWinNext, 0, sizeof(m_ulWinNext)) ;
+	memset(m_stResult, 0, sizeof(m_stResult)) ;
+}
+/*
+============================================================================
+ Function:				Process()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Conditions the samples pushed since the previous call and updates the
+ results of the axes that received some. The axes with fewer samples than
+ the others keep their filter state in the lanes beyond their count.
+============================================================================
+*/
+void CSignalCond::Process()
+{
+	int iMax = 0 ;
+	int a, k ;
+
+	for (a = 0 ; a < m_iAxes ; a++)
+	{
+		if (m_iCount[a] > iMax)
+			iMax = m_iCount[a] ;
+		//
+		// A new filter starts in steady state on its first sample, not from 0.
+		if (m_iCount[a] && !m_iPrimed[a])
+			Prime(a, m_sRaw[0][a] * m_fScale[a]) ;
+	}
+	if (iMax == 0)
+		return ;
+
+	Filter(iMax) ;
+
+	for (a = 0 ; a < m_iAxes ; a++)
+	{
+		int iCount = m_iCount[a] ;
+
+		if (iCount == 0)
+		{
+			m_iOutCount[a] = 0 ;
+			continue ;
+		}
+		for (k = 0 ; k < iCount ; k++)
+		{
+			m_fOut[a][k] = m_fBlock[k][a] ;
+		}
+		m_iOutCount[a] 				= iCount ;
+		m_stResult[a].fValue 		= m_fOut[a][iCount - 1] ;
+		m_stResult[a].ulSamples    += iCount ;
+		UpdateWindow(a) ;
+		m_iCount[a] = 0 ;
+	}
+}
+/*
+============================================================================
+ Function:				Filter()
+ Input arguments:		iSamples - the largest count of samples of the axes.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Converts m_sRaw into m_fBlock and runs the biquads in place, SIG_LANES
+ axes at a time. Transposed direct form II:
+
+ 	y 	= b0 * x + z1
+ 	z1 	= b1 * x - a1 * y + z2
+ 	z2 	= b2 * x - a2 * y
+============================================================================
+*/
+void CSignalCond::Filter(int iSamples)
+{
+	int g, s, k ;
+
+	for (g = 0 ; g < m_iAxes ; g += SIG_LANES)
+	{
+		SIG_VEC vScale = VecLoad(&m_fScale[g]) ;
+
+		for (k = 0 ; k < iSamples ; k++)
+		{
+			VecStore(&m_fBlock[k][g], VecMul(VecFromI16(&m_sRaw[k][g]), vScale)) ;
+		}
+
+		for (s = 0 ; s < SIG_BIQUADS ; s++)
+		{
+			const SIG_BIQUAD& stBq = m_stBiquad[s] ;
+			SIG_VEC vB0 = VecSet1(stBq.fB0) ;
+			SIG_VEC vB1 = VecSet1(stBq.fB1) ;
+			SIG_VEC vB2 = VecSet1(stBq.fB2) ;
+			SIG_VEC vA1 = VecSet1(stBq.fA1) ;
+			SIG_VEC vA2 = VecSet1(stBq.fA2) ;
+			SIG_VEC vZ1 = VecLoad(&m_fZ1[s][g]) ;
+			SIG_VEC vZ2 = VecLoad(&m_fZ2[s][g]) ;
+
+			for (k = 0 ; k < iSamples ; k++)
+			{
+				SIG_MASK mActive = VecBelow(k, &m_iCount[g]) ;
+				SIG_VEC vX = VecLoad(&m_fBlock[k][g]) ;
+				SIG_VEC vY = VecAdd(VecMul(vB0, vX), vZ1) ;
+				SIG_VEC vNewZ1 = VecAdd(VecSub(VecMul(vB1, vX), VecMul(vA1, vY)), vZ2) ;
+				SIG_VEC vNewZ2 = VecSub(VecMul(vB2, vX), VecMul(vA2, vY)) ;
+
+				vZ1 = VecSelect(mActive, vNewZ1, vZ1) ;
+				vZ2 = VecSelect(mActive, vNewZ2, vZ2) ;
+				VecStore(&m_fBlock[k][g], vY) ;
+			}
+			VecStore(&m_fZ1[s][g], vZ1) ;
+			VecStore(&m_fZ2[s][g], vZ2) ;
+		}
+	}
+}
+/*
+============================================================================
+ Function:				Prime()
+ Description:			Sets the filter state of an axis to the steady state of
+ 						a constant input fFirst. The sections have unit DC gain.
+============================================================================
+*/
+void CSignalCond::Prime(int iAxis, float fFirst)
+{
+	int s ;
+
+	for (s = 0 ; s < SIG_BIQUADS ; s++)
+	{
+		m_fZ1[s][iAxis] = fFirst * (1.0f - m_stBiquad[s].fB0) ;
+		m_fZ2[s][iAxis] = fFirst * (m_stBiquad[s].fB2 - m_stBiquad[s].fA2) ;
+	}
+	m_iPrimed[iAxis] = 1 ;
+}
+/*
+============================================================================
+ Function:				UpdateWindow()
+ Input arguments:		iAxis - an axis with a new output block.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Appends the output block to the window of the axis, then recomputes the
+ RMS, peak and minimum over the whole window, SIG_LANES samples at a time.
+ Recomputing, rather than updating running sums, costs SIG_WINDOW / SIG_LANES
+ steps and never drifts.
+============================================================================
+*/
+void CSignalCond::UpdateWindow(int iAxis)
+{
+	float* pfWin = m_fWindow[iAxis] ;
+	const float* pfOut = m_fOut[iAxis] ;
+	int iCount = m_iOutCount[iAxis] ;
+	uint32_t ulPos = m_ulWinNext[iAxis] & (SIG_WINDOW - 1) ;
+	int iFirst = SIG_WINDOW - (int)ulPos ;
+	int iFill ;
+	float fLane[SIG_LANES] ;
+	float fSumSq, fPeak, fMin ;
+	SIG_VEC vSumSq, vPeak, vMin ;
+	int i, l ;
+
+	if (iFirst > iCount)
+		iFirst = iCount ;
+	memcpy(pfWin + ulPos, pfOut, iFirst * sizeof(float)) ;
+	memcpy(pfWin, pfOut + iFirst, (iCount - iFirst) * sizeof(float)) ;
+	m_ulWinNext[iAxis] += iCount ;
+	iFill = (m_ulWinNext[iAxis] < SIG_WINDOW) ? (int)m_ulWinNext[iAxis] : SIG_WINDOW ;
+
+	vSumSq 	= VecSet1(0.0f) ;
+	vPeak 	= VecSet1(pfWin[0]) ;
+	vMin 	= vPeak ;
+	for (i = 0 ; i + SIG_LANES <= iFill ; i += SIG_LANES)
+	{
+		SIG_VEC v = VecLoad(pfWin + i) ;
+
+		vSumSq 	= VecAdd(vSumSq, VecMul(v, v)) ;
+		vPeak 	= VecMax(vPeak, v) ;
+		vMin 	= VecMin(vMin, v) ;
+	}
+	//
+	// Reduce the lanes, then the samples left over
+	VecStore(fLane, vSumSq) ;
+	fSumSq = 0.0f ;
+	for (l = 0 ; l < SIG_LANES ; l++)
+		fSumSq += fLane[l] ;
+	VecStore(fLane, vPeak) ;
+	fPeak = fLane[0] ;
+	for (l = 1 ; l < SIG_LANES ; l++)
+		fPeak = (fLane[l] > fPeak) ? fLane[l] : fPeak ;
+	VecStore(fLane, vMin) ;
+	fMin = fLane[0] ;
+	for (l = 1 ; l < SIG_LANES ; l++)
+		fMin = (fLane[l] < fMin) ? fLane[l] : fMin ;
+
+	for ( ; i < iFill ; i++)
+	{
+		fSumSq += pfWin[i] * pfWin[i] ;
+		fPeak = (pfWin[i] > fPeak) ? pfWin[i] : fPeak ;
+		fMin = (pfWin[i] < fMin) ? pfWin[i] : fMin ;
+	}
+
+	m_stResult[iAxis].fRms 	= sqrtf(fSumSq / iFill) ;
+	m_stResult[iAxis].fPeak = fPeak ;
+	m_stResult[iAxis].fMin 	= fMin ;
+}
+/*
+============================================================================
+ Function:				Isa()
+ Returned value:		The instruction set the kernels were compiled for.
+============================================================================
+*/
+const char* CSignalCond::Isa()
+{
+	return SIG_ISA ;
+}
@@ -0,0 +1,108 @@
+/*
+============================================================================
+ Name : signal_cond.h
+ Author  :
+ Version :
+ Description : 	Signal conditioning of the torque and current streams.
+
+ The raw samples of every axis (per-mille of the motor rated value) are
+ pushed as they are acquired, and conditioned in blocks once per cycle by
+ Process():
+
+ 	- conversion to engineering units, Nm or A, with a per-axis scale,
+ 	- 4th order Butterworth low-pass, two cascaded biquads,
+ 	- moving RMS, peak and minimum over the last SIG_WINDOW filtered samples.
+
+ The filtered samples of the last block and the statistics land in per-axis
+ result buffers, see Output() and Result().
+
+ The conversion and the filter process the axes side by side, one axis per
+ SIMD lane: the block is stored sample by sample, the axes of one sample
+ being contiguous. The window statistics run along the samples of one axis.
+ The instruction set is chosen at compile time: AVX2 (8 lanes), SSE2 or NEON
+ (4 lanes), or plain C (1 lane) for the other targets. Isa() tells which.
+
+ Push() and Process() are called from the cycle thread only.
+============================================================================
+*/
+#ifndef SIGNAL_COND_H_
+#define SIGNAL_COND_H_
+
+#include <stdint.h>
+
+#define		SIG_MAX_AXES			16		// A multiple of the widest SIMD width, 8
+#define		SIG_BLOCK				64		// Samples per axis between two Process()
+#define		SIG_WINDOW				256		// Samples of the moving RMS, peak and minimum
+#define		SIG_BIQUADS				2		// 4th order filter
+#define		SIG_ALIGN				32		// Widest SIMD register, in bytes
+
+typedef struct
+{
+	float			fB0;					// Normalized, a0 = 1
+	float			fB1;
+	float			fB2;
+	float			fA1;
+	float			fA2;
+} SIG_BIQUAD;
+
+typedef struct
+{
+	float			fValue;					// Last filtered sample, engineering units
+	float			fRms;					// Over the window
+	float			fPeak;
+	float			fMin;
+	unsigned long	ulSamples;				// Conditioned since Configure()
+} SIG_RESULT;
+
+class CSignalCond
+{
+public:
+	CSignalCond() ;
+
+	void Configure(int iAxes, double dbSampleHz, double dbCutoffHz) ;
+	void SetScale(int iAxis, float fUnitsPerRaw)	{ m_fScale[iAxis] = fUnitsPerRaw ; }
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	void Push(int iAxis, int16_t sRaw)
+	{
+		if (m_iCount[iAxis] >= SIG_BLOCK)
+			Process() ;
+		m_sRaw[m_iCount[iAxis]][iAxis] = sRaw ;
+		m_iCount[iAxis]++ ;
+	}
+	void Process() ;
+
+	const SIG_RESULT& Result(int iAxis) const	{ return m_stResult[iAxis] ; }
+	const float* Output(int iAxis) const		{ return m_fOut[iAxis] ; }
+	int  OutputCount(int iAxis) const			{ return m_iOutCount[iAxis] ; }
+
+	static const char* Isa() ;
+
+private:
+	void Filter(int iSamples) ;
+	void Prime(int iAxis, float fFirst) ;
+	void UpdateWindow(int iAxis) ;
+	//
+	// Input block, sample by sample, and the filter state, axis by axis
+	int16_t			m_sRaw[SIG_BLOCK][SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	float			m_fBlock[SIG_BLOCK][SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	int32_t			m_iCount[SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	float			m_fScale[SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	float			m_fZ1[SIG_BIQUADS][SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	float			m_fZ2[SIG_BIQUADS][SIG_MAX_AXES] __attribute__((aligned(SIG_ALIGN))) ;
+	SIG_BIQUAD		m_stBiquad[SIG_BIQUADS] ;
+	int				m_iPrimed[SIG_MAX_AXES] ;
+	//
+	// Results, axis by axis
+	float			m_fOut[SIG_MAX_AXES][SIG_BLOCK] __attribute__((aligned(SIG_ALIGN))) ;
+	int				m_iOutCount[SIG_MAX_AXES] ;
+	float			m_fWindow[SIG_MAX_AXES][SIG_WINDOW] __attribute__((aligned(SIG_ALIGN))) ;
+	uint32_t		m_ulWinNext[SIG_MAX_AXES] ;		// Free running write index
+	SIG_RESULT		m_stResult[SIG_MAX_AXES] ;
+	int				m_iAxes ;
+} ;
+
+#endif /* SIGNAL_COND_H_ */
@@ -0,0 +1,838 @@
+/*
+============================================================================
+ Name : 	sim_backend.cpp
+ Author :
+ Version :	1.00
+ Description : In-process simulated GMAS, CAN network and drives, see sim_backend.h
+============================================================================
+*/
+#include "mmc_definitions.h"
+#include "mmcpplib.h"
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include "mono_time.h"
+#include "pdo_acquisition.h"
+#include "sim_backend.h"
+
+#define		SIM_MAX_TORQUE			3000	// per-mille, drive torque limit
+#define		SIM_TPDO3_COBID			0x380	// Default TPDO3 COB-ID, plus the node ID
+#define		SIM_FRAMES_PER_SDO		2		// Expedited transfer: request and response
+/*
+============================================================================
+ Event frames, laid out as CMMCConnection::CallbackFunc() of the library
+ reads them, not from the offsets the application decodes them with, so
+ the simulator does not agree with a wrong decoder by construction.
+============================================================================
+*/
+#define		SIM_EVT_ID				1		// Low byte of the event ID, big endian on the GMAS
+#define		SIM_EVT_AXIS_REF		12		// unsigned short, in every event
+#define		SIM_EVT_PDO_TYPE		14		// Payload type of a PDORCV_EVT
+#define		SIM_EVT_PDO_DATA		15		// The CAN data of the PDO
+#define		SIM_PDO_TYPE_8_BYTES	3		// A type whose 8 bytes of data the library passes on
+#define		SIM_EVT_MBUS_FUNC		4		// Modbus function of a host write, see command_mailbox.h
+#define		SIM_EVT_MBUS_COUNT		14		// Count, then values, of a "write multiple registers"
+#define		SIM_MBUS_WRITE_SINGLE	6		// Modbus functions
+#define		SIM_MBUS_WRITE_MULTIPLE	16
+/*
+============================================================================
+ Function:				DefaultConfig()
+ Output arguments: 		stConfig - parameters giving torques in the range of a real
+ 						axis for the TEST_SPEED / TEST_POS moves of main.h.
+============================================================================
+*/
+void CSimBackend::DefaultConfig(SIM_CONFIG& stConfig)
+{
+	stConfig.ulIpcLatencyUs 	= 50 ;
+	stConfig.ulCanLatencyUs 	= 1000 ;
+	stConfig.ulPowerOnMs 		= 50 ;
+	stConfig.dbInertia 			= 0.0002 ;
+	stConfig.dbViscous 			= 0.01 ;
+	stConfig.dbCoulomb 			= 30.0 ;
+	stConfig.dbRippleAmp 		= 8.0 ;
+	stConfig.dbRipplePeriod 	= 1000.0 ;
+	stConfig.dbNoiseAmp 		= 4.0 ;
+	stConfig.dbCurrentPerTorque = 1.1 ;
+	stConfig.ulRatedTorqueMnm 	= 1270 ;
+	stConfig.ulRatedCurrentMa 	= 3300 ;
+}
+/*
+============================================================================
+ Function:				CSimBackend()
+ Description:			Constructor.
+============================================================================
+*/
+CSimBackend::CSimBackend()
+{
+	DefaultConfig(m_stConfig) ;
+	pthread_mutex_init(&m_stLock, NULL) ;
+	m_pfnCallback 	= NULL ;
+	m_iRun 			= 0 ;
+	m_ullSyncNs 	= (uint64_t)SIM_BASE_SYNC_US * NSEC_PER_USEC ;
+	m_uiRand 		= 12345 ;
+	m_ulCanFrames 	= 0 ;
+	m_ulIpcCalls 	= 0 ;
+	m_ulMbusWrites 	= 0 ;
+	m_ulMbusRegisters = 0 ;
+	m_iHostWrites 	= 0 ;
+	m_iAxes 		= 0 ;
+	m_iEvents 		= 0 ;
+	memset(m_sMbusRegs, 0, sizeof(m_sMbusRegs)) ;
+}
+/*
+============================================================================
+ Function:				ConnectIPCEx()
+ Description:			Starts the simulation thread. Events are delivered to
+ 						pfnCallback from that thread.
+============================================================================
+*/
+MMC_CONNECT_HNDL CSimBackend::ConnectIPCEx(int iEventsMask, MMC_MB_CLBK pfnCallback)
+{
+	m_pfnCallback 	= pfnCallback ;
+	m_iRun 			= 1 ;
+	if (pthread_create(&m_stThread, NULL, ThreadFunc, this) != 0)
+	{
+		printf("Simulator: cannot start the simulation thread\n") ;
+		m_iRun = 0 ;
+	}
+	return 1 ;
+}
+/*
+============================================================================
+ Function:				Close()
+ Description:			Stops the simulation thread and removes the drives, so
+ 						the backend can be connected again from scratch.
+============================================================================
+*/
+void CSimBackend::Close()
+{
+	if (m_iRun)
+	{
+		m_iRun = 0 ;
+		pthread_join(m_stThread, NULL) ;
+	}
+	m_iAxes 	= 0 ;
+	m_iEvents 	= 0 ;
+}
+/*
+============================================================================
+ Function:				CreateAxis()
+ Description:			Creates a simulated drive, node IDs are given in order.
+============================================================================
+*/
+CAxisBackend* CSimBackend::CreateAxis(const char* cpName)
+{
+	CSimAxis* pAxis ;
+
+	if (m_iAxes >= BACKEND_MAX_AXES)
+		return NULL ;
+
+	IpcCall() ;
+	pAxis = &m_cAxis[m_iAxes] ;
+	memset(&pAxis->m_stDrive, 0, sizeof(pAxis->m_stDrive)) ;
+	pAxis->m_pSim 			= this ;
+	pAxis->m_usRef 			= (unsigned short)m_iAxes ;
+	pAxis->m_fAcceleration 	= 1000000.0 ;
+	pAxis->m_fDeceleration 	= 1000000.0 ;
+	pAxis->m_ulPendHead 	= 0 ;
+	pAxis->m_ulPendTail 	= 0 ;
+	pAxis->m_ulRepHead 		= 0 ;
+	pAxis->m_ulRepTail 		= 0 ;
+	pAxis->m_ulDownHead 	= 0 ;
+	pAxis->m_ulDownTail 	= 0 ;
+	pAxis->m_ullBusFreeNs 	= 0 ;
+	pAxis->m_stDrive.lTpdo3CobId = SIM_TPDO3_COBID + m_iAxes + 1 ;
+	m_iAxes++ ;
+	return pAxis ;
+}
+/*
+============================================================================
+ Function:				SetSyncTime()
+ Description:			Sets the SYNC period of the simulated bus.
+============================================================================
+*/
+void CSimBackend::SetSyncTime(int iSyncMultiplier)
+{
+	IpcCall() ;
+	if (iSyncMultiplier < 1)
+		iSyncMultiplier = 1 ;
+	m_ullSyncNs = (uint64_t)iSyncMultiplier * SIM_BASE_SYNC_US * NSEC_PER_USEC ;
+}
+/*
+============================================================================
+ Function:				ReadInputs()
+ Input arguments:		pAxes, iAxes - axes created by this backend.
+ 						stIn - arrays to fill, NULL for the inputs not needed.
+ Output arguments: 		The arrays of stIn.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ One IPC call for the whole group. The drives are read under one lock, so
+ the image is consistent: all the axes as of the same SYNC.
+============================================================================
+*/
+void CSimBackend::ReadInputs(CAxisBackend* const* pAxes, int iAxes, const AXIS_INPUTS& stIn)
+{
+	int i ;
+
+	IpcCall() ;
+	pthread_mutex_lock(&m_stLock) ;
+	for (i = 0 ; i < iAxes ; i++)
+	{
+		const CSimAxis* pAxis = (const CSimAxis*)pAxes[i] ;
+
+		if (stIn.pulStatus)
+			stIn.pulStatus[i] = pAxis->Status() ;
+		if (stIn.plPosition)
+			stIn.plPosition[i] = (int32_t)pAxis->m_stDrive.dbPos ;
+		if (stIn.plVelocity)
+			stIn.plVelocity[i] = (int32_t)pAxis->m_stDrive.dbVel ;
+		if (stIn.plTorque)
+			stIn.plTorque[i] = pAxis->m_stDrive.sTorque ;
+	}
+	pthread_mutex_unlock(&m_stLock) ;
+}
+/*
+============================================================================
+ Function:				MbusWriteRegisters()
+ Input arguments:		iStartRef - first holding register.
+ 						iCount - registers to write, SIM_MBUS_MAX_WRITE at most.
+ 						spRegs - their values.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the request is out of range.
+ Version:				Version 1.00
+
+ Description:
+
+ One IPC call per request, whatever its size. The registers are stored in
+ the image of the server, see MbusRegister(), and counted.
+============================================================================
+*/
+int CSimBackend::MbusWriteRegisters(int iStartRef, int iCount, const short* spRegs)
+{
+	IpcCall() ;
+	if (iStartRef < 0 || iCount <= 0 || iCount > SIM_MBUS_MAX_WRITE || iStartRef + iCount > SIM_MBUS_REGS)
+		return -1 ;
+
+	pthread_mutex_lock(&m_stLock) ;
+	memcpy(&m_sMbusRegs[iStartRef], spRegs, iCount * sizeof(short)) ;
+	pthread_mutex_unlock(&m_stLock) ;
+	m_ulMbusWrites++ ;
+	m_ulMbusRegisters += iCount ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				MbusReadRegisters()
+ Input arguments:		iStartRef - first holding register.
+ 						iCount - registers to read, SIM_MBUS_MAX_READ at most.
+ Output arguments: 		spRegs - their values.
+ Returned value:		0 on success, -1 if the request is out of range.
+============================================================================
+*/
+int CSimBackend::MbusReadRegisters(int iStartRef, int iCount, short* spRegs)
+{
+	IpcCall() ;
+	if (iStartRef < 0 || iCount <= 0 || iCount > SIM_MBUS_MAX_READ || iStartRef + iCount > SIM_MBUS_REGS)
+		return -1 ;
+
+	pthread_mutex_lock(&m_stLock) ;
+	memcpy(spRegs, &m_sMbusRegs[iStartRef], iCount * sizeof(short)) ;
+	pthread_mutex_unlock(&m_stLock) ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				HostWrite()
+ Input arguments:		iStartRef - first holding register.
+ 						iCount - registers written.
+ 						spRegs - their values.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the request is out of range or
+ 						too many writes are waiting to be reported.
+ Version:				Version 1.00
+
+ Description:
+
+ Plays the host writing holding registers. They are stored at once, and a
+ MODBUS_WRITE_EVT is reported at the next SYNC: function 6 for one register,
+ else function 16 with the count and as many values as fit in the frame.
+============================================================================
+*/
+int CSimBackend::HostWrite(int iStartRef, int iCount, const short* spRegs)
+{
+	int iRes = -1 ;
+
+	if (iStartRef < 0 || iCount <= 0 || iCount > SIM_MBUS_MAX_WRITE || iStartRef + iCount > SIM_MBUS_REGS)
+		return -1 ;
+
+	pthread_mutex_lock(&m_stLock) ;
+	if (m_iHostWrites < SIM_HOST_WRITES)
+	{
+		memcpy(&m_sMbusRegs[iStartRef], spRegs, iCount * sizeof(short)) ;
+		m_usHostWrite[m_iHostWrites][0] = (uint16_t)iStartRef ;
+		m_usHostWrite[m_iHostWrites][1] = (uint16_t)iCount ;
+		m_iHostWrites++ ;
+		iRes = 0 ;
+	}
+	pthread_mutex_unlock(&m_stLock) ;
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				ThreadFunc()
+ Description:			The simulated GMAS core. Runs one Tick() per SYNC.
+============================================================================
+*/
+void* CSimBackend::ThreadFunc(void* pArg)
+{
+	CSimBackend* pSim = (CSimBackend*)pArg ;
+	uint64_t ullNext = MonoTimeNs() ;
+	uint64_t ullPrev = ullNext ;
+	struct timespec stNext ;
+
+	while (pSim->m_iRun)
+	{
+		uint64_t ullNow ;
+
+		ullNext += pSim->m_ullSyncNs ;
+		stNext.tv_sec 	= (time_t)(ullNext / NSEC_PER_SEC) ;
+		stNext.tv_nsec 	= (long)(ullNext % NSEC_PER_SEC) ;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &stNext, NULL) == EINTR)
+			;
+		ullNow = MonoTimeNs() ;
+		pSim->Tick((double)(ullNow - ullPrev) / NSEC_PER_SEC, ullNow) ;
+		ullPrev = ullNow ;
+	}
+	return NULL ;
+}
+/*
+============================================================================
+ Function:				Tick()
+ Input arguments:		dbDt - seconds since the previous tick, ullNow - time stamp.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ One SYNC of the simulated bus. The drives are updated under the lock, the
+ events are then delivered without it, so the application callback may call
+ back into the backend.
+============================================================================
+*/
+void CSimBackend::Tick(double dbDt, uint64_t ullNow)
+{
+	unsigned long ulFrames = 1 ;				// The SYNC itself
+	int i ;
+
+	pthread_mutex_lock(&m_stLock) ;
+	m_iEvents = 0 ;
+	for (i = 0 ; i < m_iAxes ; i++)
+	{
+		CSimAxis& cAxis = m_cAxis[i] ;
+		SIM_DRIVE& stDrive = cAxis.m_stDrive ;
+
+		StepDrive(stDrive, dbDt) ;
+		//
+		// TPDO3: torque, current and position, little endian
+		if (stDrive.iPdo3On && !(stDrive.lTpdo3CobId & PDO_COBID_INVALID))
+		{
+			unsigned char ucPdo[1 + PDO3_DATA_LEN] ;
+			int32_t lPos = (int32_t)floor(stDrive.dbPos + 0.5) ;
+
+			ucPdo[0] = SIM_PDO_TYPE_8_BYTES ;
+			ucPdo[1] = (unsigned char)(stDrive.sTorque & 0xFF) ;
+			ucPdo[2] = (unsigned char)((stDrive.sTorque >> 8) & 0xFF) ;
+			ucPdo[3] = (unsigned char)(stDrive.sCurrent & 0xFF) ;
+			ucPdo[4] = (unsigned char)((stDrive.sCurrent >> 8) & 0xFF) ;
+			ucPdo[5] = (unsigned char)(lPos & 0xFF) ;
+			ucPdo[6] = (unsigned char)((lPos >> 8) & 0xFF) ;
+			ucPdo[7] = (unsigned char)((lPos >> 16) & 0xFF) ;
+			ucPdo[8] = (unsigned char)((lPos >> 24) & 0xFF) ;
+			AddEvent(PDORCV_EVT, cAxis.m_usRef, SIM_EVT_PDO_TYPE, ucPdo, sizeof(ucPdo)) ;
+			ulFrames++ ;
+		}
+		if (stDrive.iMotionEnded)
+		{
+			stDrive.iMotionEnded = 0 ;
+			AddEvent(MOTIONENDED_EVT, cAxis.m_usRef, 0, NULL, 0) ;
+		}
+		//
+		// Asynchronous SDOs whose transfer is over, the replies of each
+		// direction retrieved by their own call
+		while (cAxis.m_ulPendTail != cAxis.m_ulPendHead
+			   && cAxis.m_stPending[cAxis.m_ulPendTail % SIM_SDO_QUEUE].ullDueNs <= ullNow)
+		{
+			const SIM_SDO& stSdo = cAxis.m_stPending[cAxis.m_ulPendTail % SIM_SDO_QUEUE] ;
+
+			if (stSdo.iUpload)
+				cAxis.m_lReplied[cAxis.m_ulRepHead++ % SIM_SDO_QUEUE] = stSdo.lData ;
+			else
+				cAxis.m_lDownloaded[cAxis.m_ulDownHead++ % SIM_SDO_QUEUE] = stSdo.lData ;
+			cAxis.m_ulPendTail++ ;
+			AddEvent(ASYNC_REPLY_EVT, cAxis.m_usRef, 0, NULL, 0) ;
+			ulFrames += SIM_FRAMES_PER_SDO ;
+		}
+	}
+	//
+	// Host writes: the Modbus function, the first register in the place of the
+	// axis reference, then for several registers the count and the values
+	// that fit in the frame
+	for (i = 0 ; i < m_iHostWrites ; i++)
+	{
+		unsigned char ucData[SIM_EVENT_SIZE - SIM_EVT_MBUS_FUNC] ;
+		int iCountAt = SIM_EVT_MBUS_COUNT - SIM_EVT_MBUS_FUNC ;
+		int iRegs = (int)((sizeof(ucData) - iCountAt - sizeof(uint16_t)) / sizeof(short)) ;
+		uint16_t usFunc = (m_usHostWrite[i][1] == 1) ? SIM_MBUS_WRITE_SINGLE : SIM_MBUS_WRITE_MULTIPLE ;
+		int iLen = iCountAt ;
+
+		memset(ucData, 0, sizeof(ucData)) ;
+		memcpy(ucData, &usFunc, sizeof(usFunc)) ;
+		memcpy(ucData + SIM_EVT_AXIS_REF - SIM_EVT_MBUS_FUNC, &m_usHostWrite[i][0], sizeof(uint16_t)) ;
+		if (usFunc == SIM_MBUS_WRITE_MULTIPLE)
+		{
+			if (iRegs > m_usHostWrite[i][1])
+				iRegs = m_usHostWrite[i][1] ;
+			memcpy(ucData + iCountAt, &m_usHostWrite[i][1], sizeof(uint16_t)) ;
+			memcpy(ucData + iCountAt + sizeof(uint16_t), &m_sMbusRegs[m_usHostWrite[i][0]], iRegs * sizeof(short)) ;
+			iLen += sizeof(uint16_t) + iRegs * sizeof(short) ;
+		}
+		AddEvent(MODBUS_WRITE_EVT, m_usHostWrite[i][0], SIM_EVT_MBUS_FUNC, ucData, iLen) ;
+	}
+	m_iHostWrites = 0 ;
+	pthread_mutex_unlock(&m_stLock) ;
+
+	CountFrames(ulFrames) ;
+	if (m_pfnCallback)
+	{
+		for (i = 0 ; i < m_iEvents ; i++)
+		{
+			m_pfnCallback(m_ucEvents[i], m_sEventLen[i], NULL) ;
+		}
+	}
+}
+/*
+============================================================================
+ Function:				StepDrive()
+ Input arguments:		stDrive - the drive, dbDt - time step, in seconds.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Advances the trapezoidal profile of a drive by dbDt and computes its torque
+ and current. The drive decelerates when the remaining distance is within
+ its stopping distance, and snaps to the target when it would cross it.
+============================================================================
+*/
+void CSimBackend::StepDrive(SIM_DRIVE& stDrive, double dbDt)
+{
+	double dbTorque ;
+
+	if (stDrive.iPowerTicks > 0 && --stDrive.iPowerTicks == 0)
+		stDrive.iPowered = 1 ;
+
+	if (!stDrive.iPowered)
+	{
+		stDrive.sTorque 	= 0 ;
+		stDrive.sCurrent 	= 0 ;
+		return ;
+	}
+
+	if (stDrive.iMoving)
+	{
+		double dbDist 	= stDrive.dbTarget - stDrive.dbPos ;
+		double dbDir 	= (dbDist >= 0.0) ? 1.0 : -1.0 ;
+		double dbStop 	= stDrive.dbVel * stDrive.dbVel / (2.0 * stDrive.dbDecel) ;
+		double dbVel ;
+
+		if (fabs(dbDist) <= dbStop && stDrive.dbVel * dbDir > 0.0)
+			stDrive.dbAcc = -dbDir * stDrive.dbDecel ;
+		else if (fabs(stDrive.dbVel) < stDrive.dbVmax)
+			stDrive.dbAcc = dbDir * stDrive.dbAccel ;
+		else
+			stDrive.dbAcc = 0.0 ;
+
+		dbVel = stDrive.dbVel + stDrive.dbAcc * dbDt ;
+		if (dbVel > stDrive.dbVmax)
+			dbVel = stDrive.dbVmax ;
+		if (dbVel < -stDrive.dbVmax)
+			dbVel = -stDrive.dbVmax ;
+		stDrive.dbPos += 0.5 * (stDrive.dbVel + dbVel) * dbDt ;
+		stDrive.dbVel  = dbVel ;
+
+		if ((stDrive.dbTarget - stDrive.dbPos) * dbDir <= 0.0
+			|| (fabs(stDrive.dbTarget - stDrive.dbPos) < 0.5 && fabs(stDrive.dbVel) * dbDt < 1.0))
+		{
+			stDrive.dbPos 			= stDrive.dbTarget ;
+			stDrive.dbVel 			= 0.0 ;
+			stDrive.dbAcc 			= 0.0 ;
+			stDrive.iMoving 		= 0 ;
+			stDrive.iMotionEnded 	= 1 ;
+		}
+	}
+
+	dbTorque = m_stConfig.dbInertia * stDrive.dbAcc
+			 + m_stConfig.dbViscous * stDrive.dbVel
+			 + ((stDrive.dbVel > 0.0) ? m_stConfig.dbCoulomb : (stDrive.dbVel < 0.0) ? -m_stConfig.dbCoulomb : 0.0)
+			 + m_stConfig.dbRippleAmp * sin(2.0 * M_PI * stDrive.dbPos / m_stConfig.dbRipplePeriod)
+			 + Noise() ;
+	if (dbTorque > SIM_MAX_TORQUE)
+		dbTorque = SIM_MAX_TORQUE ;
+	if (dbTorque < -SIM_MAX_TORQUE)
+		dbTorque = -SIM_MAX_TORQUE ;
+
+	stDrive.sTorque 	= (int16_t)floor(dbTorque + 0.5) ;
+	stDrive.sCurrent 	= (int16_t)floor(dbTorque * m_stConfig.dbCurrentPerTorque + Noise() + 0.5) ;
+}
+/*
+============================================================================
+ Function:				Noise()
+ Returned value:		Uniform noise in [-dbNoiseAmp, dbNoiseAmp]. Called under the lock.
+============================================================================
+*/
+double CSimBackend::Noise()
+{
+	m_uiRand = m_uiRand * 1103515245u + 12345u ;
+	return m_stConfig.dbNoiseAmp * (((double)((m_uiRand >> 8) & 0xFFFF) / 32767.5) - 1.0) ;
+}
+/*
+============================================================================
+ Function:				AddEvent()
+ Description:			Builds an event frame, as the GMAS does, with iLen
+ 						bytes of data from iOffset, for delivery at the end of
+ 						the tick.
+============================================================================
+*/
+void CSimBackend::AddEvent(unsigned char ucEvent, unsigned short usAxisRef, int iOffset, const unsigned char* ucpData, int iLen)
+{
+	unsigned char* ucpFrame ;
+	int iSize = SIM_EVT_AXIS_REF + (int)sizeof(usAxisRef) ;
+
+	if (iLen && iOffset + iLen > iSize)
+		iSize = iOffset + iLen ;
+	if (m_iEvents >= SIM_MAX_EVENTS || iSize > SIM_EVENT_SIZE)
+		return ;
+
+	ucpFrame = m_ucEvents[m_iEvents] ;
+	memset(ucpFrame, 0, SIM_EVENT_SIZE) ;
+	ucpFrame[SIM_EVT_ID] = ucEvent ;
+	memcpy(ucpFrame + SIM_EVT_AXIS_REF, &usAxisRef, sizeof(usAxisRef)) ;
+	if (iLen)
+		memcpy(ucpFrame + iOffset, ucpData, iLen) ;
+	m_sEventLen[m_iEvents] = (short)iSize ;
+	m_iEvents++ ;
+}
+/*
+============================================================================
+ Function:				IpcCall() / Delay()
+ Description:			Accounts for one call to the GMAS and waits its latency.
+============================================================================
+*/
+void CSimBackend::IpcCall()
+{
+	__sync_fetch_and_add(&m_ulIpcCalls, 1) ;
+	Delay(m_stConfig.ulIpcLatencyUs) ;
+}
+
+void CSimBackend::Delay(unsigned long ulUs)
+{
+	struct timespec stDelay ;
+
+	if (ulUs == 0)
+		return ;
+	stDelay.tv_sec 	= ulUs / 1000000 ;
+	stDelay.tv_nsec = (ulUs % 1000000) * 1000 ;
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &stDelay, &stDelay) == EINTR)
+		;
+}
+/*
+============================================================================
+ CSimAxis - parameters
+============================================================================
+*/
+void CSimAxis::SetDefaultParams(MMC_MOTIONPARAMS_SINGLE& stParams)
+{
+	m_pSim->IpcCall() ;
+	m_fAcceleration = stParams.fAcceleration ;
+	m_fDeceleration = stParams.fDeceleration ;
+}
+
+void CSimAxis::SetAcceleration(float fAcceleration)
+{
+	m_fAcceleration = fAcceleration ;
+}
+/*
+============================================================================
+ CSimAxis - status and motion
+============================================================================
+*/
+unsigned int CSimAxis::ReadStatus()
+{
+	unsigned int uiStatus ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	uiStatus = Status() ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return uiStatus ;
+}
+//
+// GMAS status of the drive, called with the simulator lock held.
+unsigned int CSimAxis::Status() const
+{
+	if (m_stDrive.iErrorStop)
+		return NC_AXIS_ERROR_STOP_MASK ;
+	if (!m_stDrive.iPowered)
+		return NC_AXIS_DISABLED_MASK ;
+	if (m_stDrive.iMoving)
+		return NC_AXIS_DISCRETE_MOTION_MASK ;
+	return NC_AXIS_STAND_STILL_MASK ;
+}
+
+double CSimAxis::GetActualPosition()
+{
+	double dbPos ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	dbPos = m_stDrive.dbPos ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return dbPos ;
+}
+
+double CSimAxis::GetActualVelocity()
+{
+	double dbVel ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	dbVel = m_stDrive.dbVel ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return dbVel ;
+}
+
+double CSimAxis::GetActualTorque()
+{
+	double dbTorque ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	dbTorque = m_stDrive.sTorque ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return dbTorque ;
+}
+
+void CSimAxis::Reset()
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	m_stDrive.iErrorStop = 0 ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+void CSimAxis::PowerOn()
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	if (!m_stDrive.iPowered && m_stDrive.iPowerTicks == 0)
+	{
+		m_stDrive.iPowerTicks = (int)(m_pSim->m_stConfig.ulPowerOnMs * NSEC_PER_MSEC / m_pSim->m_ullSyncNs) + 1 ;
+	}
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+void CSimAxis::PowerOff()
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	m_stDrive.iPowered 		= 0 ;
+	m_stDrive.iPowerTicks 	= 0 ;
+	m_stDrive.iMoving 		= 0 ;
+	m_stDrive.dbVel 		= 0.0 ;
+	m_stDrive.dbAcc 		= 0.0 ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+void CSimAxis::MoveAbsolute(double dbPosition, float fVelocity, MC_BUFFERED_MODE_ENUM eBufferMode)
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	if (m_stDrive.iPowered && !m_stDrive.iErrorStop)
+	{
+		m_stDrive.dbTarget 	= dbPosition ;
+		m_stDrive.dbVmax 	= fabs(fVelocity) ;
+		m_stDrive.dbAccel 	= m_fAcceleration ;
+		m_stDrive.dbDecel 	= m_fDeceleration ;
+		m_stDrive.iMoving 	= 1 ;
+	}
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+void CSimAxis::ElmoSetAsyncParam(char* cpName, int iValue)
+{
+	m_pSim->IpcCall() ;
+}
+/*
+============================================================================
+ CSimAxis - CANopen
+============================================================================
+*/
+void CSimAxis::ConfigPDO(unsigned char ucPDONum, unsigned char ucPDOCommParam, unsigned char ucEventGroup,
+						 unsigned char ucParam1, unsigned char ucParam2, unsigned char ucParam3,
+						 unsigned char ucParam4, unsigned char ucParam5)
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	if (ucPDONum == PDO_NUM_3)
+		m_stDrive.iPdo3On = 1 ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+long CSimAxis::ReadObject(unsigned short usIndex, unsigned char ucSubIndex)
+{
+	switch (usIndex)
+	{
+	case OD_TORQUE_ACTUAL:		return m_stDrive.sTorque ;
+	case OD_CURRENT_ACTUAL:		return m_stDrive.sCurrent ;
+	case OD_POSITION_ACTUAL:	return (long)floor(m_stDrive.dbPos + 0.5) ;
+	case OD_DC_LINK_VOLTAGE:	return SIM_DC_LINK_MV - SIM_DC_LINK_SAG_MV * abs(m_stDrive.sCurrent) ;
+	case OD_MOTOR_RATED_CURRENT:	return (long)m_pSim->m_stConfig.ulRatedCurrentMa ;
+	case OD_MOTOR_RATED_TORQUE:		return (long)m_pSim->m_stConfig.ulRatedTorqueMnm ;
+	case OD_TPDO3_COMM:			return (ucSubIndex == 1) ? m_stDrive.lTpdo3CobId : PDO_TRANS_SYNC_EVERY ;
+	}
+	return 0 ;
+}
+
+/*
+============================================================================
+ Function:				WriteObject()
+ Description:			Writes an object of the drive. Returns 0, or the SDO
+ 						abort code of the drive: only the TPDO3 parameters
+ 						are writable, the objects ReadObject() knows are read only.
+============================================================================
+*/
+long CSimAxis::WriteObject(long lData, unsigned short usIndex, unsigned char ucSubIndex)
+{
+	switch (usIndex)
+	{
+	case OD_TPDO3_COMM:
+		if (ucSubIndex == 1)
+			m_stDrive.lTpdo3CobId = lData ;
+		return 0 ;
+	case OD_TPDO3_MAP:
+		return 0 ;
+	case OD_TORQUE_ACTUAL:
+	case OD_CURRENT_ACTUAL:
+	case OD_POSITION_ACTUAL:
+	case OD_DC_LINK_VOLTAGE:
+	case OD_MOTOR_RATED_CURRENT:
+	case OD_MOTOR_RATED_TORQUE:
+		return SIM_SDO_ABORT_READ_ONLY ;
+	}
+	return SIM_SDO_ABORT_NO_OBJECT ;
+}
+
+long CSimAxis::SendSdoUpload(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+{
+	long lData ;
+
+	m_pSim->IpcCall() ;
+	m_pSim->Delay(m_pSim->m_stConfig.ulCanLatencyUs) ;
+	m_pSim->CountFrames(SIM_FRAMES_PER_SDO) ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	lData = ReadObject(usIndex, ucSubIndex) ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return lData ;
+}
+
+void CSimAxis::SendSdoDownload(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+{
+	m_pSim->IpcCall() ;
+	m_pSim->Delay(m_pSim->m_stConfig.ulCanLatencyUs) ;
+	m_pSim->CountFrames(SIM_FRAMES_PER_SDO) ;
+	//
+	// The library reports an abort of this call by a CMMCException, which the
+	// simulation does not make: the rejected write is only ignored.
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	WriteObject(lData, usIndex, ucSubIndex) ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+/*
+============================================================================
+ Function:				QueueAsync()
+ Description:			Queues the reply of an asynchronous SDO: the uploaded
+ 						value, or the abort code of a download. The transfers of
+ 						a drive are serialized: each starts when the previous ended.
+ 						Called under the lock.
+============================================================================
+*/
+void CSimAxis::QueueAsync(int iUpload, long lData)
+{
+	uint64_t ullNow = MonoTimeNs() ;
+	SIM_SDO* pSdo ;
+
+	if (m_ulPendHead - m_ulPendTail >= SIM_SDO_QUEUE)
+		return ;								// Lost, as a real SDO client would time out
+
+	if (m_ullBusFreeNs < ullNow)
+		m_ullBusFreeNs = ullNow ;
+	m_ullBusFreeNs += (uint64_t)m_pSim->m_stConfig.ulCanLatencyUs * NSEC_PER_USEC ;
+
+	pSdo = &m_stPending[m_ulPendHead % SIM_SDO_QUEUE] ;
+	pSdo->iUpload 	= iUpload ;
+	pSdo->lData 	= lData ;
+	pSdo->ullDueNs 	= m_ullBusFreeNs ;
+	m_ulPendHead++ ;
+}
+
+void CSimAxis::SendSdoUploadAsync(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	QueueAsync(1, ReadObject(usIndex, ucSubIndex)) ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+void CSimAxis::SendSdoDownloadAsync(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex)
+{
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	QueueAsync(0, WriteObject(lData, usIndex, ucSubIndex)) ;
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+}
+
+int CSimAxis::RetreiveSdoUploadAsync(long& lData)
+{
+	int iRes = -1 ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	if (m_ulRepTail != m_ulRepHead)
+	{
+		lData = m_lReplied[m_ulRepTail % SIM_SDO_QUEUE] ;
+		m_ulRepTail++ ;
+		iRes = 0 ;
+	}
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return iRes ;
+}
+
+int CSimAxis::RetreiveSdoDownloadAsync()
+{
+	int iRes = -1 ;
+
+	m_pSim->IpcCall() ;
+	pthread_mutex_lock(&m_pSim->m_stLock) ;
+	if (m_ulDownTail != m_ulDownHead)
+	{
+		iRes = (int)m_lDownloaded[m_ulDownTail % SIM_SDO_QUEUE] ;
+		m_ulDownTail++ ;
+	}
+	pthread_mutex_unlock(&m_pSim->m_stLock) ;
+	return iRes ;
+}
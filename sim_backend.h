@@ -0,0 +1,212 @@
+/*
+============================================================================
+ Name : sim_backend.h
+ Author  :
+ Version :
+ Description : 	In-process simulated GMAS, CAN network and drives.
+
+ A simulation thread plays the role of the GMAS core: every SYNC period it
+ advances the motion and torque model of each drive, transmits TPDO3 of the
+ drives where it is configured, completes the asynchronous SDOs that are due
+ and reports the end of motions. Events are delivered to the application's
+ MMC_MB_CLBK from that thread, with the same frame layout as the GMAS, just
+ as the library's IPC thread would.
+
+ Every call made by the application is delayed by the configured IPC
+ latency, and every SDO transfer by the configured CAN latency. The number
+ of CAN frames that the real bus would carry is counted, for bus load
+ reports.
+
+ The drive model is a trapezoidal profile generator with:
+
+ 	torque = inertia * acceleration + viscous * velocity + coulomb * sign(velocity)
+ 			 + position dependent ripple + noise		[per-mille of rated torque]
+============================================================================
+*/
+#ifndef SIM_BACKEND_H_
+#define SIM_BACKEND_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "motion_backend.h"
+
+#define		SIM_BASE_SYNC_US		1000	// SYNC period for a SYNC multiplier of 1
+#define		SIM_SDO_QUEUE			8		// Asynchronous SDOs pending per axis
+#define		SIM_SDO_ABORT_READ_ONLY	0x06010002	// SDO abort codes, CiA 301
+#define		SIM_SDO_ABORT_NO_OBJECT	0x06020000
+#define		SIM_MAX_EVENTS			(BACKEND_MAX_AXES * (SIM_SDO_QUEUE + 2))	// Events per SYNC
+#define		SIM_EVENT_SIZE			32		// Bytes per event frame
+#define		SIM_MBUS_REGS			1024	// Holding registers of the Modbus server
+#define		SIM_MBUS_MAX_WRITE		123		// Registers per write request, Modbus function 16
+#define		SIM_MBUS_MAX_READ		125		// Registers per read request, Modbus function 3
+#define		SIM_HOST_WRITES			16		// Host writes reported per SYNC
+#define		SIM_DC_LINK_MV			48000	// DC link voltage of the drives, no load
+#define		SIM_DC_LINK_SAG_MV		2		// DC link drop, per per-mille of rated current
+/*
+============================================================================
+ Simulation parameters
+============================================================================
+*/
+typedef struct
+{
+	unsigned long	ulIpcLatencyUs;			// Added to every call to the backend
+	unsigned long	ulCanLatencyUs;			// Added to every SDO transfer
+	unsigned long	ulPowerOnMs;			// Drive enable time
+	double			dbInertia;				// per-mille / (counts/s^2)
+	double			dbViscous;				// per-mille / (counts/s)
+	double			dbCoulomb;				// per-mille
+	double			dbRippleAmp;			// per-mille
+	double			dbRipplePeriod;			// counts
+	double			dbNoiseAmp;				// per-mille, peak
+	double			dbCurrentPerTorque;		// Current / torque ratio
+	unsigned long	ulRatedTorqueMnm;		// 0x6076
+	unsigned long	ulRatedCurrentMa;		// 0x6075
+} SIM_CONFIG;
+
+typedef struct
+{
+	int			iPowered;
+	int			iPowerTicks;				// SYNCs left until the drive is enabled
+	int			iErrorStop;
+	int			iMoving;
+	int			iMotionEnded;				// To be reported by MOTIONENDED_EVT
+	int			iPdo3On;
+	long		lTpdo3CobId;
+	double		dbPos;						// counts
+	double		dbVel;						// counts/s
+	double		dbAcc;						// counts/s^2
+	double		dbTarget;
+	double		dbVmax;
+	double		dbAccel;
+	double		dbDecel;
+	int16_t		sTorque;
+	int16_t		sCurrent;
+} SIM_DRIVE;
+
+typedef struct
+{
+	int			iUpload;
+	long		lData;						// Uploaded value, or abort code of a download
+	uint64_t	ullDueNs;
+} SIM_SDO;
+
+class CSimBackend ;
+
+class CSimAxis : public CAxisBackend
+{
+	friend class CSimBackend ;
+public:
+	unsigned short GetRef()		{ return m_usRef ; }
+	void SetDefaultParams(MMC_MOTIONPARAMS_SINGLE& stParams) ;
+	void SetAcceleration(float fAcceleration) ;
+
+	unsigned int ReadStatus() ;
+	double GetActualPosition() ;
+	double GetActualVelocity() ;
+	double GetActualTorque() ;
+	void Reset() ;
+	void PowerOn() ;
+	void PowerOff() ;
+	void MoveAbsolute(double dbPosition, float fVelocity, MC_BUFFERED_MODE_ENUM eBufferMode) ;
+	void ElmoSetAsyncParam(char* cpName, int iValue) ;
+
+	void ConfigPDO(unsigned char ucPDONum, unsigned char ucPDOCommParam, unsigned char ucEventGroup,
+				   unsigned char ucParam1, unsigned char ucParam2, unsigned char ucParam3,
+				   unsigned char ucParam4, unsigned char ucParam5) ;
+	long SendSdoUpload(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) ;
+	void SendSdoDownload(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) ;
+	void SendSdoUploadAsync(unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) ;
+	void SendSdoDownloadAsync(long lData, unsigned char ucService, unsigned char ucLength, unsigned short usIndex, unsigned char ucSubIndex) ;
+	int  RetreiveSdoUploadAsync(long& lData) ;
+	int  RetreiveSdoDownloadAsync() ;
+
+private:
+	unsigned int Status() const ;
+	long ReadObject(unsigned short usIndex, unsigned char ucSubIndex) ;
+	long WriteObject(long lData, unsigned short usIndex, unsigned char ucSubIndex) ;
+	void QueueAsync(int iUpload, long lData) ;
+
+	CSimBackend*	m_pSim ;
+	unsigned short	m_usRef ;
+	float			m_fAcceleration ;
+	float			m_fDeceleration ;
+	SIM_DRIVE		m_stDrive ;
+	SIM_SDO			m_stPending[SIM_SDO_QUEUE] ;	// Sent, reply not given yet
+	uint32_t		m_ulPendHead ;
+	uint32_t		m_ulPendTail ;
+	long			m_lReplied[SIM_SDO_QUEUE] ;		// Uploads replied, not retrieved yet
+	uint32_t		m_ulRepHead ;
+	uint32_t		m_ulRepTail ;
+	long			m_lDownloaded[SIM_SDO_QUEUE] ;	// Downloads replied, their abort code
+	uint32_t		m_ulDownHead ;
+	uint32_t		m_ulDownTail ;
+	uint64_t		m_ullBusFreeNs ;				// The drive's SDO server is busy until then
+} ;
+
+class CSimBackend : public CMotionBackend
+{
+	friend class CSimAxis ;
+public:
+	CSimBackend() ;
+
+	void Configure(const SIM_CONFIG& stConfig)	{ m_stConfig = stConfig ; }
+	const SIM_CONFIG& Config() const			{ return m_stConfig ; }
+
+	const char* Name() const		{ return "Simulator" ; }
+	int  IsSimulated() const		{ return 1 ; }
+
+	MMC_CONNECT_HNDL ConnectIPCEx(int iEventsMask, MMC_MB_CLBK pfnCallback) ;
+	void Close() ;
+	CAxisBackend* CreateAxis(const char* cpName) ;
+	void SetSyncTime(int iSyncMultiplier) ;
+	void ReadInputs(CAxisBackend* const* pAxes, int iAxes, const AXIS_INPUTS& stIn) ;
+
+	int  MbusStartServer()			{ IpcCall() ; return 0 ; }
+	void MbusStopServer()			{ IpcCall() ; }
+	int  MbusWriteRegisters(int iStartRef, int iCount, const short* spRegs) ;
+	int  MbusReadRegisters(int iStartRef, int iCount, short* spRegs) ;
+	short MbusRegister(int iRef) const	{ return m_sMbusRegs[iRef] ; }
+	int  HostWrite(int iStartRef, int iCount, const short* spRegs) ;
+//
+//	Bus load and IPC accounting
+//
+	unsigned long CanFrames() const		{ return m_ulCanFrames ; }
+	unsigned long IpcCalls() const		{ return m_ulIpcCalls ; }
+	unsigned long MbusWrites() const	{ return m_ulMbusWrites ; }
+	unsigned long MbusRegisters() const	{ return m_ulMbusRegisters ; }
+	uint64_t SyncPeriodNs() const		{ return m_ullSyncNs ; }
+
+	static void DefaultConfig(SIM_CONFIG& stConfig) ;
+
+private:
+	static void* ThreadFunc(void* pArg) ;
+	void Tick(double dbDt, uint64_t ullNow) ;
+	void StepDrive(SIM_DRIVE& stDrive, double dbDt) ;
+	void AddEvent(unsigned char ucEvent, unsigned short usAxisRef, int iOffset, const unsigned char* ucpData, int iLen) ;
+	void IpcCall() ;
+	void Delay(unsigned long ulUs) ;
+	void CountFrames(unsigned long ulFrames)	{ __sync_fetch_and_add(&m_ulCanFrames, ulFrames) ; }
+	double Noise() ;
+
+	SIM_CONFIG			m_stConfig ;
+	MMC_MB_CLBK			m_pfnCallback ;
+	pthread_t			m_stThread ;
+	pthread_mutex_t		m_stLock ;				// Protects the drives, taken by both threads
+	volatile int		m_iRun ;
+	uint64_t			m_ullSyncNs ;
+	unsigned int		m_uiRand ;
+	volatile unsigned long	m_ulCanFrames ;
+	volatile unsigned long	m_ulIpcCalls ;
+	unsigned long		m_ulMbusWrites ;
+	unsigned long		m_ulMbusRegisters ;		// Written, all requests
+	short				m_sMbusRegs[SIM_MBUS_REGS] ;	// Protected by m_stLock
+	int					m_iHostWrites ;					// Written by the host, not reported yet
+	uint16_t			m_usHostWrite[SIM_HOST_WRITES][2] ;	// Start and count
+	int					m_iAxes ;
+	CSimAxis			m_cAxis[BACKEND_MAX_AXES] ;
+	int					m_iEvents ;
+	unsigned char		m_ucEvents[SIM_MAX_EVENTS][SIM_EVENT_SIZE] ;
+	short				m_sEventLen[SIM_MAX_EVENTS] ;
+} ;
+
+#endif /* SIM_BACKEND_H_ */
@@ -0,0 +1,100 @@
+/*
+============================================================================
+ Name : spsc_ring.h
+ Author  :
+ Version :
+ Description : 	Fixed capacity, wait-free, single-producer/single-consumer ring.
+
+ One thread may call Push(), one other thread may call Pop(). Neither side
+ takes a lock or allocates memory. The producer and consumer indices live on
+ separate cache lines so the two threads do not bounce the same line.
+
+ When the ring is full Push() drops the new item and counts an overflow,
+ the producer is never blocked.
+============================================================================
+*/
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stdint.h>
+
+#define		CACHE_LINE_SIZE			64		// Covers both the Gold (32 bytes) and x86 (64 bytes) lines
+
+template <typename T, unsigned int SIZE>
+class CSpscRing
+{
+public:
+	CSpscRing() : m_ulHead(0), m_ulTailCache(0), m_ulOverflows(0), m_ulTail(0)
+	{
+		//
+		// SIZE must be a power of 2, so that the free running indices can be masked.
+		typedef char SizeMustBePowerOf2[((SIZE & (SIZE - 1)) == 0) ? 1 : -1] ;
+		(void)sizeof(SizeMustBePowerOf2) ;
+	}
+/*
+============================================================================
+ Producer side
+============================================================================
+*/
+	int Push(const T& stItem)
+	{
+		uint32_t ulHead = m_ulHead ;
+
+		if (ulHead - m_ulTailCache >= SIZE)
+		{
+			m_ulTailCache = m_ulTail ;
+			if (ulHead - m_ulTailCache >= SIZE)
+			{
+				m_ulOverflows++ ;
+				return 0 ;
+			}
+		}
+		m_Items[ulHead & (SIZE - 1)] = stItem ;
+		__sync_synchronize() ;				// Item must be visible before the index
+		m_ulHead = ulHead + 1 ;
+		return 1 ;
+	}
+/*
+============================================================================
+ Consumer side
+============================================================================
+*/
+	int Pop(T& stItem)
+	{
+		uint32_t ulTail = m_ulTail ;
+
+		if (ulTail == m_ulHead)
+			return 0 ;
+		__sync_synchronize() ;				// Index must be read before the item
+		stItem = m_Items[ulTail & (SIZE - 1)] ;
+		__sync_synchronize() ;				// Item must be copied before the slot is released
+		m_ulTail = ulTail + 1 ;
+		return 1 ;
+	}
+/*
+============================================================================
+ Either side
+============================================================================
+*/
+	unsigned int Count() const		{ return (unsigned int)(m_ulHead - m_ulTail) ; }
+	unsigned int Capacity() const	{ return SIZE ; }
+	unsigned long Overflows() const	{ return m_ulOverflows ; }
+
+private:
+//
+//	Producer cache line
+//
+	volatile uint32_t	m_ulHead ;
+	uint32_t			m_ulTailCache ;		// Producer's last view of m_ulTail
+	volatile uint32_t	m_ulOverflows ;
+	char				m_cPadProducer[CACHE_LINE_SIZE - 3 * sizeof(uint32_t)] ;
+//
+//	Consumer cache line
+//
+	volatile uint32_t	m_ulTail ;
+	char				m_cPadConsumer[CACHE_LINE_SIZE - sizeof(uint32_t)] ;
+
+	T					m_Items[SIZE] ;
+} __attribute__((aligned(CACHE_LINE_SIZE))) ;
+
+#endif /* SPSC_RING_H_ */
@@ -0,0 +1,227 @@
+/*
+============================================================================
+ Name : state_machine.h
+ Author  :
+ Version :
+ Description : 	Table driven state machine engine.
+
+ A state is a type: a struct deriving from CState<CONTEXT, ID>, which gives
+ it its ID and empty Entry(), Do() and Exit() actions, and redefining the
+ ones it needs as static functions. Do() runs once per Step() and returns
+ the next state, or SM_STAY.
+
+ 	struct SMove : CState<MACHINE, eMove>
+ 	{
+ 		static void Entry(MACHINE& stM) ;
+ 		static int  Do(MACHINE& stM) ;
+ 	} ;
+
+ The states of a machine are listed, in ID order, in a constant table built
+ with SM_STATE(). State 0 is the idle state of every table. Dispatch is an
+ index in the table and an indirect call: no switch, and the same table
+ serves any number of machines, e.g. one per axis. What a machine acts upon
+ is in its CONTEXT, given to every call.
+
+ The per-machine data used every cycle fits in one cache line. The dwell
+ counters of each state, updated on transitions only, are kept apart.
+
+ Not thread safe: a machine is stepped by one thread, the cycle.
+============================================================================
+*/
+#ifndef STATE_MACHINE_H_
+#define STATE_MACHINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "spsc_ring.h"				// CACHE_LINE_SIZE
+
+#define		SM_MAX_STATES			16		// States of a table, the idle state included
+#define		SM_IDLE					0		// First state of every table
+#define		SM_STAY					-1		// Do() result: no transition
+//
+// Entry of a state table, in ID order
+#define		SM_STATE(S)				{ S::ID, #S, &S::Entry, &S::Do, &S::Exit }
+
+template <typename CONTEXT>
+struct SM_STATE_DEF
+{
+	int				iId ;					// Must be the index in the table
+	const char*		cpName ;
+	void			(*pfnEntry)(CONTEXT& cCtx) ;
+	int				(*pfnDo)(CONTEXT& cCtx) ;
+	void			(*pfnExit)(CONTEXT& cCtx) ;
+} ;
+
+template <typename CONTEXT, int STATE_ID>
+struct CState
+{
+	enum { ID = STATE_ID } ;
+
+	static void Entry(CONTEXT&)		{ }
+	static int  Do(CONTEXT&)		{ return SM_STAY ; }
+	static void Exit(CONTEXT&)		{ }
+} ;
+
+template <typename CONTEXT>
+class CStateMachine
+{
+public:
+	typedef SM_STATE_DEF<CONTEXT> STATE_DEF ;
+
+	CStateMachine()
+	{
+		typedef char CoreMustFitCacheLine[(sizeof(m_stCore) <= CACHE_LINE_SIZE) ? 1 : -1] ;
+		(void)sizeof(CoreMustFitCacheLine) ;
+		Configure(NULL, 0) ;
+	}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		pstTable, iStates - the states, in ID order.
+ Returned value:		false if the table is not in ID order or too long. The
+ 						machine then has the idle state only.
+
+ Sets the table and puts the machine in its idle state, without calling any
+ action. Clears the counters.
+============================================================================
+*/
+	bool Configure(const STATE_DEF* pstTable, int iStates)
+	{
+		static const STATE_DEF stIdleOnly[1] = { SM_STATE(CIdle) } ;
+		bool bValid = (pstTable != NULL && iStates > 0 && iStates <= SM_MAX_STATES) ;
+		int i ;
+
+		for (i = 0 ; bValid && i < iStates ; i++)
+		{
+			bValid = (pstTable[i].iId == i) ;
+		}
+		if (!bValid)
+		{
+			pstTable 	= stIdleOnly ;
+			iStates 	= 1 ;
+		}
+		m_stCore.pstTable 		= pstTable ;
+		m_stCore.iStates 		= iStates ;
+		m_stCore.iState 		= SM_IDLE ;
+		m_stCore.iPrev 			= SM_IDLE ;
+		m_stCore.ulCycles 		= 0 ;
+		m_stCore.ulSteps 		= 0 ;
+		m_stCore.ulTransitions 	= 0 ;
+		m_stCore.ulRejected 	= 0 ;
+		for (i = 0 ; i < SM_MAX_STATES ; i++)
+		{
+			m_ulEntries[i] 	= 0 ;
+			m_ulDwell[i] 	= 0 ;
+			m_ulMaxDwell[i] = 0 ;
+		}
+		m_ulEntries[SM_IDLE] = 1 ;
+		return bValid ;
+	}
+/*
+============================================================================
+ Function:				Step()
+ Input arguments:		cCtx - what the machine acts upon.
+ Returned value:		The state after the step.
+
+ Runs Do() of the current state and makes the transition it returns.
+============================================================================
+*/
+	int Step(CONTEXT& cCtx)
+	{
+		int iNext ;
+
+		m_stCore.ulSteps++ ;
+		m_stCore.ulCycles++ ;
+		iNext = m_stCore.pstTable[m_stCore.iState].pfnDo(cCtx) ;
+		if (iNext != SM_STAY && iNext != m_stCore.iState)
+			Goto(cCtx, iNext) ;
+		return m_stCore.iState ;
+	}
+/*
+============================================================================
+ Function:				Goto()
+ Input arguments:		cCtx - what the machine acts upon.
+ 						iState - the state to go to. The current state is
+ 						left and entered again.
+ Returned value:		false if iState is not in the table; the machine
+ 						then stays where it is.
+
+ Runs Exit() of the current state, then Entry() of the new one. Entry() may
+ itself call Goto() of another machine, not of this one.
+============================================================================
+*/
+	bool Goto(CONTEXT& cCtx, int iState)
+	{
+		int iFrom = m_stCore.iState ;
+
+		if (iState < 0 || iState >= m_stCore.iStates)
+		{
+			m_stCore.ulRejected++ ;
+			return false ;
+		}
+		m_stCore.pstTable[iFrom].pfnExit(cCtx) ;
+		m_ulDwell[iFrom] += m_stCore.ulCycles ;
+		if (m_stCore.ulCycles > m_ulMaxDwell[iFrom])
+			m_ulMaxDwell[iFrom] = m_stCore.ulCycles ;
+
+		m_stCore.iPrev 		= iFrom ;
+		m_stCore.iState 	= iState ;
+		m_stCore.ulCycles 	= 0 ;
+		m_stCore.ulTransitions++ ;
+		m_ulEntries[iState]++ ;
+		m_stCore.pstTable[iState].pfnEntry(cCtx) ;
+		return true ;
+	}
+	void Stop(CONTEXT& cCtx)
+	{
+		if (m_stCore.iState != SM_IDLE)
+			Goto(cCtx, SM_IDLE) ;
+	}
+
+	int State() const				{ return m_stCore.iState ; }
+	int Previous() const			{ return m_stCore.iPrev ; }
+	int States() const				{ return m_stCore.iStates ; }
+	const char* Name(int iState) const	{ return m_stCore.pstTable[iState].cpName ; }
+	uint32_t Cycles() const			{ return m_stCore.ulCycles ; }		// Steps in the current state
+	uint32_t Steps() const			{ return m_stCore.ulSteps ; }
+	uint32_t Transitions() const	{ return m_stCore.ulTransitions ; }
+	uint32_t Rejected() const		{ return m_stCore.ulRejected ; }	// Goto() to a state not in the table
+/*
+============================================================================
+ Dwell counters of each state, in steps. The current stay is included.
+============================================================================
+*/
+	uint32_t Entries(int iState) const	{ return m_ulEntries[iState] ; }
+	uint32_t Dwell(int iState) const
+	{
+		return m_ulDwell[iState] + ((iState == m_stCore.iState) ? m_stCore.ulCycles : 0) ;
+	}
+	uint32_t MaxDwell(int iState) const
+	{
+		if (iState == m_stCore.iState && m_stCore.ulCycles > m_ulMaxDwell[iState])
+			return m_stCore.ulCycles ;
+		return m_ulMaxDwell[iState] ;
+	}
+
+private:
+	struct CIdle : CState<CONTEXT, SM_IDLE> { } ;
+
+	struct
+	{
+		const STATE_DEF*	pstTable ;
+		int					iStates ;
+		int					iState ;
+		int					iPrev ;
+		uint32_t			ulCycles ;
+		uint32_t			ulSteps ;
+		uint32_t			ulTransitions ;
+		uint32_t			ulRejected ;
+	} m_stCore __attribute__((aligned(CACHE_LINE_SIZE))) ;
+	//
+	// Updated on transitions only
+	uint32_t		m_ulEntries[SM_MAX_STATES] ;
+	uint32_t		m_ulDwell[SM_MAX_STATES] ;
+	uint32_t		m_ulMaxDwell[SM_MAX_STATES] ;
+} ;
+
+#endif /* STATE_MACHINE_H_ */
@@ -0,0 +1,876 @@
+/*
+============================================================================
+ Name : 	torque_archive.cpp
+ Author :
+ Version :	1.00
+ Description : Compressed long-term torque archive, see torque_archive.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "mono_time.h"
+#include "torque_archive.h"
+
+#define		ARCH_BYTE_ORDER			0x01020304
+#define		ARCH_FNV_BASIS			2166136261U
+#define		ARCH_FNV_PRIME			16777619U
+/*
+============================================================================
+ SIMD primitives of the decoder, on ARCH_LANES 32 bits values. ScanAdd()
+ and ScanXor() are inclusive prefix sums across the lanes, plus the carry
+ of the previous vector in every lane; Last() broadcasts the last lane, the
+ carry of the next vector.
+============================================================================
+*/
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+#define		ARCH_LANES		4
+#define		ARCH_ISA		"SSE2"
+typedef __m128i		ARCH_VEC ;
+
+static inline ARCH_VEC VecLoad(const uint32_t* p)			{ return _mm_loadu_si128((const __m128i*)p) ; }
+static inline void VecStore(uint32_t* p, ARCH_VEC v)		{ _mm_storeu_si128((__m128i*)p, v) ; }
+static inline ARCH_VEC VecSet1(uint32_t ul)					{ return _mm_set1_epi32((int)ul) ; }
+static inline ARCH_VEC VecUnzigzag(ARCH_VEC v)
+{
+	return _mm_xor_si128(_mm_srli_epi32(v, 1), _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi32(1)))) ;
+}
+static inline ARCH_VEC VecScanAdd(ARCH_VEC v, ARCH_VEC vCarry)
+{
+	v = _mm_add_epi32(v, _mm_slli_si128(v, 4)) ;
+	v = _mm_add_epi32(v, _mm_slli_si128(v, 8)) ;
+	return _mm_add_epi32(v, vCarry) ;
+}
+static inline ARCH_VEC VecScanXor(ARCH_VEC v, ARCH_VEC vCarry)
+{
+	v = _mm_xor_si128(v, _mm_slli_si128(v, 4)) ;
+	v = _mm_xor_si128(v, _mm_slli_si128(v, 8)) ;
+	return _mm_xor_si128(v, vCarry) ;
+}
+static inline ARCH_VEC VecLast(ARCH_VEC v)					{ return _mm_shuffle_epi32(v, 0xFF) ; }
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+#define		ARCH_LANES		4
+#define		ARCH_ISA		"NEON"
+typedef uint32x4_t	ARCH_VEC ;
+
+static inline ARCH_VEC VecLoad(const uint32_t* p)			{ return vld1q_u32(p) ; }
+static inline void VecStore(uint32_t* p, ARCH_VEC v)		{ vst1q_u32(p, v) ; }
+static inline ARCH_VEC VecSet1(uint32_t ul)					{ return vdupq_n_u32(ul) ; }
+static inline ARCH_VEC VecUnzigzag(ARCH_VEC v)
+{
+	return veorq_u32(vshrq_n_u32(v, 1),
+					 vreinterpretq_u32_s32(vnegq_s32(vreinterpretq_s32_u32(vandq_u32(v, vdupq_n_u32(1)))))) ;
+}
+static inline ARCH_VEC VecScanAdd(ARCH_VEC v, ARCH_VEC vCarry)
+{
+	v = vaddq_u32(v, vextq_u32(vdupq_n_u32(0), v, 3)) ;
+	v = vaddq_u32(v, vextq_u32(vdupq_n_u32(0), v, 2)) ;
+	return vaddq_u32(v, vCarry) ;
+}
+static inline ARCH_VEC VecScanXor(ARCH_VEC v, ARCH_VEC vCarry)
+{
+	v = veorq_u32(v, vextq_u32(vdupq_n_u32(0), v, 3)) ;
+	v = veorq_u32(v, vextq_u32(vdupq_n_u32(0), v, 2)) ;
+	return veorq_u32(v, vCarry) ;
+}
+static inline ARCH_VEC VecLast(ARCH_VEC v)					{ return vdupq_n_u32(vgetq_lane_u32(v, 3)) ; }
+
+#else
+
+#define		ARCH_LANES		1
+#define		ARCH_ISA		"scalar"
+typedef uint32_t	ARCH_VEC ;
+
+static inline ARCH_VEC VecLoad(const uint32_t* p)			{ return *p ; }
+static inline void VecStore(uint32_t* p, ARCH_VEC v)		{ *p = v ; }
+static inline ARCH_VEC VecSet1(uint32_t ul)					{ return ul ; }
+static inline ARCH_VEC VecUnzigzag(ARCH_VEC v)				{ return (v >> 1) ^ (0U - (v & 1)) ; }
+static inline ARCH_VEC VecScanAdd(ARCH_VEC v, ARCH_VEC vCarry)	{ return v + vCarry ; }
+static inline ARCH_VEC VecScanXor(ARCH_VEC v, ARCH_VEC vCarry)	{ return v ^ vCarry ; }
+static inline ARCH_VEC VecLast(ARCH_VEC v)					{ return v ; }
+
+#endif
+/*
+============================================================================
+ Bit packing. A group of ARCH_GROUP values of B bits takes B words, value k
+ starting at bit k * B, the low bits first.
+
+ The unpacking is unrolled for every width at compile time, so the shifts
+ and masks are constants and there is no loop nor branch left.
+============================================================================
+*/
+template <int B, int K>
+struct CUnpack
+{
+	static inline void Run(const uint32_t* pulIn, uint32_t* pulOut)
+	{
+		const int iWord 	= (K * B) >> 5 ;
+		const int iShift 	= (K * B) & 31 ;
+		uint32_t ulValue 	= pulIn[iWord] >> iShift ;
+
+		if (iShift + B > 32)
+			ulValue |= pulIn[iWord + 1] << ((32 - iShift) & 31) ;
+		pulOut[K] = ulValue & (uint32_t)(((uint64_t)1 << B) - 1) ;
+		CUnpack<B, K + 1>::Run(pulIn, pulOut) ;
+	}
+} ;
+
+template <int B>
+struct CUnpack<B, ARCH_GROUP>
+{
+	static inline void Run(const uint32_t*, uint32_t*)
+	{
+	}
+} ;
+
+template <int B>
+static void Unpack(const uint32_t* pulIn, uint32_t* pulOut)
+{
+	CUnpack<B, 0>::Run(pulIn, pulOut) ;
+}
+
+typedef void (*ARCH_UNPACK)(const uint32_t* pulIn, uint32_t* pulOut) ;
+
+static const ARCH_UNPACK gpfnUnpack[33] =
+{
+	0,			Unpack<1>,	Unpack<2>,	Unpack<3>,	Unpack<4>,	Unpack<5>,	Unpack<6>,	Unpack<7>,
+	Unpack<8>,	Unpack<9>,	Unpack<10>,	Unpack<11>,	Unpack<12>,	Unpack<13>,	Unpack<14>,	Unpack<15>,
+	Unpack<16>,	Unpack<17>,	Unpack<18>,	Unpack<19>,	Unpack<20>,	Unpack<21>,	Unpack<22>,	Unpack<23>,
+	Unpack<24>,	Unpack<25>,	Unpack<26>,	Unpack<27>,	Unpack<28>,	Unpack<29>,	Unpack<30>,	Unpack<31>,
+	Unpack<32>,
+} ;
+
+static void PackColumn(const uint32_t* pulIn, int iWidth, uint32_t* pulOut)
+{
+	uint64_t ullBits = 0 ;
+	int iBits = 0 ;
+	int k ;
+
+	if (iWidth == 0)
+		return ;
+
+	for (k = 0 ; k < ARCH_GROUP ; k++)
+	{
+		ullBits |= (uint64_t)pulIn[k] << iBits ;
+		iBits 	+= iWidth ;
+		if (iBits >= 32)
+		{
+			*pulOut++ 	= (uint32_t)ullBits ;
+			ullBits 	>>= 32 ;
+			iBits 		-= 32 ;
+		}
+	}
+}
+/*
+============================================================================
+ Helpers
+============================================================================
+*/
+static inline uint32_t Zigzag(int32_t lValue)
+{
+	return ((uint32_t)lValue << 1) ^ (uint32_t)(lValue >> 31) ;
+}
+
+static inline int Width(uint32_t ulValues)
+{
+	return ulValues ? 32 - __builtin_clz(ulValues) : 0 ;
+}
+
+static uint32_t Checksum(const uint8_t* pucData, uint32_t ulBytes)
+{
+	uint32_t ulHash = ARCH_FNV_BASIS ;
+	uint32_t i ;
+
+	for (i = 0 ; i < ulBytes ; i++)
+	{
+		ulHash = (ulHash ^ pucData[i]) * ARCH_FNV_PRIME ;
+	}
+	return ulHash ;
+}
+//
+// pulOut[k] = ulCarry + pulIn[0] + ... + pulIn[k], the inputs zig-zag decoded if bZigzag.
+// pulIn and pulOut may be the same.
+static void ScanAdd(const uint32_t* pulIn, uint32_t ulCarry, bool bZigzag, uint32_t* pulOut)
+{
+	ARCH_VEC vCarry = VecSet1(ulCarry) ;
+	int k ;
+
+	for (k = 0 ; k < ARCH_GROUP ; k += ARCH_LANES)
+	{
+		ARCH_VEC v = VecLoad(pulIn + k) ;
+
+		if (bZigzag)
+			v = VecUnzigzag(v) ;
+		v = VecScanAdd(v, vCarry) ;
+		VecStore(pulOut + k, v) ;
+		vCarry = VecLast(v) ;
+	}
+}
+
+static void ScanXor(const uint32_t* pulIn, uint32_t ulCarry, uint32_t* pulOut)
+{
+	ARCH_VEC vCarry = VecSet1(ulCarry) ;
+	int k ;
+
+	for (k = 0 ; k < ARCH_GROUP ; k += ARCH_LANES)
+	{
+		ARCH_VEC v = VecScanXor(VecLoad(pulIn + k), vCarry) ;
+
+		VecStore(pulOut + k, v) ;
+		vCarry = VecLast(v) ;
+	}
+}
+/*
+============================================================================
+ Function:				CTorqueArchive()
+ Description:			Constructor.
+============================================================================
+*/
+CTorqueArchive::CTorqueArchive()
+{
+	int i ;
+
+	memset(m_cBase, 0, sizeof(m_cBase)) ;
+	memset(m_stAxis, 0, sizeof(m_stAxis)) ;
+	for (i = 0 ; i < ARCH_MAX_AXES ; i++)
+	{
+		m_stAxis[i].iBlock = -1 ;			// No block open, even if never opened
+	}
+	m_pstPool 		= 0 ;
+	m_ulAppended 	= 0 ;
+	m_ulDropped 	= 0 ;
+	m_ullBytes 		= 0 ;
+	m_iFd 			= -1 ;
+	m_ulFileBytes 	= 0 ;
+	m_ullSequence 	= 0 ;
+	m_ulWriteErrors = 0 ;
+	m_iRun 			= 0 ;
+}
+
+CTorqueArchive::~CTorqueArchive()
+{
+	Close() ;
+	delete[] m_pstPool ;
+}
+/*
+============================================================================
+ Function:				Open()
+ Input arguments:		cpBase - path and file name prefix of the archive files.
+ 						ulBudgetMb - flash the archive files may take, in MB.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the first file could not be created
+ 						or the writer thread could not be started.
+ Version:				Version 1.00
+
+ Description:
+
+ Keeps as many files as fit in ulBudgetMb, ARCH_MIN_FILES to
+ ARCH_MAX_FILES. Finds the newest archive file of cpBase among them and
+ starts a new one after it.
+ Allocates and touches the block pool, then starts the writer thread. Must
+ not be called from the cycle.
+============================================================================
+*/
+int CTorqueArchive::Open(const char* cpBase, unsigned long ulBudgetMb)
+{
+	char cPath[ARCH_PATH_LEN + 16] ;
+	ARCH_FILE_HEADER stHead ;
+	int iFd ;
+	int i ;
+
+	if (m_iRun)
+		return -1 ;
+
+	strncpy(m_cBase, cpBase, sizeof(m_cBase) - 1) ;
+	m_iFiles = (int)(ulBudgetMb < (unsigned long)ARCH_MAX_FILES * ARCH_FILE_BYTES / (1024 * 1024) ?
+					 ulBudgetMb * 1024 * 1024 / ARCH_FILE_BYTES : ARCH_MAX_FILES) ;
+	if (m_iFiles < ARCH_MIN_FILES)
+		m_iFiles = ARCH_MIN_FILES ;
+	m_ullSequence = 0 ;
+	for (i = 0 ; i < m_iFiles ; i++)
+	{
+		snprintf(cPath, sizeof(cPath), "%s.%02d.tqa", m_cBase, i) ;
+		iFd = open(cPath, O_RDONLY) ;
+		if (iFd < 0)
+			continue ;
+		if (read(iFd, &stHead, sizeof(stHead)) == (ssize_t)sizeof(stHead) &&
+			memcmp(stHead.cMagic, ARCH_MAGIC, sizeof(stHead.cMagic)) == 0 && stHead.ullSequence >= m_ullSequence)
+			m_ullSequence = stHead.ullSequence + 1 ;
+		close(iFd) ;
+	}
+
+	if (m_pstPool == 0)
+		m_pstPool = new ARCH_BLOCK[ARCH_POOL_BLOCKS] ;
+	memset(m_pstPool, 0, ARCH_POOL_BLOCKS * sizeof(ARCH_BLOCK)) ;
+	while (m_cFull.Pop(i))
+		;
+	while (m_cFree.Pop(i))
+		;
+	for (i = 0 ; i < ARCH_POOL_BLOCKS ; i++)
+	{
+		m_cFree.Push(i) ;
+	}
+	for (i = 0 ; i < ARCH_MAX_AXES ; i++)
+	{
+		m_stAxis[i].iBlock = -1 ;
+	}
+	m_ulAppended 	= 0 ;
+	m_ulDropped 	= 0 ;
+	m_ullBytes 		= 0 ;
+	m_ulWriteErrors = 0 ;
+
+	if (NextFile() != 0)
+		return -1 ;
+
+	m_iRun = 1 ;
+	if (pthread_create(&m_stThread, NULL, ThreadFunc, this) != 0)
+	{
+		printf("Torque archive: cannot start the writer thread\n") ;
+		m_iRun = 0 ;
+		close(m_iFd) ;
+		m_iFd = -1 ;
+		return -1 ;
+	}
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Close()
+ Description:			Closes the open blocks, lets the writer thread write
+ 						them and stops it. Append() must not be running.
+============================================================================
+*/
+void CTorqueArchive::Close()
+{
+	if (!m_iRun)
+		return ;
+
+	Flush() ;
+	m_iRun = 0 ;
+	pthread_join(m_stThread, NULL) ;
+	if (m_iFd >= 0)
+	{
+		fdatasync(m_iFd) ;
+		close(m_iFd) ;
+		m_iFd = -1 ;
+	}
+	if (m_ulWriteErrors)
+		printf("Torque archive: %lu blocks not written\n", m_ulWriteErrors) ;
+}
+/*
+============================================================================
+ Function:				Append()
+ Input arguments:		stRec - a sample, as logged to the torque log.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Adds the sample to the open group of its axis, as deltas of the previous
+ sample. The first sample of a block goes to its header. Packs the group
+ when it is full, and hands the block to the writer thread when it is
+ full. Called from the cycle thread only.
+============================================================================
+*/
+void CTorqueArchive::Append(const TORQUE_LOG_RECORD& stRec)
+{
+	ARCH_AXIS& stAxis = m_stAxis[(stRec.usAxis < ARCH_MAX_AXES) ? stRec.usAxis : 0] ;
+	uint64_t ullTime ;
+	int32_t lTimeDelta ;
+	uint32_t ulPositionDelta ;
+	int k ;
+	int c ;
+
+	if (!m_iRun || stRec.usAxis >= ARCH_MAX_AXES)
+		return ;
+
+	m_ulAppended++ ;
+	ullTime = stRec.ullTimeNs / ARCH_TIME_UNIT_NS ;
+	if (stAxis.iBlock >= 0 && (ullTime < stAxis.ullTime || ullTime - stAxis.ullTime > ARCH_MAX_TIME_DELTA))
+		End(stAxis) ;
+	if (stAxis.iBlock < 0)
+	{
+		Begin(stAxis, stRec, ullTime) ;
+		return ;
+	}
+
+	lTimeDelta 		= (int32_t)(ullTime - stAxis.ullTime) ;
+	ulPositionDelta = (uint32_t)stRec.lPosition - stAxis.ulPosition ;
+	k 				= stAxis.iCount ;
+
+	stAxis.ulCol[eARCH_TIME][k] 	= Zigzag(lTimeDelta - stAxis.lTimeDelta) ;
+	stAxis.ulCol[eARCH_POSITION][k] = Zigzag((int32_t)(ulPositionDelta - stAxis.ulPositionDelta)) ;
+	stAxis.ulCol[eARCH_TORQUE][k] 	= Zigzag(stRec.sTorque - stAxis.sTorque) ;
+	stAxis.ulCol[eARCH_CURRENT][k] 	= Zigzag(stRec.sCurrent - stAxis.sCurrent) ;
+	stAxis.ulCol[eARCH_STATUS][k] 	= stRec.ulStatus ^ stAxis.ulStatus ;
+	for (c = 0 ; c < eARCH_COLUMNS ; c++)
+	{
+		stAxis.ulOr[c] |= stAxis.ulCol[c][k] ;
+	}
+
+	stAxis.ullTime 			= ullTime ;
+	stAxis.lTimeDelta 		= lTimeDelta ;
+	stAxis.ulPosition 		= (uint32_t)stRec.lPosition ;
+	stAxis.ulPositionDelta 	= ulPositionDelta ;
+	stAxis.sTorque 			= stRec.sTorque ;
+	stAxis.sCurrent 		= stRec.sCurrent ;
+	stAxis.ulStatus 		= stRec.ulStatus ;
+
+	if (++stAxis.iCount == ARCH_GROUP)
+	{
+		Pack(stAxis) ;
+		if (stAxis.iGroups == ARCH_BLOCK_GROUPS)
+			End(stAxis) ;
+	}
+}
+/*
+============================================================================
+ Function:				Flush()
+ Description:			Hands the open blocks of all the axes to the writer
+ 						thread, short. From the thread of Append().
+============================================================================
+*/
+void CTorqueArchive::Flush()
+{
+	int i ;
+
+	if (m_pstPool == 0)
+		return ;							// Never opened
+	for (i = 0 ; i < ARCH_MAX_AXES ; i++)
+	{
+		if (m_stAxis[i].iBlock >= 0)
+			End(m_stAxis[i]) ;
+	}
+}
+/*
+============================================================================
+ Function:				Begin()
+ Description:			Opens a block with the sample in its header. Drops
+ 						the sample if the pool is empty.
+============================================================================
+*/
+void CTorqueArchive::Begin(ARCH_AXIS& stAxis, const TORQUE_LOG_RECORD& stRec, uint64_t ullTime)
+{
+	ARCH_BLOCK_HEADER* pHead ;
+	int iBlock ;
+	int c ;
+
+	if (!m_cFree.Pop(iBlock))
+	{
+		m_ulDropped++ ;
+		return ;
+	}
+	pHead = (ARCH_BLOCK_HEADER*)m_pstPool[iBlock].ulData ;
+	pHead->ulMagic 		= ARCH_BLOCK_MAGIC ;
+	pHead->usAxis 		= stRec.usAxis ;
+	pHead->usSamples 	= 1 ;
+	pHead->ulBytes 		= 0 ;
+	pHead->ulCheck 		= 0 ;
+	pHead->ulTimeUnitNs = ARCH_TIME_UNIT_NS ;
+	pHead->ulStatus 	= stRec.ulStatus ;
+	pHead->ullTime 		= ullTime ;
+	pHead->lPosition 	= stRec.lPosition ;
+	pHead->sTorque 		= stRec.sTorque ;
+	pHead->sCurrent 	= stRec.sCurrent ;
+	m_pstPool[iBlock].ulBytes = sizeof(ARCH_BLOCK_HEADER) ;
+
+	stAxis.iBlock 			= iBlock ;
+	stAxis.iCount 			= 0 ;
+	stAxis.iGroups 			= 0 ;
+	stAxis.ullTime 			= ullTime ;
+	stAxis.lTimeDelta 		= 0 ;
+	stAxis.ulPosition 		= (uint32_t)stRec.lPosition ;
+	stAxis.ulPositionDelta 	= 0 ;
+	stAxis.sTorque 			= stRec.sTorque ;
+	stAxis.sCurrent 		= stRec.sCurrent ;
+	stAxis.ulStatus 		= stRec.ulStatus ;
+	for (c = 0 ; c < eARCH_COLUMNS ; c++)
+	{
+		stAxis.ulOr[c] = 0 ;
+	}
+}
+/*
+============================================================================
+ Function:				Pack()
+ Description:			Bit-packs the open group of the axis at the end of
+ 						its block. The unused values of a short group are
+ 						packed as 0.
+============================================================================
+*/
+void CTorqueArchive::Pack(ARCH_AXIS& stAxis)
+{
+	ARCH_BLOCK& stBlock = m_pstPool[stAxis.iBlock] ;
+	ARCH_GROUP_HEADER* pGroup ;
+	uint32_t* pulOut ;
+	int c, k ;
+
+	if (stAxis.iCount == 0)
+		return ;
+
+	pGroup = (ARCH_GROUP_HEADER*)((uint8_t*)stBlock.ulData + stBlock.ulBytes) ;
+	pulOut = (uint32_t*)(pGroup + 1) ;
+	pGroup->ucCount 		= (uint8_t)stAxis.iCount ;
+	pGroup->ucReserved[0] 	= 0 ;
+	pGroup->ucReserved[1] 	= 0 ;
+	for (c = 0 ; c < eARCH_COLUMNS ; c++)
+	{
+		int iWidth = Width(stAxis.ulOr[c]) ;
+
+		for (k = stAxis.iCount ; k < ARCH_GROUP ; k++)
+		{
+			stAxis.ulCol[c][k] = 0 ;
+		}
+		pGroup->ucWidth[c] = (uint8_t)iWidth ;
+		PackColumn(stAxis.ulCol[c], iWidth, pulOut) ;
+		pulOut 			+= iWidth ;
+		stAxis.ulOr[c] 	= 0 ;
+	}
+	stBlock.ulBytes = (uint32_t)((uint8_t*)pulOut - (uint8_t*)stBlock.ulData) ;
+	((ARCH_BLOCK_HEADER*)stBlock.ulData)->usSamples += stAxis.iCount ;
+	stAxis.iGroups++ ;
+	stAxis.iCount = 0 ;
+}
+/*
+============================================================================
+ Function:				End()
+ Description:			Closes the open block of the axis and hands it to the
+ 						writer thread.
+============================================================================
+*/
+void CTorqueArchive::End(ARCH_AXIS& stAxis)
+{
+	ARCH_BLOCK& stBlock = m_pstPool[stAxis.iBlock] ;
+
+	Pack(stAxis) ;
+	((ARCH_BLOCK_HEADER*)stBlock.ulData)->ulBytes = stBlock.ulBytes ;
+	m_ullBytes += stBlock.ulBytes ;
+	m_cFull.Push(stAxis.iBlock) ;			// Never full: it holds the whole pool
+	stAxis.iBlock = -1 ;
+}
+/*
+============================================================================
+ Function:				NextFile()
+ Description:			Closes the archive file being written and starts the
+ 						next one, overwriting the oldest.
+============================================================================
+*/
+int CTorqueArchive::NextFile()
+{
+	char cPath[ARCH_PATH_LEN + 16] ;
+	ARCH_FILE_HEADER stHead ;
+	struct timespec stNow ;
+
+	if (m_iFd >= 0)
+	{
+		fdatasync(m_iFd) ;
+		close(m_iFd) ;
+	}
+	snprintf(cPath, sizeof(cPath), "%s.%02u.tqa", m_cBase, (unsigned int)(m_ullSequence % m_iFiles)) ;
+	m_iFd = open(cPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+	if (m_iFd < 0)
+	{
+		printf("Torque archive: cannot create %s, errno %d\n", cPath, errno) ;
+		return -1 ;
+	}
+
+	memset(&stHead, 0, sizeof(stHead)) ;
+	memcpy(stHead.cMagic, ARCH_MAGIC, sizeof(stHead.cMagic)) ;
+	clock_gettime(CLOCK_REALTIME, &stNow) ;
+	stHead.ulVersion 	= ARCH_VERSION ;
+	stHead.ulByteOrder 	= ARCH_BYTE_ORDER ;
+	stHead.ullSequence 	= m_ullSequence++ ;
+	stHead.ullMonoNs 	= MonoTimeNs() ;
+	stHead.ullWallNs 	= (uint64_t)stNow.tv_sec * NSEC_PER_SEC + (uint64_t)stNow.tv_nsec ;
+	if (write(m_iFd, &stHead, sizeof(stHead)) != (ssize_t)sizeof(stHead))
+	{
+		printf("Torque archive: cannot write %s, errno %d\n", cPath, errno) ;
+		close(m_iFd) ;
+		m_iFd = -1 ;
+		return -1 ;
+	}
+	m_ulFileBytes = sizeof(stHead) ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Write()
+ Description:			Checksums a full block and appends it to the archive,
+ 						in a new file if it does not fit in the current one.
+============================================================================
+*/
+void CTorqueArchive::Write(ARCH_BLOCK& stBlock)
+{
+	ARCH_BLOCK_HEADER* pHead = (ARCH_BLOCK_HEADER*)stBlock.ulData ;
+	const uint8_t* pucData = (const uint8_t*)stBlock.ulData ;
+
+	pHead->ulCheck = Checksum(pucData + sizeof(ARCH_BLOCK_HEADER), stBlock.ulBytes - sizeof(ARCH_BLOCK_HEADER)) ;
+	if (m_iFd < 0 || m_ulFileBytes + stBlock.ulBytes > ARCH_FILE_BYTES)
+		NextFile() ;
+	if (m_iFd < 0 || write(m_iFd, pucData, stBlock.ulBytes) != (ssize_t)stBlock.ulBytes)
+	{
+		m_ulWriteErrors++ ;
+		return ;
+	}
+	m_ulFileBytes += stBlock.ulBytes ;
+}
+/*
+============================================================================
+ Function:				Background()
+ Description:			The writer thread. Every ARCH_WRITE_MS, writes the
+ 						full blocks and returns them to the pool, then syncs
+ 						the file. Writes the last ones once stopped.
+============================================================================
+*/
+void CTorqueArchive::Background()
+{
+	struct timespec stPeriod ;
+	int iRun ;
+	int iBlock ;
+	int iWritten ;
+
+	stPeriod.tv_sec 	= ARCH_WRITE_MS / 1000 ;
+	stPeriod.tv_nsec 	= (ARCH_WRITE_MS % 1000) * 1000000L ;
+
+	do
+	{
+		iRun = m_iRun ;
+		if (iRun)
+			nanosleep(&stPeriod, NULL) ;
+
+		iWritten = 0 ;
+		while (m_cFull.Pop(iBlock))
+		{
+			Write(m_pstPool[iBlock]) ;
+			m_cFree.Push(iBlock) ;
+			iWritten++ ;
+		}
+		if (iWritten && m_iFd >= 0)
+			fdatasync(m_iFd) ;
+	} while (iRun) ;
+}
+
+void* CTorqueArchive::ThreadFunc(void* pArg)
+{
+	((CTorqueArchive*)pArg)->Background() ;
+	return NULL ;
+}
+/*
+============================================================================
+ Function:				Decode()
+ Input arguments:		pBlock, ulBytes - a block and the bytes available there.
+ 						pstOut, iMax - where to decode its samples.
+ Output arguments: 		pstOut - the samples, time stamps to ulTimeUnitNs.
+ Returned value:		The number of samples, -1 if the block is damaged or
+ 						holds more than iMax samples.
+ Version:				Version 1.00
+
+ Description:
+
+ Checks the header and checksum, then decodes the groups one after the
+ other: every column is unpacked by the routine of its width, then the
+ zig-zag coding and the deltas are undone by SIMD prefix sums, carried from
+ the last sample of the previous group.
+============================================================================
+*/
+int CTorqueArchive::Decode(const void* pBlock, uint32_t ulBytes, TORQUE_LOG_RECORD* pstOut, int iMax)
+{
+	const uint8_t* pucData = (const uint8_t*)pBlock ;
+	ARCH_BLOCK_HEADER stHead ;
+	ARCH_GROUP_HEADER stGroup ;
+	uint32_t ulWords[ARCH_GROUP] ;
+	uint32_t ulCol[eARCH_COLUMNS][ARCH_GROUP] ;
+	uint32_t ulTimeDelta, ulPositionDelta ;
+	uint32_t ulPosition, ulTorque, ulCurrent, ulStatus ;
+	uint64_t ullTime ;
+	uint32_t ulOffset ;
+	int iSamples ;
+	int c, k, n ;
+
+	if (ulBytes < sizeof(stHead))
+		return -1 ;
+	memcpy(&stHead, pucData, sizeof(stHead)) ;
+	if (stHead.ulMagic != ARCH_BLOCK_MAGIC || stHead.ulBytes < sizeof(stHead) || stHead.ulBytes > ulBytes ||
+		stHead.usSamples == 0 || stHead.usSamples > iMax)
+		return -1 ;
+	if (Checksum(pucData + sizeof(stHead), stHead.ulBytes - sizeof(stHead)) != stHead.ulCheck)
+		return -1 ;
+
+	ullTime 		= stHead.ullTime ;
+	ulTimeDelta 	= 0 ;
+	ulPosition 		= (uint32_t)stHead.lPosition ;
+	ulPositionDelta = 0 ;
+	ulTorque 		= (uint32_t)(int32_t)stHead.sTorque ;
+	ulCurrent 		= (uint32_t)(int32_t)stHead.sCurrent ;
+	ulStatus 		= stHead.ulStatus ;
+
+	pstOut[0].ullTimeNs 	= ullTime * stHead.ulTimeUnitNs ;
+	pstOut[0].lPosition 	= stHead.lPosition ;
+	pstOut[0].ulStatus 		= stHead.ulStatus ;
+	pstOut[0].usAxis 		= stHead.usAxis ;
+	pstOut[0].sTorque 		= stHead.sTorque ;
+	pstOut[0].sCurrent 		= stHead.sCurrent ;
+	pstOut[0].usReserved 	= 0 ;
+
+	iSamples = 1 ;
+	ulOffset = sizeof(stHead) ;
+	while (iSamples < stHead.usSamples)
+	{
+		if (ulOffset + sizeof(stGroup) > stHead.ulBytes)
+			return -1 ;
+		memcpy(&stGroup, pucData + ulOffset, sizeof(stGroup)) ;
+		ulOffset += sizeof(stGroup) ;
+		n = stGroup.ucCount ;
+		if (n == 0 || n > ARCH_GROUP || iSamples + n > stHead.usSamples)
+			return -1 ;
+
+		for (c = 0 ; c < eARCH_COLUMNS ; c++)
+		{
+			uint32_t ulSize = stGroup.ucWidth[c] * sizeof(uint32_t) ;
+
+			if (stGroup.ucWidth[c] > 32 || ulOffset + ulSize > stHead.ulBytes)
+				return -1 ;
+			if (stGroup.ucWidth[c] == 0)
+			{
+				memset(ulCol[c], 0, sizeof(ulCol[c])) ;
+				continue ;
+			}
+			memcpy(ulWords, pucData + ulOffset, ulSize) ;
+			gpfnUnpack[stGroup.ucWidth[c]](ulWords, ulCol[c]) ;
+			ulOffset += ulSize ;
+		}
+		//
+		// Delta of delta -> delta -> value, delta -> value, XOR -> value
+		ScanAdd(ulCol[eARCH_TIME], ulTimeDelta, true, ulCol[eARCH_TIME]) ;
+		ScanAdd(ulCol[eARCH_POSITION], ulPositionDelta, true, ulCol[eARCH_POSITION]) ;
+		ulPositionDelta = ulCol[eARCH_POSITION][n - 1] ;
+		ScanAdd(ulCol[eARCH_POSITION], ulPosition, false, ulCol[eARCH_POSITION]) ;
+		ScanAdd(ulCol[eARCH_TORQUE], ulTorque, true, ulCol[eARCH_TORQUE]) ;
+		ScanAdd(ulCol[eARCH_CURRENT], ulCurrent, true, ulCol[eARCH_CURRENT]) ;
+		ScanXor(ulCol[eARCH_STATUS], ulStatus, ulCol[eARCH_STATUS]) ;
+
+		for (k = 0 ; k < n ; k++)
+		{
+			TORQUE_LOG_RECORD& stRec = pstOut[iSamples + k] ;
+
+			ullTime 		   += ulCol[eARCH_TIME][k] ;
+			stRec.ullTimeNs 	= ullTime * stHead.ulTimeUnitNs ;
+			stRec.lPosition 	= (int32_t)ulCol[eARCH_POSITION][k] ;
+			stRec.ulStatus 		= ulCol[eARCH_STATUS][k] ;
+			stRec.usAxis 		= stHead.usAxis ;
+			stRec.sTorque 		= (int16_t)ulCol[eARCH_TORQUE][k] ;
+			stRec.sCurrent 		= (int16_t)ulCol[eARCH_CURRENT][k] ;
+			stRec.usReserved 	= 0 ;
+		}
+		ulTimeDelta = ulCol[eARCH_TIME][n - 1] ;
+		ulPosition 	= ulCol[eARCH_POSITION][n - 1] ;
+		ulTorque 	= ulCol[eARCH_TORQUE][n - 1] ;
+		ulCurrent 	= ulCol[eARCH_CURRENT][n - 1] ;
+		ulStatus 	= ulCol[eARCH_STATUS][n - 1] ;
+		iSamples   += n ;
+	}
+	return iSamples ;
+}
+/*
+============================================================================
+ Function:				Dump()
+ Input arguments:		cpFile - an archive file.
+ Output arguments: 		None.
+ Returned value:		The number of samples decoded, -1 if the file cannot
+ 						be read.
+ Version:				Version 1.00
+
+ Description:
+
+ Prints every sample of the file, one line each, then the compression and
+ the decoding speed. A damaged block is skipped; the file is not read past
+ a block header that does not make sense.
+============================================================================
+*/
+long CTorqueArchive::Dump(const char* cpFile)
+{
+	static ARCH_BLOCK stBlock ;
+	static TORQUE_LOG_RECORD stRec[ARCH_BLOCK_SAMPLES] ;
+	ARCH_FILE_HEADER stFile ;
+	ARCH_BLOCK_HEADER* pHead = (ARCH_BLOCK_HEADER*)stBlock.ulData ;
+	FILE* pFile ;
+	uint64_t ullDecodeNs = 0 ;
+	uint64_t ullBytes = 0 ;
+	unsigned long ulBlocks = 0 ;
+	unsigned long ulDamaged = 0 ;
+	long lSamples = 0 ;
+	int n, k ;
+
+	pFile = fopen(cpFile, "rb") ;
+	if (pFile == NULL)
+	{
+		printf("Torque archive: cannot open %s, errno %d\n", cpFile, errno) ;
+		return -1 ;
+	}
+	if (fread(&stFile, sizeof(stFile), 1, pFile) != 1 || memcmp(stFile.cMagic, ARCH_MAGIC, sizeof(stFile.cMagic)) != 0 ||
+		stFile.ulVersion != ARCH_VERSION || stFile.ulByteOrder != ARCH_BYTE_ORDER)
+	{
+		printf("Torque archive: %s is not an archive file of this version and byte order\n", cpFile) ;
+		fclose(pFile) ;
+		return -1 ;
+	}
+	printf("# %s: file %llu, created at %llu.%09llu s (monotonic %llu ns)\n", cpFile,
+		   (unsigned long long)stFile.ullSequence, (unsigned long long)(stFile.ullWallNs / NSEC_PER_SEC),
+		   (unsigned long long)(stFile.ullWallNs % NSEC_PER_SEC), (unsigned long long)stFile.ullMonoNs) ;
+	printf("# axis time_ns position status torque current\n") ;
+
+	while (fread(pHead, sizeof(ARCH_BLOCK_HEADER), 1, pFile) == 1)
+	{
+		uint64_t ullStartNs ;
+
+		if (pHead->ulMagic != ARCH_BLOCK_MAGIC || pHead->ulBytes < sizeof(ARCH_BLOCK_HEADER) ||
+			pHead->ulBytes > sizeof(stBlock.ulData))
+			break ;
+		if (pHead->ulBytes > sizeof(ARCH_BLOCK_HEADER) &&
+			fread((uint8_t*)stBlock.ulData + sizeof(ARCH_BLOCK_HEADER), pHead->ulBytes - sizeof(ARCH_BLOCK_HEADER), 1, pFile) != 1)
+			break ;
+		ulBlocks++ ;
+		ullBytes += pHead->ulBytes ;
+
+		ullStartNs 	= MonoTimeNs() ;
+		n 			= Decode(stBlock.ulData, pHead->ulBytes, stRec, ARCH_BLOCK_SAMPLES) ;
+		ullDecodeNs += MonoTimeNs() - ullStartNs ;
+		if (n < 0)
+		{
+			ulDamaged++ ;
+			continue ;
+		}
+		for (k = 0 ; k < n ; k++)
+		{
+			printf("%u %llu %ld %lu %d %d\n", stRec[k].usAxis, (unsigned long long)stRec[k].ullTimeNs,
+				   (long)stRec[k].lPosition, (unsigned long)stRec[k].ulStatus, stRec[k].sTorque, stRec[k].sCurrent) ;
+		}
+		lSamples += n ;
+	}
+	fclose(pFile) ;
+
+	printf("# %lu blocks, %lu damaged, %ld samples in %llu bytes: %.2f bytes per sample, %.1f times smaller than the torque log\n",
+		   ulBlocks, ulDamaged, lSamples, (unsigned long long)ullBytes,
+		   lSamples ? (double)ullBytes / lSamples : 0.0,
+		   ullBytes ? (double)lSamples * sizeof(TORQUE_LOG_RECORD) / ullBytes : 0.0) ;
+	printf("# Decoded at %.1f Msamples/s (%s)\n", ullDecodeNs ? lSamples * 1e3 / ullDecodeNs : 0.0, ARCH_ISA) ;
+	return lSamples ;
+}
+/*
+============================================================================
+ Function:				Isa()
+ Returned value:		The instruction set the decoder was compiled for.
+============================================================================
+*/
+const char* CTorqueArchive::Isa()
+{
+	return ARCH_ISA ;
+}
@@ -0,0 +1,212 @@
+/*
+============================================================================
+ Name : torque_archive.h
+ Author  :
+ Version :
+ Description : 	Compressed long-term archive of the torque samples.
+
+ The torque log (torque_log.h) keeps the last seconds of raw records. The
+ archive keeps as many of them as a flash budget given to Open() holds, in
+ blocks of up to
+ ARCH_BLOCK_SAMPLES samples of one axis. A block holds the first sample in
+ full in its header, then the others in groups of ARCH_GROUP, each field of
+ a group as a column:
+
+ 	time		delta of delta, in ARCH_TIME_UNIT_NS
+ 	position	delta of delta
+ 	torque		delta
+ 	current		delta
+ 	status		XOR with the previous one
+
+ The signed values are zig-zag coded, so small magnitudes have few
+ significant bits, and every column is bit-packed with the width of its
+ largest value: ARCH_GROUP values of B bits take B 32 bits words. A column
+ that does not change takes no word. At a constant speed the time and
+ position columns are jitter only, and a group of 32 samples typically
+ takes 2 to 4 bytes per sample instead of the 24 of a TORQUE_LOG_RECORD.
+
+ A block depends on nothing outside itself: a reader may start at any
+ block, and a damaged block, detected by its checksum, loses its samples
+ only. Time gaps too long for the column start a new block.
+
+ Encoder, Append(): called by the cycle with every record it logs. It only
+ computes the deltas into the open group of the axis; a full group is
+ packed into the open block, a full block is handed to the writer thread.
+ The blocks come from a pool allocated by Open(), Append() never allocates
+ nor blocks. If the pool is empty, samples are dropped and counted.
+
+ Writer thread: checksums the full blocks and appends them to the archive
+ files, <base>.<nn>.tqa, ARCH_FILE_BYTES each, as many as fit in the budget,
+ the oldest being overwritten. Open() continues after the newest file found,
+ so the history survives a restart. Keep the budget between restarts: files
+ beyond a smaller one are left as they are.
+
+ Retention: budget / (bytes per sample x samples per second x axes). At the
+ 2 to 3 bytes per sample of the test strokes (printed at exit) and 1 kHz,
+ an axis takes 7 to 11 MB per hour: the default ARCH_BUDGET_MB, 64 MB, keeps
+ 6 to 9 hours of one axis, 2 to 3 of three. A week of one axis takes 1.2 to
+ 1.8 GB.
+
+ Decoder, Decode(): unpacks a block with one routine per bit width, and
+ undoes the zig-zag coding, the deltas and the XOR with SIMD prefix sums,
+ ARCH_LANES values at a time. Isa() tells which instruction set. Dump()
+ decodes an archive file.
+============================================================================
+*/
+#ifndef TORQUE_ARCHIVE_H_
+#define TORQUE_ARCHIVE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include "spsc_ring.h"
+#include "torque_log.h"
+
+#define		ARCH_MAGIC				"TQARC01"	// 8 bytes with the terminating 0
+#define		ARCH_VERSION			1
+#define		ARCH_BLOCK_MAGIC		0x42415154	// "TQAB" in a little endian dump
+#define		ARCH_MAX_AXES			16
+#define		ARCH_GROUP				32			// Samples per group, bit-packed together
+#define		ARCH_BLOCK_GROUPS		8			// Groups per block
+#define		ARCH_BLOCK_SAMPLES		(1 + ARCH_BLOCK_GROUPS * ARCH_GROUP)	// First one in the header
+#define		ARCH_TIME_UNIT_NS		1000		// Time stamps kept to the us
+#define		ARCH_MAX_TIME_DELTA		0x3FFFFFFF	// Between two samples, in ARCH_TIME_UNIT_NS
+#define		ARCH_POOL_BLOCKS		64			// Blocks open, full or being written. Power of 2.
+#define		ARCH_FILE_BYTES			(4 * 1024 * 1024)
+#define		ARCH_BUDGET_MB			64			// Flash given to the archive files by default
+#define		ARCH_MIN_FILES			2			// The one being written and the previous one
+#define		ARCH_MAX_FILES			1024		// 4 GB
+#define		ARCH_WRITE_MS			500			// Writer thread period
+#define		ARCH_PATH_LEN			256
+/*
+============================================================================
+ On-disk format, native byte order of the writer (see ulByteOrder)
+============================================================================
+*/
+enum eArchColumn
+{
+	eARCH_TIME		= 0,
+	eARCH_POSITION	= 1,
+	eARCH_TORQUE	= 2,
+	eARCH_CURRENT	= 3,
+	eARCH_STATUS	= 4,
+	eARCH_COLUMNS	= 5,
+};
+
+typedef struct
+{
+	char			cMagic[8];				// ARCH_MAGIC
+	uint32_t		ulVersion;
+	uint32_t		ulByteOrder;			// 0x01020304 as written by the writer
+	uint64_t		ullSequence;			// File number, never reused
+	uint64_t		ullMonoNs;				// MonoTimeNs() when the file was created...
+	uint64_t		ullWallNs;				// ...and CLOCK_REALTIME at the same time
+} ARCH_FILE_HEADER;
+
+typedef struct
+{
+	uint32_t		ulMagic;				// ARCH_BLOCK_MAGIC
+	uint16_t		usAxis;
+	uint16_t		usSamples;				// The first one included
+	uint32_t		ulBytes;				// Of the block, this header included
+	uint32_t		ulCheck;				// FNV-1a of the bytes after this header
+	uint32_t		ulTimeUnitNs;
+	uint32_t		ulStatus;				// First sample
+	uint64_t		ullTime;				// In ulTimeUnitNs
+	int32_t			lPosition;
+	int16_t			sTorque;
+	int16_t			sCurrent;
+} ARCH_BLOCK_HEADER;
+
+typedef struct
+{
+	uint8_t			ucCount;				// Samples in the group, ARCH_GROUP at most
+	uint8_t			ucWidth[eARCH_COLUMNS];	// Bits per value, then ucWidth[c] words per column
+	uint8_t			ucReserved[2];
+} ARCH_GROUP_HEADER;
+
+#define		ARCH_BLOCK_BYTES		(sizeof(ARCH_BLOCK_HEADER) + ARCH_BLOCK_GROUPS * \
+									 (sizeof(ARCH_GROUP_HEADER) + eARCH_COLUMNS * ARCH_GROUP * sizeof(uint32_t)))
+/*
+============================================================================
+ Encoder and writer
+============================================================================
+*/
+typedef struct
+{
+	uint32_t		ulBytes;				// Written so far
+	uint32_t		ulData[ARCH_BLOCK_BYTES / sizeof(uint32_t)];	// ARCH_BLOCK_HEADER first
+} ARCH_BLOCK;
+
+typedef struct
+{
+	int				iBlock;					// Open block in the pool, -1 for none
+	int				iCount;					// Samples in the open group
+	int				iGroups;				// Groups packed in the open block
+	uint64_t		ullTime;				// Previous sample
+	int32_t			lTimeDelta;
+	uint32_t		ulPosition;
+	uint32_t		ulPositionDelta;
+	int16_t			sTorque;
+	int16_t			sCurrent;
+	uint32_t		ulStatus;
+	uint32_t		ulOr[eARCH_COLUMNS];	// Of the values of the open group, for the widths
+	uint32_t		ulCol[eARCH_COLUMNS][ARCH_GROUP];
+} ARCH_AXIS;
+
+class CTorqueArchive
+{
+public:
+	CTorqueArchive() ;
+	~CTorqueArchive() ;
+
+	int  Open(const char* cpBase, unsigned long ulBudgetMb = ARCH_BUDGET_MB) ;
+	void Close() ;
+	int  IsOpen() const				{ return m_iRun ; }
+	int  Files() const				{ return m_iFiles ; }
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	void Append(const TORQUE_LOG_RECORD& stRec) ;
+	void Flush() ;
+
+	unsigned long Appended() const	{ return m_ulAppended ; }
+	unsigned long Dropped() const	{ return m_ulDropped ; }
+	uint64_t Bytes() const			{ return m_ullBytes ; }
+/*
+============================================================================
+ Decoder
+============================================================================
+*/
+	static int  Decode(const void* pBlock, uint32_t ulBytes, TORQUE_LOG_RECORD* pstOut, int iMax) ;
+	static long Dump(const char* cpFile) ;
+	static const char* Isa() ;
+
+private:
+	void Begin(ARCH_AXIS& stAxis, const TORQUE_LOG_RECORD& stRec, uint64_t ullTime) ;
+	void Pack(ARCH_AXIS& stAxis) ;
+	void End(ARCH_AXIS& stAxis) ;
+	int  NextFile() ;
+	void Write(ARCH_BLOCK& stBlock) ;
+	void Background() ;
+	static void* ThreadFunc(void* pArg) ;
+
+	char					m_cBase[ARCH_PATH_LEN] ;
+	int						m_iFiles ;						// Archive files kept, from the budget
+	ARCH_AXIS				m_stAxis[ARCH_MAX_AXES] ;
+	ARCH_BLOCK*				m_pstPool ;						// ARCH_POOL_BLOCKS, allocated by Open()
+	CSpscRing<int, ARCH_POOL_BLOCKS>	m_cFree ;			// Writer -> cycle: blocks to fill
+	CSpscRing<int, ARCH_POOL_BLOCKS>	m_cFull ;			// Cycle -> writer: blocks to write
+	volatile unsigned long	m_ulAppended ;
+	volatile unsigned long	m_ulDropped ;
+	volatile uint64_t		m_ullBytes ;					// Of the blocks handed to the writer
+	int						m_iFd ;							// Archive file being written
+	uint32_t				m_ulFileBytes ;
+	uint64_t				m_ullSequence ;					// Of the next file
+	unsigned long			m_ulWriteErrors ;
+	volatile int			m_iRun ;
+	pthread_t				m_stThread ;
+} ;
+
+#endif /* TORQUE_ARCHIVE_H_ */
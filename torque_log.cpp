@@ -0,0 +1,382 @@
+/*
+============================================================================
+ Name : 	torque_log.cpp
+ Author :
+ Version :	1.00
+ Description : Memory-mapped binary torque log, see torque_log.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include "mono_time.h"
+#include "torque_log.h"
+
+#define		TORQUE_LOG_BYTE_ORDER	0x01020304
+/*
+============================================================================
+ Layout of TORQUE_LOG_RECORD, written in every segment header
+============================================================================
+*/
+static const TORQUE_LOG_FIELD gstTorqueLogFields[] =
+{
+	{ "time_ns",	offsetof(TORQUE_LOG_RECORD, ullTimeNs),	8, eTLOG_UINT },
+	{ "position",	offsetof(TORQUE_LOG_RECORD, lPosition),	4, eTLOG_INT },
+	{ "status",		offsetof(TORQUE_LOG_RECORD, ulStatus),	4, eTLOG_UINT },
+	{ "axis",		offsetof(TORQUE_LOG_RECORD, usAxis),	2, eTLOG_UINT },
+	{ "torque",		offsetof(TORQUE_LOG_RECORD, sTorque),	2, eTLOG_INT },
+	{ "current",	offsetof(TORQUE_LOG_RECORD, sCurrent),	2, eTLOG_INT },
+};
+#define		TORQUE_LOG_FIELDS		(sizeof(gstTorqueLogFields) / sizeof(gstTorqueLogFields[0]))
+/*
+============================================================================
+ Function:				CTorqueLog()
+ Description:			Constructor.
+============================================================================
+*/
+CTorqueLog::CTorqueLog()
+{
+	int i ;
+
+	memset(m_cBase, 0, sizeof(m_cBase)) ;
+	memset(m_stSeg, 0, sizeof(m_stSeg)) ;
+	for (i = 0 ; i < 3 ; i++)
+	{
+		m_stSeg[i].iFd = -1 ;
+	}
+	m_pCurrent 			= 0 ;
+	m_pSpare 			= 0 ;
+	m_pRetired 			= 0 ;
+	m_ulWrite 			= 0 ;
+	m_ulRetiredCount 	= 0 ;
+	m_ulAppended 		= 0 ;
+	m_ulDropped 		= 0 ;
+	m_ullNextSequence 	= 0 ;
+	m_iRun 				= 0 ;
+}
+
+CTorqueLog::~CTorqueLog()
+{
+	Close() ;
+}
+/*
+============================================================================
+ Function:				Open()
+ Input arguments:		cpBase - path and file name prefix of the segments.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 if the first segments could not be
+ 						created or the background thread could not be started.
+ Version:				Version 1.00
+
+ Description:
+
+ Finds the newest segment of cpBase, prepares the next segment after it and
+ a spare one, then starts the background thread. The segments of a previous
+ run are kept, only the oldest ones are overwritten as the log goes round.
+ Must not be called from the cycle: it creates and pre-faults files.
+============================================================================
+*/
+int CTorqueLog::Open(const char* cpBase)
+{
+	char cPath[TORQUE_LOG_PATH_LEN + 16] ;
+	TORQUE_LOG_HEADER stHead ;
+	int iFd ;
+	int i ;
+
+	if (m_pCurrent)
+		return -1 ;
+
+	strncpy(m_cBase, cpBase, sizeof(m_cBase) - 1) ;
+	m_ullNextSequence 	= 0 ;
+	for (i = 0 ; i < TORQUE_LOG_SEGMENTS ; i++)
+	{
+		snprintf(cPath, sizeof(cPath), "%s.%02d.tlog", m_cBase, i) ;
+		iFd = open(cPath, O_RDONLY) ;
+		if (iFd < 0)
+			continue ;
+		if (read(iFd, &stHead, sizeof(stHead)) == (ssize_t)sizeof(stHead) &&
+			memcmp(stHead.cMagic, TORQUE_LOG_MAGIC, sizeof(stHead.cMagic)) == 0 && stHead.ullSequence >= m_ullNextSequence)
+			m_ullNextSequence = stHead.ullSequence + 1 ;
+		close(iFd) ;
+	}
+	m_ulWrite 			= 0 ;
+	m_ulAppended 		= 0 ;
+	m_ulDropped 		= 0 ;
+
+	if (Prepare(m_stSeg[0], m_ullNextSequence++) != 0)
+		return -1 ;
+	if (Prepare(m_stSeg[1], m_ullNextSequence++) != 0)
+	{
+		Release(m_stSeg[0], 0) ;
+		return -1 ;
+	}
+	m_pCurrent 	= &m_stSeg[0] ;
+	m_pSpare 	= &m_stSeg[1] ;
+	m_pRetired 	= 0 ;
+
+	m_iRun = 1 ;
+	if (pthread_create(&m_stThread, NULL, ThreadFunc, this) != 0)
+	{
+		printf("Torque log: cannot start the background thread\n") ;
+		m_iRun = 0 ;
+		Close() ;
+		return -1 ;
+	}
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Close()
+ Description:			Stops the background thread, flushes and closes all the
+ 						segments. Append() must not be running.
+============================================================================
+*/
+void CTorqueLog::Close()
+{
+	if (m_iRun)
+	{
+		m_iRun = 0 ;
+		pthread_join(m_stThread, NULL) ;
+	}
+	if (m_pRetired)
+		Release(*m_pRetired, m_ulRetiredCount) ;
+	if (m_pCurrent)
+		Release(*m_pCurrent, m_ulWrite) ;
+	if (m_pSpare)
+		Release(*m_pSpare, 0) ;
+	m_pCurrent 	= 0 ;
+	m_pSpare 	= 0 ;
+	m_pRetired 	= 0 ;
+}
+/*
+============================================================================
+ Function:				Rotate()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		The new current segment, NULL if no spare segment is ready.
+ Version:				Version 1.00
+
+ Description:
+
+ Called by Append() when the current segment is full. Hands the full segment
+ to the background thread and continues in the spare one. Only pointers are
+ exchanged. The write index is reset before the current segment changes, the
+ background thread relies on this order, see Background().
+============================================================================
+*/
+TORQUE_LOG_SEGMENT* CTorqueLog::Rotate()
+{
+	TORQUE_LOG_SEGMENT* pSpare = m_pSpare ;
+
+	if (pSpare == 0 || m_pRetired != 0)
+		return 0 ;
+
+	m_ulRetiredCount 	= m_ulWrite ;
+	__sync_synchronize() ;
+	m_pRetired 			= m_pCurrent ;
+	m_pSpare 			= 0 ;
+	m_ulWrite 			= 0 ;
+	__sync_synchronize() ;
+	m_pCurrent 			= pSpare ;
+	return pSpare ;
+}
+/*
+============================================================================
+ Function:				Prepare()
+ Input arguments:		stSeg - an unused segment slot.
+ 						ullSequence - the segment number.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 otherwise.
+ Version:				Version 1.00
+
+ Description:
+
+ Creates the segment file, or reuses the oldest one, sizes it, maps it and
+ clears all its pages, so Append() neither allocates blocks nor page faults.
+ Then writes the header.
+============================================================================
+*/
+int CTorqueLog::Prepare(TORQUE_LOG_SEGMENT& stSeg, uint64_t ullSequence)
+{
+	char cPath[TORQUE_LOG_PATH_LEN + 16] ;
+	TORQUE_LOG_HEADER* pHeader ;
+	void* pMap ;
+	size_t ulSize ;
+
+	snprintf(cPath, sizeof(cPath), "%s.%02u.tlog", m_cBase, (unsigned int)(ullSequence % TORQUE_LOG_SEGMENTS)) ;
+	ulSize = sizeof(TORQUE_LOG_HEADER) + (size_t)TORQUE_LOG_SEG_RECORDS * sizeof(TORQUE_LOG_RECORD) ;
+
+	stSeg.iFd = open(cPath, O_RDWR | O_CREAT, 0644) ;
+	if (stSeg.iFd < 0)
+	{
+		printf("Torque log: cannot create %s, errno %d\n", cPath, errno) ;
+		return -1 ;
+	}
+	if (ftruncate(stSeg.iFd, (off_t)ulSize) != 0)
+	{
+		printf("Torque log: cannot size %s, errno %d\n", cPath, errno) ;
+		close(stSeg.iFd) ;
+		stSeg.iFd = -1 ;
+		return -1 ;
+	}
+	pMap = mmap(NULL, ulSize, PROT_READ | PROT_WRITE, MAP_SHARED, stSeg.iFd, 0) ;
+	if (pMap == MAP_FAILED)
+	{
+		printf("Torque log: cannot map %s, errno %d\n", cPath, errno) ;
+		close(stSeg.iFd) ;
+		stSeg.iFd = -1 ;
+		return -1 ;
+	}
+	memset(pMap, 0, ulSize) ;
+
+	pHeader = (TORQUE_LOG_HEADER*)pMap ;
+	memcpy(pHeader->cMagic, TORQUE_LOG_MAGIC, sizeof(pHeader->cMagic)) ;
+	pHeader->ulVersion 		= TORQUE_LOG_VERSION ;
+	pHeader->ulByteOrder 	= TORQUE_LOG_BYTE_ORDER ;
+	pHeader->ulHeaderSize 	= sizeof(TORQUE_LOG_HEADER) ;
+	pHeader->ulRecordSize 	= sizeof(TORQUE_LOG_RECORD) ;
+	pHeader->ulCapacity 	= TORQUE_LOG_SEG_RECORDS ;
+	pHeader->ulRecords 		= 0 ;
+	pHeader->ullSequence 	= ullSequence ;
+	pHeader->ullCreatedNs 	= MonoTimeNs() ;
+	pHeader->ulFields 		= TORQUE_LOG_FIELDS ;
+	memcpy(pHeader->stField, gstTorqueLogFields, sizeof(gstTorqueLogFields)) ;
+
+	stSeg.ullSequence 	= ullSequence ;
+	stSeg.ulSize 		= ulSize ;
+	stSeg.pHeader 		= pHeader ;
+	stSeg.pRecords 		= (TORQUE_LOG_RECORD*)((char*)pMap + sizeof(TORQUE_LOG_HEADER)) ;
+	stSeg.ulSynced 		= 0 ;
+	return 0 ;
+}
+/*
+============================================================================
+ Function:				Sync()
+ Input arguments:		stSeg - a mapped segment.
+ 						ulRecords - records known to be written in it.
+ 						iFlags - MS_ASYNC while the segment is appended,
+ 						MS_SYNC when it is released.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Writes back the pages of the records appended since the previous call, then
+ publishes the count in the header. The count never decreases.
+============================================================================
+*/
+void CTorqueLog::Sync(TORQUE_LOG_SEGMENT& stSeg, uint32_t ulRecords, int iFlags)
+{
+	uintptr_t ulPage = (uintptr_t)sysconf(_SC_PAGESIZE) ;
+	uintptr_t ulStart ;
+	uintptr_t ulEnd ;
+
+	if (ulRecords <= stSeg.ulSynced)
+		return ;
+
+	ulStart = (uintptr_t)&stSeg.pRecords[stSeg.ulSynced] & ~(ulPage - 1) ;
+	ulEnd 	= (uintptr_t)&stSeg.pRecords[ulRecords] ;
+	msync((void*)ulStart, ulEnd - ulStart, iFlags) ;
+
+	stSeg.pHeader->ulRecords = ulRecords ;
+	msync((void*)stSeg.pHeader, sizeof(TORQUE_LOG_HEADER), iFlags) ;
+	stSeg.ulSynced = ulRecords ;
+}
+/*
+============================================================================
+ Function:				Release()
+ Description:			Flushes the segment, publishes its final record count,
+ 						unmaps and closes it.
+============================================================================
+*/
+void CTorqueLog::Release(TORQUE_LOG_SEGMENT& stSeg, uint32_t ulRecords)
+{
+	if (stSeg.pHeader == 0)
+		return ;
+
+	Sync(stSeg, ulRecords, MS_SYNC) ;
+	munmap((void*)stSeg.pHeader, stSeg.ulSize) ;
+	close(stSeg.iFd) ;
+	stSeg.iFd 		= -1 ;
+	stSeg.pHeader 	= 0 ;
+	stSeg.pRecords 	= 0 ;
+}
+/*
+============================================================================
+ Function:				Background()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ The background thread. Every TORQUE_LOG_SYNC_MS it releases the segment that
+ was rotated out, prepares a spare segment if there is none, and msync()s the
+ current one.
+
+ The current segment and its write index are read current, index, current:
+ if the segment changed meanwhile the pass is skipped. Rotate() resets the
+ index before it changes the segment, so an index read for the old segment
+ may be too low, never too high, and Sync() ignores counts that went down.
+============================================================================
+*/
+void CTorqueLog::Background()
+{
+	struct timespec stPeriod ;
+	int i ;
+
+	stPeriod.tv_sec 	= TORQUE_LOG_SYNC_MS / 1000 ;
+	stPeriod.tv_nsec 	= (TORQUE_LOG_SYNC_MS % 1000) * 1000000L ;
+
+	while (m_iRun)
+	{
+		TORQUE_LOG_SEGMENT* pCurrent ;
+		uint32_t ulWrite ;
+
+		nanosleep(&stPeriod, NULL) ;
+
+		if (m_pRetired)
+		{
+			__sync_synchronize() ;
+			Release(*m_pRetired, m_ulRetiredCount) ;
+			__sync_synchronize() ;
+			m_pRetired = 0 ;
+		}
+		if (m_pSpare == 0)
+		{
+			for (i = 0 ; i < 3 ; i++)
+			{
+				if (&m_stSeg[i] != m_pCurrent && m_stSeg[i].pHeader == 0)
+				{
+					if (Prepare(m_stSeg[i], m_ullNextSequence) == 0)
+					{
+						m_ullNextSequence++ ;
+						__sync_synchronize() ;
+						m_pSpare = &m_stSeg[i] ;
+					}
+					break ;
+				}
+			}
+		}
+
+		pCurrent = m_pCurrent ;
+		__sync_synchronize() ;
+		ulWrite = m_ulWrite ;
+		__sync_synchronize() ;
+		if (pCurrent == m_pCurrent)
+			Sync(*pCurrent, ulWrite, MS_ASYNC) ;
+	}
+}
+
+void* CTorqueLog::ThreadFunc(void* pArg)
+{
+	((CTorqueLog*)pArg)->Background() ;
+	return NULL ;
+}
@@ -0,0 +1,172 @@
+/*
+============================================================================
+ Name : torque_log.h
+ Author  :
+ Version :
+ Description : 	Memory-mapped, append-only binary log of torque samples.
+
+ The log is a set of segment files, <base>.<nn>.tlog, each holding a
+ TORQUE_LOG_HEADER followed by a fixed number of TORQUE_LOG_RECORD. The
+ header describes the record layout field by field, so a reader does not
+ need this file to decode the log.
+
+ The segment being written is mapped with mmap(MAP_SHARED). Append() only
+ copies the record into the mapping, it never calls the kernel. A background
+ thread:
+
+ 	- msync(MS_ASYNC)s the records appended since its previous pass, every
+ 	  TORQUE_LOG_SYNC_MS, and publishes their count in the header,
+ 	- prepares the next segment in advance: created, sized, mapped and
+ 	  pre-faulted, so rotation is a pointer swap in Append(),
+ 	- flushes, unmaps and closes the segments that were rotated out.
+
+ Segments are reused round robin, TORQUE_LOG_SEGMENTS files at most, the
+ oldest one being overwritten. The header sequence number orders them, and
+ Open() continues after the newest segment found, so a restart does not
+ overwrite the log of the previous run.
+
+ Limitation: the kernel write-protects a page while writing it back, to see
+ the next write. The page Append() is filling is written back with the
+ records before it, so the next Append() may take a page fault, about once
+ per TORQUE_LOG_SYNC_MS. The blocks of the segment exist, so the fault reads
+ nothing, but on a file system that needs stable pages it waits for the end
+ of the write-back of that page.
+
+ Append() must be called from one thread only. If the next segment is not
+ ready when the current one is full, records are dropped and counted.
+============================================================================
+*/
+#ifndef TORQUE_LOG_H_
+#define TORQUE_LOG_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define		TORQUE_LOG_MAGIC		"TQLOG01"	// 8 bytes with the terminating 0
+#define		TORQUE_LOG_VERSION		1
+#define		TORQUE_LOG_SEG_RECORDS	65536		// Records per segment, 1.5 MB
+#define		TORQUE_LOG_SEGMENTS		8			// Segment files kept
+#define		TORQUE_LOG_SYNC_MS		200			// Background msync() period
+#define		TORQUE_LOG_MAX_FIELDS	8
+#define		TORQUE_LOG_PATH_LEN		256
+/*
+============================================================================
+ On-disk format, native byte order of the writer (see ulByteOrder)
+============================================================================
+*/
+typedef struct
+{
+	uint64_t		ullTimeNs;				// MonoTimeNs() of the sample
+	int32_t			lPosition;				// 0x6064, counts
+	uint32_t		ulStatus;				// GMAS axis status
+	uint16_t		usAxis;					// Index of the axis, a01 is 0
+	int16_t			sTorque;				// 0x6077, per-mille of rated torque
+	int16_t			sCurrent;				// 0x6078, per-mille of rated current
+	uint16_t		usReserved;
+} TORQUE_LOG_RECORD;
+
+enum eTorqueLogFieldType
+{
+	eTLOG_UINT		= 0,
+	eTLOG_INT		= 1,
+};
+
+typedef struct
+{
+	char			cName[16];
+	uint16_t		usOffset;				// In the record
+	uint8_t			ucSize;					// Bytes
+	uint8_t			ucType;					// eTorqueLogFieldType
+} TORQUE_LOG_FIELD;
+
+typedef struct
+{
+	char				cMagic[8];			// TORQUE_LOG_MAGIC
+	uint32_t			ulVersion;
+	uint32_t			ulByteOrder;		// 0x01020304 as written by the writer
+	uint32_t			ulHeaderSize;		// Offset of the first record
+	uint32_t			ulRecordSize;
+	uint32_t			ulCapacity;			// Records in the segment
+	volatile uint32_t	ulRecords;			// Records written, updated at every msync()
+	uint64_t			ullSequence;		// Segment number, continued by Open()
+	uint64_t			ullCreatedNs;		// MonoTimeNs() when the segment was prepared
+	uint32_t			ulFields;
+	uint32_t			ulReserved;
+	TORQUE_LOG_FIELD	stField[TORQUE_LOG_MAX_FIELDS];
+} TORQUE_LOG_HEADER;
+/*
+============================================================================
+ Writer
+============================================================================
+*/
+typedef struct
+{
+	int					iFd;
+	uint64_t			ullSequence;
+	size_t				ulSize;				// Of the mapping
+	TORQUE_LOG_HEADER*	pHeader;			// Start of the mapping
+	TORQUE_LOG_RECORD*	pRecords;
+	uint32_t			ulSynced;			// Records already msync()ed
+} TORQUE_LOG_SEGMENT;
+
+class CTorqueLog
+{
+public:
+	CTorqueLog() ;
+	~CTorqueLog() ;
+
+	int  Open(const char* cpBase) ;
+	void Close() ;
+	int  IsOpen() const				{ return m_pCurrent != 0 ; }
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	void Append(const TORQUE_LOG_RECORD& stRec)
+	{
+		TORQUE_LOG_SEGMENT* pSeg = m_pCurrent ;
+
+		if (pSeg == 0)
+			return ;
+		if (m_ulWrite >= TORQUE_LOG_SEG_RECORDS)
+		{
+			pSeg = Rotate() ;
+			if (pSeg == 0)
+			{
+				m_ulDropped++ ;
+				return ;
+			}
+		}
+		pSeg->pRecords[m_ulWrite] = stRec ;
+		__sync_synchronize() ;				// Record must be complete before it is counted
+		m_ulWrite = m_ulWrite + 1 ;
+		m_ulAppended++ ;
+	}
+
+	unsigned long Appended() const	{ return m_ulAppended ; }
+	unsigned long Dropped() const	{ return m_ulDropped ; }
+
+private:
+	TORQUE_LOG_SEGMENT* Rotate() ;
+	int  Prepare(TORQUE_LOG_SEGMENT& stSeg, uint64_t ullSequence) ;
+	void Sync(TORQUE_LOG_SEGMENT& stSeg, uint32_t ulRecords, int iFlags) ;
+	void Release(TORQUE_LOG_SEGMENT& stSeg, uint32_t ulRecords) ;
+	void Background() ;
+	static void* ThreadFunc(void* pArg) ;
+
+	char							m_cBase[TORQUE_LOG_PATH_LEN] ;
+	TORQUE_LOG_SEGMENT				m_stSeg[3] ;		// Current, spare and retired
+	TORQUE_LOG_SEGMENT* volatile	m_pCurrent ;		// Written by Append()
+	TORQUE_LOG_SEGMENT* volatile	m_pSpare ;			// Ready for the next rotation, or NULL
+	TORQUE_LOG_SEGMENT* volatile	m_pRetired ;		// Rotated out, to be released, or NULL
+	volatile uint32_t				m_ulWrite ;			// Next record of the current segment
+	volatile uint32_t				m_ulRetiredCount ;	// Records written in the retired segment
+	volatile unsigned long			m_ulAppended ;
+	volatile unsigned long			m_ulDropped ;
+	uint64_t						m_ullNextSequence ;
+	volatile int					m_iRun ;
+	pthread_t						m_stThread ;
+} ;
+
+#endif /* TORQUE_LOG_H_ */
@@ -0,0 +1,313 @@
+/*
+============================================================================
+ Name : 	torque_signature.cpp
+ Author :
+ Version :	1.00
+ Description : Torque versus position signature, see torque_signature.h
+============================================================================
+*/
+#include <stdio.h>
+#include <string.h>
+#include "torque_signature.h"
+/*
+============================================================================
+ Function:				CTorqueSignature()
+ Description:			Constructor.
+============================================================================
+*/
+CTorqueSignature::CTorqueSignature()
+{
+	int i ;
+
+	Configure(0, 0) ;
+	for (i = 0 ; i < TSIG_STROKES ; i++)
+	{
+		SetGrid(i, 0, 0) ;
+	}
+}
+/*
+============================================================================
+ Function:				Configure()
+ Input arguments:		iAxes - axes that may be captured, TSIG_MAX_AXES at most.
+ 						lMargin - tolerance around the envelope, in the unit
+ 						of the samples.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Forgets the envelopes, the learning starts again, and the captured stroke.
+ The grids are kept.
+============================================================================
+*/
+void CTorqueSignature::Configure(int iAxes, int32_t lMargin)
+{
+	if (iAxes > TSIG_MAX_AXES)
+		iAxes = TSIG_MAX_AXES ;
+
+	m_iAxes 	= iAxes ;
+	m_lMargin 	= lMargin ;
+	m_iStroke 	= TSIG_NO_STROKE ;
+	m_ulAxes 	= 0 ;
+	memset(m_stEnv, 0, sizeof(m_stEnv)) ;
+	memset(m_ulLearned, 0, sizeof(m_ulLearned)) ;
+	memset(m_lSum, 0, sizeof(m_lSum)) ;
+	memset(m_ulCount, 0, sizeof(m_ulCount)) ;
+	memset(m_ulFlags, 0, sizeof(m_ulFlags)) ;
+	memset(m_ulOut, 0, sizeof(m_ulOut)) ;
+}
+/*
+============================================================================
+ Function:				SetGrid()
+ Input arguments:		iStroke - 0 .. TSIG_STROKES-1
+ 						lLow, lHigh - positions covered by the bins, in any
+ 						order. The stroke is not captured if they are less
+ 						than TSIG_BINS apart.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Sets the position grid of a stroke. Changing the grid of a stroke whose
+ envelope is learned makes the envelope meaningless: call Configure() too.
+============================================================================
+*/
+void CTorqueSignature::SetGrid(int iStroke, int32_t lLow, int32_t lHigh)
+{
+	uint64_t ullScale ;
+
+	if (lLow > lHigh)
+	{
+		int32_t lTemp = lLow ;
+
+		lLow 	= lHigh ;
+		lHigh 	= lTemp ;
+	}
+	m_lLow[iStroke] = lLow ;
+
+	if ((int64_t)lHigh - lLow + 1 < TSIG_BINS)
+	{
+		m_lSpan[iStroke] 		= -1 ;			// Nothing falls in
+		m_ullBinScale[iStroke] 	= 0 ;
+		return ;
+	}
+	m_lSpan[iStroke] = lHigh - lLow ;
+	//
+	// Rounded up, so the first position of a bin is not put in the bin before
+	ullScale = ((uint64_t)TSIG_BINS << 32) + (uint64_t)m_lSpan[iStroke] ;
+	m_ullBinScale[iStroke] = ullScale / ((uint64_t)m_lSpan[iStroke] + 1) ;
+}
+/*
+============================================================================
+ Function:				BinPosition()
+ Input arguments:		iStroke, iBin - the bin.
+ Returned value:		The position at the middle of the bin.
+============================================================================
+*/
+int32_t CTorqueSignature::BinPosition(int iStroke, int iBin) const
+{
+	return m_lLow[iStroke] + (int32_t)(((int64_t)m_lSpan[iStroke] + 1) * (2 * iBin + 1) / (2 * TSIG_BINS)) ;
+}
+/*
+============================================================================
+ Function:				Begin()
+ Input arguments:		iStroke - the stroke starting.
+ 						ulAxes - bit i set to capture axis i.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Clears the signature and the flags of the axes, and starts adding their
+ samples to the stroke. Ends the stroke being captured, if any.
+============================================================================
+*/
+void CTorqueSignature::Begin(int iStroke, uint32_t ulAxes)
+{
+	int i ;
+
+	if (m_iStroke != TSIG_NO_STROKE)
+		End() ;
+
+	for (i = 0 ; i < m_iAxes ; i++)
+	{
+		if ((ulAxes & (1u << i)) == 0)
+			continue ;
+		memset(m_lSum[i], 0, sizeof(m_lSum[i])) ;
+		memset(m_ulCount[i], 0, sizeof(m_ulCount[i])) ;
+		memset(m_ulFlags[i], 0, sizeof(m_ulFlags[i])) ;
+		m_ulOut[i] = 0 ;
+	}
+	m_ulAxes 	= ulAxes & ((m_iAxes < 32) ? (1u << m_iAxes) - 1 : 0xFFFFFFFFu) ;
+	m_iStroke 	= iStroke ;
+}
+/*
+============================================================================
+ Function:				End()
+ Input arguments:		None.
+ Output arguments: 		None.
+ Returned value:		None.
+ Version:				Version 1.00
+
+ Description:
+
+ Stops adding samples. A learning stroke is now part of the envelope. The
+ signature and the flags stay available until the next Begin().
+============================================================================
+*/
+void CTorqueSignature::End()
+{
+	if (m_iStroke == TSIG_NO_STROKE)
+		return ;
+
+	if (m_ulLearned[m_iStroke] < TSIG_LEARN_STROKES)
+		m_ulLearned[m_iStroke]++ ;
+	m_iStroke = TSIG_NO_STROKE ;
+}
+/*
+============================================================================
+ Function:				Signature()
+ Input arguments:		iAxis, iBin - the bin.
+ Output arguments: 		lTorque - mean torque of the bin in the stroke.
+ Returned value:		false if no sample fell in the bin.
+============================================================================
+*/
+bool CTorqueSignature::Signature(int iAxis, int iBin, int32_t& lTorque) const
+{
+	if (m_ulCount[iAxis][iBin] == 0)
+		return false ;
+	lTorque = m_lSum[iAxis][iBin] / (int32_t)m_ulCount[iAxis][iBin] ;
+	return true ;
+}
+/*
+============================================================================
+ Function:				BinsCovered()
+ Returned value:		Bins of the stroke that got at least one sample.
+============================================================================
+*/
+int CTorqueSignature::BinsCovered(int iAxis) const
+{
+	int iBins = 0 ;
+	int i ;
+
+	for (i = 0 ; i < TSIG_BINS ; i++)
+	{
+		iBins += (m_ulCount[iAxis][i] != 0) ;
+	}
+	return iBins ;
+}
+/*
+============================================================================
+ Function:				BinsOut()
+ Returned value:		Bins of the stroke flagged out of the envelope.
+============================================================================
+*/
+int CTorqueSignature::BinsOut(int iAxis) const
+{
+	int iBins = 0 ;
+	int i ;
+
+	for (i = 0 ; i < TSIG_BINS / 32 ; i++)
+	{
+		iBins += __builtin_popcount(m_ulFlags[iAxis][i]) ;
+	}
+	return iBins ;
+}
+/*
+============================================================================
+ Function:				Load()
+ Input arguments:		cpPath - file written by Save().
+ Output arguments: 		None.
+ Returned value:		0 if the envelopes were loaded, -1 otherwise. No
+ 						envelope is learned then.
+ Version:				Version 1.00
+
+ Description:
+
+ Reads the envelopes and the learned strokes count. The file must have the
+ same sizes and grids as this object.
+============================================================================
+*/
+int CTorqueSignature::Load(const char* cpPath)
+{
+	TSIG_FILE_HEADER stHeader ;
+	FILE* pFile ;
+	int iRes = -1 ;
+	int i ;
+
+	memset(m_stEnv, 0, sizeof(m_stEnv)) ;
+	memset(m_ulLearned, 0, sizeof(m_ulLearned)) ;
+	pFile = fopen(cpPath, "rb") ;
+	if (pFile == NULL)
+		return -1 ;
+
+	if (fread(&stHeader, sizeof(stHeader), 1, pFile) == 1
+		&& memcmp(stHeader.cMagic, TSIG_MAGIC, sizeof(stHeader.cMagic)) == 0
+		&& stHeader.ulVersion == TSIG_VERSION
+		&& stHeader.ulAxes == TSIG_MAX_AXES
+		&& stHeader.ulStrokes == TSIG_STROKES
+		&& stHeader.ulBins == TSIG_BINS)
+	{
+		iRes = 0 ;
+		for (i = 0 ; i < TSIG_STROKES ; i++)
+		{
+			if (stHeader.lLow[i] != m_lLow[i] || stHeader.lHigh[i] != m_lLow[i] + m_lSpan[i])
+				iRes = -1 ;
+		}
+		if (iRes == 0 && fread(m_stEnv, sizeof(m_stEnv), 1, pFile) == 1)
+		{
+			for (i = 0 ; i < TSIG_STROKES ; i++)
+			{
+				m_ulLearned[i] = stHeader.ulLearned[i] ;
+			}
+		}
+		else
+		{
+			memset(m_stEnv, 0, sizeof(m_stEnv)) ;		// Truncated
+			iRes = -1 ;
+		}
+	}
+	fclose(pFile) ;
+	return iRes ;
+}
+/*
+============================================================================
+ Function:				Save()
+ Input arguments:		cpPath - file to write, replaced if it exists.
+ Output arguments: 		None.
+ Returned value:		0 on success, -1 otherwise.
+============================================================================
+*/
+int CTorqueSignature::Save(const char* cpPath) const
+{
+	TSIG_FILE_HEADER stHeader ;
+	FILE* pFile ;
+	int iRes = 0 ;
+	int i ;
+
+	memset(&stHeader, 0, sizeof(stHeader)) ;
+	memcpy(stHeader.cMagic, TSIG_MAGIC, sizeof(stHeader.cMagic)) ;
+	stHeader.ulVersion 	= TSIG_VERSION ;
+	stHeader.ulAxes 	= TSIG_MAX_AXES ;
+	stHeader.ulStrokes 	= TSIG_STROKES ;
+	stHeader.ulBins 	= TSIG_BINS ;
+	for (i = 0 ; i < TSIG_STROKES ; i++)
+	{
+		stHeader.lLow[i] 		= m_lLow[i] ;
+		stHeader.lHigh[i] 		= m_lLow[i] + m_lSpan[i] ;
+		stHeader.ulLearned[i] 	= m_ulLearned[i] ;
+	}
+
+	pFile = fopen(cpPath, "wb") ;
+	if (pFile == NULL)
+		return -1 ;
+	if (fwrite(&stHeader, sizeof(stHeader), 1, pFile) != 1
+		|| fwrite(m_stEnv, sizeof(m_stEnv), 1, pFile) != 1)
+		iRes = -1 ;
+	if (fclose(pFile) != 0)
+		iRes = -1 ;
+	return iRes ;
+}
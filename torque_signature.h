@@ -0,0 +1,165 @@
+/*
+============================================================================
+ Name : torque_signature.h
+ Author  :
+ Version :
+ Description : 	Torque versus position signature of the test strokes.
+
+ A stroke is one of the test moves, Move1 or Move2, for a set of axes. The
+ stroke has a position grid of TSIG_BINS equal bins between the two ends
+ given by SetGrid(). While a stroke is captured, every torque sample is put
+ in the bin of the position it was taken at:
+
+ 	- the sum and count of the bin give the signature of the stroke, the
+ 	  mean torque per bin, see Signature(),
+ 	- for the first TSIG_LEARN_STROKES strokes, assumed good, the sample
+ 	  widens the envelope of the bin: minimum, maximum and mean over all
+ 	  the samples of the learning strokes,
+ 	- once the envelope is learned, the sample is compared to it. A sample
+ 	  more than the margin outside [minimum, maximum] flags its bin, and
+ 	  Add() returns true so the caller reports it in the same cycle.
+
+ Add() is O(1): an integer multiply picks the bin, two compares test it.
+ Begin() and End() are O(TSIG_BINS) per axis of the stroke.
+
+ The envelope may be saved to a file and loaded at start-up, so the learning
+ strokes of several runs add up. A file of another grid is not loaded.
+
+ All the methods are called from the cycle thread, except Load() and Save().
+============================================================================
+*/
+#ifndef TORQUE_SIGNATURE_H_
+#define TORQUE_SIGNATURE_H_
+
+#include <stdint.h>
+
+#define		TSIG_MAX_AXES			16
+#define		TSIG_STROKES			2		// Move1 and Move2
+#define		TSIG_NO_STROKE			-1		// Stroke(): none captured
+#define		TSIG_BINS				128		// Position bins per stroke
+#define		TSIG_LEARN_STROKES		5		// Strokes learned before the envelope is used
+#define		TSIG_MAGIC				"TQSIG01"	// 8 bytes with the terminating 0
+#define		TSIG_VERSION			1
+/*
+============================================================================
+ File format, native byte order: a TSIG_FILE_HEADER, then the TSIG_BIN
+ envelope of every axis, stroke and bin, in this order.
+============================================================================
+*/
+typedef struct
+{
+	char			cMagic[8];				// TSIG_MAGIC
+	uint32_t		ulVersion;				// TSIG_VERSION
+	uint32_t		ulAxes;					// TSIG_MAX_AXES
+	uint32_t		ulStrokes;				// TSIG_STROKES
+	uint32_t		ulBins;					// TSIG_BINS
+	int32_t			lLow[TSIG_STROKES];		// Grid of each stroke
+	int32_t			lHigh[TSIG_STROKES];
+	uint32_t		ulLearned[TSIG_STROKES];	// Strokes in the envelope
+} TSIG_FILE_HEADER;
+
+typedef struct
+{
+	int32_t			lMin;					// Envelope, over the samples of the learning strokes
+	int32_t			lMax;
+	float			fMean;
+	uint32_t		ulLearned;				// Samples in the envelope, 0 if the bin was never reached
+} TSIG_BIN;
+
+class CTorqueSignature
+{
+public:
+	CTorqueSignature() ;
+
+	void Configure(int iAxes, int32_t lMargin) ;
+	void SetGrid(int iStroke, int32_t lLow, int32_t lHigh) ;
+	int  Load(const char* cpPath) ;
+	int  Save(const char* cpPath) const ;
+/*
+============================================================================
+ Cycle side
+============================================================================
+*/
+	void Begin(int iStroke, uint32_t ulAxes) ;
+	void End() ;
+	bool Add(int iAxis, int32_t lPosition, int32_t lTorque)
+	{
+		int32_t lOffset ;
+		int iBin ;
+
+		if (m_iStroke == TSIG_NO_STROKE || (m_ulAxes & (1u << iAxis)) == 0)
+			return false ;
+
+		lOffset = lPosition - m_lLow[m_iStroke] ;
+		if (lOffset < 0 || lOffset > m_lSpan[m_iStroke])
+			return false ;
+		iBin = (int)(((uint64_t)(uint32_t)lOffset * m_ullBinScale[m_iStroke]) >> 32) ;
+		if (iBin >= TSIG_BINS)
+			iBin = TSIG_BINS - 1 ;				// Spans of millions, the rounding of the scale
+
+		m_lSum[iAxis][iBin] += lTorque ;
+		m_ulCount[iAxis][iBin]++ ;
+		return (m_ulLearned[m_iStroke] < TSIG_LEARN_STROKES) ? Learn(iAxis, iBin, lTorque) : Check(iAxis, iBin, lTorque) ;
+	}
+
+	int  Stroke() const						{ return m_iStroke ; }
+	bool Learning(int iStroke) const		{ return m_ulLearned[iStroke] < TSIG_LEARN_STROKES ; }
+	uint32_t Learned(int iStroke) const		{ return m_ulLearned[iStroke] ; }
+	int32_t BinPosition(int iStroke, int iBin) const ;
+	//
+	// Of the stroke being captured, or of the last one after End().
+	bool Signature(int iAxis, int iBin, int32_t& lTorque) const ;
+	int  BinsCovered(int iAxis) const ;
+	int  BinsOut(int iAxis) const ;
+	unsigned long SamplesOut(int iAxis) const	{ return m_ulOut[iAxis] ; }
+	const TSIG_BIN& Envelope(int iAxis, int iStroke, int iBin) const	{ return m_stEnv[iAxis][iStroke][iBin] ; }
+
+private:
+	bool Learn(int iAxis, int iBin, int32_t lTorque)
+	{
+		TSIG_BIN& stBin = m_stEnv[iAxis][m_iStroke][iBin] ;
+
+		if (stBin.ulLearned == 0)
+		{
+			stBin.lMin = lTorque ;
+			stBin.lMax = lTorque ;
+		}
+		else if (lTorque < stBin.lMin)
+			stBin.lMin = lTorque ;
+		else if (lTorque > stBin.lMax)
+			stBin.lMax = lTorque ;
+		stBin.ulLearned++ ;
+		stBin.fMean += (lTorque - stBin.fMean) / stBin.ulLearned ;
+		return false ;
+	}
+	bool Check(int iAxis, int iBin, int32_t lTorque)
+	{
+		const TSIG_BIN& stBin = m_stEnv[iAxis][m_iStroke][iBin] ;
+
+		if (stBin.ulLearned == 0)
+			return false ;
+		if (lTorque >= stBin.lMin - m_lMargin && lTorque <= stBin.lMax + m_lMargin)
+			return false ;
+		m_ulFlags[iAxis][iBin / 32] |= 1u << (iBin % 32) ;
+		m_ulOut[iAxis]++ ;
+		return true ;
+	}
+
+	TSIG_BIN		m_stEnv[TSIG_MAX_AXES][TSIG_STROKES][TSIG_BINS] ;
+	uint32_t		m_ulLearned[TSIG_STROKES] ;
+	int32_t			m_lLow[TSIG_STROKES] ;
+	int32_t			m_lSpan[TSIG_STROKES] ;			// High - low
+	uint64_t		m_ullBinScale[TSIG_STROKES] ;	// 2^32 * TSIG_BINS / (span + 1), rounded up
+	//
+	// Stroke being captured
+	int32_t			m_lSum[TSIG_MAX_AXES][TSIG_BINS] ;
+	uint32_t		m_ulCount[TSIG_MAX_AXES][TSIG_BINS] ;
+	uint32_t		m_ulFlags[TSIG_MAX_AXES][TSIG_BINS / 32] ;	// Bins out of the envelope
+	unsigned long	m_ulOut[TSIG_MAX_AXES] ;
+	int				m_iStroke ;
+	uint32_t		m_ulAxes ;						// Bit i for axis i
+	int32_t			m_lMargin ;
+	int				m_iAxes ;
+} ;
+
+#endif /* TORQUE_SIGNATURE_H_ */